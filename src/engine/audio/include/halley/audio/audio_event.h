@@ -30,6 +30,7 @@ namespace Halley
 		void reload(Resource&& resource) override;
 		static std::shared_ptr<AudioEvent> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::AudioEvent; }
+		constexpr static bool canLoadAsync() { return true; }
 
 	private:
 		std::vector<std::unique_ptr<IAudioEventAction>> actions;
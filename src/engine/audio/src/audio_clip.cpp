@@ -10,6 +10,7 @@ using namespace Halley;
 AudioClip::AudioClip(size_t numChannels)
 	: numChannels(numChannels)
 {
+	setLoadedThroughWeakReferences();
 	startLoading();
 }
 
@@ -149,10 +150,17 @@ std::shared_ptr<AudioClip> AudioClip::loadResource(ResourceLoader& loader)
 			result->loadFromStream(stream, meta);
 		});
 	} else {
+		std::weak_ptr<AudioClip> weakResult = result;
 		loader
-			.getAsync()
-			.then([result, meta](std::unique_ptr<ResourceDataStatic> data) {
-				result->loadFromStatic(std::shared_ptr<ResourceDataStatic>(std::move(data)), meta);
+			.getAsync(result)
+			.then([weakResult, meta](std::unique_ptr<ResourceDataStatic> data) {
+				if (auto result = weakResult.lock()) {
+					if (data) {
+						result->loadFromStatic(std::shared_ptr<ResourceDataStatic>(std::move(data)), meta);
+					} else {
+						result->loadingFailed();
+					}
+				}
 			});
 	}
 
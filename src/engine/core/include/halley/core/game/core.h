@@ -19,6 +19,7 @@ namespace Halley
 	class HalleyAPI;
 	class Stage;
 	class Painter;
+	class RenderThread;
 	class Camera;
 	class RenderTarget;
 	class Environment;
@@ -74,6 +75,7 @@ namespace Halley
 
 		void pumpEvents(Time time);
 		void pumpAudio();
+		void pumpMainThread();
 
 		std::array<StopwatchAveraging, int(TimeLine::NUMBER_OF_TIMELINES)> engineTimers;
 		std::array<StopwatchAveraging, int(TimeLine::NUMBER_OF_TIMELINES)> gameTimers;
@@ -87,6 +89,7 @@ namespace Halley
 		std::unique_ptr<Resources> resources;
 
 		std::unique_ptr<Painter> painter;
+		std::unique_ptr<RenderThread> renderThread;
 		std::unique_ptr<Camera> camera;
 		std::unique_ptr<RenderTarget> screenTarget;
 		Vector2i prevWindowSize = Vector2i(-1, -1);
@@ -31,6 +31,9 @@ namespace Halley
 
 		virtual int getTargetFPS() const { return 60; }
 
+		// Replays rendering commands on a separate thread. The video plugin must support rendering from a thread other than the one that created it.
+		virtual bool shouldUseRenderThread() const { return false; }
+
 		virtual String getDevConAddress() const { return ""; }
 		virtual int getDevConPort() const { return 12500; }
 
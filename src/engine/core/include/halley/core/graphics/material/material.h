@@ -49,13 +49,20 @@ namespace Halley
 		gsl::span<const gsl::byte> getData() const;
 		MaterialDataBlockType getType() const;
 
+		// Incremented every time the data changes
+		uint64_t getRevision() const { return revision; }
+		uint64_t getHash() const;
+
 	private:
 		std::unique_ptr<MaterialConstantBuffer> constantBuffer;
 		Bytes data;
 		Vector<int> addresses;
 		MaterialDataBlockType dataBlockType;
 		int bindPoint = 0;
-		bool dirty = true;
+		uint64_t revision = 1;
+		uint64_t uploadedRevision = 0;
+		mutable uint64_t hashValue = 0;
+		mutable uint64_t hashRevision = 0;
 
 		bool setUniform(size_t offset, ShaderParameterType type, void* data);
 		void upload(VideoAPI* api);
@@ -102,6 +109,8 @@ namespace Halley
 			return *this;
 		}
 
+		// Incremented every time a texture, uniform or pass changes
+		uint64_t getRevision() const { return revision; }
 		uint64_t getHash() const;
 
 	private:
@@ -114,8 +123,9 @@ namespace Halley
 
 		std::vector<char> passEnabled;
 
-		mutable uint64_t hashValue;
-		mutable bool needToUpdateHash = true;
+		uint64_t revision = 1;
+		mutable uint64_t hashValue = 0;
+		mutable uint64_t hashRevision = 0;
 		bool needToUploadData = true;
 
 		void initUniforms(bool forceLocalBlocks);
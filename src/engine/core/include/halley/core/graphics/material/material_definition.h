@@ -9,6 +9,7 @@ namespace Halley
 	class Serializer;
 	class MaterialPass;
 	class ResourceLoader;
+	class Resources;
 	class Shader;
 	class VideoAPI;
 	class Painter;
@@ -143,6 +144,8 @@ namespace Halley
 		explicit MaterialDefinition(ResourceLoader& loader);
 
 		void reload(Resource&& resource) override;
+		void onLoaded(Resources& resources) override;
+		void getDependencies(Vector<ResourceReference>& dependencies) const override;
 		void load(const ConfigNode& node);
 
 		int getNumPasses() const;
@@ -153,6 +156,7 @@ namespace Halley
 		size_t getVertexSize() const;
 		size_t getVertexStride() const;
 		size_t getVertexPosOffset() const;
+		bool isInstanced() const { return instanced; }
 		const Vector<MaterialAttribute>& getAttributes() const { return attributes; }
 		const Vector<MaterialUniformBlock>& getUniformBlocks() const { return uniformBlocks; }
 		const Vector<String>& getTextures() const { return textures; }
@@ -161,6 +165,7 @@ namespace Halley
 
 		static std::unique_ptr<MaterialDefinition> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::MaterialDefinition; }
+		constexpr static bool canLoadAsync() { return true; }
 
 		void serialize(Serializer& s) const;
 		void deserialize(Deserializer& s);
@@ -175,6 +180,7 @@ namespace Halley
 		Vector<MaterialAttribute> attributes;
 		int vertexSize = 0;
 		int vertexPosOffset = 0;
+		bool instanced = false;
 
 		void loadUniforms(const ConfigNode& node);
 		void loadTextures(const ConfigNode& node);
@@ -232,6 +238,7 @@ namespace Halley
 	public:
 		MaterialPass();
 		explicit MaterialPass(const String& shaderAssetId, const ConfigNode& node);
+		MaterialPass(BlendType blend, std::shared_ptr<Shader> shader); // For materials built in code, rather than loaded
 
 		BlendType getBlend() const { return blend; }
 		Shader& getShader() const { return *shader; }
@@ -240,7 +247,8 @@ namespace Halley
 		void serialize(Serializer& s) const;
 		void deserialize(Deserializer& s);
 
-		void createShader(ResourceLoader& loader, String name, const Vector<MaterialAttribute>& attributes);
+		String getShaderFileName(VideoAPI& video) const;
+		void createShader(Resources& resources, VideoAPI& video, String name, const Vector<MaterialAttribute>& attributes);
 
 	private:
 		std::shared_ptr<Shader> shader;
@@ -3,7 +3,9 @@
 #include "blend.h"
 #include "halley/maths/colour.h"
 #include <condition_variable>
+#include <limits>
 #include <halley/maths/vector4.h>
+#include <halley/data_structures/hash_map.h>
 
 namespace Halley
 {
@@ -14,22 +16,48 @@ namespace Halley
 	class Camera;
 	class RenderContext;
 	class Core;
+	class RenderCommandBuffer;
+	class RenderThread;
+
+	enum class IndexFormat : uint8_t
+	{
+		UInt16,
+		UInt32
+	};
 
 	class Painter
 	{
 		friend class RenderContext;
 		friend class Core;
+		friend class RenderThread;
+		friend class DummyRenderer;
 
 		struct PainterVertexData
 		{
 			char* dstVertex;
-			unsigned short* dstIndex;
+			void* dstIndex;
 			size_t vertexSize;
 			size_t vertexStride;
 			size_t dataSize;
-			unsigned short firstIndex;
+			uint32_t firstIndex;
+			IndexFormat indexFormat;
+		};
+
+		// Indices start as 16-bit, and are promoted to 32-bit once they need to address more vertices than that
+		struct IndexStorage
+		{
+			Vector<unsigned short> indices16;
+			Vector<uint32_t> indices32;
+			IndexFormat format = IndexFormat::UInt16;
+
+			void* reserve(size_t curIndices, size_t numIndices);
+			void promote(size_t curIndices);
+			const void* getData() const;
+			void* at(size_t index);
 		};
 
+		constexpr static size_t maxVertices16 = size_t(std::numeric_limits<unsigned short>::max()) + 1;
+
 	public:
 		Painter(Resources& resources);
 		virtual ~Painter();
@@ -40,7 +68,7 @@ namespace Halley
 		Camera& getCurrentCamera() const { return *camera; }
 		Rect4f getWorldViewAABB() const;
 
-		virtual void clear(Colour colour) = 0;
+		void clear(Colour colour);
 		virtual void setMaterialPass(const Material& material, int pass) = 0;
 		virtual void setMaterialData(const Material& material) = 0;
 
@@ -53,37 +81,80 @@ namespace Halley
 
 		// Draw sprites takes a single vertex per sprite, duplicates the data across multiple vertices, and draws
 		// vertPosOffset is the offset, in bytes, from the start of each vertex's data, to a Vector2f which will be filled with the vertex's position in 0-1 space.
+		// If the material is instanced and the backend supports it, the vertices are submitted once per sprite instead, and expanded by the vertex shader.
 		void drawSprites(std::shared_ptr<Material> material, size_t numSprites, const void* vertexData);
 
 		// Draw one sliced sprite. Slices -> x = left, y = top, z = right, w = bottom, in [0..1] space relative to the texture
 		void drawSlicedSprite(std::shared_ptr<Material> material, Vector2f scale, Vector4f slices, const void* vertexData);
 
+		// Sprites can also be drawn in steps, so their vertices can be generated in parallel:
+		// reserveSprites() and reserveSlicedSprite() lay out a run of sprites, in draw order, and return its id.
+		// fillReservedSprites() writes a range of a run, taking one vertex per sprite; it can be called from several threads at once, for different ranges.
+		// submitReservedSprites() draws all reserved runs, after anything else drawn so far. Every sprite must be filled by then.
+		size_t reserveSprites(std::shared_ptr<Material> material, size_t numSprites);
+		size_t reserveSlicedSprite(std::shared_ptr<Material> material, Vector2f scale, Vector4f slices);
+		void fillReservedSprites(size_t run, size_t firstSprite, size_t numSprites, const void* const* vertexData);
+		void submitReservedSprites();
+
+		// Between these two calls, draw order doesn't matter, so geometry is grouped by material before being submitted.
+		// Anything that flushes (e.g. changing the clip rectangle) submits whatever was grouped so far.
+		void beginUnorderedBatch();
+		void endUnorderedBatch();
+		bool isUnorderedBatch() const { return unordered; }
+
+		// While recording, backend calls are stored in the buffer instead of being executed. replay() executes them.
+		void setRecording(RenderCommandBuffer* buffer);
+		bool isRecording() const { return recording != nullptr; }
+		void replay(RenderCommandBuffer& buffer);
+
 		size_t getNumDrawCalls() const { return nDrawCalls; }
+		size_t getNumDrawCallsUnbatched() const { return nDrawCallsUnbatched; }
 		size_t getNumVertices() const { return nVertices; }
 		size_t getNumTriangles() const { return nTriangles; }
+		size_t getNumBytesSubmitted() const { return nBytes; }
 
 		size_t getPrevDrawCalls() const { return prevDrawCalls; }
+		size_t getPrevDrawCallsUnbatched() const { return prevDrawCallsUnbatched; }
 		size_t getPrevVertices() const { return prevVertices; }
 		size_t getPrevTriangles() const { return prevTriangles; }
+		size_t getPrevBytesSubmitted() const { return prevBytes; }
+
+		virtual bool supportsInstancing() const { return false; }
+		virtual bool supports32BitIndices() const { return false; }
+		bool isInstanced(const MaterialDefinition& material) const;
 
 	protected:
 		virtual void startDrawCall() {}
 		virtual void endDrawCall() {}
+		virtual void doClear(Colour colour) = 0;
 		virtual void doStartRender() = 0;
 		virtual void doEndRender() = 0;
-		virtual void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly) = 0;
+		virtual void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly) = 0;
 		virtual void drawTriangles(size_t numIndices) = 0;
+		virtual void drawInstances(size_t numIndices, size_t numInstances);
 
 		virtual void setViewPort(Rect4i rect) = 0;
 		virtual void setClip(Rect4i clip, bool enable) = 0;
 
 		virtual void onUpdateProjection(Material& material) = 0;
 		void generateQuadIndices(unsigned short firstVertex, size_t numQuads, unsigned short* target);
+		void generateQuadIndices(uint32_t firstVertex, size_t numQuads, uint32_t* target);
 		RenderTarget& getActiveRenderTarget();
 
 	private:
 		RenderContext* activeContext = nullptr;
 		RenderTarget* activeRenderTarget = nullptr;
+		RenderTarget* backendRenderTarget = nullptr;
+
+		struct MaterialSnapshot
+		{
+			std::shared_ptr<Material> material;
+			uint64_t lastFrame = 0;
+		};
+
+		RenderCommandBuffer* recording = nullptr;
+		HashMap<uint64_t, MaterialSnapshot> materialSnapshots;
+		uint64_t frameNumber = 0;
 		Matrix4f projection;
 		Rect4i viewPort;
 		Camera* camera = nullptr;
@@ -93,16 +164,70 @@ namespace Halley
 		size_t indicesPending = 0;
 		bool allIndicesAreQuads = true;
 		Vector<char> vertexBuffer;
-		Vector<unsigned short> indexBuffer;
+		IndexStorage indexBuffer;
 		std::shared_ptr<Material> materialPending;
 		std::unique_ptr<Material> halleyGlobalMaterial;
 
+		struct MaterialBatch
+		{
+			std::shared_ptr<Material> material;
+			Vector<char> vertexBuffer;
+			IndexStorage indexBuffer;
+			size_t verticesPending = 0;
+			size_t bytesPending = 0;
+			size_t indicesPending = 0;
+			size_t runs = 0;
+			bool allIndicesAreQuads = true;
+		};
+
+		bool unordered = false;
+		Vector<MaterialBatch> batches;
+		HashMap<uint64_t, size_t> batchesByMaterial; // Active batch index, by material hash and definition
+		size_t nBatchesActive = 0;
+		size_t lastBatch = std::numeric_limits<size_t>::max();
+
+		struct ReservedGroup
+		{
+			std::shared_ptr<Material> material;
+			Vector<char> vertexBuffer;
+			IndexStorage indexBuffer;
+			size_t vertexSize = 0;
+			size_t vertexStride = 0;
+			size_t vertPosOffset = 0;
+			size_t numVertices = 0;
+			size_t numIndices = 0;
+			size_t runs = 0;
+			bool instanced = false;
+			bool allIndicesAreQuads = true;
+		};
+
+		struct ReservedRun
+		{
+			size_t group;
+			size_t firstVertex;
+			size_t firstIndex;
+			size_t numSprites;
+			bool sliced;
+			Vector2f scale;
+			Vector4f slices;
+		};
+
+		Vector<ReservedGroup> reservedGroups;
+		Vector<ReservedRun> reservedRuns;
+		size_t nReservedGroups = 0;
+		size_t firstOpenReservedGroup = 0;
+		size_t lastReservedGroup = std::numeric_limits<size_t>::max();
+
 		size_t nDrawCalls = 0;
+		size_t nDrawCallsUnbatched = 0;
 		size_t nVertices = 0;
 		size_t nTriangles = 0;
+		size_t nBytes = 0;
 		size_t prevDrawCalls = 0;
+		size_t prevDrawCallsUnbatched = 0;
 		size_t prevVertices = 0;
 		size_t prevTriangles = 0;
+		size_t prevBytes = 0;
 
 		Vector<unsigned short> stdQuadIndexCache;
 
@@ -115,14 +240,37 @@ namespace Halley
 		void resetPending();
 		void startDrawCall(std::shared_ptr<Material>& material);
 		void flushPending();
-		void executeDrawTriangles(Material& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices);
+		void executeDrawTriangles(Material& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, size_t runs = 1);
+
+		void execStartRender();
+		void execEndRender();
+		void execClear(Colour colour);
+		void execBindRenderTarget(RenderTarget& target);
+		void execUnbindRenderTarget(RenderTarget& target);
+		void execViewPort(Rect4i rect);
+		void execClip(Rect4i rect, bool enable);
+		void execUpdateProjection(Material& material);
+		void execResetBindCache();
+		void execDraw(Material& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly);
+
+		std::shared_ptr<Material> getSnapshot(const Material& material);
+		void purgeSnapshots();
+
+		MaterialBatch& getBatch(std::shared_ptr<Material>& material, size_t numVertices, size_t numIndices);
+		bool canAddressVertices(IndexStorage& indices, size_t curIndices, size_t totalVertices);
+		PainterVertexData addBatchedDrawData(std::shared_ptr<Material>& material, size_t numVertices, size_t numIndices, bool standardQuadsOnly);
+		void flushBatch(MaterialBatch& batch);
+		void flushBatches();
+
+		ReservedGroup& getReservedGroup(std::shared_ptr<Material>& material, size_t numVertices);
+		void resetReservedSprites();
 
 		void makeSpaceForPendingVertices(size_t numBytes);
-		void makeSpaceForPendingIndices(size_t numIndices);
 		PainterVertexData addDrawData(std::shared_ptr<Material>& material, size_t numVertices, size_t numIndices, bool standardQuadsOnly);
 
 		unsigned short* getStandardQuadIndices(size_t numQuads);
-		void generateQuadIndicesOffset(unsigned short firstVertex, unsigned short lineStride, unsigned short* target);
+		void generateQuadIndices(const PainterVertexData& data, size_t numQuads);
+		template <typename T> void generateSlicedIndices(T firstVertex, T* target);
 
 		void updateProjection();
 
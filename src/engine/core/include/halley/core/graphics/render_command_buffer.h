@@ -0,0 +1,118 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <halley/data_structures/vector.h>
+#include "halley/maths/rect.h"
+#include "halley/maths/colour.h"
+#include "painter.h"
+
+namespace Halley
+{
+	class Material;
+	class RenderTarget;
+
+	enum class RenderCommandType : uint8_t
+	{
+		StartRender,
+		EndRender,
+		Clear,
+		BindRenderTarget,
+		UnbindRenderTarget,
+		SetViewPort,
+		SetClip,
+		UpdateProjection,
+		ResetBindCache,
+		Draw
+	};
+
+	// Backend calls made by the Painter during a frame, stored so they can be replayed later (e.g. on a render thread).
+	// Materials are kept alive by the buffer, but render targets aren't, so they must outlive the replay.
+	class RenderCommandBuffer
+	{
+	public:
+		struct ClipData
+		{
+			Rect4i rect;
+			bool enable;
+		};
+
+		struct DrawData
+		{
+			uint32_t material;
+			uint32_t numVertices;
+			uint32_t numIndices;
+			uint32_t vertexOffset;
+			uint32_t indexOffset;
+			IndexFormat indexFormat;
+			bool standardQuadsOnly;
+		};
+
+		class Reader
+		{
+		public:
+			explicit Reader(const RenderCommandBuffer& buffer) : buffer(buffer) {}
+
+			bool hasNext() const { return pos < buffer.stream.size(); }
+			RenderCommandType nextType()
+			{
+				return RenderCommandType(buffer.stream[pos++]);
+			}
+
+			template <typename T>
+			T read()
+			{
+				typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+				memcpy(&storage, buffer.stream.data() + pos, sizeof(T));
+				pos += sizeof(T);
+				return *reinterpret_cast<const T*>(&storage);
+			}
+
+		private:
+			const RenderCommandBuffer& buffer;
+			size_t pos = 0;
+		};
+
+		void clear();
+		bool empty() const { return stream.empty(); }
+		size_t getNumCommands() const { return numCommands; }
+		size_t getSizeBytes() const;
+
+		void add(RenderCommandType type)
+		{
+			stream.push_back(char(type));
+			++numCommands;
+		}
+
+		template <typename T>
+		void add(RenderCommandType type, const T& payload)
+		{
+			// Plain data only (some maths types have user-declared copies, so this can't demand trivially copyable)
+			static_assert(std::is_trivially_destructible<T>::value && std::is_standard_layout<T>::value, "Payload must be plain data");
+			const size_t start = stream.size();
+			stream.resize(start + 1 + sizeof(T));
+			stream[start] = char(type);
+			memcpy(stream.data() + start + 1, &payload, sizeof(T));
+			++numCommands;
+		}
+
+		uint32_t addMaterial(std::shared_ptr<Material> material);
+		void addDraw(std::shared_ptr<Material> material, size_t numVertices, const void* vertexData, size_t vertexBytes, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly);
+
+		Material& getMaterial(uint32_t idx) const { return *materials[idx]; }
+		size_t getNumDraws() const { return draws.size(); }
+		const DrawData& getDraw(uint32_t idx) const { return draws[idx]; }
+		char* getVertexData(const DrawData& draw) { return vertexData.data() + draw.vertexOffset; }
+		const void* getIndexData(const DrawData& draw) const { return indexData.data() + draw.indexOffset; }
+
+	private:
+		Vector<char> stream;
+		Vector<char> vertexData;
+		Vector<char> indexData;
+		Vector<std::shared_ptr<Material>> materials;
+		Vector<DrawData> draws;
+		size_t numCommands = 0;
+	};
+}
@@ -9,6 +9,7 @@ namespace Halley
 	class RenderContext
 	{
 		friend class Core;
+		friend class DummyRenderer;
 
 	public:
 		void bind(std::function<void(Painter&)> f)
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "render_command_buffer.h"
+
+namespace Halley
+{
+	class Painter;
+	class VideoAPI;
+	class SystemAPI;
+
+	// Records each frame's painter commands on the calling thread, and replays them to the video backend on a separate thread.
+	// While frame N is being replayed, frame N+1 is recorded into the other buffer.
+	class RenderThread
+	{
+	public:
+		RenderThread(Painter& painter, VideoAPI& video, SystemAPI& system);
+		~RenderThread();
+
+		RenderThread(const RenderThread& other) = delete;
+		RenderThread& operator=(const RenderThread& other) = delete;
+
+		void beginFrame();
+		void endFrame();
+
+		// Blocks until the last submitted frame has been replayed. Call before destroying anything it might reference, e.g. render targets.
+		void waitIdle();
+
+	private:
+		Painter& painter;
+		VideoAPI& video;
+
+		RenderCommandBuffer buffers[2];
+		int recordingIdx = 0;
+		RenderCommandBuffer* pending = nullptr;
+
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool running = true;
+		bool busy = false;
+		std::exception_ptr error;
+
+		void run();
+		void rethrow();
+	};
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "halley/core/graphics/material/material.h"
 #include <halley/data_structures/vector.h>
+#include <map>
 
 namespace Halley
 {
@@ -46,6 +47,7 @@ namespace Halley
 		static std::unique_ptr<ShaderFile> loadResource(ResourceLoader& loader);
 		void reload(Resource&& resource) override;
 		constexpr static AssetType getAssetType() { return AssetType::Shader; }
+		constexpr static bool canLoadAsync() { return true; }
 
 		void serialize(Serializer& s) const;
 		void deserialize(Deserializer& s);
@@ -118,7 +118,10 @@ namespace Halley
 
 		static std::unique_ptr<Animation> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::Animation; }
+		constexpr static bool canLoadAsync() { return true; }
 		void reload(Resource&& resource) override;
+		void onLoaded(Resources& resources) override;
+		void getDependencies(Vector<ResourceReference>& dependencies) const override;
 
 		const String& getName() const { return name; }
 		const SpriteSheet& getSpriteSheet() const { return *spriteSheet; }
@@ -132,7 +135,7 @@ namespace Halley
 
 		void serialize(Serializer& s) const;
 		void deserialize(Deserializer& s);
-		void loadDependencies(ResourceLoader& loader);
+		void loadDependencies(Resources& resources);
 
 		void setName(const String& name);
 		void setMaterialName(const String& name);
@@ -48,7 +48,9 @@ namespace Halley
 		Sprite& setMaterial(Resources& resources, String materialName = "");
 		Sprite& setMaterial(std::shared_ptr<Material> m);
 		Material& getMaterial() const { return *material; }
+		const std::shared_ptr<Material>& getMaterialPtr() const { return material; }
 		bool hasMaterial() const { return material != nullptr; }
+		const SpriteVertexAttrib& getVertexAttrib() const { return vertexAttrib; }
 
 		Sprite& setImage(Resources& resources, String imageName, String materialName = "");
 		Sprite& setImage(std::shared_ptr<const Texture> image, std::shared_ptr<const MaterialDefinition> material);
@@ -91,6 +93,8 @@ namespace Halley
 
 		Sprite& setSliced(Vector4s slices);
 		Sprite& setNotSliced();
+		bool isSliced() const;
+		Vector4f getRelativeSlices() const;
 
 		Sprite& setVisible(bool visible);
 		bool isVisible() const;
@@ -122,5 +126,6 @@ namespace Halley
 		bool sliced = false;
 
 		void computeSize();
+		Vector4f getRelativeSlices(Vector4s slicesPixel) const;
 	};
 }
@@ -2,8 +2,10 @@
 
 #include <halley/data_structures/vector.h>
 #include <cstddef>
+#include <cstdint>
 #include "halley/maths/rect.h"
 #include <limits>
+#include <memory>
 
 namespace Halley
 {
@@ -11,6 +13,8 @@ namespace Halley
 	class String;
 	class Sprite;
 	class Painter;
+	class Material;
+	class SpriteCuller;
 
 	enum class SpritePainterEntryType
 	{
@@ -28,11 +32,13 @@ namespace Halley
 		SpritePainterEntry(SpritePainterEntryType type, size_t spriteIdx, int mask, int layer, float tieBreaker);
 
 		bool operator<(const SpritePainterEntry& o) const;
+		uint64_t getSortKey() const;
 		SpritePainterEntryType getType() const;
 		const Sprite& getSprite() const;
 		const TextRenderer& getText() const;
 		size_t getIndex() const;
 		int getMask() const;
+		int getLayer() const;
 
 	private:
 		const void* ptr = nullptr;
@@ -46,6 +52,9 @@ namespace Halley
 	class SpritePainter
 	{
 	public:
+		SpritePainter();
+		~SpritePainter();
+
 		void start(size_t nSprites);
 		void add(const Sprite& sprite, int mask, int layer, float tieBreaker);
 		void addCopy(const Sprite& sprite, int mask, int layer, float tieBreaker);
@@ -53,13 +62,77 @@ namespace Halley
 		void addCopy(const TextRenderer& text, int mask, int layer, float tieBreaker);
 		void draw(int mask, Painter& painter);
 
+		// Sprites on these layers can be drawn in any order (e.g. they don't overlap), so the painter may group them by material
+		void setOrderIndependentLayers(int minLayer, int maxLayer);
+
 	private:
+		struct SortItem
+		{
+			uint64_t key;
+			uint32_t pos;
+		};
+
+		// Kept per draw mask, so the ordering from the previous frame can be reused
+		struct DrawList
+		{
+			int mask = 0;
+			Vector<uint32_t> entries;
+			Vector<uint32_t> prevEntries;
+			Vector<uint64_t> keys;
+			Vector<uint32_t> order;
+		};
+
 		Vector<SpritePainterEntry> sprites;
 		Vector<Sprite> cachedSprites;
 		Vector<TextRenderer> cachedText;
-		bool dirty = false;
+		Vector<DrawList> drawLists;
+		Vector<SortItem> sortItems;
+		Vector<SortItem> sortScratch;
+		// Bounds of the sprites being culled, as structure of arrays (see SpriteCuller)
+		struct CullData
+		{
+			Vector<float> posX;
+			Vector<float> posY;
+			Vector<float> pivotX;
+			Vector<float> pivotY;
+			Vector<float> sizeX;
+			Vector<float> sizeY;
+			Vector<float> rotation;
+			Vector<uint32_t> visible;
+			Vector<uint32_t> candidates;
+		};
+		std::unique_ptr<SpriteCuller> culler;
+		CullData cullData;
+
+		int orderIndependentMin = std::numeric_limits<int>::max();
+		int orderIndependentMax = std::numeric_limits<int>::min();
+
+		// Consecutive unclipped sprites are gathered into runs, which are reserved in the painter and then filled in parallel
+		struct SpriteRun
+		{
+			size_t id;
+			size_t firstSprite;
+			size_t numSprites;
+			const void* const* vertices;
+		};
+		Vector<const void*> runVertices;
+		Vector<SpriteRun> runs;
+		Vector<SpriteRun> fillJobs;
+		std::shared_ptr<Material> runMaterial;
+		size_t runStart = 0;
+
+		DrawList& getDrawList(int mask);
+		const Sprite* getSprite(const SpritePainterEntry& entry) const;
+		void cull(int mask, Rect4f view, DrawList& list);
+		void sort(DrawList& list);
+		bool sortFromPrevious(DrawList& list);
+		void radixSort(DrawList& list);
+
+		void draw(const Sprite& sprite, Painter& painter);
+		void draw(const TextRenderer& text, Painter& painter);
 
-		void draw(const Sprite& sprite, Painter& painter, Rect4f view);
-		void draw(const TextRenderer& text, Painter& painter, Rect4f view);
+		void addToRun(const Sprite& sprite, Painter& painter);
+		void closeRun(Painter& painter);
+		void submitRuns(Painter& painter);
 	};
 }
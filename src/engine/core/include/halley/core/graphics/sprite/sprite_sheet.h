@@ -67,7 +67,9 @@ namespace Halley
 
 		static std::unique_ptr<SpriteSheet> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::SpriteSheet; }
+		constexpr static bool canLoadAsync() { return true; }
 		void reload(Resource&& resource) override;
+		void getDependencies(Vector<ResourceReference>& dependencies) const override;
 
 		void serialize(Serializer& s) const;
 		void deserialize(Deserializer& s);
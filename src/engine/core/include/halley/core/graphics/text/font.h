@@ -43,8 +43,10 @@ namespace Halley
 
 		static std::unique_ptr<Font> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::Font; }
+		constexpr static bool canLoadAsync() { return true; }
 		void reload(Resource&& resource) override;
 		void onLoaded(Resources& resources) override;
+		void getDependencies(Vector<ResourceReference>& dependencies) const override;
 
 		const Glyph& getGlyph(int code) const;
 		const Font& getFontForGlyph(int code) const;
@@ -60,6 +62,7 @@ namespace Halley
 		void addGlyph(const Glyph& glyph);
 
 		std::shared_ptr<Material> getMaterial() const;
+		void setMaterial(std::shared_ptr<Material> material); // Only loaded fonts get a material automatically
 
 		void serialize(Serializer& deserializer) const;
 		void deserialize(Deserializer& deserializer);
@@ -80,5 +83,7 @@ namespace Halley
 
 		std::shared_ptr<Material> material;
 		FlatMap<int, Glyph> glyphs;
+
+		String getMaterialName() const;
 	};
 }
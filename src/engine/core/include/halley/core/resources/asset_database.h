@@ -18,8 +18,13 @@ namespace Halley
 			String path;
 			Metadata meta;
 
+			// Where the asset is in a pack. Packs store these in their index, so serialize() doesn't include them.
+			uint64_t pos = 0;
+			uint64_t size = 0;
+
 			Entry();
 			Entry(const String& path, const Metadata& meta);
+			Entry(uint64_t pos, uint64_t size, const Metadata& meta);
 
 			void serialize(Serializer& s) const;
 			void deserialize(Deserializer& s);
@@ -30,6 +35,7 @@ namespace Halley
 		public:
 			void add(const String& name, Entry&& asset);
 			const Entry& get(const String& name) const;
+			bool contains(const String& name) const;
 
 			void serialize(Serializer& s) const;
 			void deserialize(Deserializer& s);
@@ -42,7 +48,9 @@ namespace Halley
 
 		void addAsset(const String& name, AssetType type, Entry&& entry);
 		const TypedDB& getDatabase(AssetType type) const;
+		std::vector<AssetType> getTypes() const;
 		std::vector<String> getAssets() const;
+		bool contains(const String& name) const;
 
 		void serialize(Serializer& s) const;
 		void deserialize(Deserializer& s);
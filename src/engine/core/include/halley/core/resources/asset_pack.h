@@ -10,13 +10,15 @@ namespace Halley {
 	class Deserializer;
 	class Serializer;
 	class AssetDatabase;
+	class AssetPackIndex;
 	class ResourceData;
 	class ResourceDataReader;
+	class MemoryMappedFile;
 
 	struct AssetPackHeader {
 		std::array<char, 8> identifier;
 		std::array<char, 16> iv;
-		uint64_t assetDbStartPos;
+		uint64_t assetDbStartPos; // Where the AssetPackIndex starts
 		uint64_t dataStartPos;
 
 		void init(size_t assetDbSize);
@@ -24,25 +26,38 @@ namespace Halley {
 
     class AssetPack {
     public:
+		// Encrypted data is split into blocks of this size, each with its own IV, so they can be processed in parallel
+		constexpr static size_t encryptionBlockSize = 1024 * 1024;
+
 		AssetPack();
 		AssetPack(const AssetPack& other) = delete;
 		AssetPack(AssetPack&& other);
 		AssetPack(std::unique_ptr<ResourceDataReader> reader, const String& encryptionKey = "", bool preLoad = false);
+		AssetPack(std::shared_ptr<MemoryMappedFile> file, const String& encryptionKey = "", bool preLoad = false);
 		~AssetPack();
 
 		AssetPack& operator=(const AssetPack& other) = delete;
 		AssetPack& operator=(AssetPack&& other);
 
+		// Loaded packs only have an index, so these build a database from it the first time they're called
 		AssetDatabase& getAssetDatabase();
 		const AssetDatabase& getAssetDatabase() const;
+		const AssetPackIndex& getIndex() const;
 		Bytes& getData();
 		const Bytes& getData() const;
 
 		Bytes writeOut() const;
+		Bytes writeOutHeader() const; // Everything that goes before getData() in the pack file, for writing them out separately
 
 		std::unique_ptr<ResourceData> getData(const String& asset, AssetType type, bool stream);
 
+		// Only reports a location if the data is still on disk; there's nothing to gain from merging reads from memory
+		bool getLocation(const String& asset, AssetType type, size_t& pos, size_t& size) const;
+
+		// On a memory mapped pack, this only asks the OS to start paging the data in
 		void readToMemory();
+
+		// Both run on the CPU executor
 		void encrypt(const String& key);
 		void decrypt(const String& key);
 	    
@@ -51,13 +66,24 @@ namespace Halley {
 		std::unique_ptr<ResourceDataReader> extractReader();
 
     private:
-		std::unique_ptr<AssetDatabase> assetDb;
+		mutable std::unique_ptr<AssetDatabase> assetDb;
+		mutable std::unique_ptr<AssetPackIndex> index;
 		std::unique_ptr<ResourceDataReader> reader;
+		std::shared_ptr<MemoryMappedFile> mappedFile;
 		std::atomic<bool> hasReader;
 		std::mutex readerMutex;
 		size_t dataOffset = 0;
+		bool legacyFormat = false;
+		bool blockEncryption = true; // Older packs were encrypted as a single CBC stream
 		Bytes data;
 		std::array<char, 16> iv;
+
+		void readHeader(const AssetPackHeader& header);
+		void readIndex(gsl::span<const gsl::byte> bytes, bool copy);
+		bool isEncrypted(const String& encryptionKey) const;
+		void getAssetRange(const String& asset, AssetType type, size_t& pos, size_t& size) const;
+		gsl::span<const gsl::byte> getMappedData() const;
+		std::array<char, 16> getBlockIV(size_t block, const String& key) const;
     };
 
 
@@ -65,6 +91,9 @@ namespace Halley {
 	public:
 		PackDataReader(AssetPack& pack, size_t startPos, size_t fileSize);
 
+		// Reads straight from a memory mapped pack, without going through it
+		PackDataReader(std::shared_ptr<const MemoryMappedFile> file, gsl::span<const gsl::byte> data);
+
 		size_t size() const override;
 		int read(gsl::span<gsl::byte> dst) override;
 		void seek(int64_t pos, int whence) override;
@@ -72,10 +101,11 @@ namespace Halley {
 		void close() override;
 
 	private:
-		AssetPack& pack;
+		AssetPack* pack = nullptr;
+		std::shared_ptr<const MemoryMappedFile> file;
+		const gsl::byte* mapped = nullptr;
 		const size_t startPos;
 		const size_t fileSize;
-		size_t curPos = 0;
-		mutable std::mutex mutex;
+		std::atomic<size_t> curPos;
 	};
 }
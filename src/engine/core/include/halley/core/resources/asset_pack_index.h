@@ -0,0 +1,90 @@
+#pragma once
+
+#include "halley/text/halleystring.h"
+#include "halley/data_structures/hash_map.h"
+#include "halley/utils/utils.h"
+#include <mutex>
+#include <gsl/span>
+
+namespace Halley
+{
+	enum class AssetType;
+	class AssetDatabase;
+	class Metadata;
+
+	// The table of contents of an asset pack, in a form that can be used straight from the pack's bytes, without being parsed first.
+	// Entries are sorted by name (then type), and names are found through a perfect hash table, so lookups never allocate.
+	// Metadata is only deserialized the first time it's asked for.
+	class AssetPackIndex
+	{
+	public:
+		struct Header
+		{
+			std::array<char, 8> identifier;
+			uint32_t numEntries;
+			uint32_t numBuckets;
+			uint32_t numSlots;
+			uint32_t padding;
+			uint64_t entriesPos;
+			uint64_t bucketsPos;
+			uint64_t slotsPos;
+			uint64_t stringsPos;
+			uint64_t metadataPos;
+			uint64_t totalSize;
+		};
+
+		struct Entry
+		{
+			uint64_t pos;
+			uint64_t size;
+			uint32_t nameOffset;
+			uint32_t nameLength;
+			uint32_t metadataOffset;
+			uint32_t metadataLength;
+			int32_t type;
+			uint32_t padding; // Always 0. Whether an asset is compressed is in its metadata.
+		};
+
+		AssetPackIndex();
+		explicit AssetPackIndex(gsl::span<const gsl::byte> data); // data must outlive the index
+		explicit AssetPackIndex(Bytes data);
+		AssetPackIndex(const AssetPackIndex& other) = delete;
+		AssetPackIndex& operator=(const AssetPackIndex& other) = delete;
+
+		static Bytes build(const AssetDatabase& db);
+
+		const Entry* find(const String& name, AssetType type) const;
+		bool contains(const String& name) const;
+
+		size_t getNumEntries() const;
+		const Entry& getEntry(size_t idx) const;
+		String getName(const Entry& entry) const;
+		const Metadata& getMetadata(const Entry& entry) const;
+
+		std::vector<String> enumerate(AssetType type) const;
+		void toAssetDatabase(AssetDatabase& db) const;
+
+	private:
+		constexpr static uint32_t noEntry = 0xFFFFFFFF;
+
+		Bytes ownedData;
+		gsl::span<const gsl::byte> data;
+		const Header* header = nullptr;
+		const Entry* entries = nullptr;
+		const uint32_t* buckets = nullptr;
+		const uint32_t* slots = nullptr;
+		const char* strings = nullptr;
+		const gsl::byte* metadata = nullptr;
+		bool legacyMetadata = false; // "HALLEYIX" indices have metadata in its old text format
+
+		mutable std::mutex metadataMutex;
+		mutable HashMap<uint32_t, std::unique_ptr<Metadata>> metadataCache;
+
+		void init();
+		const Entry* findFirst(const char* name, size_t length) const;
+		bool nameEquals(const Entry& entry, const char* name, size_t length) const;
+
+		static uint64_t hashName(const char* name, size_t length);
+		static uint32_t getSlot(uint64_t hash, uint32_t seed, uint32_t numSlots);
+	};
+}
@@ -3,9 +3,16 @@
 #include <utility>
 #include <memory>
 #include <functional>
+#include <array>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <halley/text/halleystring.h>
+#include <halley/resources/resource.h>
 #include <halley/resources/resource_data.h>
 #include <halley/data_structures/hash_map.h>
+#include <halley/concurrency/future.h>
+#include <halley/concurrency/executor.h>
 
 namespace Halley
 {
@@ -14,11 +21,16 @@ namespace Halley
 	class Resources;
 	class ResourceLoader;
 
+	// Safe to use from any thread: resources are split in shards, each with its own lock, which lookups share and changes take exclusively.
+	// Each asset is only loaded once; anyone else asking for it meanwhile waits for that load, unless that would never end (see doGet()).
 	class ResourceCollectionBase
 	{
+		friend class Resources;
+
 		class Wrapper
 		{
 		public:
+			Wrapper(const Wrapper& other) = default;
 			Wrapper(Wrapper&& other) noexcept
 				: res(std::move(other.res))
 				, depth(other.depth)
@@ -33,6 +45,28 @@ namespace Halley
 			int depth;
 		};
 
+		struct Loading
+		{
+			Promise<std::shared_ptr<Resource>> decoded; // Set once loadResource() returns, null if it failed
+			Promise<std::shared_ptr<Resource>> published; // Set once onLoaded() returns, null if anything failed
+			std::thread::id loadingThread; // Only for blocking loads
+			std::thread::id publishingThread;
+			std::shared_ptr<Resource> publishing;
+			Vector<ResourceReference> waitingFor; // Main thread only, see loadDependencies()
+		};
+
+		using Map = HashMap<String, Wrapper>;
+
+		struct Shard
+		{
+			std::mutex mutex; // Guards loading, taken before resourcesMutex
+			std::shared_timed_mutex resourcesMutex;
+			Map resources;
+			HashMap<String, std::shared_ptr<Loading>> loading;
+		};
+
+		constexpr static size_t numShards = 16;
+
 	public:
 		using ResourceLoaderFunc = std::function<std::shared_ptr<Resource>(const String&, ResourceLoadPriority)>;
 
@@ -55,14 +89,31 @@ namespace Halley
 	protected:
 		virtual std::shared_ptr<Resource> loadResource(ResourceLoader& loader) = 0;
 
+		virtual bool canLoadAsync() const = 0;
+
+		// Blocks until the resource is loaded and published, by this thread or by whichever one got to it first.
+		// If that thread is (indirectly) waiting for this one, e.g. two onLoaded() calls needing each other's resource, this one doesn't wait:
+		// it loads an uncached copy of its own if the other load isn't decoded yet, or gets the resource as it is if the other thread is in its onLoaded().
 		std::shared_ptr<Resource> doGet(const String& name, ResourceLoadPriority priority);
 		std::shared_ptr<Resource> loadAsset(const String& assetId, ResourceLoadPriority priority);
 
+		// Reads on the disk IO executor and, if the type allows it (see Resource::canLoadAsync()), decodes on the CPU executor, requesting the resource's dependencies as soon as they're known.
+		// It's published (cached, and onLoaded() called) on the main thread once the dependencies it started are, unless a blocking get() does it first. The result is null if it failed to load.
+		// Call from the main thread, which has to run the Executors::getMainThread() queue (Core does it every frame).
+		Future<std::shared_ptr<Resource>> doGetAsync(const String& assetId, ResourceLoadPriority priority);
+
 	private:
 		Resources& parent;
-		HashMap<String, Wrapper> resources;
+		std::array<Shard, numShards> shards;
 		AssetType type;
 		ResourceLoaderFunc resourceLoader;
+
+		Shard& getShard(const String& assetId);
+		std::shared_ptr<Resource> find(const String& assetId);
+
+		bool isWaitingFor(const String& assetId, const ResourceReference& target);
+		void loadDependencies(const String& assetId, std::shared_ptr<Resource> resource, ResourceLoadPriority priority, std::shared_ptr<Loading> loading);
+		std::shared_ptr<Resource> publish(const String& assetId, std::shared_ptr<Resource> resource, const std::shared_ptr<Loading>& loading);
 	};
 
 	template <typename T>
@@ -80,9 +131,22 @@ namespace Halley
 			return std::static_pointer_cast<T>(doGet(assetId, priority));
 		}
 
+		// The future is fulfilled on the main thread; see doGetAsync()
+		Future<std::shared_ptr<const T>> getAsync(const String& assetId, ResourceLoadPriority priority = ResourceLoadPriority::Normal)
+		{
+			return doGetAsync(assetId, priority).then(Executors::getMainThread(), [] (std::shared_ptr<Resource> resource) -> std::shared_ptr<const T>
+			{
+				return std::static_pointer_cast<const T>(resource);
+			});
+		}
+
 	protected:
 		std::shared_ptr<Resource> loadResource(ResourceLoader& loader) override {
 			return T::loadResource(loader);
 		}
+
+		bool canLoadAsync() const override {
+			return T::canLoadAsync();
+		}
 	};
 }
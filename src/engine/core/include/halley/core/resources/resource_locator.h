@@ -31,15 +31,21 @@ namespace Halley {
 	enum class AssetType;
 	class ResourceData;
 	class SystemAPI;
-	class AssetDatabase;
+	class Metadata;
 
 	class IResourceLocatorProvider {
 	public:
 		virtual ~IResourceLocatorProvider() {}
 		virtual std::unique_ptr<ResourceData> getData(const String& path, AssetType type, bool stream) = 0;
-		virtual const AssetDatabase& getAssetDatabase() = 0;
+		virtual bool contains(const String& asset) = 0;
+		virtual const Metadata& getMetaData(const String& asset, AssetType type) = 0;
+		virtual std::vector<String> enumerate(AssetType type) = 0;
 		virtual int getPriority() const { return 0; }
 		virtual void purge(SystemAPI& system) = 0;
+
+		// Only needed for reads to be merged, see IResourceLocator::getLocation()
+		virtual bool getLocation(const String& asset, AssetType type, size_t& pos, size_t& size) { return false; }
+		virtual void readData(size_t pos, gsl::span<gsl::byte> dst) {}
 	};
 
 	class ResourceLocator : public IResourceLocator
@@ -54,6 +60,8 @@ namespace Halley {
 
 		std::unique_ptr<ResourceDataStatic> getStatic(const String& asset, AssetType type) override;
 		std::unique_ptr<ResourceDataStream> getStream(const String& asset, AssetType type) override;
+		bool getLocation(const String& asset, AssetType type, ResourceDataLocation& location) override;
+		void readLocation(const ResourceDataLocation& location, gsl::span<gsl::byte> dst) override;
 		void purge(const String& asset, AssetType type);
 
 		std::vector<String> enumerate(const AssetType type);
@@ -61,9 +69,9 @@ namespace Halley {
 
 	private:
 		SystemAPI& system;
-		HashMap<String, IResourceLocatorProvider*> locators;
-		Vector<std::unique_ptr<IResourceLocatorProvider>> locatorList;
+		Vector<std::unique_ptr<IResourceLocatorProvider>> locatorList; // Highest priority first
 
+		IResourceLocatorProvider* getProvider(const String& asset) const;
 		std::unique_ptr<ResourceData> getResource(const String& asset, AssetType type, bool stream);
 	};
 }
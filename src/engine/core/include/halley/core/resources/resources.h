@@ -66,6 +66,16 @@ namespace Halley {
 			return of<T>().get(name, priority);
 		}
 
+		template <typename T>
+		Future<std::shared_ptr<const T>> getAsync(const String& name, ResourceLoadPriority priority = ResourceLoadPriority::Normal) const
+		{
+			return of<T>().getAsync(name, priority);
+		}
+
+		// Loads the given assets, and what they depend on, in the background (see ResourceCollectionBase::doGetAsync()).
+		// Anything that fails to load is logged and skipped.
+		Future<void> preload(const Vector<ResourceReference>& assets, ResourceLoadPriority priority = ResourceLoadPriority::Normal);
+
 		template <typename T>
 		void unload(const String& name) const
 		{
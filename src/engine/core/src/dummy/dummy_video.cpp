@@ -3,6 +3,10 @@
 #include <halley/core/graphics/texture.h>
 #include <halley/core/graphics/shader.h>
 #include <halley/core/graphics/render_target/render_target_texture.h>
+#include <halley/core/graphics/render_context.h>
+#include <halley/core/graphics/material/material.h>
+#include <halley/core/graphics/material/material_definition.h>
+#include <halley/utils/hash.h>
 #include "dummy_system.h"
 
 using namespace Halley;
@@ -100,26 +104,148 @@ int DummyShader::getBlockLocation(const String&, ShaderType)
 
 void DummyMaterialConstantBuffer::update(const MaterialDataBlock&) {}
 
+bool DummyRenderStats::operator==(const DummyRenderStats& other) const
+{
+	return drawCalls == other.drawCalls
+		&& instancedDrawCalls == other.instancedDrawCalls
+		&& stateChanges == other.stateChanges
+		&& materialBinds == other.materialBinds
+		&& materialDataUpdates == other.materialDataUpdates
+		&& clipChanges == other.clipChanges
+		&& viewPortChanges == other.viewPortChanges
+		&& clears == other.clears
+		&& vertices == other.vertices
+		&& indices == other.indices
+		&& vertexBytes == other.vertexBytes
+		&& indexBytes == other.indexBytes
+		&& dataHash == other.dataHash;
+}
+
+bool DummyRenderStats::operator!=(const DummyRenderStats& other) const
+{
+	return !(*this == other);
+}
+
 DummyPainter::DummyPainter(Resources& resources)
 	: Painter(resources)
 {}
 
-void DummyPainter::clear(Colour colour) {}
+void DummyPainter::doClear(Colour)
+{
+	++stats.clears;
+}
 
-void DummyPainter::setMaterialPass(const Material&, int) {}
+void DummyPainter::setMaterialPass(const Material& material, int pass)
+{
+	++stats.materialBinds;
+	addToHash(material.getHash());
+	addToHash(pass);
+	if (&material != lastMaterial || pass != lastPass) {
+		++stats.stateChanges;
+		lastMaterial = &material;
+		lastPass = pass;
+	}
+}
 
-void DummyPainter::doStartRender() {}
+void DummyPainter::doStartRender()
+{
+	stats = DummyRenderStats();
+	lastMaterial = nullptr;
+	lastPass = -1;
+	lastClip = Rect4i();
+	lastClipEnabled = false;
+	lastViewPort = Rect4i();
+}
+
+void DummyPainter::doEndRender()
+{
+	lastFrameStats = stats;
+}
+
+void DummyPainter::setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, bool)
+{
+	const size_t vertexBytes = numVertices * material.getVertexStride();
+	const size_t indexBytes = numIndices * (indexFormat == IndexFormat::UInt16 ? sizeof(unsigned short) : sizeof(uint32_t));
+	stats.vertices += numVertices;
+	stats.indices += numIndices;
+	stats.vertexBytes += vertexBytes;
+	stats.indexBytes += indexBytes;
+	addToHash(vertexData, vertexBytes);
+	addToHash(indices, indexBytes);
+}
+
+void DummyPainter::drawTriangles(size_t numIndices)
+{
+	++stats.drawCalls;
+	addToHash(numIndices);
+}
 
-void DummyPainter::doEndRender() {}
+void DummyPainter::drawInstances(size_t numIndices, size_t numInstances)
+{
+	++stats.drawCalls;
+	addToHash(numIndices);
+	addToHash(numInstances);
+	++stats.instancedDrawCalls;
+}
 
-void DummyPainter::setVertices(const MaterialDefinition&, size_t, void*, size_t, unsigned short*, bool) {}
+bool DummyPainter::supportsInstancing() const
+{
+	return true;
+}
 
-void DummyPainter::drawTriangles(size_t) {}
+bool DummyPainter::supports32BitIndices() const
+{
+	return true;
+}
 
-void DummyPainter::setViewPort(Rect4i) {}
+void DummyPainter::setViewPort(Rect4i rect)
+{
+	if (rect != lastViewPort) {
+		++stats.viewPortChanges;
+		++stats.stateChanges;
+		lastViewPort = rect;
+	}
+}
 
-void DummyPainter::setClip(Rect4i, bool) {}
+void DummyPainter::setClip(Rect4i clip, bool enable)
+{
+	if (enable != lastClipEnabled || (enable && clip != lastClip)) {
+		++stats.clipChanges;
+		addToHash(clip);
+		addToHash(enable);
+		++stats.stateChanges;
+		lastClip = clip;
+		lastClipEnabled = enable;
+	}
+}
 
-void DummyPainter::setMaterialData(const Material&) {}
+void DummyPainter::setMaterialData(const Material& material)
+{
+	++stats.materialDataUpdates;
+	addToHash(material.getHash());
+	++stats.stateChanges;
+}
 
 void DummyPainter::onUpdateProjection(Material&) {}
+
+void DummyPainter::addToHash(const void* data, size_t size)
+{
+	if (size > 0) {
+		stats.dataHash = stats.dataHash * 31 + Hash::hash(gsl::as_bytes(gsl::span<const char>(static_cast<const char*>(data), size)));
+	}
+}
+
+DummyRenderer::DummyRenderer(Resources& resources, Vector2i size)
+	: painter(resources)
+	, renderTarget(Rect4i({}, size))
+	, camera(Vector2f(size) * 0.5f)
+{
+}
+
+void DummyRenderer::render(std::function<void(RenderContext&)> f)
+{
+	painter.startRender();
+	RenderContext context(painter, camera, renderTarget);
+	f(context);
+	painter.endRender();
+}
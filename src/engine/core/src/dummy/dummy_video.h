@@ -5,8 +5,12 @@
 #include "graphics/render_target/render_target_screen.h"
 #include "graphics/shader.h"
 #include "graphics/painter.h"
+#include "graphics/camera.h"
+#include <functional>
 
 namespace Halley {
+	class RenderContext;
+
 	class DummyVideoAPI : public VideoAPIInternal {
 	public:
 		explicit DummyVideoAPI(SystemAPI& system);
@@ -50,19 +54,82 @@ namespace Halley {
 		void update(const MaterialDataBlock& dataBlock) override;
 	};
 
+	// What the backend was asked to do during a frame
+	struct DummyRenderStats
+	{
+		size_t drawCalls = 0;
+		size_t instancedDrawCalls = 0;
+		size_t stateChanges = 0;
+		size_t materialBinds = 0;
+		size_t materialDataUpdates = 0;
+		size_t clipChanges = 0;
+		size_t viewPortChanges = 0;
+		size_t clears = 0;
+		size_t vertices = 0;
+		size_t indices = 0;
+		size_t vertexBytes = 0;
+		size_t indexBytes = 0;
+		uint64_t dataHash = 0; // Of everything it was given (vertices, indices, clips, materials), in order, so frames can be compared
+
+		bool operator==(const DummyRenderStats& other) const;
+		bool operator!=(const DummyRenderStats& other) const;
+	};
+
+	// Doesn't draw anything, but records what it's asked to, so rendering can be measured without a GPU
 	class DummyPainter : public Painter
 	{
 	public:
 		explicit DummyPainter(Resources& resources);
-		void clear(Colour colour) override;
+
+		const DummyRenderStats& getStats() const { return stats; }
+		const DummyRenderStats& getLastFrameStats() const { return lastFrameStats; }
+
+		void doClear(Colour colour) override;
 		void setMaterialPass(const Material& material, int pass) override;
 		void doStartRender() override;
 		void doEndRender() override;
-		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly) override;
+		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly) override;
 		void drawTriangles(size_t numIndices) override;
+		void drawInstances(size_t numIndices, size_t numInstances) override;
+		bool supportsInstancing() const override;
+		bool supports32BitIndices() const override;
 		void setViewPort(Rect4i rect) override;
 		void setClip(Rect4i clip, bool enable) override;
 		void setMaterialData(const Material& material) override;
 		void onUpdateProjection(Material& material) override;
+
+	private:
+		DummyRenderStats stats;
+		DummyRenderStats lastFrameStats;
+		const Material* lastMaterial = nullptr;
+		int lastPass = -1;
+		Rect4i lastClip;
+		bool lastClipEnabled = false;
+		Rect4i lastViewPort;
+
+		void addToHash(const void* data, size_t size);
+
+		template <typename T>
+		void addToHash(const T& value)
+		{
+			addToHash(&value, sizeof(T));
+		}
+	};
+
+	// Renders frames to a DummyPainter, without a window or a game loop, e.g. for benchmarks on machines without a GPU
+	class DummyRenderer
+	{
+	public:
+		DummyRenderer(Resources& resources, Vector2i size);
+
+		void render(std::function<void(RenderContext&)> f);
+
+		DummyPainter& getPainter() { return painter; }
+		Camera& getCamera() { return camera; }
+
+	private:
+		DummyPainter painter;
+		ScreenRenderTarget renderTarget;
+		Camera camera;
 	};
 }
@@ -5,6 +5,7 @@
 #include "api/halley_api.h"
 #include "graphics/camera.h"
 #include "graphics/render_context.h"
+#include "graphics/render_thread.h"
 #include "graphics/render_target/render_target_screen.h"
 #include "graphics/window.h"
 #include "resources/resources.h"
@@ -177,6 +178,9 @@ void Core::init()
 	// Get video resources
 	if (api->video) {
 		painter = api->videoInternal->makePainter(api->core->getResources());
+		if (game->shouldUseRenderThread()) {
+			renderThread = std::make_unique<RenderThread>(*painter, *api->video, *api->system);
+		}
 	}
 }
 
@@ -198,6 +202,7 @@ void Core::deInit()
 	}
 
 	// Deinit painter
+	renderThread.reset();
 	painter.reset();
 
 	// Stop audio playback before releasing resources
@@ -276,6 +281,14 @@ void Core::pumpAudio()
 	}
 }
 
+void Core::pumpMainThread()
+{
+	// Work handed back by background tasks, such as publishing resources that finished loading
+	for (auto& task: Executors::getMainThread().getAll()) {
+		task();
+	}
+}
+
 void Core::onFixedUpdate(Time time)
 {
 	if (isRunning()) {
@@ -324,6 +337,7 @@ void Core::doVariableUpdate(Time time)
 	engineTimer.beginSample();
 
 	pumpEvents(time);
+	pumpMainThread();
 	gameTimer.beginSample();
 	if (running && currentStage) {
 		try {
@@ -355,12 +369,19 @@ void Core::doRender(Time)
 	engineTimer.beginSample();
 
 	if (api->video) {
-		api->video->startRender();
-		painter->startRender();
+		if (renderThread) {
+			renderThread->beginFrame();
+		} else {
+			api->video->startRender();
+			painter->startRender();
+		}
 
 		if (currentStage) {
 			auto windowSize = api->video->getWindow().getDefinition().getSize();
 			if (windowSize != prevWindowSize) {
+				if (renderThread) {
+					renderThread->waitIdle();
+				}
 				screenTarget.reset();
 				screenTarget = api->video->createScreenRenderTarget();
 				camera = std::make_unique<Camera>(Vector2f(windowSize) * 0.5f);
@@ -380,11 +401,18 @@ void Core::doRender(Time)
 			gameSampled = true;
 		}
 
-		painter->endRender();
+		if (renderThread) {
+			// Waits for the previous frame to finish replaying
+			vsyncTimer.beginSample();
+			renderThread->endFrame();
+			vsyncTimer.endSample();
+		} else {
+			painter->endRender();
 
-		vsyncTimer.beginSample();
-		api->video->finishRender();
-		vsyncTimer.endSample();
+			vsyncTimer.beginSample();
+			api->video->finishRender();
+			vsyncTimer.endSample();
+		}
 	}
 
 	if (!gameSampled) {
@@ -485,6 +513,10 @@ bool Core::transitionStage()
 		// Get rid of current stage
 		if (currentStage) {
 			HALLEY_DEBUG_TRACE();
+			if (renderThread) {
+				// The frame being replayed might still reference its render targets
+				renderThread->waitIdle();
+			}
 			currentStage.reset();
 			HALLEY_DEBUG_TRACE();
 		}
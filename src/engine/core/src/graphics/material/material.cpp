@@ -37,7 +37,9 @@ MaterialDataBlock::MaterialDataBlock(const MaterialDataBlock& other)
 	, addresses(other.addresses)
 	, dataBlockType(other.dataBlockType)
 	, bindPoint(other.bindPoint)
-	, dirty(true)
+	, revision(other.revision)
+	, hashValue(other.hashValue)
+	, hashRevision(other.hashRevision)
 {}
 
 MaterialDataBlock::MaterialDataBlock(MaterialDataBlock&& other) noexcept
@@ -46,7 +48,10 @@ MaterialDataBlock::MaterialDataBlock(MaterialDataBlock&& other) noexcept
 	, addresses(std::move(other.addresses))
 	, dataBlockType(other.dataBlockType)
 	, bindPoint(other.bindPoint)
-	, dirty(other.dirty)
+	, revision(other.revision)
+	, uploadedRevision(other.uploadedRevision)
+	, hashValue(other.hashValue)
+	, hashRevision(other.hashRevision)
 {}
 
 MaterialConstantBuffer& MaterialDataBlock::getConstantBuffer() const
@@ -75,6 +80,15 @@ MaterialDataBlockType MaterialDataBlock::getType() const
 	return dataBlockType;
 }
 
+uint64_t MaterialDataBlock::getHash() const
+{
+	if (hashRevision != revision) {
+		hashValue = Hash::hash(getData());
+		hashRevision = revision;
+	}
+	return hashValue;
+}
+
 bool MaterialDataBlock::setUniform(size_t offset, ShaderParameterType type, void* srcData)
 {
 	Expects(dataBlockType != MaterialDataBlockType::SharedExternal);
@@ -85,7 +99,7 @@ bool MaterialDataBlock::setUniform(size_t offset, ShaderParameterType type, void
 
 	if (memcmp(data.data() + offset, srcData, size) != 0) {
 		memcpy(data.data() + offset, srcData, size);
-		dirty = true;
+		++revision;
 		return true;
 	} else {
 		return false;
@@ -97,11 +111,11 @@ void MaterialDataBlock::upload(VideoAPI* api)
 	if (dataBlockType != MaterialDataBlockType::SharedExternal) {
 		if (!constantBuffer) {
 			constantBuffer = api->createConstantBuffer();
-			dirty = true;
+			uploadedRevision = 0;
 		}
-		if (dirty) {
+		if (uploadedRevision != revision) {
 			constantBuffer->update(*this);
-			dirty = false;
+			uploadedRevision = revision;
 		}
 	}
 }
@@ -113,6 +127,9 @@ Material::Material(const Material& other)
 	, dataBlocks(other.dataBlocks)
 	, textures(other.textures)
 	, passEnabled(other.passEnabled)
+	, revision(other.revision)
+	, hashValue(other.hashValue)
+	, hashRevision(other.hashRevision)
 {
 	for (auto& u: uniforms) {
 		u.rebind(*this);
@@ -192,6 +209,11 @@ bool Material::operator==(const Material& other) const
 		return false;
 	}
 
+	// Different main texture, which is cheaper to check than the hash
+	if (!textures.empty() && textures[0] != other.textures[0]) {
+		return false;
+	}
+
 	constexpr bool useHash = true;
 
 	if (useHash) {
@@ -241,7 +263,7 @@ void Material::setUniform(int blockNumber, size_t offset, ShaderParameterType ty
 {
 	if (dataBlocks[blockNumber].setUniform(offset, type, data)) {
 		needToUploadData = true;
-		needToUpdateHash = true;
+		++revision;
 	}
 }
 
@@ -253,8 +275,9 @@ uint64_t Material::computeHash() const
 		hasher.feed(texture.get());
 	}
 
+	// Each block caches its own hash, so only blocks that changed are rehashed
 	for (const auto& dataBlock: dataBlocks) {
-		hasher.feedBytes(dataBlock.getData());
+		hasher.feed(dataBlock.getHash());
 	}
 
 	hasher.feedBytes(gsl::as_bytes(gsl::span<const char>(passEnabled.data(), passEnabled.size())));
@@ -282,7 +305,7 @@ void Material::setPassEnabled(int pass, bool enabled)
 	const auto value = enabled ? 1 : 0;
 	auto& p = passEnabled.at(pass);
 	if (p != value) {
-		needToUpdateHash = true;
+		++revision;
 		p = value;
 	}
 }
@@ -305,7 +328,7 @@ Material& Material::set(const String& name, const std::shared_ptr<const Texture>
 			const auto textureUnit = i;
 			if (textures[textureUnit] != texture) {
 				textures[textureUnit] = texture;
-				needToUpdateHash = true;
+				++revision;
 			}
 			return *this;
 		}
@@ -331,9 +354,9 @@ bool Material::hasParameter(const String& name) const
 
 uint64_t Material::getHash() const
 {
-	if (needToUpdateHash) {
+	if (hashRevision != revision) {
 		hashValue = computeHash();
-		needToUpdateHash = false;
+		hashRevision = revision;
 	}
 	return hashValue;
 }
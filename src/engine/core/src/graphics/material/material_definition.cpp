@@ -109,10 +109,6 @@ MaterialDefinition::MaterialDefinition(ResourceLoader& loader)
 	s >> *this;
 
 	api = loader.getAPI().video;
-	int i = 0;
-	for (auto& p: passes) {
-		p.createShader(loader, name + "/pass" + toString(i++), attributes);
-	}
 }
 
 void MaterialDefinition::reload(Resource&& resource)
@@ -121,11 +117,31 @@ void MaterialDefinition::reload(Resource&& resource)
 	*this = std::move(other);
 }
 
+void MaterialDefinition::onLoaded(Resources& resources)
+{
+	int i = 0;
+	for (auto& p: passes) {
+		p.createShader(resources, *api, name + "/pass" + toString(i++), attributes);
+	}
+}
+
+void MaterialDefinition::getDependencies(Vector<ResourceReference>& dependencies) const
+{
+	for (auto& p: passes) {
+		dependencies.push_back({ AssetType::Shader, p.getShaderFileName(*api) });
+	}
+}
+
 void MaterialDefinition::load(const ConfigNode& root)
 {
 	// Load name
 	name = root["name"].asString("Unknown");
 
+	// Instanced materials take one vertex per sprite, and expand it to the four corners in the vertex shader
+	if (root.hasKey("instanced")) {
+		instanced = root["instanced"].asBool();
+	}
+
 	// Load attributes & uniforms
 	if (root.hasKey("attributes")) {
 		loadAttributes(root["attributes"]);
@@ -196,6 +212,7 @@ void MaterialDefinition::serialize(Serializer& s) const
 	s << attributes;
 	s << vertexSize;
 	s << vertexPosOffset;
+	s << instanced;
 }
 
 void MaterialDefinition::deserialize(Deserializer& s)
@@ -207,6 +224,7 @@ void MaterialDefinition::deserialize(Deserializer& s)
 	s >> attributes;
 	s >> vertexSize;
 	s >> vertexPosOffset;
+	s >> instanced;
 }
 
 void MaterialDefinition::loadUniforms(const ConfigNode& node)
@@ -440,6 +458,11 @@ MaterialPass::MaterialPass(const String& shaderAssetId, const ConfigNode& node)
 	}
 }
 
+MaterialPass::MaterialPass(BlendType blend, std::shared_ptr<Shader> shader)
+	: shader(std::move(shader))
+	, blend(blend)
+{}
+
 void MaterialPass::serialize(Serializer& s) const
 {
 	s << blend;
@@ -454,11 +477,14 @@ void MaterialPass::deserialize(Deserializer& s)
 	s >> depthStencil;
 }
 
-void MaterialPass::createShader(ResourceLoader& loader, String name, const Vector<MaterialAttribute>& attributes)
+String MaterialPass::getShaderFileName(VideoAPI& video) const
+{
+	return shaderAssetId + ":" + video.getShaderLanguage();
+}
+
+void MaterialPass::createShader(Resources& resources, VideoAPI& video, String name, const Vector<MaterialAttribute>& attributes)
 {
-	auto& api = loader.getAPI();
-	auto& video = *api.video;
-	auto shaderData = api.getResource<ShaderFile>(shaderAssetId + ":" + video.getShaderLanguage());
+	auto shaderData = resources.get<ShaderFile>(getShaderFileName(video));
 
 	ShaderDefinition definition;
 	definition.name = name;
@@ -1,6 +1,7 @@
 #include "halley/core/graphics/painter.h"
 #include "halley/core/graphics/render_context.h"
 #include "halley/core/graphics/render_target/render_target.h"
+#include "halley/core/graphics/render_command_buffer.h"
 #include "halley/core/graphics/material/material.h"
 #include "halley/core/graphics/material/material_definition.h"
 #include "halley/core/graphics/material/material_parameter.h"
@@ -8,8 +9,15 @@
 #include <gsl/gsl_assert>
 #include "resources/resources.h"
 
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386)
+#define HAS_SSE
+#include <xmmintrin.h>
+#endif
+
 using namespace Halley;
 
+constexpr size_t Painter::maxVertices16;
+
 Painter::Painter(Resources& resources)
 	: halleyGlobalMaterial(std::make_unique<Material>(resources.get<MaterialDefinition>("Halley/MaterialBase"), true))
 {
@@ -21,20 +29,34 @@ Painter::~Painter()
 
 void Painter::startRender()
 {
-	Material::resetBindCache();
 	prevDrawCalls = nDrawCalls;
 	prevTriangles = nTriangles;
 	prevVertices = nVertices;
-	nDrawCalls = nTriangles = nVertices = 0;
+	prevDrawCallsUnbatched = nDrawCallsUnbatched;
+	prevBytes = nBytes;
+	nDrawCalls = nDrawCallsUnbatched = nTriangles = nVertices = nBytes = 0;
+	unordered = false;
+	++frameNumber;
 
 	resetPending();
-	doStartRender();
+	resetReservedSprites();
+	if (recording) {
+		recording->add(RenderCommandType::StartRender);
+	} else {
+		execStartRender();
+	}
 }
 
 void Painter::endRender()
 {
 	flush();
-	doEndRender();
+	unordered = false;
+	if (recording) {
+		recording->add(RenderCommandType::EndRender);
+		purgeSnapshots();
+	} else {
+		execEndRender();
+	}
 	camera = nullptr;
 	viewPort = Rect4i(0, 0, 0, 0);
 }
@@ -44,6 +66,67 @@ void Painter::flush()
 	flushPending();
 }
 
+void Painter::clear(Colour colour)
+{
+	flushPending();
+	if (recording) {
+		recording->add(RenderCommandType::Clear, colour);
+	} else {
+		execClear(colour);
+	}
+}
+
+void Painter::setRecording(RenderCommandBuffer* buffer)
+{
+	flushPending();
+	recording = buffer;
+}
+
+void Painter::replay(RenderCommandBuffer& buffer)
+{
+	RenderCommandBuffer::Reader reader(buffer);
+	while (reader.hasNext()) {
+		switch (reader.nextType()) {
+		case RenderCommandType::StartRender:
+			execStartRender();
+			break;
+		case RenderCommandType::EndRender:
+			execEndRender();
+			break;
+		case RenderCommandType::Clear:
+			execClear(reader.read<Colour>());
+			break;
+		case RenderCommandType::BindRenderTarget:
+			execBindRenderTarget(*reader.read<RenderTarget*>());
+			break;
+		case RenderCommandType::UnbindRenderTarget:
+			execUnbindRenderTarget(*reader.read<RenderTarget*>());
+			break;
+		case RenderCommandType::SetViewPort:
+			execViewPort(reader.read<Rect4i>());
+			break;
+		case RenderCommandType::SetClip:
+			{
+				const auto clip = reader.read<RenderCommandBuffer::ClipData>();
+				execClip(clip.rect, clip.enable);
+			}
+			break;
+		case RenderCommandType::UpdateProjection:
+			execUpdateProjection(buffer.getMaterial(reader.read<uint32_t>()));
+			break;
+		case RenderCommandType::ResetBindCache:
+			execResetBindCache();
+			break;
+		case RenderCommandType::Draw:
+			{
+				const auto& draw = buffer.getDraw(reader.read<uint32_t>());
+				execDraw(buffer.getMaterial(draw.material), draw.numVertices, buffer.getVertexData(draw), draw.numIndices, buffer.getIndexData(draw), draw.indexFormat, draw.standardQuadsOnly);
+			}
+			break;
+		}
+	}
+}
+
 Rect4f Painter::getWorldViewAABB() const
 {
 	Vector2f size = Vector2f(viewPort.getSize()) / camera->getZoom();
@@ -56,13 +139,115 @@ static Vector4f& getVertPos(char* vertexAttrib, size_t vertPosOffset)
 	return *reinterpret_cast<Vector4f*>(vertexAttrib + vertPosOffset);
 }
 
+static void expandSprite(char* dst, const char* src, size_t vertexSize, size_t vertexStride, size_t vertPosOffset)
+{
+	// Writes four copies of the sprite's vertex, each with its own vertPos:
+	// j -> vertPos
+	// 0 -> 0, 0
+	// 1 -> 1, 0
+	// 2 -> 1, 1
+	// 3 -> 0, 1
+#ifdef HAS_SSE
+	if ((vertexSize & 15) == 0 && (vertPosOffset & 15) == 0 && vertPosOffset + 16 <= vertexSize) {
+		// Read each 16 bytes of the source once, and store them to all four vertices
+		const __m128 corners[4] = { _mm_setr_ps(0, 0, 0, 0), _mm_setr_ps(1, 0, 1, 0), _mm_setr_ps(1, 1, 1, 1), _mm_setr_ps(0, 1, 0, 1) };
+		for (size_t offset = 0; offset < vertexSize; offset += 16) {
+			if (offset == vertPosOffset) {
+				for (size_t j = 0; j < 4; j++) {
+					_mm_storeu_ps(reinterpret_cast<float*>(dst + j * vertexStride + offset), corners[j]);
+				}
+			} else {
+				const __m128 value = _mm_loadu_ps(reinterpret_cast<const float*>(src + offset));
+				for (size_t j = 0; j < 4; j++) {
+					_mm_storeu_ps(reinterpret_cast<float*>(dst + j * vertexStride + offset), value);
+				}
+			}
+		}
+		return;
+	}
+#endif
+
+	for (size_t j = 0; j < 4; j++) {
+		char* vertex = dst + j * vertexStride;
+		memcpy(vertex, src, vertexSize);
+		const float x = ((j & 1) ^ ((j & 2) >> 1)) * 1.0f;
+		const float y = ((j & 2) >> 1) * 1.0f;
+		getVertPos(vertex, vertPosOffset) = Vector4f(x, y, x, y);
+	}
+}
+
+static void expandSlicedSprite(char* dst, const char* src, size_t vertexSize, size_t vertexStride, size_t vertPosOffset, Vector2f scale, Vector4f slices)
+{
+	//         a        c
+	//   00 -- 01 ----- 02 -- 03
+	//   |     |        |     |
+	// b 04 -- 05 ----- 06 -- 07
+	//   |     |        |     |
+	//   |     |        |     |
+	// d 08 -- 09 ----- 10 -- 11
+	//   |     |        |     |
+	//   12 -- 13 ----- 14 -- 15
+
+	std::array<Vector2f, 4> pos = {{ Vector2f(0, 0), Vector2f(slices.x / scale.x, slices.y / scale.y), Vector2f(1 - slices.z / scale.x, 1 - slices.w / scale.y), Vector2f(1, 1) }};
+	std::array<Vector2f, 4> tex = {{ Vector2f(0, 0), Vector2f(slices.x, slices.y), Vector2f(1 - slices.z, 1 - slices.w), Vector2f(1, 1) }};
+	for (size_t i = 0; i < 16; i++) {
+		const size_t ix = i & 3;
+		const size_t iy = i >> 2;
+		const size_t dstOffset = i * vertexStride;
+
+		memmove(dst + dstOffset, src, vertexSize);
+
+		Vector4f& vertPos = getVertPos(dst + dstOffset, vertPosOffset);
+		vertPos = Vector4f(pos[ix].x, pos[iy].y, tex[ix].x, tex[iy].y);
+	}
+}
+
+template <typename T>
+static void doGenerateQuadIndices(T pos, size_t numQuads, T* target)
+{
+	size_t numIndices = numQuads * 6;
+	for (size_t i = 0; i < numIndices; i += 6) {
+		// A-----B
+		// |     |
+		// D-----C
+		// ABC
+		target[i] = pos;
+		target[i + 1] = pos + 1;
+		target[i + 2] = pos + 2;
+		// CDA
+		target[i + 3] = pos + 2;
+		target[i + 4] = pos + 3;
+		target[i + 5] = pos;
+		pos += 4;
+	}
+}
+
+
 Painter::PainterVertexData Painter::addDrawData(std::shared_ptr<Material>& material, size_t numVertices, size_t numIndices, bool standardQuadsOnly)
 {
 	Expects(material);
 	Expects(numVertices > 0);
-	Expects(numIndices >= numVertices);
+	if (isInstanced(material->getDefinition())) {
+		if (numIndices != 0) {
+			throw Exception("Material \"" + material->getDefinition().getName() + "\" is instanced, so it can only be drawn with drawSprites.", HalleyExceptions::Graphics);
+		}
+	} else {
+		Expects(numIndices >= numVertices);
+	}
+
+	if (unordered) {
+		return addBatchedDrawData(material, numVertices, numIndices, standardQuadsOnly);
+	}
 
 	startDrawCall(material);
+	if (numIndices > 0 && !canAddressVertices(indexBuffer, indicesPending, verticesPending + numVertices)) {
+		// The backend only takes 16-bit indices, so submit what's there and start over
+		flushPending();
+		startDrawCall(material);
+		if (numVertices > maxVertices16) {
+			throw Exception("Draw of " + toString(numVertices) + " vertices needs 32-bit indices, which aren't supported by this painter.", HalleyExceptions::Graphics);
+		}
+	}
 
 	PainterVertexData result;
 
@@ -70,11 +255,11 @@ Painter::PainterVertexData Painter::addDrawData(std::shared_ptr<Material>& mater
 	result.vertexStride = material->getDefinition().getVertexStride();
 	result.dataSize = numVertices * result.vertexStride;
 	makeSpaceForPendingVertices(result.dataSize);
-	makeSpaceForPendingIndices(numIndices);
 
 	result.dstVertex = vertexBuffer.data() + bytesPending;
-	result.dstIndex = indexBuffer.data() + indicesPending;
-	result.firstIndex = static_cast<unsigned short>(verticesPending);
+	result.dstIndex = indexBuffer.reserve(indicesPending, numIndices);
+	result.firstIndex = uint32_t(verticesPending);
+	result.indexFormat = indexBuffer.format;
 
 	indicesPending += numIndices;
 	verticesPending += numVertices;
@@ -84,22 +269,209 @@ Painter::PainterVertexData Painter::addDrawData(std::shared_ptr<Material>& mater
 	return result;
 }
 
+void Painter::beginUnorderedBatch()
+{
+	if (!unordered) {
+		flushPending();
+		unordered = true;
+		firstOpenReservedGroup = nReservedGroups;
+	}
+}
+
+void Painter::endUnorderedBatch()
+{
+	if (unordered) {
+		flushPending();
+		unordered = false;
+		firstOpenReservedGroup = nReservedGroups;
+	}
+}
+
+bool Painter::canAddressVertices(IndexStorage& indices, size_t curIndices, size_t totalVertices)
+{
+	if (indices.format == IndexFormat::UInt32 || totalVertices <= maxVertices16) {
+		return true;
+	}
+	if (supports32BitIndices()) {
+		indices.promote(curIndices);
+		return true;
+	}
+	return false;
+}
+
+void* Painter::IndexStorage::reserve(size_t curIndices, size_t numIndices)
+{
+	const size_t requiredSize = curIndices + numIndices;
+	if (format == IndexFormat::UInt16) {
+		if (indices16.size() < requiredSize) {
+			indices16.resize(requiredSize * 2);
+		}
+		return indices16.data() + curIndices;
+	} else {
+		if (indices32.size() < requiredSize) {
+			indices32.resize(requiredSize * 2);
+		}
+		return indices32.data() + curIndices;
+	}
+}
+
+void Painter::IndexStorage::promote(size_t curIndices)
+{
+	Expects(format == IndexFormat::UInt16);
+	if (indices32.size() < curIndices * 2) {
+		indices32.resize(curIndices * 2);
+	}
+	std::copy(indices16.begin(), indices16.begin() + curIndices, indices32.begin());
+	format = IndexFormat::UInt32;
+}
+
+const void* Painter::IndexStorage::getData() const
+{
+	return format == IndexFormat::UInt16 ? static_cast<const void*>(indices16.data()) : static_cast<const void*>(indices32.data());
+}
+
+void* Painter::IndexStorage::at(size_t index)
+{
+	return format == IndexFormat::UInt16 ? static_cast<void*>(indices16.data() + index) : static_cast<void*>(indices32.data() + index);
+}
+
+Painter::MaterialBatch& Painter::getBatch(std::shared_ptr<Material>& material, size_t numVertices, size_t numIndices)
+{
+	// Consecutive draws with the same material are the common case, so that's checked before hashing
+	size_t index = nBatchesActive;
+	if (lastBatch < nBatchesActive && batches[lastBatch].material == material) {
+		index = lastBatch;
+	} else {
+		const uint64_t key = material->getHash() ^ (uint64_t(reinterpret_cast<uintptr_t>(&material->getDefinition())) * 0x9E3779B97F4A7C15ull);
+		auto iter = batchesByMaterial.find(key);
+		if (iter != batchesByMaterial.end() && (batches[iter->second].material == material || *batches[iter->second].material == *material)) {
+			index = iter->second;
+		} else {
+			// On a hash collision, the new batch takes over the key; the old one still gets flushed, it just isn't added to again
+			if (nBatchesActive == batches.size()) {
+				batches.emplace_back();
+			}
+			batchesByMaterial[key] = nBatchesActive;
+			batches[nBatchesActive++].material = material;
+		}
+	}
+
+	auto& batch = batches[index];
+	if (numIndices > 0 && !canAddressVertices(batch.indexBuffer, batch.indicesPending, batch.verticesPending + numVertices)) {
+		// The backend only takes 16-bit indices, so submit what's there and start over
+		flushBatch(batch);
+	}
+	lastBatch = index;
+	return batch;
+}
+
+Painter::PainterVertexData Painter::addBatchedDrawData(std::shared_ptr<Material>& material, size_t numVertices, size_t numIndices, bool standardQuadsOnly)
+{
+	const size_t prevBatch = lastBatch;
+	auto& batch = getBatch(material, numVertices, numIndices);
+	if (numIndices > 0 && !canAddressVertices(batch.indexBuffer, batch.indicesPending, batch.verticesPending + numVertices)) {
+		throw Exception("Draw of " + toString(numVertices) + " vertices needs 32-bit indices, which aren't supported by this painter.", HalleyExceptions::Graphics);
+	}
+	if (lastBatch != prevBatch || batch.runs == 0) {
+		// Without batching, this would have started a new draw call
+		++batch.runs;
+	}
+
+	PainterVertexData result;
+
+	result.vertexSize = material->getDefinition().getVertexSize();
+	result.vertexStride = material->getDefinition().getVertexStride();
+	result.dataSize = numVertices * result.vertexStride;
+	if (batch.vertexBuffer.size() < batch.bytesPending + result.dataSize) {
+		batch.vertexBuffer.resize((batch.bytesPending + result.dataSize) * 2);
+	}
+
+	result.dstVertex = batch.vertexBuffer.data() + batch.bytesPending;
+	result.dstIndex = batch.indexBuffer.reserve(batch.indicesPending, numIndices);
+	result.firstIndex = uint32_t(batch.verticesPending);
+	result.indexFormat = batch.indexBuffer.format;
+
+	batch.indicesPending += numIndices;
+	batch.verticesPending += numVertices;
+	batch.bytesPending += result.dataSize;
+	batch.allIndicesAreQuads &= standardQuadsOnly;
+
+	return result;
+}
+
+void Painter::flushBatch(MaterialBatch& batch)
+{
+	if (batch.verticesPending > 0) {
+		allIndicesAreQuads = batch.allIndicesAreQuads;
+		executeDrawTriangles(*batch.material, batch.verticesPending, batch.vertexBuffer.data(), batch.indicesPending, batch.indexBuffer.getData(), batch.indexBuffer.format, batch.runs);
+		allIndicesAreQuads = true;
+	}
+
+	batch.verticesPending = 0;
+	batch.bytesPending = 0;
+	batch.indicesPending = 0;
+	batch.runs = 0;
+	batch.allIndicesAreQuads = true;
+	batch.indexBuffer.format = IndexFormat::UInt16;
+}
+
+void Painter::flushBatches()
+{
+	if (nBatchesActive > 0) {
+		for (size_t i = 0; i < nBatchesActive; ++i) {
+			flushBatch(batches[i]);
+			batches[i].material.reset();
+		}
+		batchesByMaterial.clear();
+		nBatchesActive = 0;
+		lastBatch = std::numeric_limits<size_t>::max();
+		if (recording) {
+			recording->add(RenderCommandType::ResetBindCache);
+		} else {
+			execResetBindCache();
+		}
+	}
+}
+
 void Painter::drawQuads(std::shared_ptr<Material> material, size_t numVertices, const void* vertexData)
 {
 	Expects(numVertices % 4 == 0);
 	Expects(vertexData != nullptr);
 
+	if (numVertices > maxVertices16 && !supports32BitIndices()) {
+		const size_t stride = material->getDefinition().getVertexStride();
+		for (size_t i = 0; i < numVertices; i += maxVertices16) {
+			drawQuads(material, std::min(maxVertices16, numVertices - i), static_cast<const char*>(vertexData) + i * stride);
+		}
+		return;
+	}
+
 	auto result = addDrawData(material, numVertices, numVertices * 3 / 2, true);
 
 	memmove(result.dstVertex, vertexData, result.dataSize);
-	generateQuadIndices(result.firstIndex, numVertices / 4, result.dstIndex);
+	generateQuadIndices(result, numVertices / 4);
 }
 
 void Painter::drawSprites(std::shared_ptr<Material> material, size_t numSprites, const void* vertexData)
 {
 	Expects(vertexData != nullptr);
 
+	if (isInstanced(material->getDefinition())) {
+		auto result = addDrawData(material, numSprites, 0, true);
+		memcpy(result.dstVertex, vertexData, result.dataSize);
+		return;
+	}
+
 	const size_t verticesPerSprite = 4;
+	const size_t maxSprites = maxVertices16 / verticesPerSprite;
+	if (numSprites > maxSprites && !supports32BitIndices()) {
+		const size_t stride = material->getDefinition().getVertexStride();
+		for (size_t i = 0; i < numSprites; i += maxSprites) {
+			drawSprites(material, std::min(maxSprites, numSprites - i), static_cast<const char*>(vertexData) + i * stride);
+		}
+		return;
+	}
+
 	const size_t numVertices = verticesPerSprite * numSprites;
 	const size_t vertPosOffset = material->getDefinition().getVertexPosOffset();
 
@@ -108,23 +480,10 @@ void Painter::drawSprites(std::shared_ptr<Material> material, size_t numSprites,
 	const char* const src = reinterpret_cast<const char*>(vertexData);
 
 	for (size_t i = 0; i < numSprites; i++) {
-		for (size_t j = 0; j < verticesPerSprite; j++) {
-			size_t srcOffset = i * result.vertexStride;
-			size_t dstOffset = (i * verticesPerSprite + j) * result.vertexStride;
-			memmove(result.dstVertex + dstOffset, src + srcOffset, result.vertexSize);
-
-			// j -> vertPos
-			// 0 -> 0, 0
-			// 1 -> 1, 0
-			// 2 -> 1, 1
-			// 3 -> 0, 1
-			const float x = ((j & 1) ^ ((j & 2) >> 1)) * 1.0f;
-			const float y = ((j & 2) >> 1) * 1.0f;
-			getVertPos(result.dstVertex + dstOffset, vertPosOffset) = Vector4f(x, y, x, y);
-		}
+		expandSprite(result.dstVertex + i * verticesPerSprite * result.vertexStride, src + i * result.vertexStride, result.vertexSize, result.vertexStride, vertPosOffset);
 	}
 
-	generateQuadIndices(result.firstIndex, numSprites, result.dstIndex);
+	generateQuadIndices(result, numSprites);
 }
 
 void Painter::drawSlicedSprite(std::shared_ptr<Material> material, Vector2f scale, Vector4f slices, const void* vertexData)
@@ -137,60 +496,217 @@ void Painter::drawSlicedSprite(std::shared_ptr<Material> material, Vector2f scal
 	//Expects(scale.x > 0.0001f);
 	//Expects(scale.y > 0.0001f);
 
-	//         a        c
-	//   00 -- 01 ----- 02 -- 03
-	//   |     |        |     |
-	// b 04 -- 05 ----- 06 -- 07
-	//   |     |        |     |
-	//   |     |        |     |
-	// d 08 -- 09 ----- 10 -- 11
-	//   |     |        |     |
-	//   12 -- 13 ----- 14 -- 15
-
 	const size_t numVertices = 16;
 	const size_t numIndices = 9 * 6; // 9 quads, 6 indices per quad
 	const size_t vertPosOffset = material->getDefinition().getVertexPosOffset();
 
 	auto result = addDrawData(material, numVertices, numIndices, false);
-	const char* const src = reinterpret_cast<const char*>(vertexData);
+	expandSlicedSprite(result.dstVertex, reinterpret_cast<const char*>(vertexData), result.vertexSize, result.vertexStride, vertPosOffset, scale, slices);
 
-	// Vertices
-	std::array<Vector2f, 4> pos = {{ Vector2f(0, 0), Vector2f(slices.x / scale.x, slices.y / scale.y), Vector2f(1 - slices.z / scale.x, 1 - slices.w / scale.y), Vector2f(1, 1) }};
-	std::array<Vector2f, 4> tex = {{ Vector2f(0, 0), Vector2f(slices.x, slices.y), Vector2f(1 - slices.z, 1 - slices.w), Vector2f(1, 1) }};
-	for (size_t i = 0; i < numVertices; i++) {
-		const size_t ix = i & 3;
-		const size_t iy = i >> 2;
-		const size_t dstOffset = i * result.vertexStride;
+	// Indices
+	if (result.indexFormat == IndexFormat::UInt16) {
+		generateSlicedIndices(static_cast<unsigned short>(result.firstIndex), static_cast<unsigned short*>(result.dstIndex));
+	} else {
+		generateSlicedIndices(result.firstIndex, static_cast<uint32_t*>(result.dstIndex));
+	}
+}
 
-		memmove(result.dstVertex + dstOffset, src, result.vertexSize);
+size_t Painter::reserveSprites(std::shared_ptr<Material> material, size_t numSprites)
+{
+	Expects(material);
+	Expects(numSprites > 0);
 
-		Vector4f& vertPos = getVertPos(result.dstVertex + dstOffset, vertPosOffset);
-		vertPos = Vector4f(pos[ix].x, pos[iy].y, tex[ix].x, tex[iy].y);
+	const bool instanced = isInstanced(material->getDefinition());
+	const size_t numVertices = instanced ? numSprites : numSprites * 4;
+	const size_t numIndices = instanced ? 0 : numSprites * 6;
+	if (!instanced && numVertices > maxVertices16 && !supports32BitIndices()) {
+		throw Exception("Run of " + toString(numSprites) + " sprites needs 32-bit indices, which aren't supported by this painter.", HalleyExceptions::Graphics);
 	}
 
-	// Indices
-	unsigned short* dstIndex = result.dstIndex;
-	for (size_t y = 0; y < 3; y++) {
-		for (size_t x = 0; x < 3; x++) {
-			generateQuadIndicesOffset(static_cast<unsigned short>(result.firstIndex + x + (y * 4)), 4, dstIndex);
-			dstIndex += 6;
+	auto& group = getReservedGroup(material, numVertices);
+
+	ReservedRun run;
+	run.group = lastReservedGroup;
+	run.firstVertex = group.numVertices;
+	run.firstIndex = group.numIndices;
+	run.numSprites = numSprites;
+	run.sliced = false;
+
+	group.numVertices += numVertices;
+	group.numIndices += numIndices;
+	const size_t numBytes = group.numVertices * group.vertexStride;
+	if (group.vertexBuffer.size() < numBytes) {
+		group.vertexBuffer.resize(numBytes * 2);
+	}
+	group.indexBuffer.reserve(run.firstIndex, numIndices);
+
+	reservedRuns.push_back(run);
+	return reservedRuns.size() - 1;
+}
+
+size_t Painter::reserveSlicedSprite(std::shared_ptr<Material> material, Vector2f scale, Vector4f slices)
+{
+	Expects(material);
+
+	ReservedRun run;
+	run.numSprites = 1;
+	run.sliced = true;
+	run.scale = scale;
+	run.slices = slices;
+	if (scale.x < 0.00001f || scale.y < 0.00001f) {
+		// Not drawn, as in drawSlicedSprite
+		run.group = std::numeric_limits<size_t>::max();
+		run.firstVertex = run.firstIndex = 0;
+		reservedRuns.push_back(run);
+		return reservedRuns.size() - 1;
+	}
+	if (isInstanced(material->getDefinition())) {
+		throw Exception("Material \"" + material->getDefinition().getName() + "\" is instanced, so it can only be drawn with drawSprites.", HalleyExceptions::Graphics);
+	}
+
+	const size_t numVertices = 16;
+	const size_t numIndices = 9 * 6;
+	auto& group = getReservedGroup(material, numVertices);
+	run.group = lastReservedGroup;
+	run.firstVertex = group.numVertices;
+	run.firstIndex = group.numIndices;
+
+	group.numVertices += numVertices;
+	group.numIndices += numIndices;
+	group.allIndicesAreQuads = false;
+	const size_t numBytes = group.numVertices * group.vertexStride;
+	if (group.vertexBuffer.size() < numBytes) {
+		group.vertexBuffer.resize(numBytes * 2);
+	}
+	group.indexBuffer.reserve(run.firstIndex, numIndices);
+
+	reservedRuns.push_back(run);
+	return reservedRuns.size() - 1;
+}
+
+Painter::ReservedGroup& Painter::getReservedGroup(std::shared_ptr<Material>& material, size_t numVertices)
+{
+	// In order, a run can only join the group before it. In an unordered batch, it can join any group with the same material.
+	const size_t first = unordered || nReservedGroups == 0 ? firstOpenReservedGroup : std::max(firstOpenReservedGroup, nReservedGroups - 1);
+	for (size_t i = first; i < nReservedGroups; ++i) {
+		auto& group = reservedGroups[i];
+		if (group.material == material || *group.material == *material) {
+			if (group.instanced || canAddressVertices(group.indexBuffer, group.numIndices, group.numVertices + numVertices)) {
+				if (i != lastReservedGroup) {
+					// Without batching, this would have started a new draw call
+					++group.runs;
+				}
+				lastReservedGroup = i;
+				return group;
+			}
 		}
 	}
+
+	if (nReservedGroups == reservedGroups.size()) {
+		reservedGroups.emplace_back();
+	}
+	lastReservedGroup = nReservedGroups++;
+	auto& group = reservedGroups[lastReservedGroup];
+	const auto& definition = material->getDefinition();
+	group.material = material;
+	group.vertexSize = definition.getVertexSize();
+	group.vertexStride = definition.getVertexStride();
+	group.vertPosOffset = definition.getVertexPosOffset();
+	group.instanced = isInstanced(definition);
+	group.numVertices = 0;
+	group.numIndices = 0;
+	group.runs = 1;
+	group.allIndicesAreQuads = true;
+	group.indexBuffer.format = IndexFormat::UInt16;
+	if (!group.instanced) {
+		canAddressVertices(group.indexBuffer, 0, numVertices);
+	}
+	return group;
 }
 
-void Painter::makeSpaceForPendingVertices(size_t numBytes)
+void Painter::fillReservedSprites(size_t runIdx, size_t firstSprite, size_t numSprites, const void* const* vertexData)
 {
-	size_t requiredSize = bytesPending + numBytes;
-	if (vertexBuffer.size() < requiredSize) {
-		vertexBuffer.resize(requiredSize * 2);
+	// Only touches this range of the run, so different ranges can be filled concurrently
+	Expects(runIdx < reservedRuns.size());
+	const auto& run = reservedRuns[runIdx];
+	Expects(firstSprite + numSprites <= run.numSprites);
+	if (run.group >= nReservedGroups) {
+		return;
+	}
+	auto& group = reservedGroups[run.group];
+	const size_t stride = group.vertexStride;
+
+	if (run.sliced) {
+		expandSlicedSprite(group.vertexBuffer.data() + run.firstVertex * stride, static_cast<const char*>(vertexData[0]), group.vertexSize, stride, group.vertPosOffset, run.scale, run.slices);
+		void* dstIndex = group.indexBuffer.at(run.firstIndex);
+		if (group.indexBuffer.format == IndexFormat::UInt16) {
+			generateSlicedIndices(static_cast<unsigned short>(run.firstVertex), static_cast<unsigned short*>(dstIndex));
+		} else {
+			generateSlicedIndices(uint32_t(run.firstVertex), static_cast<uint32_t*>(dstIndex));
+		}
+		return;
+	}
+
+	if (group.instanced) {
+		char* dst = group.vertexBuffer.data() + (run.firstVertex + firstSprite) * stride;
+		for (size_t i = 0; i < numSprites; i++) {
+			memcpy(dst + i * stride, vertexData[i], group.vertexSize);
+		}
+		return;
 	}
+
+	const size_t firstVertex = run.firstVertex + firstSprite * 4;
+	char* dst = group.vertexBuffer.data() + firstVertex * stride;
+	for (size_t i = 0; i < numSprites; i++) {
+		expandSprite(dst + i * 4 * stride, static_cast<const char*>(vertexData[i]), group.vertexSize, stride, group.vertPosOffset);
+	}
+
+	void* dstIndex = group.indexBuffer.at(run.firstIndex + firstSprite * 6);
+	if (group.indexBuffer.format == IndexFormat::UInt16) {
+		doGenerateQuadIndices(static_cast<unsigned short>(firstVertex), numSprites, static_cast<unsigned short*>(dstIndex));
+	} else {
+		doGenerateQuadIndices(uint32_t(firstVertex), numSprites, static_cast<uint32_t*>(dstIndex));
+	}
+}
+
+void Painter::submitReservedSprites()
+{
+	flushPending();
+	if (nReservedGroups == 0) {
+		return;
+	}
+
+	for (size_t i = 0; i < nReservedGroups; ++i) {
+		auto& group = reservedGroups[i];
+		allIndicesAreQuads = group.allIndicesAreQuads;
+		executeDrawTriangles(*group.material, group.numVertices, group.vertexBuffer.data(), group.numIndices, group.indexBuffer.getData(), group.indexBuffer.format, group.runs);
+	}
+	allIndicesAreQuads = true;
+	if (recording) {
+		recording->add(RenderCommandType::ResetBindCache);
+	} else {
+		execResetBindCache();
+	}
+
+	resetReservedSprites();
 }
 
-void Painter::makeSpaceForPendingIndices(size_t numIndices)
+void Painter::resetReservedSprites()
 {
-	size_t requiredSize = indicesPending + numIndices;
-	if (indexBuffer.size() < requiredSize) {
-		indexBuffer.resize(requiredSize * 2);
+	for (size_t i = 0; i < nReservedGroups; ++i) {
+		reservedGroups[i].material.reset();
+	}
+	reservedRuns.clear();
+	nReservedGroups = 0;
+	firstOpenReservedGroup = 0;
+	lastReservedGroup = std::numeric_limits<size_t>::max();
+}
+
+void Painter::makeSpaceForPendingVertices(size_t numBytes)
+{
+	size_t requiredSize = bytesPending + numBytes;
+	if (vertexBuffer.size() < requiredSize) {
+		vertexBuffer.resize(requiredSize * 2);
 	}
 }
 
@@ -203,11 +719,20 @@ void Painter::bind(RenderContext& context)
 
 	// Set render target
 	activeRenderTarget = &camera->getActiveRenderTarget();
-	activeRenderTarget->onBind(*this);
+	if (recording) {
+		recording->add(RenderCommandType::BindRenderTarget, activeRenderTarget);
+	} else {
+		execBindRenderTarget(*activeRenderTarget);
+	}
 
 	// Set viewport
 	viewPort = camera->getActiveViewPort();
-	setViewPort(getRectangleForActiveRenderTarget(viewPort));
+	const Rect4i targetViewPort = getRectangleForActiveRenderTarget(viewPort);
+	if (recording) {
+		recording->add(RenderCommandType::SetViewPort, targetViewPort);
+	} else {
+		execViewPort(targetViewPort);
+	}
 	setClip();
 
 	// Update projection
@@ -217,7 +742,11 @@ void Painter::bind(RenderContext& context)
 void Painter::unbind(RenderContext& context)
 {
 	flush();
-	activeRenderTarget->onUnbind(*this);
+	if (recording) {
+		recording->add(RenderCommandType::UnbindRenderTarget, activeRenderTarget);
+	} else {
+		execUnbindRenderTarget(*activeRenderTarget);
+	}
 	activeRenderTarget = nullptr;
 	camera->rendering = false;
 }
@@ -243,13 +772,23 @@ void Painter::setClip(Rect4i rect)
 {
 	flushPending();
 	Rect4i finalRect = (rect + viewPort.getTopLeft()).intersection(viewPort);
-	setClip(getRectangleForActiveRenderTarget(finalRect), finalRect != activeRenderTarget->getViewPort());
+	const auto clip = RenderCommandBuffer::ClipData{ getRectangleForActiveRenderTarget(finalRect), finalRect != activeRenderTarget->getViewPort() };
+	if (recording) {
+		recording->add(RenderCommandType::SetClip, clip);
+	} else {
+		execClip(clip.rect, clip.enable);
+	}
 }
 
 void Painter::setClip()
 {
 	flushPending();
-	setClip(getRectangleForActiveRenderTarget(viewPort), viewPort != activeRenderTarget->getViewPort());
+	const auto clip = RenderCommandBuffer::ClipData{ getRectangleForActiveRenderTarget(viewPort), viewPort != activeRenderTarget->getViewPort() };
+	if (recording) {
+		recording->add(RenderCommandType::SetClip, clip);
+	} else {
+		execClip(clip.rect, clip.enable);
+	}
 }
 
 Rect4i Painter::getRectangleForActiveRenderTarget(Rect4i r)
@@ -277,10 +816,11 @@ void Painter::startDrawCall(std::shared_ptr<Material>& material)
 void Painter::flushPending()
 {
 	if (verticesPending > 0) {
-		executeDrawTriangles(*materialPending, verticesPending, vertexBuffer.data(), indicesPending, indexBuffer.data());
+		executeDrawTriangles(*materialPending, verticesPending, vertexBuffer.data(), indicesPending, indexBuffer.getData(), indexBuffer.format);
 	}
 
 	resetPending();
+	flushBatches();
 }
 
 void Painter::resetPending()
@@ -289,18 +829,101 @@ void Painter::resetPending()
 	verticesPending = 0;
 	indicesPending = 0;
 	allIndicesAreQuads = true;
+	indexBuffer.format = IndexFormat::UInt16;
 	if (materialPending) {
-		Material::resetBindCache();
+		if (recording) {
+			recording->add(RenderCommandType::ResetBindCache);
+		} else {
+			execResetBindCache();
+		}
 		materialPending.reset();
 	}
 }
 
-void Painter::executeDrawTriangles(Material& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices)
+void Painter::executeDrawTriangles(Material& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, size_t runs)
+{
+	// Log stats
+	const size_t vertexBytes = numVertices * material.getDefinition().getVertexStride();
+	const bool instanced = isInstanced(material.getDefinition());
+	for (int i = 0; i < material.getDefinition().getNumPasses(); i++) {
+		if (material.isPassEnabled(i)) {
+			nDrawCalls++;
+			nDrawCallsUnbatched += runs;
+			nTriangles += instanced ? numVertices * 2 : numIndices / 3;
+			nVertices += instanced ? numVertices * 4 : numVertices;
+		}
+	}
+	const size_t indexSize = indexFormat == IndexFormat::UInt16 ? sizeof(unsigned short) : sizeof(uint32_t);
+	nBytes += vertexBytes + (instanced ? 6 : numIndices) * indexSize;
+
+	if (recording) {
+		recording->addDraw(getSnapshot(material), numVertices, vertexData, vertexBytes, numIndices, indices, indexFormat, allIndicesAreQuads);
+	} else {
+		execDraw(material, numVertices, vertexData, numIndices, indices, indexFormat, allIndicesAreQuads);
+	}
+}
+
+void Painter::execStartRender()
+{
+	Material::resetBindCache();
+	doStartRender();
+}
+
+void Painter::execEndRender()
+{
+	doEndRender();
+}
+
+void Painter::execClear(Colour colour)
+{
+	doClear(colour);
+}
+
+void Painter::execBindRenderTarget(RenderTarget& target)
+{
+	backendRenderTarget = &target;
+	target.onBind(*this);
+}
+
+void Painter::execUnbindRenderTarget(RenderTarget& target)
+{
+	target.onUnbind(*this);
+	backendRenderTarget = nullptr;
+}
+
+void Painter::execViewPort(Rect4i rect)
+{
+	setViewPort(rect);
+}
+
+void Painter::execClip(Rect4i rect, bool enable)
+{
+	setClip(rect, enable);
+}
+
+void Painter::execUpdateProjection(Material& material)
+{
+	onUpdateProjection(material);
+}
+
+void Painter::execResetBindCache()
+{
+	Material::resetBindCache();
+}
+
+void Painter::execDraw(Material& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly)
 {
 	startDrawCall();
 
 	// Load vertices
-	setVertices(material.getDefinition(), numVertices, vertexData, numIndices, indices, allIndicesAreQuads);
+	const bool instanced = isInstanced(material.getDefinition());
+	if (instanced) {
+		// One vertex per instance, drawn with the indices of a single quad
+		static unsigned short quadIndices[] = { 0, 1, 2, 2, 3, 0 };
+		setVertices(material.getDefinition(), numVertices, vertexData, 6, quadIndices, IndexFormat::UInt16, true);
+	} else {
+		setVertices(material.getDefinition(), numVertices, vertexData, numIndices, indices, indexFormat, standardQuadsOnly);
+	}
 
 	// Load material uniforms
 	material.uploadData(*this);
@@ -313,18 +936,56 @@ void Painter::executeDrawTriangles(Material& material, size_t numVertices, void*
 			material.bind(i, *this);
 
 			// Draw
-			drawTriangles(numIndices);
-
-			// Log stats
-			nDrawCalls++;
-			nTriangles += numIndices / 3;
-			nVertices += numVertices;
+			if (instanced) {
+				drawInstances(6, numVertices);
+			} else {
+				drawTriangles(numIndices);
+			}
 		}
 	}
 
 	endDrawCall();
 }
 
+std::shared_ptr<Material> Painter::getSnapshot(const Material& material)
+{
+	// The recorded frame is replayed while the next one is being built, so it needs a copy of the material as it is now.
+	// Copies are kept around while in use, so materials that don't change aren't copied every frame.
+	const auto& definition = material.getDefinition();
+	const uint64_t key = material.getHash() ^ (uint64_t(reinterpret_cast<uintptr_t>(&definition)) * 0x9E3779B97F4A7C15ull);
+	auto& entry = materialSnapshots[key];
+	if (!entry.material || &entry.material->getDefinition() != &definition) {
+		entry.material = material.clone();
+	}
+	entry.lastFrame = frameNumber;
+	return entry.material;
+}
+
+void Painter::purgeSnapshots()
+{
+	constexpr uint64_t maxAge = 60;
+	if (frameNumber % maxAge != 0) {
+		return;
+	}
+	for (auto iter = materialSnapshots.begin(); iter != materialSnapshots.end(); ) {
+		if (iter->second.lastFrame + maxAge < frameNumber) {
+			iter = materialSnapshots.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+}
+
+bool Painter::isInstanced(const MaterialDefinition& material) const
+{
+	return material.isInstanced() && supportsInstancing();
+}
+
+void Painter::drawInstances(size_t, size_t)
+{
+	throw Exception("Instanced drawing is not supported by this painter.", HalleyExceptions::Graphics);
+}
+
 unsigned short* Painter::getStandardQuadIndices(size_t numQuads)
 {
 	size_t sz = numQuads * 6;
@@ -352,44 +1013,54 @@ unsigned short* Painter::getStandardQuadIndices(size_t numQuads)
 	return stdQuadIndexCache.data();
 }
 
-void Painter::generateQuadIndices(unsigned short pos, size_t numQuads, unsigned short* target)
+void Painter::generateQuadIndices(unsigned short firstVertex, size_t numQuads, unsigned short* target)
 {
-	size_t numIndices = numQuads * 6;
-	for (size_t i = 0; i < numIndices; i += 6) {
-		// A-----B
-		// |     |
-		// D-----C
-		// ABC
-		target[i] = pos;
-		target[i + 1] = pos + 1;
-		target[i + 2] = pos + 2;
-		// CDA
-		target[i + 3] = pos + 2;
-		target[i + 4] = pos + 3;
-		target[i + 5] = pos;
-		pos += 4;
+	doGenerateQuadIndices(firstVertex, numQuads, target);
+}
+
+void Painter::generateQuadIndices(uint32_t firstVertex, size_t numQuads, uint32_t* target)
+{
+	doGenerateQuadIndices(firstVertex, numQuads, target);
+}
+
+void Painter::generateQuadIndices(const PainterVertexData& data, size_t numQuads)
+{
+	if (data.indexFormat == IndexFormat::UInt16) {
+		doGenerateQuadIndices(static_cast<unsigned short>(data.firstIndex), numQuads, static_cast<unsigned short*>(data.dstIndex));
+	} else {
+		doGenerateQuadIndices(data.firstIndex, numQuads, static_cast<uint32_t*>(data.dstIndex));
 	}
 }
 
 RenderTarget& Painter::getActiveRenderTarget()
 {
-	Expects(activeRenderTarget);
-	return *activeRenderTarget;
+	Expects(backendRenderTarget);
+	return *backendRenderTarget;
 }
 
-void Painter::generateQuadIndicesOffset(unsigned short pos, unsigned short lineStride, unsigned short* target)
+template <typename T>
+void Painter::generateSlicedIndices(T firstVertex, T* target)
 {
-	// A-----B
-	// |     |
-	// C-----D
-	// ABD
-	target[0] = pos;
-	target[1] = pos + 1;
-	target[2] = pos + lineStride + 1;
-	// DCA
-	target[3] = pos + lineStride + 1;
-	target[4] = pos + lineStride;
-	target[5] = pos;
+	// 3x3 quads over a 4x4 grid of vertices
+	constexpr T lineStride = 4;
+	for (T y = 0; y < 3; y++) {
+		for (T x = 0; x < 3; x++) {
+			const T pos = firstVertex + x + y * lineStride;
+
+			// A-----B
+			// |     |
+			// C-----D
+			// ABD
+			target[0] = pos;
+			target[1] = pos + 1;
+			target[2] = pos + lineStride + 1;
+			// DCA
+			target[3] = pos + lineStride + 1;
+			target[4] = pos + lineStride;
+			target[5] = pos;
+			target += 6;
+		}
+	}
 }
 
 void Painter::updateProjection()
@@ -397,9 +1068,13 @@ void Painter::updateProjection()
 	camera->updateProjection(activeRenderTarget->getProjectionFlipVertical());
 	projection = camera->getProjection();
 	
-	auto old = halleyGlobalMaterial->clone();
+	const auto oldRevision = halleyGlobalMaterial->getRevision();
 	halleyGlobalMaterial->set("u_mvp", projection);
-	if (*old != *halleyGlobalMaterial) {
-		onUpdateProjection(*halleyGlobalMaterial);
+	if (halleyGlobalMaterial->getRevision() != oldRevision) {
+		if (recording) {
+			recording->add(RenderCommandType::UpdateProjection, recording->addMaterial(getSnapshot(*halleyGlobalMaterial)));
+		} else {
+			execUpdateProjection(*halleyGlobalMaterial);
+		}
 	}
 }
@@ -0,0 +1,51 @@
+#include "halley/core/graphics/render_command_buffer.h"
+#include "halley/core/graphics/material/material.h"
+#include "halley/utils/utils.h"
+
+using namespace Halley;
+
+void RenderCommandBuffer::clear()
+{
+	stream.clear();
+	vertexData.clear();
+	indexData.clear();
+	materials.clear();
+	draws.clear();
+	numCommands = 0;
+}
+
+size_t RenderCommandBuffer::getSizeBytes() const
+{
+	return stream.size() + vertexData.size() + indexData.size();
+}
+
+uint32_t RenderCommandBuffer::addMaterial(std::shared_ptr<Material> material)
+{
+	// Consecutive commands usually share a material
+	if (materials.empty() || materials.back() != material) {
+		materials.push_back(std::move(material));
+	}
+	return uint32_t(materials.size() - 1);
+}
+
+void RenderCommandBuffer::addDraw(std::shared_ptr<Material> material, size_t numVertices, const void* vertices, size_t vertexBytes, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly)
+{
+	// Keep 32-bit indices aligned
+	indexData.resize(alignUp(indexData.size(), size_t(4)));
+	const size_t indexBytes = numIndices * (indexFormat == IndexFormat::UInt16 ? sizeof(unsigned short) : sizeof(uint32_t));
+
+	DrawData draw;
+	draw.material = addMaterial(std::move(material));
+	draw.numVertices = uint32_t(numVertices);
+	draw.numIndices = uint32_t(numIndices);
+	draw.vertexOffset = uint32_t(vertexData.size());
+	draw.indexOffset = uint32_t(indexData.size());
+	draw.indexFormat = indexFormat;
+	draw.standardQuadsOnly = standardQuadsOnly;
+
+	vertexData.insert(vertexData.end(), static_cast<const char*>(vertices), static_cast<const char*>(vertices) + vertexBytes);
+	indexData.insert(indexData.end(), static_cast<const char*>(indices), static_cast<const char*>(indices) + indexBytes);
+
+	add(RenderCommandType::Draw, uint32_t(draws.size()));
+	draws.push_back(draw);
+}
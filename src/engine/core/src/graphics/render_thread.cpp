@@ -0,0 +1,99 @@
+#include "halley/core/graphics/render_thread.h"
+#include "halley/core/graphics/painter.h"
+#include "halley/core/api/video_api.h"
+#include "halley/core/api/system_api.h"
+
+using namespace Halley;
+
+RenderThread::RenderThread(Painter& painter, VideoAPI& video, SystemAPI& system)
+	: painter(painter)
+	, video(video)
+{
+	thread = system.createThread("Render", ThreadPriority::High, [this] () { run(); });
+}
+
+RenderThread::~RenderThread()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		running = false;
+	}
+	condition.notify_all();
+	thread.join();
+}
+
+void RenderThread::beginFrame()
+{
+	auto& buffer = buffers[recordingIdx];
+	buffer.clear();
+	painter.setRecording(&buffer);
+	painter.startRender();
+}
+
+void RenderThread::endFrame()
+{
+	painter.endRender();
+	painter.setRecording(nullptr);
+
+	// Only one frame can be in flight, as it owns the other buffer
+	waitIdle();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		pending = &buffers[recordingIdx];
+		busy = true;
+	}
+	condition.notify_all();
+	recordingIdx = 1 - recordingIdx;
+}
+
+void RenderThread::waitIdle()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [&] () { return !busy; });
+	}
+	rethrow();
+}
+
+void RenderThread::run()
+{
+	while (true) {
+		RenderCommandBuffer* buffer;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&] () { return pending || !running; });
+			if (!pending) {
+				return;
+			}
+			buffer = pending;
+			pending = nullptr;
+		}
+
+		try {
+			video.startRender();
+			painter.replay(*buffer);
+			video.finishRender();
+		} catch (...) {
+			std::unique_lock<std::mutex> lock(mutex);
+			error = std::current_exception();
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			busy = false;
+		}
+		condition.notify_all();
+	}
+}
+
+void RenderThread::rethrow()
+{
+	std::exception_ptr e;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		std::swap(e, error);
+	}
+	if (e) {
+		std::rethrow_exception(e);
+	}
+}
@@ -173,7 +173,6 @@ std::unique_ptr<Animation> Animation::loadResource(ResourceLoader& loader)
 	auto sData = loader.getStatic();
 	Deserializer s(sData->getSpan());
 	s >> *result;
-	result->loadDependencies(loader);
 	return result;
 }
 
@@ -182,11 +181,22 @@ void Animation::reload(Resource&& resource)
 	*this = std::move(dynamic_cast<Animation&>(resource));
 }
 
-void Animation::loadDependencies(ResourceLoader& loader)
+void Animation::onLoaded(Resources& resources)
 {
-	spriteSheet = loader.getAPI().getResource<SpriteSheet>(spriteSheetName);
+	loadDependencies(resources);
+}
+
+void Animation::getDependencies(Vector<ResourceReference>& dependencies) const
+{
+	dependencies.push_back({ AssetType::SpriteSheet, spriteSheetName });
+	dependencies.push_back({ AssetType::MaterialDefinition, materialName });
+}
+
+void Animation::loadDependencies(Resources& resources)
+{
+	spriteSheet = resources.get<SpriteSheet>(spriteSheetName);
 
-	auto matDef = loader.getAPI().getResource<MaterialDefinition>(materialName);
+	auto matDef = resources.get<MaterialDefinition>(materialName);
 	material = std::make_shared<Material>(matDef);
 	material->set("tex0", spriteSheet->getTexture());
 
@@ -50,12 +50,7 @@ void Sprite::drawSliced(Painter& painter, Vector4s slicesPixel) const
 	Expects(material);
 	Expects(material->getDefinition().getVertexStride() == sizeof(SpriteVertexAttrib));
 	
-	Vector4f slices(slicesPixel);
-	slices.x /= size.x;
-	slices.y /= size.y;
-	slices.z /= size.x;
-	slices.w /= size.y;
-
+	const Vector4f slices = getRelativeSlices(slicesPixel);
 	if (clip) {
 		painter.setRelativeClip(clip.get() + vertexAttrib.pos);
 	}
@@ -361,6 +356,26 @@ Sprite& Sprite::setNotSliced()
 	return *this;
 }
 
+bool Sprite::isSliced() const
+{
+	return sliced;
+}
+
+Vector4f Sprite::getRelativeSlices() const
+{
+	return getRelativeSlices(slices);
+}
+
+Vector4f Sprite::getRelativeSlices(Vector4s slicesPixel) const
+{
+	Vector4f result(slicesPixel);
+	result.x /= size.x;
+	result.y /= size.y;
+	result.z /= size.x;
+	result.w /= size.y;
+	return result;
+}
+
 Sprite& Sprite::setVisible(bool v)
 {
 	visible = v;
@@ -0,0 +1,93 @@
+#include "sprite_culler.h"
+#include "sprite_culler_sse.h"
+#include "sprite_culler_avx.h"
+#include <algorithm>
+#include <gsl/gsl_assert>
+
+#ifdef HAS_AVX
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+using namespace Halley;
+
+void SpriteCuller::cull(const SpriteBounds& bounds, Rect4f view, gsl::span<uint32_t> visible) const
+{
+	Expects(size_t(visible.size()) * 32 >= size_t(bounds.posX.size()));
+	std::fill(visible.begin(), visible.end(), 0u);
+	cullRange(bounds, view, 0, size_t(bounds.posX.size()), visible);
+}
+
+void SpriteCuller::cullRange(const SpriteBounds& bounds, Rect4f view, size_t start, size_t end, gsl::span<uint32_t> visible)
+{
+	// Same as Sprite::getAABB
+	for (size_t i = start; i < end; ++i) {
+		const Vector2f pos(bounds.posX[i], bounds.posY[i]);
+		const Vector2f pivot(bounds.pivotX[i], bounds.pivotY[i]);
+		const Vector2f size(bounds.sizeX[i], bounds.sizeY[i]);
+
+		Rect4f aabb;
+		if (std::abs(bounds.rotation[i]) < 0.0001f) {
+			aabb = Rect4f(pos - size * pivot, pos + size * (Vector2f(1, 1) - pivot));
+		} else {
+			const Vector2f sz = size * 1.4142136f;
+			aabb = Rect4f(pos - sz, pos + sz);
+		}
+
+		if (aabb.overlaps(view)) {
+			visible[i >> 5] |= 1u << (i & 31);
+		}
+	}
+}
+
+#ifdef HAS_AVX
+static bool hasAVX()
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 1);
+
+	const bool osUsesXSAVE_XRSTORE = (regs[2] & (1 << 27)) != 0;
+	const bool cpuAVXSupport = (regs[2] & (1 << 28)) != 0;
+	if (osUsesXSAVE_XRSTORE && cpuAVXSupport) {
+		return (_xgetbv(_XCR_XFEATURE_ENABLED_MASK) & 0x6) == 0x6;
+	} else {
+		return false;
+	}
+#else
+	// Also checks that the OS saves the AVX registers
+	return __builtin_cpu_supports("avx") != 0;
+#endif
+}
+#endif
+
+std::unique_ptr<SpriteCuller> SpriteCuller::makeCuller()
+{
+#if defined(HAS_AVX)
+	if (hasAVX()) {
+		return std::make_unique<SpriteCullerAVX>();
+	} else {
+		return std::make_unique<SpriteCullerSSE>();
+	}
+#elif defined(HAS_SSE)
+	return std::make_unique<SpriteCullerSSE>();
+#else
+	return std::make_unique<SpriteCuller>();
+#endif
+}
+
+Vector<std::unique_ptr<SpriteCuller>> SpriteCuller::makeAllCullers()
+{
+	Vector<std::unique_ptr<SpriteCuller>> result;
+	result.push_back(std::make_unique<SpriteCuller>());
+#if defined(HAS_SSE)
+	result.push_back(std::make_unique<SpriteCullerSSE>());
+#endif
+#if defined(HAS_AVX)
+	if (hasAVX()) {
+		result.push_back(std::make_unique<SpriteCullerAVX>());
+	}
+#endif
+	return result;
+}
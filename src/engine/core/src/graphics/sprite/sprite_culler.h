@@ -0,0 +1,46 @@
+#pragma once
+#include <memory>
+#include <gsl/span>
+#include "halley/maths/rect.h"
+#include "halley/data_structures/vector.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define HAS_SSE
+#define HAS_AVX
+#endif
+
+#if defined(_M_IX86) || defined(__i386)
+#define HAS_SSE
+#endif
+
+namespace Halley
+{
+	// Sprite bounds as a structure of arrays, one entry per sprite (see Sprite::getAABB)
+	struct SpriteBounds
+	{
+		gsl::span<const float> posX;
+		gsl::span<const float> posY;
+		gsl::span<const float> pivotX;
+		gsl::span<const float> pivotY;
+		gsl::span<const float> sizeX; // Scaled size
+		gsl::span<const float> sizeY;
+		gsl::span<const float> rotation;
+	};
+
+	class SpriteCuller
+	{
+	public:
+		virtual ~SpriteCuller() {}
+
+		// Sets bit i of visible (i.e. bit i % 32 of visible[i / 32]) if sprite i overlaps view, and clears it otherwise
+		virtual void cull(const SpriteBounds& bounds, Rect4f view, gsl::span<uint32_t> visible) const;
+
+		static std::unique_ptr<SpriteCuller> makeCuller();
+
+		// Every implementation this CPU can run, starting with the portable one, so they can be checked against each other
+		static Vector<std::unique_ptr<SpriteCuller>> makeAllCullers();
+
+	protected:
+		static void cullRange(const SpriteBounds& bounds, Rect4f view, size_t start, size_t end, gsl::span<uint32_t> visible);
+	};
+}
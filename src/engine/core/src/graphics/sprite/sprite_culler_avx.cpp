@@ -0,0 +1,67 @@
+#include "sprite_culler_avx.h"
+
+#ifdef HAS_AVX
+#include <immintrin.h>
+#include <algorithm>
+#include <gsl/gsl_assert>
+
+using namespace Halley;
+
+void SpriteCullerAVX::cull(const SpriteBounds& bounds, Rect4f view, gsl::span<uint32_t> visible) const
+{
+	const size_t n = size_t(bounds.posX.size());
+	Expects(size_t(visible.size()) * 32 >= n);
+	std::fill(visible.begin(), visible.end(), 0u);
+
+	const float* posX = bounds.posX.data();
+	const float* posY = bounds.posY.data();
+	const float* pivotX = bounds.pivotX.data();
+	const float* pivotY = bounds.pivotY.data();
+	const float* sizeX = bounds.sizeX.data();
+	const float* sizeY = bounds.sizeY.data();
+	const float* rotation = bounds.rotation.data();
+	uint32_t* dst = visible.data();
+
+	const __m256 viewX0 = _mm256_set1_ps(view.getLeft());
+	const __m256 viewX1 = _mm256_set1_ps(view.getRight());
+	const __m256 viewY0 = _mm256_set1_ps(view.getTop());
+	const __m256 viewY1 = _mm256_set1_ps(view.getBottom());
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 diagonal = _mm256_set1_ps(1.4142136f);
+	const __m256 minRotation = _mm256_set1_ps(0.0001f);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256 px = _mm256_loadu_ps(posX + i);
+		const __m256 py = _mm256_loadu_ps(posY + i);
+		const __m256 pvx = _mm256_loadu_ps(pivotX + i);
+		const __m256 pvy = _mm256_loadu_ps(pivotY + i);
+		const __m256 sx = _mm256_loadu_ps(sizeX + i);
+		const __m256 sy = _mm256_loadu_ps(sizeY + i);
+		const __m256 rotated = _mm256_cmp_ps(_mm256_and_ps(_mm256_loadu_ps(rotation + i), absMask), minRotation, _CMP_NLT_UQ);
+
+		// Not rotated: [pos - size * pivot, pos + size * (1 - pivot)]. Rotated: pos +- size * sqrt(2).
+		const __m256 rsx = _mm256_mul_ps(sx, diagonal);
+		const __m256 rsy = _mm256_mul_ps(sy, diagonal);
+		const __m256 ax = _mm256_blendv_ps(_mm256_sub_ps(px, _mm256_mul_ps(sx, pvx)), _mm256_sub_ps(px, rsx), rotated);
+		const __m256 ay = _mm256_blendv_ps(_mm256_sub_ps(py, _mm256_mul_ps(sy, pvy)), _mm256_sub_ps(py, rsy), rotated);
+		const __m256 bx = _mm256_blendv_ps(_mm256_add_ps(px, _mm256_mul_ps(sx, _mm256_sub_ps(one, pvx))), _mm256_add_ps(px, rsx), rotated);
+		const __m256 by = _mm256_blendv_ps(_mm256_add_ps(py, _mm256_mul_ps(sy, _mm256_sub_ps(one, pvy))), _mm256_add_ps(py, rsy), rotated);
+
+		// Operand order matches std::min/std::max in Rect4f::set, so NaNs behave the same
+		const __m256 x0 = _mm256_min_ps(bx, ax);
+		const __m256 x1 = _mm256_max_ps(bx, ax);
+		const __m256 y0 = _mm256_min_ps(by, ay);
+		const __m256 y1 = _mm256_max_ps(by, ay);
+
+		// Rect4f::overlaps
+		const __m256 overlapsX = _mm256_and_ps(_mm256_cmp_ps(x1, viewX0, _CMP_NLE_UQ), _mm256_cmp_ps(viewX1, x0, _CMP_NLE_UQ));
+		const __m256 overlapsY = _mm256_and_ps(_mm256_cmp_ps(y1, viewY0, _CMP_NLE_UQ), _mm256_cmp_ps(viewY1, y0, _CMP_NLE_UQ));
+		dst[i >> 5] |= uint32_t(_mm256_movemask_ps(_mm256_and_ps(overlapsX, overlapsY))) << (i & 31);
+	}
+
+	cullRange(bounds, view, i, n, visible);
+}
+
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+#include "sprite_culler.h"
+
+#ifdef HAS_AVX
+namespace Halley
+{
+	class SpriteCullerAVX : public SpriteCuller
+	{
+	public:
+		void cull(const SpriteBounds& bounds, Rect4f view, gsl::span<uint32_t> visible) const override;
+	};
+}
+#endif
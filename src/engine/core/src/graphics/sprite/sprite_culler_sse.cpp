@@ -0,0 +1,71 @@
+#include "sprite_culler_sse.h"
+
+#ifdef HAS_SSE
+#include <emmintrin.h>
+#include <algorithm>
+#include <gsl/gsl_assert>
+
+using namespace Halley;
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+void SpriteCullerSSE::cull(const SpriteBounds& bounds, Rect4f view, gsl::span<uint32_t> visible) const
+{
+	const size_t n = size_t(bounds.posX.size());
+	Expects(size_t(visible.size()) * 32 >= n);
+	std::fill(visible.begin(), visible.end(), 0u);
+
+	const float* posX = bounds.posX.data();
+	const float* posY = bounds.posY.data();
+	const float* pivotX = bounds.pivotX.data();
+	const float* pivotY = bounds.pivotY.data();
+	const float* sizeX = bounds.sizeX.data();
+	const float* sizeY = bounds.sizeY.data();
+	const float* rotation = bounds.rotation.data();
+	uint32_t* dst = visible.data();
+
+	const __m128 viewX0 = _mm_set1_ps(view.getLeft());
+	const __m128 viewX1 = _mm_set1_ps(view.getRight());
+	const __m128 viewY0 = _mm_set1_ps(view.getTop());
+	const __m128 viewY1 = _mm_set1_ps(view.getBottom());
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 diagonal = _mm_set1_ps(1.4142136f);
+	const __m128 minRotation = _mm_set1_ps(0.0001f);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128 px = _mm_loadu_ps(posX + i);
+		const __m128 py = _mm_loadu_ps(posY + i);
+		const __m128 pvx = _mm_loadu_ps(pivotX + i);
+		const __m128 pvy = _mm_loadu_ps(pivotY + i);
+		const __m128 sx = _mm_loadu_ps(sizeX + i);
+		const __m128 sy = _mm_loadu_ps(sizeY + i);
+		const __m128 rotated = _mm_cmpnlt_ps(_mm_and_ps(_mm_loadu_ps(rotation + i), absMask), minRotation);
+
+		// Not rotated: [pos - size * pivot, pos + size * (1 - pivot)]. Rotated: pos +- size * sqrt(2).
+		const __m128 rsx = _mm_mul_ps(sx, diagonal);
+		const __m128 rsy = _mm_mul_ps(sy, diagonal);
+		const __m128 ax = select(rotated, _mm_sub_ps(px, rsx), _mm_sub_ps(px, _mm_mul_ps(sx, pvx)));
+		const __m128 ay = select(rotated, _mm_sub_ps(py, rsy), _mm_sub_ps(py, _mm_mul_ps(sy, pvy)));
+		const __m128 bx = select(rotated, _mm_add_ps(px, rsx), _mm_add_ps(px, _mm_mul_ps(sx, _mm_sub_ps(one, pvx))));
+		const __m128 by = select(rotated, _mm_add_ps(py, rsy), _mm_add_ps(py, _mm_mul_ps(sy, _mm_sub_ps(one, pvy))));
+
+		// Operand order matches std::min/std::max in Rect4f::set, so NaNs behave the same
+		const __m128 x0 = _mm_min_ps(bx, ax);
+		const __m128 x1 = _mm_max_ps(bx, ax);
+		const __m128 y0 = _mm_min_ps(by, ay);
+		const __m128 y1 = _mm_max_ps(by, ay);
+
+		// Rect4f::overlaps
+		const __m128 overlaps = _mm_and_ps(_mm_and_ps(_mm_cmpnle_ps(x1, viewX0), _mm_cmpnle_ps(viewX1, x0)), _mm_and_ps(_mm_cmpnle_ps(y1, viewY0), _mm_cmpnle_ps(viewY1, y0)));
+		dst[i >> 5] |= uint32_t(_mm_movemask_ps(overlaps)) << (i & 31);
+	}
+
+	cullRange(bounds, view, i, n, visible);
+}
+
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+#include "sprite_culler.h"
+
+#ifdef HAS_SSE
+namespace Halley
+{
+	class SpriteCullerSSE : public SpriteCuller
+	{
+	public:
+		void cull(const SpriteBounds& bounds, Rect4f view, gsl::span<uint32_t> visible) const override;
+	};
+}
+#endif
@@ -3,6 +3,13 @@
 #include "graphics/painter.h"
 #include <gsl/gsl>
 #include "graphics/text/text_renderer.h"
+#include "halley/core/graphics/material/material.h"
+#include "halley/core/graphics/material/material_definition.h"
+#include <halley/concurrency/concurrent.h>
+#include "sprite_culler.h"
+#include <cstring>
+#include <numeric>
+#include <array>
 
 using namespace Halley;
 
@@ -42,6 +49,16 @@ bool SpritePainterEntry::operator<(const SpritePainterEntry& o) const
 	}
 }
 
+uint64_t SpritePainterEntry::getSortKey() const
+{
+	// Flip bits so that unsigned integer order matches (layer, tieBreaker) order
+	const uint32_t layerBits = uint32_t(layer) ^ 0x80000000u;
+	uint32_t tieBits;
+	std::memcpy(&tieBits, &tieBreaker, sizeof(tieBits));
+	tieBits = (tieBits & 0x80000000u) ? ~tieBits : (tieBits | 0x80000000u);
+	return (uint64_t(layerBits) << 32) | uint64_t(tieBits);
+}
+
 SpritePainterEntryType SpritePainterEntry::getType() const
 {
 	return type;
@@ -72,6 +89,18 @@ int SpritePainterEntry::getMask() const
 	return mask;
 }
 
+int SpritePainterEntry::getLayer() const
+{
+	return layer;
+}
+
+SpritePainter::SpritePainter()
+	: culler(SpriteCuller::makeCuller())
+{
+}
+
+SpritePainter::~SpritePainter() = default;
+
 void SpritePainter::start(size_t nSprites)
 {
 	if (sprites.capacity() < nSprites) {
@@ -85,70 +114,340 @@ void SpritePainter::start(size_t nSprites)
 void SpritePainter::add(const Sprite& sprite, int mask, int layer, float tieBreaker)
 {
 	sprites.push_back(SpritePainterEntry(sprite, mask, layer, tieBreaker));
-	dirty = true;
 }
 
 void SpritePainter::addCopy(const Sprite& sprite, int mask, int layer, float tieBreaker)
 {
 	sprites.push_back(SpritePainterEntry(SpritePainterEntryType::SpriteCached, cachedSprites.size(), mask, layer, tieBreaker));
 	cachedSprites.push_back(sprite);
-	dirty = true;
 }
 
 void SpritePainter::add(const TextRenderer& text, int mask, int layer, float tieBreaker)
 {
 	sprites.push_back(SpritePainterEntry(text, mask, layer, tieBreaker));
-	dirty = true;
 }
 
 void SpritePainter::addCopy(const TextRenderer& text, int mask, int layer, float tieBreaker)
 {
 	sprites.push_back(SpritePainterEntry(SpritePainterEntryType::TextCached, cachedText.size(), mask, layer, tieBreaker));
 	cachedText.push_back(text);
-	dirty = true;
 }
 
 void SpritePainter::draw(int mask, Painter& painter)
 {
-	if (dirty) {
-		// TODO: implement hierarchical bucketing.
-		// - one bucket per layer
-		// - for each layer, one bucket per vertical band of the screen (32px or so)
-		// - sort each leaf bucket
-		std::sort(sprites.begin(), sprites.end()); // lol
-		dirty = false;
-	}
-
 	// View
 	auto& cam = painter.getCurrentCamera();
 	Rect4f view = cam.getClippingRectangle();
 
+	// Cull first, so only what's visible needs sorting
+	auto& list = getDrawList(mask);
+	cull(mask, view, list);
+	sort(list);
+
 	// Draw!
-	for (auto& s : sprites) {
-		if ((s.getMask() & mask) != 0) {
-			auto type = s.getType();
-			if (type == SpritePainterEntryType::SpriteRef) {
-				draw(s.getSprite(), painter, view);
-			} else if (type == SpritePainterEntryType::SpriteCached) {
-				draw(cachedSprites[s.getIndex()], painter, view);
-			} else if (type == SpritePainterEntryType::TextRef) {
-				draw(s.getText(), painter, view);
-			} else if (type == SpritePainterEntryType::TextCached) {
-				draw(cachedText[s.getIndex()], painter, view);
+	for (auto pos : list.order) {
+		auto& s = sprites[list.entries[pos]];
+		const bool orderIndependent = s.getLayer() >= orderIndependentMin && s.getLayer() <= orderIndependentMax;
+		if (orderIndependent != painter.isUnorderedBatch()) {
+			submitRuns(painter);
+			if (orderIndependent) {
+				painter.beginUnorderedBatch();
+			} else {
+				painter.endUnorderedBatch();
 			}
 		}
+
+		auto type = s.getType();
+		const Sprite* sprite = getSprite(s);
+		if (sprite && !sprite->getClip()) {
+			addToRun(*sprite, painter);
+			continue;
+		}
+
+		// Anything else is drawn right away, so runs before it must be submitted first (unless order doesn't matter here)
+		if (!painter.isUnorderedBatch()) {
+			submitRuns(painter);
+		}
+		if (sprite) {
+			draw(*sprite, painter);
+		} else if (type == SpritePainterEntryType::TextRef) {
+			draw(s.getText(), painter);
+		} else if (type == SpritePainterEntryType::TextCached) {
+			draw(cachedText[s.getIndex()], painter);
+		}
 	}
+	submitRuns(painter);
+	painter.endUnorderedBatch();
 	painter.flush();
 }
 
-void SpritePainter::draw(const Sprite& sprite, Painter& painter, Rect4f view)
+void SpritePainter::setOrderIndependentLayers(int minLayer, int maxLayer)
+{
+	orderIndependentMin = minLayer;
+	orderIndependentMax = maxLayer;
+}
+
+SpritePainter::DrawList& SpritePainter::getDrawList(int mask)
+{
+	for (auto& l: drawLists) {
+		if (l.mask == mask) {
+			return l;
+		}
+	}
+	drawLists.emplace_back();
+	drawLists.back().mask = mask;
+	return drawLists.back();
+}
+
+const Sprite* SpritePainter::getSprite(const SpritePainterEntry& entry) const
+{
+	switch (entry.getType()) {
+	case SpritePainterEntryType::SpriteRef:
+		return &entry.getSprite();
+	case SpritePainterEntryType::SpriteCached:
+		return &cachedSprites[entry.getIndex()];
+	default:
+		return nullptr;
+	}
+}
+
+void SpritePainter::cull(int mask, Rect4f view, DrawList& list)
+{
+	std::swap(list.entries, list.prevEntries);
+	list.entries.clear();
+	list.keys.clear();
+
+	// Gather the bounds of every visible sprite, and cull them all in one go. Text is never culled.
+	auto& data = cullData;
+	data.posX.clear();
+	data.posY.clear();
+	data.pivotX.clear();
+	data.pivotY.clear();
+	data.sizeX.clear();
+	data.sizeY.clear();
+	data.rotation.clear();
+	data.candidates.clear();
+
+	const size_t n = sprites.size();
+	for (size_t i = 0; i < n; ++i) {
+		auto& s = sprites[i];
+		if ((s.getMask() & mask) == 0) {
+			continue;
+		}
+
+		if (auto sprite = getSprite(s)) {
+			if (!sprite->isVisible()) {
+				continue;
+			}
+			auto& attrib = sprite->getVertexAttrib();
+			const Vector2f size = sprite->getScaledSize();
+			data.posX.push_back(attrib.pos.x);
+			data.posY.push_back(attrib.pos.y);
+			data.pivotX.push_back(attrib.pivot.x);
+			data.pivotY.push_back(attrib.pivot.y);
+			data.sizeX.push_back(size.x);
+			data.sizeY.push_back(size.y);
+			data.rotation.push_back(attrib.rotation);
+		}
+		data.candidates.push_back(uint32_t(i));
+	}
+
+	const size_t nSprites = data.posX.size();
+	data.visible.resize((nSprites + 31) / 32);
+	SpriteBounds bounds;
+	bounds.posX = gsl::span<const float>(data.posX.data(), nSprites);
+	bounds.posY = gsl::span<const float>(data.posY.data(), nSprites);
+	bounds.pivotX = gsl::span<const float>(data.pivotX.data(), nSprites);
+	bounds.pivotY = gsl::span<const float>(data.pivotY.data(), nSprites);
+	bounds.sizeX = gsl::span<const float>(data.sizeX.data(), nSprites);
+	bounds.sizeY = gsl::span<const float>(data.sizeY.data(), nSprites);
+	bounds.rotation = gsl::span<const float>(data.rotation.data(), nSprites);
+	culler->cull(bounds, view, gsl::span<uint32_t>(data.visible.data(), data.visible.size()));
+
+	// Candidates are in the order they were added, so ties in sorting are still broken the same way
+	size_t spriteIdx = 0;
+	for (auto i: data.candidates) {
+		auto& s = sprites[i];
+		if (getSprite(s)) {
+			const bool visible = (data.visible[spriteIdx >> 5] >> (spriteIdx & 31)) & 1;
+			++spriteIdx;
+			if (!visible) {
+				continue;
+			}
+		}
+		list.entries.push_back(i);
+		list.keys.push_back(s.getSortKey());
+	}
+}
+
+void SpritePainter::sort(DrawList& list)
+{
+	// Entries with equal keys stay in the order they were added, whichever path is taken
+	if (list.entries == list.prevEntries && list.order.size() == list.entries.size() && sortFromPrevious(list)) {
+		return;
+	}
+
+	const size_t n = list.entries.size();
+	list.order.resize(n);
+	if (n < 256) {
+		std::iota(list.order.begin(), list.order.end(), 0u);
+		auto& keys = list.keys;
+		std::sort(list.order.begin(), list.order.end(), [&] (uint32_t a, uint32_t b) { return keys[a] < keys[b] || (keys[a] == keys[b] && a < b); });
+	} else {
+		radixSort(list);
+	}
+}
+
+bool SpritePainter::sortFromPrevious(DrawList& list)
 {
-	if (sprite.isInView(view)) {
-		sprite.draw(painter);
+	// Same entries as last frame, so last frame's order is probably close. Insertion sort it, but give up if it's too far off.
+	auto& order = list.order;
+	auto& keys = list.keys;
+	const size_t n = order.size();
+	size_t movesLeft = n;
+
+	for (size_t i = 1; i < n; ++i) {
+		const uint32_t cur = order[i];
+		const uint64_t key = keys[cur];
+		size_t j = i;
+		while (j > 0 && (keys[order[j - 1]] > key || (keys[order[j - 1]] == key && order[j - 1] > cur))) {
+			if (movesLeft-- == 0) {
+				return false;
+			}
+			order[j] = order[j - 1];
+			--j;
+		}
+		order[j] = cur;
 	}
+	return true;
 }
 
-void SpritePainter::draw(const TextRenderer& text, Painter& painter, Rect4f view)
+void SpritePainter::radixSort(DrawList& list)
+{
+	// LSD radix sort on the (layer, tieBreaker) key, one byte at a time.
+	// Layers are few and tieBreakers are usually screen positions, so the high bytes bucket by layer and then by band of the screen,
+	// and any pass where every key falls in the same bucket is skipped.
+	const size_t n = list.keys.size();
+	sortItems.resize(n);
+	sortScratch.resize(n);
+
+	std::array<std::array<uint32_t, 256>, 8> histograms;
+	for (auto& h: histograms) {
+		h.fill(0);
+	}
+	for (size_t i = 0; i < n; ++i) {
+		const uint64_t key = list.keys[i];
+		sortItems[i] = SortItem{ key, uint32_t(i) };
+		for (size_t b = 0; b < 8; ++b) {
+			++histograms[b][(key >> (b * 8)) & 0xFF];
+		}
+	}
+
+	SortItem* src = sortItems.data();
+	SortItem* dst = sortScratch.data();
+	for (size_t b = 0; b < 8; ++b) {
+		auto& h = histograms[b];
+		const int shift = int(b * 8);
+		if (h[(src[0].key >> shift) & 0xFF] == n) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (auto& count: h) {
+			const uint32_t c = count;
+			count = offset;
+			offset += c;
+		}
+		for (size_t i = 0; i < n; ++i) {
+			dst[h[(src[i].key >> shift) & 0xFF]++] = src[i];
+		}
+		std::swap(src, dst);
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		list.order[i] = src[i].pos;
+	}
+}
+
+void SpritePainter::draw(const Sprite& sprite, Painter& painter)
+{
+	sprite.draw(painter);
+}
+
+void SpritePainter::draw(const TextRenderer& text, Painter& painter)
 {
 	text.draw(painter);
 }
+
+void SpritePainter::addToRun(const Sprite& sprite, Painter& painter)
+{
+	// Small enough to always fit in 16-bit indices
+	constexpr size_t maxRunSprites = 16384;
+
+	auto& material = sprite.getMaterialPtr();
+	Expects(material);
+	Expects(material->getDefinition().getVertexStride() == sizeof(SpriteVertexAttrib));
+
+	if (sprite.isSliced()) {
+		// Sliced sprites get a run of their own, but are still filled along with everything else
+		closeRun(painter);
+		auto& vertexAttrib = sprite.getVertexAttrib();
+		runs.push_back(SpriteRun{ painter.reserveSlicedSprite(material, vertexAttrib.scale, sprite.getRelativeSlices()), runVertices.size(), 1, nullptr });
+		runVertices.push_back(&vertexAttrib);
+		runStart = runVertices.size();
+		return;
+	}
+
+	if (material != runMaterial || runVertices.size() - runStart == maxRunSprites) {
+		closeRun(painter);
+		runMaterial = material;
+	}
+	runVertices.push_back(&sprite.getVertexAttrib());
+}
+
+void SpritePainter::closeRun(Painter& painter)
+{
+	const size_t n = runVertices.size() - runStart;
+	if (n > 0) {
+		runs.push_back(SpriteRun{ painter.reserveSprites(runMaterial, n), runStart, n, nullptr });
+		runStart = runVertices.size();
+	}
+	runMaterial.reset();
+}
+
+void SpritePainter::submitRuns(Painter& painter)
+{
+	closeRun(painter);
+	if (runs.empty()) {
+		return;
+	}
+
+	// Split runs into jobs of at most jobSize sprites, so a single large run is still spread across threads
+	constexpr size_t jobSize = 512;
+	constexpr size_t minParallelSprites = 2048;
+	fillJobs.clear();
+	for (auto& run: runs) {
+		for (size_t i = 0; i < run.numSprites; i += jobSize) {
+			fillJobs.push_back(SpriteRun{ run.id, i, std::min(jobSize, run.numSprites - i), runVertices.data() + run.firstSprite + i });
+		}
+	}
+
+	auto fill = [&painter] (const SpriteRun& job)
+	{
+		painter.fillReservedSprites(job.id, job.firstSprite, job.numSprites, job.vertices);
+	};
+	if (runVertices.size() >= minParallelSprites) {
+		Concurrent::parallelFor(Executors::getCPU(), fillJobs.begin(), fillJobs.end(), 1, fill);
+	} else {
+		for (auto& job: fillJobs) {
+			fill(job);
+		}
+	}
+
+	// Submission happens in reserve order, regardless of which thread filled what
+	painter.submitReservedSprites();
+
+	runs.clear();
+	runVertices.clear();
+	runStart = 0;
+}
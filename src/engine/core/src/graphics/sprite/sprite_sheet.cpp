@@ -142,6 +142,12 @@ std::unique_ptr<SpriteSheet> SpriteSheet::loadResource(ResourceLoader& loader)
 	return result;
 }
 
+void SpriteSheet::getDependencies(Vector<ResourceReference>& dependencies) const
+{
+	// Not taken in onLoaded(), but fetching it along makes the first getTexture() cheap
+	dependencies.push_back({ AssetType::Texture, textureName });
+}
+
 void SpriteSheet::loadTexture(Resources& resources) const
 {
 	texture = resources.get<Texture>(textureName);
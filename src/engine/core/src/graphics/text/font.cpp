@@ -69,11 +69,6 @@ Font::Font(ResourceLoader& loader)
 	auto data = loader.getStatic();
 	auto ds = Deserializer(data->getSpan());
 	deserialize(ds);
-
-	auto texture = loader.getAPI().getResource<Texture>(imageName);
-	auto matDef = loader.getAPI().getResource<MaterialDefinition>(distanceField ? "Halley/Text" : "Halley/Sprite");
-	material = std::make_unique<Material>(matDef);
-	material->set("tex0", texture);
 }
 
 std::unique_ptr<Font> Font::loadResource(ResourceLoader& loader)
@@ -88,11 +83,30 @@ void Font::reload(Resource&& resource)
 
 void Font::onLoaded(Resources& resources)
 {
+	auto texture = resources.get<Texture>(imageName);
+	auto matDef = resources.get<MaterialDefinition>(getMaterialName());
+	material = std::make_unique<Material>(matDef);
+	material->set("tex0", texture);
+
 	for (auto& fontName: fallback) {
 		fallbackFont.push_back(resources.get<Font>(fontName));
 	}
 }
 
+String Font::getMaterialName() const
+{
+	return distanceField ? "Halley/Text" : "Halley/Sprite";
+}
+
+void Font::getDependencies(Vector<ResourceReference>& dependencies) const
+{
+	dependencies.push_back({ AssetType::Texture, imageName });
+	dependencies.push_back({ AssetType::MaterialDefinition, getMaterialName() });
+	for (auto& fontName: fallback) {
+		dependencies.push_back({ AssetType::Font, fontName });
+	}
+}
+
 const Font::Glyph& Font::getGlyph(int code) const
 {
 	auto& font = getFontForGlyph(code);
@@ -170,6 +184,11 @@ std::shared_ptr<Material> Font::getMaterial() const
 	return material;
 }
 
+void Font::setMaterial(std::shared_ptr<Material> m)
+{
+	material = std::move(m);
+}
+
 void Font::serialize(Serializer& s) const
 {
 	s << name;
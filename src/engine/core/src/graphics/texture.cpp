@@ -7,9 +7,30 @@
 
 using namespace Halley;
 
+namespace {
+	struct TextureMetaKeys
+	{
+		MetadataKey width = "width";
+		MetadataKey height = "height";
+		MetadataKey compression = "compression";
+		MetadataKey format = "format";
+		MetadataKey filtering = "filtering";
+		MetadataKey mipmap = "mipmap";
+		MetadataKey clamp = "clamp";
+	};
+
+	const TextureMetaKeys& getKeys()
+	{
+		static const TextureMetaKeys keys;
+		return keys;
+	}
+}
+
 Texture::Texture(Vector2i size)
 	: size(size)
-{}
+{
+	setLoadedThroughWeakReferences();
+}
 
 void Texture::load(TextureDescriptor&& descriptor)
 {
@@ -17,8 +38,9 @@ void Texture::load(TextureDescriptor&& descriptor)
 
 std::shared_ptr<Texture> Texture::loadResource(ResourceLoader& loader)
 {
+	auto& keys = getKeys();
 	auto& meta = loader.getMeta();
-	Vector2i size(meta.getInt("width", -1), meta.getInt("height", -1));
+	Vector2i size(meta.getInt(keys.width, -1), meta.getInt(keys.height, -1));
 	if (size.x == -1 && size.y == -1) {
 		throw Exception("Unable to load texture \"" + loader.getName() + "\" due to missing asset data.", HalleyExceptions::Graphics);
 	}
@@ -26,33 +48,50 @@ std::shared_ptr<Texture> Texture::loadResource(ResourceLoader& loader)
 	std::shared_ptr<Texture> texture = loader.getAPI().video->createTexture(size);
 	texture->setMeta(meta);
 
-	loader.getAsync()
-	.then([texture](std::unique_ptr<ResourceDataStatic> data) -> TextureDescriptorImageData
+	// Only weak references are kept while loading, so the load is dropped if the texture is
+	std::weak_ptr<Texture> weakTexture = texture;
+	loader.getAsync(texture)
+	.then([weakTexture](std::unique_ptr<ResourceDataStatic> data) -> TextureDescriptorImageData
 	{
+		auto texture = weakTexture.lock();
+		if (!texture) {
+			return TextureDescriptorImageData();
+		}
+		if (!data) {
+			texture->loadingFailed();
+			return TextureDescriptorImageData();
+		}
+
 		auto& meta = texture->getMeta();
-		if (meta.getString("compression") == "png") {
+		if (meta.getString(getKeys().compression) == "png") {
 			return TextureDescriptorImageData(std::make_unique<Image>(*data, meta));
 		} else {
 			return TextureDescriptorImageData(data->getSpan());
 		}
 	})
-	.then(Executors::getVideoAux(), [texture](TextureDescriptorImageData img)
+	.then(Executors::getVideoAux(), [weakTexture](TextureDescriptorImageData img)
 	{
+		auto texture = weakTexture.lock();
+		if (!texture || img.empty()) {
+			return;
+		}
+
+		auto& keys = getKeys();
 		auto& meta = texture->getMeta();
 
-		auto formatStr = meta.getString("format", "rgba");
+		auto formatStr = meta.getString(keys.format, "rgba");
 		if (formatStr == "rgba_premultiplied") {
 			formatStr = "rgba";
 		}
 
-		Vector2i size(meta.getInt("width"), meta.getInt("height"));
+		Vector2i size(meta.getInt(keys.width), meta.getInt(keys.height));
 		TextureDescriptor descriptor(size);
-		descriptor.useFiltering = meta.getBool("filtering", false);
-		descriptor.useMipMap = meta.getBool("mipmap", false);
-		descriptor.clamp = meta.getBool("clamp", true);
+		descriptor.useFiltering = meta.getBool(keys.filtering, false);
+		descriptor.useMipMap = meta.getBool(keys.mipmap, false);
+		descriptor.clamp = meta.getBool(keys.clamp, true);
 		descriptor.format = fromString<TextureFormat>(formatStr);
 		descriptor.pixelData = std::move(img);
-		descriptor.pixelFormat = meta.getString("compression") == "png" ? PixelDataFormat::Image : PixelDataFormat::Precompiled;
+		descriptor.pixelFormat = meta.getString(keys.compression) == "png" ? PixelDataFormat::Image : PixelDataFormat::Precompiled;
 		texture->load(std::move(descriptor));
 	});
 
@@ -12,6 +12,12 @@ AssetDatabase::Entry::Entry(const String& path, const Metadata& meta)
 	, meta(meta)
 {}
 
+AssetDatabase::Entry::Entry(uint64_t pos, uint64_t size, const Metadata& meta)
+	: meta(meta)
+	, pos(pos)
+	, size(size)
+{}
+
 void AssetDatabase::Entry::serialize(Serializer& s) const
 {
 	s << path;
@@ -38,6 +44,11 @@ const AssetDatabase::Entry& AssetDatabase::TypedDB::get(const String& name) cons
 	return i->second;
 }
 
+bool AssetDatabase::TypedDB::contains(const String& name) const
+{
+	return assets.find(name) != assets.end();
+}
+
 void AssetDatabase::TypedDB::serialize(Serializer& s) const
 {
 	s << assets;
@@ -63,6 +74,15 @@ const AssetDatabase::TypedDB& AssetDatabase::getDatabase(AssetType type) const
 	return dbs[int(type)];
 }
 
+std::vector<AssetType> AssetDatabase::getTypes() const
+{
+	std::vector<AssetType> result;
+	for (auto& db: dbs) {
+		result.push_back(AssetType(db.first));
+	}
+	return result;
+}
+
 std::vector<String> AssetDatabase::getAssets() const
 {
 	std::set<String> contains;
@@ -80,6 +100,16 @@ std::vector<String> AssetDatabase::getAssets() const
 	return result;
 }
 
+bool AssetDatabase::contains(const String& name) const
+{
+	for (auto& db: dbs) {
+		if (db.second.contains(name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void AssetDatabase::serialize(Serializer& s) const
 {
 	s << dbs;
@@ -1,8 +1,11 @@
 #include "resources/asset_pack.h"
 #include "resources/asset_database.h"
+#include "resources/asset_pack_index.h"
 #include "halley/resources/resource_data.h"
 #include "halley/bytes/byte_serializer.h"
 #include "halley/bytes/compression.h"
+#include "halley/concurrency/concurrent.h"
+#include "halley/file/memory_mapped_file.h"
 #include "halley/maths/random.h"
 #include "halley/utils/encrypt.h"
 
@@ -10,7 +13,7 @@ using namespace Halley;
 
 void AssetPackHeader::init(size_t assetDbSize)
 {
-	memcpy(identifier.data(), "HALLEYPK", 8);
+	memcpy(identifier.data(), "HALLEYP3", 8);
 	assetDbStartPos = sizeof(AssetPackHeader);
 	dataStartPos = assetDbStartPos + assetDbSize;
 	memset(iv.data(), 0, iv.size());
@@ -42,11 +45,7 @@ AssetPack::AssetPack(std::unique_ptr<ResourceDataReader> _reader, const String&
 	if (nRead != int(sizeof(header))) {
 		throw Exception("Unable to read header", HalleyExceptions::Resources);
 	}
-	if (memcmp(header.identifier.data(), "HALLEYPK", 8) != 0) {
-		throw Exception("Asset pack is invalid (invalid identifier)", HalleyExceptions::Resources);
-	}
-	iv = header.iv;
-	dataOffset = size_t(header.dataStartPos);
+	readHeader(header);
 
 	// Read asset database
 	{
@@ -56,14 +55,10 @@ AssetPack::AssetPack(std::unique_ptr<ResourceDataReader> _reader, const String&
 		if (nRead != int(assetDbBytes.size())) {
 			throw Exception("Unable to read header", HalleyExceptions::Resources);
 		}
-		assetDb = std::make_unique<AssetDatabase>();
-		Deserializer::fromBytes<AssetDatabase>(*assetDb, Compression::decompress(assetDbBytes));
+		readIndex(gsl::as_bytes(gsl::span<Byte>(assetDbBytes)), true);
 	}
 
-	std::array<char, 16> ivEmpty;
-	memset(ivEmpty.data(), 0, ivEmpty.size());
-	const bool hasCrypt = memcmp(iv.data(), ivEmpty.data(), iv.size()) != 0 && !encryptionKey.isEmpty();
-
+	const bool hasCrypt = isEncrypted(encryptionKey);
 	if (preLoad || hasCrypt) {
 		readToMemory();
 	}
@@ -73,18 +68,102 @@ AssetPack::AssetPack(std::unique_ptr<ResourceDataReader> _reader, const String&
 	}
 }
 
+AssetPack::AssetPack(std::shared_ptr<MemoryMappedFile> file, const String& encryptionKey, bool preLoad)
+	: mappedFile(std::move(file))
+	, hasReader(false)
+{
+	const auto bytes = mappedFile->getSpan();
+	if (size_t(bytes.size()) < sizeof(AssetPackHeader)) {
+		throw Exception("Asset pack is invalid (too small)", HalleyExceptions::Resources);
+	}
+	AssetPackHeader header;
+	memcpy(&header, bytes.data(), sizeof(header));
+	readHeader(header);
+	if (header.assetDbStartPos > header.dataStartPos || header.dataStartPos > uint64_t(bytes.size())) {
+		throw Exception("Asset pack is invalid (truncated)", HalleyExceptions::Resources);
+	}
+	const bool hasCrypt = isEncrypted(encryptionKey);
+	readIndex(bytes.subspan(size_t(header.assetDbStartPos), size_t(header.dataStartPos - header.assetDbStartPos)), hasCrypt);
+
+	if (hasCrypt) {
+		// Decrypted data can't live in the file, so this one has to be copied after all
+		const auto encrypted = getMappedData();
+		data.resize(size_t(encrypted.size()));
+		memcpy(data.data(), encrypted.data(), data.size());
+		mappedFile.reset();
+		decrypt(encryptionKey);
+	} else if (preLoad) {
+		readToMemory();
+	}
+}
+
 AssetPack::~AssetPack()
 {
 }
 
+void AssetPack::readHeader(const AssetPackHeader& header)
+{
+	if (memcmp(header.identifier.data(), "HALLEYP3", 8) == 0) {
+		legacyFormat = false;
+		blockEncryption = true;
+	} else if (memcmp(header.identifier.data(), "HALLEYP2", 8) == 0) {
+		legacyFormat = false;
+		blockEncryption = false;
+	} else if (memcmp(header.identifier.data(), "HALLEYPK", 8) == 0) {
+		legacyFormat = true;
+		blockEncryption = false;
+	} else {
+		throw Exception("Asset pack is invalid (invalid identifier)", HalleyExceptions::Resources);
+	}
+	iv = header.iv;
+	dataOffset = size_t(header.dataStartPos);
+}
+
+void AssetPack::readIndex(gsl::span<const gsl::byte> bytes, bool copy)
+{
+	if (legacyFormat) {
+		// Packs from before the index was introduced have a serialized AssetDatabase, with locations written as "pos:size"
+		AssetDatabase legacyDb;
+		const auto dbBytes = Compression::decompress(bytes);
+		Deserializer s(dbBytes);
+		s.setVersion(Metadata::legacyTextFormatVersion);
+		s >> legacyDb;
+		AssetDatabase db;
+		for (auto type: legacyDb.getTypes()) {
+			for (auto& asset: legacyDb.getDatabase(type).getAssets()) {
+				auto ps = asset.second.path.split(':');
+				db.addAsset(asset.first, type, AssetDatabase::Entry(uint64_t(ps.at(0).toInteger64()), uint64_t(ps.at(1).toInteger64()), asset.second.meta));
+			}
+		}
+		index = std::make_unique<AssetPackIndex>(AssetPackIndex::build(db));
+	} else if (copy) {
+		index = std::make_unique<AssetPackIndex>(Bytes(reinterpret_cast<const Byte*>(bytes.data()), reinterpret_cast<const Byte*>(bytes.data()) + bytes.size()));
+	} else {
+		index = std::make_unique<AssetPackIndex>(bytes);
+	}
+	assetDb.reset();
+}
+
+bool AssetPack::isEncrypted(const String& encryptionKey) const
+{
+	std::array<char, 16> ivEmpty;
+	memset(ivEmpty.data(), 0, ivEmpty.size());
+	return memcmp(iv.data(), ivEmpty.data(), iv.size()) != 0 && !encryptionKey.isEmpty();
+}
+
 AssetPack& AssetPack::operator=(AssetPack&& other)
 {
 	std::unique_lock<std::mutex> lock(other.readerMutex);
 
 	assetDb = std::move(other.assetDb);
+	index = std::move(other.index);
+	legacyFormat = other.legacyFormat;
+	blockEncryption = other.blockEncryption;
 	dataOffset = other.dataOffset;
 	reader = std::move(other.reader);
+	mappedFile = std::move(other.mappedFile);
 	data = std::move(other.data);
+	iv = other.iv;
 	hasReader = !!reader;
 
 	other.hasReader = false;
@@ -95,14 +174,30 @@ AssetPack& AssetPack::operator=(AssetPack&& other)
 
 AssetDatabase& AssetPack::getAssetDatabase()
 {
-	return *assetDb;
+	const auto& db = static_cast<const AssetPack*>(this)->getAssetDatabase();
+
+	// The database might be about to change, so the index will need rebuilding
+	index.reset();
+	return const_cast<AssetDatabase&>(db);
 }
 
 const AssetDatabase& AssetPack::getAssetDatabase() const
 {
+	if (!assetDb) {
+		assetDb = std::make_unique<AssetDatabase>();
+		index->toAssetDatabase(*assetDb);
+	}
 	return *assetDb;
 }
 
+const AssetPackIndex& AssetPack::getIndex() const
+{
+	if (!index) {
+		index = std::make_unique<AssetPackIndex>(AssetPackIndex::build(*assetDb));
+	}
+	return *index;
+}
+
 Bytes& AssetPack::getData()
 {
 	return data;
@@ -115,24 +210,50 @@ const Bytes& AssetPack::getData() const
 
 Bytes AssetPack::writeOut() const
 {
-	auto assetDbBytes = Compression::compress(Serializer::toBytes(*assetDb));
+	auto result = writeOutHeader();
+	const size_t dataStartPos = result.size();
+	result.resize(dataStartPos + data.size());
+	memcpy(result.data() + dataStartPos, data.data(), data.size());
+	return result;
+}
+
+Bytes AssetPack::writeOutHeader() const
+{
+	const auto indexBytes = AssetPackIndex::build(getAssetDatabase());
 	AssetPackHeader header;
-	header.init(assetDbBytes.size());
+	header.init(indexBytes.size());
 	header.iv = iv;
 
-	auto result = Bytes(size_t(header.dataStartPos + data.size()));
+	auto result = Bytes(size_t(header.dataStartPos));
 	memcpy(result.data(), &header, sizeof(AssetPackHeader));
-	memcpy(result.data() + header.assetDbStartPos, assetDbBytes.data(), assetDbBytes.size());
-	memcpy(result.data() + header.dataStartPos, data.data(), data.size());
+	memcpy(result.data() + header.assetDbStartPos, indexBytes.data(), indexBytes.size());
 	return result;
 }
 
 std::unique_ptr<ResourceData> AssetPack::getData(const String& asset, AssetType type, bool stream)
 {
 	auto path = asset;
-	auto ps = assetDb->getDatabase(type).get(asset).path.split(':');
-	size_t pos = size_t(ps.at(0).toInteger());
-	size_t size = size_t(ps.at(1).toInteger());
+	size_t pos;
+	size_t size;
+	getAssetRange(asset, type, pos, size);
+
+	if (mappedFile) {
+		const auto mapped = getMappedData();
+		if (pos + size > size_t(mapped.size())) {
+			throw Exception("Asset \"" + asset + "\" is out of pack bounds.", HalleyExceptions::Resources);
+		}
+
+		// Both point straight into the mapping, and keep it alive for as long as they need it
+		const auto assetBytes = mapped.subspan(pos, size);
+		if (stream) {
+			std::shared_ptr<const MemoryMappedFile> file = mappedFile;
+			return std::make_unique<ResourceDataStream>(path, [=] () -> std::unique_ptr<ResourceDataReader> {
+				return std::make_unique<PackDataReader>(file, assetBytes);
+			});
+		} else {
+			return std::make_unique<ResourceDataStatic>(std::shared_ptr<const char>(mappedFile, reinterpret_cast<const char*>(assetBytes.data())), size, path);
+		}
+	}
 
 	if (stream) {
 		return std::make_unique<ResourceDataStream>(path, [=] () -> std::unique_ptr<ResourceDataReader> {
@@ -159,8 +280,39 @@ std::unique_ptr<ResourceData> AssetPack::getData(const String& asset, AssetType
 	}
 }
 
+bool AssetPack::getLocation(const String& asset, AssetType type, size_t& pos, size_t& size) const
+{
+	if (!hasReader) {
+		return false;
+	}
+	getAssetRange(asset, type, pos, size);
+	return true;
+}
+
+void AssetPack::getAssetRange(const String& asset, AssetType type, size_t& pos, size_t& size) const
+{
+	const auto entry = getIndex().find(asset, type);
+	if (!entry) {
+		throw Exception("Asset not found: " + asset, HalleyExceptions::Resources);
+	}
+	pos = size_t(entry->pos);
+	size = size_t(entry->size);
+}
+
+gsl::span<const gsl::byte> AssetPack::getMappedData() const
+{
+	const auto bytes = mappedFile->getSpan();
+	return bytes.subspan(dataOffset, bytes.size() - dataOffset);
+}
+
 void AssetPack::readToMemory()
 {
+	if (mappedFile) {
+		const auto mapped = getMappedData();
+		mappedFile->prefetch(dataOffset, size_t(mapped.size()));
+		return;
+	}
+
 	std::unique_lock<std::mutex> lock(readerMutex);
 	reader->seek(dataOffset, SEEK_SET);
 	data = reader->readAll();
@@ -168,22 +320,71 @@ void AssetPack::readToMemory()
 	reader.reset();
 }
 
+namespace {
+	struct CryptBlock
+	{
+		std::array<char, 16> iv;
+		gsl::span<gsl::byte> data;
+	};
+}
+
 void AssetPack::encrypt(const String& key)
 {
 	// Generate IV
 	Random::getGlobal().getBytes(gsl::as_writeable_bytes(gsl::span<char>(iv)));
-	Bytes ivBytes(iv.size());
-	memcpy(ivBytes.data(), iv.data(), iv.size());
+	blockEncryption = true;
 
-	data = Encrypt::encrypt(ivBytes, key, data);
+	Encrypt::addPadding(data);
+	const auto bytes = gsl::as_writeable_bytes(gsl::span<Byte>(data));
+
+	Vector<CryptBlock> blocks;
+	for (size_t pos = 0; pos < data.size(); pos += encryptionBlockSize) {
+		blocks.push_back(CryptBlock{ getBlockIV(blocks.size(), key), bytes.subspan(pos, std::min(encryptionBlockSize, data.size() - pos)) });
+	}
+	Concurrent::parallelFor(Executors::getCPU(), blocks.begin(), blocks.end(), 1, [&] (const CryptBlock& block)
+	{
+		Encrypt::encryptInPlace(gsl::as_bytes(gsl::span<const char>(block.iv)), key, block.data);
+	});
 }
 
 void AssetPack::decrypt(const String& key)
 {
-	Bytes ivBytes(iv.size());
-	memcpy(ivBytes.data(), iv.data(), iv.size());
+	if (data.size() % 16 != 0) {
+		throw Exception("Encrypted asset pack data does not have the correct length.", HalleyExceptions::Resources);
+	}
+	const auto bytes = gsl::as_writeable_bytes(gsl::span<Byte>(data));
+
+	Vector<CryptBlock> blocks;
+	for (size_t pos = 0; pos < data.size(); pos += encryptionBlockSize) {
+		CryptBlock block{ blockEncryption ? getBlockIV(blocks.size(), key) : iv, bytes.subspan(pos, std::min(encryptionBlockSize, data.size() - pos)) };
+		if (!blockEncryption && pos > 0) {
+			// A single CBC stream can still be decrypted in pieces, as each piece's IV is just the last ciphertext block before it.
+			// They're copied out first, since decrypting the previous piece will overwrite them.
+			memcpy(block.iv.data(), data.data() + pos - block.iv.size(), block.iv.size());
+		}
+		blocks.push_back(block);
+	}
+	Concurrent::parallelFor(Executors::getCPU(), blocks.begin(), blocks.end(), 1, [&] (const CryptBlock& block)
+	{
+		Encrypt::decryptInPlace(gsl::as_bytes(gsl::span<const char>(block.iv)), key, block.data);
+	});
 
-	data = Encrypt::decrypt(ivBytes, key, data);
+	Encrypt::removePadding(data);
+}
+
+std::array<char, 16> AssetPack::getBlockIV(size_t block, const String& key) const
+{
+	// The pack's IV, with the block number added to its last 8 bytes
+	auto result = iv;
+	uint64_t counter;
+	memcpy(&counter, result.data() + 8, sizeof(counter));
+	counter += uint64_t(block);
+	memcpy(result.data() + 8, &counter, sizeof(counter));
+
+	// CBC needs IVs that can't be predicted, so that counter is encrypted (as a single block, with a zero IV) rather than used as is
+	const std::array<char, 16> zero = {};
+	Encrypt::encryptInPlace(gsl::as_bytes(gsl::span<const char>(zero)), key, gsl::as_writeable_bytes(gsl::span<char>(result)));
+	return result;
 }
 
 void AssetPack::readData(size_t pos, gsl::span<gsl::byte> dst)
@@ -197,6 +398,15 @@ void AssetPack::readData(size_t pos, gsl::span<gsl::byte> dst)
 		}
 	}
 
+	if (mappedFile) {
+		const auto mapped = getMappedData();
+		if (pos + size_t(dst.size()) > size_t(mapped.size())) {
+			throw Exception("Asset data is out of pack bounds.", HalleyExceptions::Resources);
+		}
+		memcpy(dst.data(), mapped.data() + pos, dst.size());
+		return;
+	}
+
 	// Didn't read with reader, read from data
 	if (pos + size_t(dst.size()) > data.size()) {
 		throw Exception("Asset data is out of pack bounds.", HalleyExceptions::Resources);
@@ -212,9 +422,19 @@ std::unique_ptr<ResourceDataReader> AssetPack::extractReader()
 }
 
 PackDataReader::PackDataReader(AssetPack& pack, size_t startPos, size_t fileSize)
-	: pack(pack)
+	: pack(&pack)
 	, startPos(startPos)
 	, fileSize(fileSize)
+	, curPos(0)
+{
+}
+
+PackDataReader::PackDataReader(std::shared_ptr<const MemoryMappedFile> file, gsl::span<const gsl::byte> data)
+	: file(std::move(file))
+	, mapped(data.data())
+	, startPos(0)
+	, fileSize(size_t(data.size()))
+	, curPos(0)
 {
 }
 
@@ -225,19 +445,22 @@ size_t PackDataReader::size() const
 
 int PackDataReader::read(gsl::span<gsl::byte> dst)
 {
-	std::unique_lock<std::mutex> lock(mutex);
-	size_t available = fileSize - curPos;
+	const size_t pos = std::min(curPos.load(), fileSize);
+	size_t available = fileSize - pos;
 	size_t toRead = std::min(available, size_t(dst.size()));
 
-	pack.readData(startPos + curPos, dst.subspan(0, toRead));
-	curPos += toRead;
+	if (mapped) {
+		memcpy(dst.data(), mapped + pos, toRead);
+	} else {
+		pack->readData(startPos + pos, dst.subspan(0, toRead));
+	}
+	curPos = pos + toRead;
 
 	return int(toRead);
 }
 
 void PackDataReader::seek(int64_t pos, int whence)
 {
-	std::unique_lock<std::mutex> lock(mutex);
 	switch (whence) {
 	case SEEK_SET:
 		curPos = size_t(pos);
@@ -253,11 +476,9 @@ void PackDataReader::seek(int64_t pos, int whence)
 
 size_t PackDataReader::tell() const
 {
-	std::unique_lock<std::mutex> lock(mutex);
 	return curPos;
 }
 
 void PackDataReader::close()
 {
 }
-
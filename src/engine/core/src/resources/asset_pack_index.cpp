@@ -0,0 +1,319 @@
+#include "halley/core/resources/asset_pack_index.h"
+#include "halley/core/resources/asset_database.h"
+#include "halley/resources/metadata.h"
+#include "halley/bytes/byte_serializer.h"
+#include "halley/support/exception.h"
+#include "halley/utils/hash.h"
+#include <algorithm>
+
+using namespace Halley;
+
+namespace {
+	size_t align8(size_t pos)
+	{
+		return (pos + 7) & ~size_t(7);
+	}
+}
+
+AssetPackIndex::AssetPackIndex()
+{
+	ownedData = build(AssetDatabase());
+	data = gsl::as_bytes(gsl::span<const Byte>(ownedData));
+	init();
+}
+
+AssetPackIndex::AssetPackIndex(gsl::span<const gsl::byte> data)
+	: data(data)
+{
+	init();
+}
+
+AssetPackIndex::AssetPackIndex(Bytes bytes)
+	: ownedData(std::move(bytes))
+{
+	data = gsl::as_bytes(gsl::span<const Byte>(ownedData));
+	init();
+}
+
+void AssetPackIndex::init()
+{
+	const size_t size = size_t(data.size());
+	if (size < sizeof(Header)) {
+		throw Exception("Asset pack index is invalid (too small)", HalleyExceptions::Resources);
+	}
+	if (reinterpret_cast<uintptr_t>(data.data()) % alignof(Header) != 0) {
+		throw Exception("Asset pack index is misaligned", HalleyExceptions::Resources);
+	}
+
+	header = reinterpret_cast<const Header*>(data.data());
+	if (memcmp(header->identifier.data(), "HALLEYI2", 8) == 0) {
+		legacyMetadata = false;
+	} else if (memcmp(header->identifier.data(), "HALLEYIX", 8) == 0) {
+		legacyMetadata = true;
+	} else {
+		throw Exception("Asset pack index is invalid (invalid identifier)", HalleyExceptions::Resources);
+	}
+
+	const bool inBounds = header->totalSize <= size
+		&& header->numBuckets > 0 && header->numSlots > 0
+		&& header->entriesPos + uint64_t(header->numEntries) * sizeof(Entry) <= header->bucketsPos
+		&& header->bucketsPos + uint64_t(header->numBuckets) * sizeof(uint32_t) <= header->slotsPos
+		&& header->slotsPos + uint64_t(header->numSlots) * sizeof(uint32_t) <= header->stringsPos
+		&& header->stringsPos <= header->metadataPos
+		&& header->metadataPos <= header->totalSize;
+	if (!inBounds) {
+		throw Exception("Asset pack index is invalid (truncated)", HalleyExceptions::Resources);
+	}
+
+	const auto base = reinterpret_cast<const char*>(data.data());
+	entries = reinterpret_cast<const Entry*>(base + header->entriesPos);
+	buckets = reinterpret_cast<const uint32_t*>(base + header->bucketsPos);
+	slots = reinterpret_cast<const uint32_t*>(base + header->slotsPos);
+	strings = base + header->stringsPos;
+	metadata = data.data() + header->metadataPos;
+}
+
+Bytes AssetPackIndex::build(const AssetDatabase& db)
+{
+	struct Source
+	{
+		String name;
+		int type;
+		const AssetDatabase::Entry* entry;
+	};
+
+	Vector<Source> sources;
+	for (auto type: db.getTypes()) {
+		for (auto& asset: db.getDatabase(type).getAssets()) {
+			sources.push_back(Source{ asset.first, int(type), &asset.second });
+		}
+	}
+	std::sort(sources.begin(), sources.end(), [] (const Source& a, const Source& b)
+	{
+		return a.name != b.name ? a.name < b.name : a.type < b.type;
+	});
+
+	// Names and metadata
+	Vector<Entry> entries(sources.size());
+	Vector<uint32_t> firstEntries;
+	Bytes stringData;
+	Bytes metadataData;
+	for (size_t i = 0; i < sources.size(); ++i) {
+		auto& src = sources[i];
+		auto& entry = entries[i];
+		entry.pos = src.entry->pos;
+		entry.size = src.entry->size;
+		entry.type = src.type;
+
+		if (i > 0 && src.name == sources[i - 1].name) {
+			entry.nameOffset = entries[i - 1].nameOffset;
+			entry.nameLength = entries[i - 1].nameLength;
+		} else {
+			entry.nameOffset = uint32_t(stringData.size());
+			entry.nameLength = uint32_t(src.name.size());
+			stringData.insert(stringData.end(), src.name.c_str(), src.name.c_str() + src.name.size());
+			firstEntries.push_back(uint32_t(i));
+		}
+
+		if (src.entry->meta == Metadata()) {
+			entry.metadataOffset = 0;
+			entry.metadataLength = 0;
+		} else {
+			const auto meta = Serializer::toBytes(src.entry->meta);
+			entry.metadataOffset = uint32_t(metadataData.size());
+			entry.metadataLength = uint32_t(meta.size());
+			metadataData.insert(metadataData.end(), meta.begin(), meta.end());
+		}
+	}
+
+	// Perfect hash, using hash and displace: names are spread into buckets, then, starting from the largest bucket,
+	// a seed is picked for each bucket which sends all of its names to free slots
+	const uint32_t numNames = uint32_t(firstEntries.size());
+	const uint32_t numBuckets = numNames / 4 + 1;
+	const uint32_t numSlots = numNames + numNames / 4 + 1;
+
+	Vector<Vector<uint32_t>> bucketNames(numBuckets);
+	Vector<uint64_t> hashes(numNames);
+	for (uint32_t i = 0; i < numNames; ++i) {
+		const auto& e = entries[firstEntries[i]];
+		hashes[i] = hashName(reinterpret_cast<const char*>(stringData.data()) + e.nameOffset, e.nameLength);
+		bucketNames[hashes[i] % numBuckets].push_back(i);
+	}
+
+	Vector<uint32_t> bucketOrder(numBuckets);
+	for (uint32_t i = 0; i < numBuckets; ++i) {
+		bucketOrder[i] = i;
+	}
+	std::stable_sort(bucketOrder.begin(), bucketOrder.end(), [&] (uint32_t a, uint32_t b)
+	{
+		return bucketNames[a].size() > bucketNames[b].size();
+	});
+
+	Vector<uint32_t> bucketSeeds(numBuckets, 0);
+	Vector<uint32_t> slotEntries(numSlots, noEntry);
+	Vector<uint32_t> candidate;
+	for (auto bucket: bucketOrder) {
+		const auto& names = bucketNames[bucket];
+		if (names.empty()) {
+			break;
+		}
+
+		bool found = false;
+		for (uint32_t seed = 0; seed < 0x1000000 && !found; ++seed) {
+			candidate.clear();
+			found = true;
+			for (auto name: names) {
+				const auto slot = getSlot(hashes[name], seed, numSlots);
+				if (slotEntries[slot] != noEntry || std::find(candidate.begin(), candidate.end(), slot) != candidate.end()) {
+					found = false;
+					break;
+				}
+				candidate.push_back(slot);
+			}
+			if (found) {
+				bucketSeeds[bucket] = seed;
+				for (size_t i = 0; i < names.size(); ++i) {
+					slotEntries[candidate[i]] = firstEntries[names[i]];
+				}
+			}
+		}
+		if (!found) {
+			throw Exception("Unable to build asset pack index", HalleyExceptions::Resources);
+		}
+	}
+
+	// Lay it all out
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.identifier.data(), "HALLEYI2", 8);
+	header.numEntries = uint32_t(entries.size());
+	header.numBuckets = numBuckets;
+	header.numSlots = numSlots;
+	header.entriesPos = align8(sizeof(Header));
+	header.bucketsPos = align8(size_t(header.entriesPos) + entries.size() * sizeof(Entry));
+	header.slotsPos = align8(size_t(header.bucketsPos) + bucketSeeds.size() * sizeof(uint32_t));
+	header.stringsPos = align8(size_t(header.slotsPos) + slotEntries.size() * sizeof(uint32_t));
+	header.metadataPos = align8(size_t(header.stringsPos) + stringData.size());
+	header.totalSize = align8(size_t(header.metadataPos) + metadataData.size());
+
+	Bytes result(size_t(header.totalSize), 0);
+	memcpy(result.data(), &header, sizeof(header));
+	memcpy(result.data() + header.entriesPos, entries.data(), entries.size() * sizeof(Entry));
+	memcpy(result.data() + header.bucketsPos, bucketSeeds.data(), bucketSeeds.size() * sizeof(uint32_t));
+	memcpy(result.data() + header.slotsPos, slotEntries.data(), slotEntries.size() * sizeof(uint32_t));
+	memcpy(result.data() + header.stringsPos, stringData.data(), stringData.size());
+	memcpy(result.data() + header.metadataPos, metadataData.data(), metadataData.size());
+	return result;
+}
+
+const AssetPackIndex::Entry* AssetPackIndex::find(const String& name, AssetType type) const
+{
+	const auto first = findFirst(name.c_str(), name.size());
+	if (first) {
+		const auto end = entries + header->numEntries;
+		for (auto e = first; e != end && e->nameOffset == first->nameOffset; ++e) {
+			if (e->type == int32_t(type)) {
+				return e;
+			}
+		}
+	}
+	return nullptr;
+}
+
+bool AssetPackIndex::contains(const String& name) const
+{
+	return findFirst(name.c_str(), name.size()) != nullptr;
+}
+
+size_t AssetPackIndex::getNumEntries() const
+{
+	return header->numEntries;
+}
+
+const AssetPackIndex::Entry& AssetPackIndex::getEntry(size_t idx) const
+{
+	return entries[idx];
+}
+
+String AssetPackIndex::getName(const Entry& entry) const
+{
+	return String(strings + entry.nameOffset, entry.nameLength);
+}
+
+const Metadata& AssetPackIndex::getMetadata(const Entry& entry) const
+{
+	static const Metadata empty;
+	if (entry.metadataLength == 0) {
+		return empty;
+	}
+
+	std::unique_lock<std::mutex> lock(metadataMutex);
+	auto& result = metadataCache[uint32_t(&entry - entries)];
+	if (!result) {
+		if (header->metadataPos + entry.metadataOffset + entry.metadataLength > header->totalSize) {
+			throw Exception("Asset metadata is out of index bounds.", HalleyExceptions::Resources);
+		}
+		result = std::make_unique<Metadata>();
+		Deserializer s(gsl::span<const gsl::byte>(metadata + entry.metadataOffset, entry.metadataLength));
+		if (legacyMetadata) {
+			s.setVersion(Metadata::legacyTextFormatVersion);
+		}
+		s >> *result;
+	}
+	return *result;
+}
+
+std::vector<String> AssetPackIndex::enumerate(AssetType type) const
+{
+	std::vector<String> result;
+	for (size_t i = 0; i < header->numEntries; ++i) {
+		if (entries[i].type == int32_t(type)) {
+			result.push_back(getName(entries[i]));
+		}
+	}
+	return result;
+}
+
+void AssetPackIndex::toAssetDatabase(AssetDatabase& db) const
+{
+	for (size_t i = 0; i < header->numEntries; ++i) {
+		auto& e = entries[i];
+		db.addAsset(getName(e), AssetType(e.type), AssetDatabase::Entry(e.pos, e.size, getMetadata(e)));
+	}
+}
+
+const AssetPackIndex::Entry* AssetPackIndex::findFirst(const char* name, size_t length) const
+{
+	const uint64_t hash = hashName(name, length);
+	const uint32_t seed = buckets[hash % header->numBuckets];
+	const uint32_t idx = slots[getSlot(hash, seed, header->numSlots)];
+	if (idx == noEntry || idx >= header->numEntries) {
+		return nullptr;
+	}
+
+	// Anything not in the index still lands on some slot, so the name has to be checked
+	const auto& entry = entries[idx];
+	return nameEquals(entry, name, length) ? &entry : nullptr;
+}
+
+bool AssetPackIndex::nameEquals(const Entry& entry, const char* name, size_t length) const
+{
+	return entry.nameLength == length
+		&& header->stringsPos + entry.nameOffset + entry.nameLength <= header->metadataPos
+		&& memcmp(strings + entry.nameOffset, name, length) == 0;
+}
+
+uint64_t AssetPackIndex::hashName(const char* name, size_t length)
+{
+	return Hash::hash(gsl::as_bytes(gsl::span<const char>(name, length)));
+}
+
+uint32_t AssetPackIndex::getSlot(uint64_t hash, uint32_t seed, uint32_t numSlots)
+{
+	// splitmix64 finalizer
+	uint64_t x = hash ^ (uint64_t(seed) * 0x9E3779B97F4A7C15ull);
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	x = x ^ (x >> 31);
+	return uint32_t(x % numSlots);
+}
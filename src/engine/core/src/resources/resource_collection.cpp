@@ -2,52 +2,94 @@
 #include "resources/resource_locator.h"
 #include "resources/resources.h"
 #include <halley/resources/resource.h>
+#include "halley/concurrency/concurrent.h"
 #include "halley/support/logger.h"
 
 using namespace Halley;
 
+namespace {
+	// Which thread each thread is blocked on, waiting for a load or an onLoaded() call it's doing, so waits that would never end can be avoided
+	class LoadWaits
+	{
+	public:
+		static LoadWaits& getInstance()
+		{
+			static LoadWaits waits;
+			return waits;
+		}
+
+		// Returns false if owner is (indirectly) waiting for this thread, in which case this thread mustn't wait for it
+		bool startWaiting(std::thread::id owner, Future<std::shared_ptr<Resource>> future)
+		{
+			const auto self = std::this_thread::get_id();
+			std::unique_lock<std::mutex> lock(mutex);
+			for (auto thread = owner; thread != std::thread::id(); ) {
+				if (thread == self) {
+					return false;
+				}
+				// Threads whose wait is over, but haven't called stopWaiting() yet, aren't waiting anymore
+				auto iter = waitingOn.find(thread);
+				thread = iter != waitingOn.end() && !iter->second.second.isReady() ? iter->second.first : std::thread::id();
+			}
+			waitingOn[self] = std::make_pair(owner, std::move(future));
+			return true;
+		}
+
+		void stopWaiting()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			waitingOn.erase(std::this_thread::get_id());
+		}
+
+	private:
+		std::mutex mutex;
+		HashMap<std::thread::id, std::pair<std::thread::id, Future<std::shared_ptr<Resource>>>> waitingOn;
+	};
+}
 
 ResourceCollectionBase::ResourceCollectionBase(Resources& parent, AssetType type)
 	: parent(parent)
 	, type(type)
-{
-}
+{}
 
 void ResourceCollectionBase::clear()
 {
-	resources.clear();
+	for (auto& shard: shards) {
+		std::unique_lock<std::shared_timed_mutex> lock(shard.resourcesMutex);
+		shard.resources.clear();
+	}
 }
 
 void ResourceCollectionBase::unload(const String& assetId)
 {
-	resources.erase(assetId);
+	auto& shard = getShard(assetId);
+	std::unique_lock<std::shared_timed_mutex> lock(shard.resourcesMutex);
+	shard.resources.erase(assetId);
 }
 
 void ResourceCollectionBase::unloadAll(int minDepth)
 {
-	for (auto iter = resources.begin(); iter != resources.end(); ) {
-		auto next = iter;
-		++next;
-
-		auto& res = (*iter).second;
-		if (res.depth >= minDepth) {
-			resources.erase(iter);
+	for (auto& shard: shards) {
+		std::unique_lock<std::shared_timed_mutex> lock(shard.resourcesMutex);
+		for (auto iter = shard.resources.begin(); iter != shard.resources.end(); ) {
+			if (iter->second.depth >= minDepth) {
+				iter = shard.resources.erase(iter);
+			} else {
+				++iter;
+			}
 		}
-
-		iter = next;
 	}
 }
 
 void ResourceCollectionBase::reload(const String& assetId)
 {
-	auto res = resources.find(assetId);
-	if (res != resources.end()) {
-		auto& resWrap = res->second;
+	auto res = find(assetId);
+	if (res) {
 		try {
 			std::shared_ptr<Resource> newAsset = loadAsset(assetId, ResourceLoadPriority::High);
 			newAsset->setAssetId(assetId);
 			newAsset->onLoaded(parent);
-			resWrap.res->reloadResource(std::move(*newAsset));
+			res->reloadResource(std::move(*newAsset));
 		} catch (std::exception& e) {
 			Logger::logError("Error while reloading " + assetId + ": " + e.what());
 		} catch (...) {
@@ -92,27 +134,280 @@ std::shared_ptr<Resource> ResourceCollectionBase::loadAsset(const String& assetI
 std::shared_ptr<Resource> ResourceCollectionBase::doGet(const String& assetId, ResourceLoadPriority priority)
 {
 	// Look in cache and return if it's there
-	auto res = resources.find(assetId);
-	if (res != resources.end()) {
-		return res->second.res;
+	if (auto res = find(assetId)) {
+		return res;
 	}
-	
-	// Load resource from disk
-	std::shared_ptr<Resource> newRes = loadAsset(assetId, priority);
 
-	// Store in cache
-	newRes->setAssetId(assetId);
-	resources.emplace(assetId, Wrapper(newRes, 0));
-	newRes->onLoaded(parent);
+	// Join the load in progress, or start one
+	auto& shard = getShard(assetId);
+	std::shared_ptr<Loading> loading;
+	bool joined = false;
+	std::thread::id owner;
+	{
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		if (auto res = find(assetId)) {
+			return res;
+		}
+
+		auto iter = shard.loading.find(assetId);
+		if (iter != shard.loading.end()) {
+			loading = iter->second;
+			const auto thisThread = std::this_thread::get_id();
+			if (loading->publishingThread == thisThread) {
+				// Requested by onLoaded(), directly or through a dependency
+				return loading->publishing;
+			}
+			if (loading->loadingThread == thisThread) {
+				throw Exception("Circular dependency while loading resource: " + assetId, HalleyExceptions::Resources);
+			}
+			joined = true;
+			owner = loading->loadingThread;
+		} else {
+			loading = std::make_shared<Loading>();
+			loading->loadingThread = std::this_thread::get_id();
+			shard.loading[assetId] = loading;
+		}
+	}
+
+	std::shared_ptr<Resource> newRes;
+	if (joined) {
+		if (!LoadWaits::getInstance().startWaiting(owner, loading->decoded.getFuture())) {
+			// That load is waiting for one this thread is doing, so load a copy of its own instead
+			newRes = loadAsset(assetId, priority);
+			newRes->setAssetId(assetId);
+			newRes->onLoaded(parent);
+			return newRes;
+		}
+		newRes = loading->decoded.getFuture().get();
+		LoadWaits::getInstance().stopWaiting();
+	} else {
+		// Load resource from disk
+		try {
+			newRes = loadAsset(assetId, priority);
+		} catch (...) {
+			loading->decoded.setValue({});
+			publish(assetId, {}, loading);
+			throw;
+		}
+		loading->decoded.setValue(std::shared_ptr<Resource>(newRes));
+	}
 
+	// Store in cache
+	if (newRes) {
+		newRes = publish(assetId, std::move(newRes), loading);
+	}
+	if (!newRes) {
+		throw Exception("Unable to load resource: " + assetId, HalleyExceptions::Resources);
+	}
 	return newRes;
 }
 
+Future<std::shared_ptr<Resource>> ResourceCollectionBase::doGetAsync(const String& assetId, ResourceLoadPriority priority)
+{
+	auto& shard = getShard(assetId);
+	const bool blocking = resourceLoader || !canLoadAsync();
+	std::shared_ptr<Loading> loading;
+	{
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		auto iter = shard.loading.find(assetId);
+		if (iter != shard.loading.end()) {
+			// Already on its way
+			return iter->second->published.getFuture();
+		}
+
+		loading = std::make_shared<Loading>();
+		if (auto res = find(assetId)) {
+			// Look in cache
+			loading->published.setValue(std::move(res));
+			return loading->published.getFuture();
+		}
+
+		if (blocking) {
+			loading->loadingThread = std::this_thread::get_id();
+		}
+		shard.loading[assetId] = loading;
+	}
+
+	if (blocking) {
+		// Has to be created here, though e.g. textures and audio clips still read and decode their data in the background
+		std::shared_ptr<Resource> newRes;
+		try {
+			newRes = loadAsset(assetId, priority);
+		} catch (std::exception& e) {
+			Logger::logError("Error while loading " + assetId + ": " + e.what());
+		}
+		{
+			std::unique_lock<std::mutex> lock(shard.mutex);
+			loading->loadingThread = std::thread::id();
+		}
+		loading->decoded.setValue(std::shared_ptr<Resource>(newRes));
+		loadDependencies(assetId, std::move(newRes), priority, loading);
+	} else {
+		std::shared_ptr<ResourceLoader> resLoader;
+		try {
+			resLoader.reset(new ResourceLoader(*(parent.locator), assetId, type, priority, parent.api), [] (ResourceLoader* l) { delete l; });
+		} catch (std::exception& e) {
+			Logger::logError("Error while loading " + assetId + ": " + e.what());
+			loading->decoded.setValue({});
+			loadDependencies(assetId, {}, priority, loading);
+			return loading->published.getFuture();
+		}
+
+		resLoader->getAsync()
+			.then(Executors::getCPU(), [this, resLoader, loading] (std::unique_ptr<ResourceDataStatic> data) -> std::shared_ptr<Resource>
+			{
+				std::shared_ptr<Resource> newRes;
+				resLoader->prefetched = std::move(data);
+				try {
+					newRes = loadResource(*resLoader);
+					if (!newRes) {
+						throw Exception("Unable to construct resource from data: " + resLoader->getName(), HalleyExceptions::Resources);
+					}
+				} catch (std::exception& e) {
+					Logger::logError("Error while loading " + resLoader->getName() + ": " + e.what());
+				}
+				loading->decoded.setValue(std::shared_ptr<Resource>(newRes));
+				return newRes;
+			})
+			.then(Executors::getMainThread(), [this, assetId, priority, loading] (std::shared_ptr<Resource> newRes)
+			{
+				loadDependencies(assetId, std::move(newRes), priority, loading);
+			});
+	}
+
+	return loading->published.getFuture();
+}
+
+void ResourceCollectionBase::loadDependencies(const String& assetId, std::shared_ptr<Resource> resource, ResourceLoadPriority priority, std::shared_ptr<Loading> loading)
+{
+	Vector<ResourceReference> dependencies;
+	if (resource) {
+		resource->getDependencies(dependencies);
+	}
+
+	const ResourceReference self{ type, assetId };
+	Vector<ResourceReference> waitingFor;
+	Vector<Future<std::shared_ptr<Resource>>> pending;
+	for (auto& dep: dependencies) {
+		const auto typeIdx = size_t(dep.type);
+		if (typeIdx >= parent.resources.size() || !parent.resources[typeIdx] || (dep.type == type && dep.name == assetId)) {
+			continue;
+		}
+		auto& collection = *parent.resources[typeIdx];
+
+		// Waiting for a load that's (indirectly) waiting for this one would never finish; onLoaded() will load it synchronously instead
+		auto future = collection.doGetAsync(dep.name, priority);
+		if (!future.isReady() && !collection.isWaitingFor(dep.name, self)) {
+			waitingFor.push_back(dep);
+			pending.push_back(std::move(future));
+		}
+	}
+
+	auto doPublish = [this, assetId, resource, loading] ()
+	{
+		try {
+			publish(assetId, resource, loading);
+		} catch (std::exception& e) {
+			Logger::logError("Error while loading " + assetId + ": " + e.what());
+		}
+	};
+
+	if (pending.empty()) {
+		doPublish();
+	} else {
+		loading->waitingFor = std::move(waitingFor);
+		Concurrent::whenAll(pending.begin(), pending.end()).then(Executors::getMainThread(), doPublish);
+	}
+}
+
+bool ResourceCollectionBase::isWaitingFor(const String& assetId, const ResourceReference& target)
+{
+	std::shared_ptr<Loading> loading;
+	{
+		auto& shard = getShard(assetId);
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		auto iter = shard.loading.find(assetId);
+		if (iter == shard.loading.end()) {
+			return false;
+		}
+		loading = iter->second;
+	}
+
+	for (auto& dep: loading->waitingFor) {
+		if ((dep.type == target.type && dep.name == target.name) || parent.ofType(dep.type).isWaitingFor(dep.name, target)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::shared_ptr<Resource> ResourceCollectionBase::publish(const String& assetId, std::shared_ptr<Resource> resource, const std::shared_ptr<Loading>& loading)
+{
+	auto& shard = getShard(assetId);
+	bool cached = false;
+	{
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		if (loading->publishingThread != std::thread::id()) {
+			// Another thread got here first
+			const auto owner = loading->publishingThread;
+			auto inProgress = loading->publishing;
+			lock.unlock();
+			if (!LoadWaits::getInstance().startWaiting(owner, loading->published.getFuture()) && inProgress) {
+				// Its onLoaded() is waiting for this thread, so it gets the resource as it is
+				return inProgress;
+			}
+			auto result = loading->published.getFuture().get();
+			LoadWaits::getInstance().stopWaiting();
+			return result;
+		}
+		loading->publishingThread = std::this_thread::get_id();
+
+		if (auto res = find(assetId)) {
+			// Set with setResource() in the meantime
+			resource = std::move(res);
+			cached = true;
+		} else {
+			loading->publishing = resource;
+		}
+	}
+
+	auto finish = [&] (bool store)
+	{
+		{
+			std::unique_lock<std::mutex> lock(shard.mutex);
+			if (store) {
+				std::unique_lock<std::shared_timed_mutex> resourcesLock(shard.resourcesMutex);
+				shard.resources.emplace(assetId, Wrapper(resource, 0));
+			}
+			auto iter = shard.loading.find(assetId);
+			if (iter != shard.loading.end() && iter->second == loading) {
+				shard.loading.erase(iter);
+			}
+			loading->publishing.reset();
+		}
+		loading->published.setValue(std::shared_ptr<Resource>(resource));
+	};
+
+	if (resource && !cached) {
+		// Only visible to other threads once onLoaded() is done
+		resource->setAssetId(assetId);
+		try {
+			resource->onLoaded(parent);
+		} catch (...) {
+			resource.reset();
+			finish(false);
+			throw;
+		}
+	}
+
+	finish(resource && !cached);
+	return resource;
+}
+
 bool ResourceCollectionBase::exists(const String& assetId)
 {
 	// Look in cache
-	auto res = resources.find(assetId);
-	if (res != resources.end()) {
+	if (find(assetId)) {
 		return true;
 	}
 
@@ -120,10 +415,25 @@ bool ResourceCollectionBase::exists(const String& assetId)
 }
 
 void ResourceCollectionBase::setResource(int curDepth, const String& name, std::shared_ptr<Resource> resource) {
-	resources.emplace(name, Wrapper(resource, curDepth));
+	auto& shard = getShard(name);
+	std::unique_lock<std::shared_timed_mutex> lock(shard.resourcesMutex);
+	shard.resources.emplace(name, Wrapper(resource, curDepth));
 }
 
 void ResourceCollectionBase::setResourceLoader(ResourceLoaderFunc loader)
 {
 	resourceLoader = loader;
 }
+
+ResourceCollectionBase::Shard& ResourceCollectionBase::getShard(const String& assetId)
+{
+	return shards[std::hash<String>()(assetId) % numShards];
+}
+
+std::shared_ptr<Resource> ResourceCollectionBase::find(const String& assetId)
+{
+	auto& shard = getShard(assetId);
+	std::shared_lock<std::shared_timed_mutex> lock(shard.resourcesMutex);
+	auto iter = shard.resources.find(assetId);
+	return iter != shard.resources.end() ? iter->second.res : std::shared_ptr<Resource>();
+}
@@ -33,12 +33,28 @@ FileSystemResourceLocator::FileSystemResourceLocator(SystemAPI& system, const Pa
 	loadAssetDb();
 }
 
-const AssetDatabase& FileSystemResourceLocator::getAssetDatabase()
+bool FileSystemResourceLocator::contains(const String& asset)
 {
 	if (!assetDb) {
 		loadAssetDb();
 	}
-	return *assetDb;
+	return assetDb->contains(asset);
+}
+
+const Metadata& FileSystemResourceLocator::getMetaData(const String& asset, AssetType type)
+{
+	if (!assetDb) {
+		loadAssetDb();
+	}
+	return assetDb->getDatabase(type).get(asset).meta;
+}
+
+std::vector<String> FileSystemResourceLocator::enumerate(AssetType type)
+{
+	if (!assetDb) {
+		loadAssetDb();
+	}
+	return assetDb->enumerate(type);
 }
 
 int FileSystemResourceLocator::getPriority() const
@@ -12,7 +12,9 @@ namespace Halley {
 
 	protected:
 		std::unique_ptr<ResourceData> getData(const String& asset, AssetType type, bool stream) override;
-		const AssetDatabase& getAssetDatabase() override;
+		bool contains(const String& asset) override;
+		const Metadata& getMetaData(const String& asset, AssetType type) override;
+		std::vector<String> enumerate(AssetType type) override;
 		int getPriority() const override;
 		void purge(SystemAPI& system) override;
 
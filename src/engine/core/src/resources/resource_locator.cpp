@@ -2,10 +2,12 @@
 #include "resources/resource_locator.h"
 #include <iostream>
 #include <set>
+#include <algorithm>
 #include <halley/support/exception.h>
 #include "resource_pack.h"
 #include "halley/support/logger.h"
 #include "api/system_api.h"
+#include "halley/file/memory_mapped_file.h"
 
 using namespace Halley;
 
@@ -16,21 +18,29 @@ ResourceLocator::ResourceLocator(SystemAPI& system)
 
 void ResourceLocator::add(std::unique_ptr<IResourceLocatorProvider> locator)
 {
-	auto& db = locator->getAssetDatabase();
-	for (auto& asset: db.getAssets()) {
-		auto result = locators.find(asset);
-		if (result == locators.end() || result->second->getPriority() < locator->getPriority()) {
-			locators[asset] = locator.get();
+	// Providers are asked in order, so an asset comes from the highest priority provider that has it, or the first one added on ties
+	auto pos = std::find_if(locatorList.begin(), locatorList.end(), [&] (const std::unique_ptr<IResourceLocatorProvider>& l)
+	{
+		return l->getPriority() < locator->getPriority();
+	});
+	locatorList.insert(pos, std::move(locator));
+}
+
+IResourceLocatorProvider* ResourceLocator::getProvider(const String& asset) const
+{
+	for (auto& l: locatorList) {
+		if (l->contains(asset)) {
+			return l.get();
 		}
 	}
-	locatorList.emplace_back(std::move(locator));
+	return nullptr;
 }
 
 std::unique_ptr<ResourceData> ResourceLocator::getResource(const String& asset, AssetType type, bool stream)
 {
-	auto result = locators.find(asset);
-	if (result != locators.end()) {
-		auto data = result->second->getData(asset, type, stream);
+	auto provider = getProvider(asset);
+	if (provider) {
+		auto data = provider->getData(asset, type, stream);
 		if (data) {
 			return data;
 		} else {
@@ -63,12 +73,33 @@ std::unique_ptr<ResourceDataStream> ResourceLocator::getStream(const String& ass
 	return std::unique_ptr<ResourceDataStream>(ptr);
 }
 
+bool ResourceLocator::getLocation(const String& asset, AssetType type, ResourceDataLocation& location)
+{
+	auto provider = getProvider(asset);
+	if (provider && provider->getLocation(asset, type, location.pos, location.size)) {
+		location.source = provider;
+		return true;
+	}
+	return false;
+}
+
+void ResourceLocator::readLocation(const ResourceDataLocation& location, gsl::span<gsl::byte> dst)
+{
+	for (auto& l: locatorList) {
+		if (l.get() == location.source) {
+			l->readData(location.pos, dst);
+			return;
+		}
+	}
+	throw Exception("Unable to read from unknown resource source", HalleyExceptions::Resources);
+}
+
 void ResourceLocator::purge(const String& asset, AssetType type)
 {
-	auto result = locators.find(asset);
-	if (result != locators.end()) {
+	auto provider = getProvider(asset);
+	if (provider) {
 		// Found the locator for this file, purge it
-		result->second->purge(system);
+		provider->purge(system);
 	} else {
 		// Couldn't find a locator (new file?), purge everything
 		for (auto& l: locatorList) {
@@ -81,7 +112,7 @@ std::vector<String> ResourceLocator::enumerate(const AssetType type)
 {
 	std::vector<String> result;
 	for (auto& l: locatorList) {
-		for (auto& r: l->getAssetDatabase().enumerate(type)) {
+		for (auto& r: l->enumerate(type)) {
 			result.push_back(std::move(r));
 		}
 	}
@@ -95,6 +126,13 @@ void ResourceLocator::addFileSystem(const Path& path)
 
 void ResourceLocator::addPack(const Path& path, const String& encryptionKey, bool preLoad, bool allowFailure)
 {
+	// Map the pack where possible, so its assets don't need to be copied out of it
+	auto file = std::make_shared<MemoryMappedFile>();
+	if (file->open(path)) {
+		add(std::make_unique<PackResourceLocator>(std::move(file), path, encryptionKey, preLoad));
+		return;
+	}
+
 	auto dataReader = system.getDataReader(path.string());
 	if (dataReader) {
 		add(std::make_unique<PackResourceLocator>(std::move(dataReader), path, encryptionKey, preLoad));
@@ -109,9 +147,9 @@ void ResourceLocator::addPack(const Path& path, const String& encryptionKey, boo
 
 const Metadata& ResourceLocator::getMetaData(const String& asset, AssetType type) const
 {
-	auto result = locators.find(asset);
-	if (result != locators.end()) {
-		return result->second->getAssetDatabase().getDatabase(type).get(asset).meta;
+	auto provider = getProvider(asset);
+	if (provider) {
+		return provider->getMetaData(asset, type);
 	} else {
 		throw Exception("Unable to locate resource: " + asset, HalleyExceptions::Resources);
 	}
@@ -119,5 +157,5 @@ const Metadata& ResourceLocator::getMetaData(const String& asset, AssetType type
 
 bool ResourceLocator::exists(const String& asset)
 {
-	return locators.find(asset) != locators.end();
+	return getProvider(asset) != nullptr;
 }
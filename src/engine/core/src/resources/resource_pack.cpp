@@ -1,7 +1,9 @@
 #include "resource_pack.h"
 #include <utility>
 #include "resources/asset_pack.h"
+#include "resources/asset_pack_index.h"
 #include "api/system_api.h"
+#include "halley/file/memory_mapped_file.h"
 using namespace Halley;
 
 PackResourceLocator::PackResourceLocator(std::unique_ptr<ResourceDataReader> reader, Path path, String key, bool preLoad)
@@ -12,6 +14,15 @@ PackResourceLocator::PackResourceLocator(std::unique_ptr<ResourceDataReader> rea
 	assetPack = std::make_unique<AssetPack>(std::move(reader), encryptionKey, preLoad);
 }
 
+PackResourceLocator::PackResourceLocator(std::shared_ptr<MemoryMappedFile> file, Path path, String key, bool preLoad)
+	: path(std::move(path))
+	, encryptionKey(std::move(key))
+	, preLoad(preLoad)
+	, mapped(true)
+{
+	assetPack = std::make_unique<AssetPack>(std::move(file), encryptionKey, preLoad);
+}
+
 PackResourceLocator::~PackResourceLocator()
 {
 }
@@ -24,12 +35,33 @@ std::unique_ptr<ResourceData> PackResourceLocator::getData(const String& asset,
 	return assetPack->getData(asset, type, stream);
 }
 
-const AssetDatabase& PackResourceLocator::getAssetDatabase()
+bool PackResourceLocator::contains(const String& asset)
+{
+	if (!assetPack) {
+		loadAfterPurge();
+	}
+	return assetPack->getIndex().contains(asset);
+}
+
+const Metadata& PackResourceLocator::getMetaData(const String& asset, AssetType type)
+{
+	if (!assetPack) {
+		loadAfterPurge();
+	}
+	auto& index = assetPack->getIndex();
+	auto entry = index.find(asset, type);
+	if (!entry) {
+		throw Exception("Asset not found: " + asset, HalleyExceptions::Resources);
+	}
+	return index.getMetadata(*entry);
+}
+
+std::vector<String> PackResourceLocator::enumerate(AssetType type)
 {
 	if (!assetPack) {
 		loadAfterPurge();
 	}
-	return assetPack->getAssetDatabase();
+	return assetPack->getIndex().enumerate(type);
 }
 
 void PackResourceLocator::purge(SystemAPI& sys)
@@ -38,7 +70,30 @@ void PackResourceLocator::purge(SystemAPI& sys)
 	system = &sys;
 }
 
+bool PackResourceLocator::getLocation(const String& asset, AssetType type, size_t& pos, size_t& size)
+{
+	if (!assetPack) {
+		loadAfterPurge();
+	}
+	return assetPack->getLocation(asset, type, pos, size);
+}
+
+void PackResourceLocator::readData(size_t pos, gsl::span<gsl::byte> dst)
+{
+	if (!assetPack) {
+		loadAfterPurge();
+	}
+	assetPack->readData(pos, dst);
+}
+
 void PackResourceLocator::loadAfterPurge()
 {
+	if (mapped) {
+		auto file = std::make_shared<MemoryMappedFile>();
+		if (file->open(path)) {
+			assetPack = std::make_unique<AssetPack>(std::move(file), encryptionKey, preLoad);
+			return;
+		}
+	}
 	assetPack = std::make_unique<AssetPack>(system->getDataReader(path.string()), encryptionKey, preLoad);
 }
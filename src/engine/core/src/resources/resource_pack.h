@@ -6,16 +6,22 @@
 namespace Halley {
 	class SystemAPI;
 	class AssetPack;
+	class MemoryMappedFile;
 
 	class PackResourceLocator : public IResourceLocatorProvider {
 	public:
 		explicit PackResourceLocator(std::unique_ptr<ResourceDataReader> reader, Path path, String encryptionKey = "", bool preLoad = false);
+		explicit PackResourceLocator(std::shared_ptr<MemoryMappedFile> file, Path path, String encryptionKey = "", bool preLoad = false);
 		~PackResourceLocator();
 
 	protected:
 		std::unique_ptr<ResourceData> getData(const String& asset, AssetType type, bool stream) override;
-		const AssetDatabase& getAssetDatabase() override;
+		bool contains(const String& asset) override;
+		const Metadata& getMetaData(const String& asset, AssetType type) override;
+		std::vector<String> enumerate(AssetType type) override;
 		void purge(SystemAPI& system) override;
+		bool getLocation(const String& asset, AssetType type, size_t& pos, size_t& size) override;
+		void readData(size_t pos, gsl::span<gsl::byte> dst) override;
 
 	private:
 		void loadAfterPurge();
@@ -25,6 +31,7 @@ namespace Halley {
 		Path path;
 		String encryptionKey; // :(
 		bool preLoad;
+		bool mapped = false;
 		SystemAPI* system = nullptr;
 	};
 }
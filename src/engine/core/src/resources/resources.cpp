@@ -1,6 +1,7 @@
 #include "resources/resources.h"
 #include "resources/resource_locator.h"
 #include "api/halley_api.h"
+#include "halley/concurrency/concurrent.h"
 
 using namespace Halley;
 
@@ -10,3 +11,13 @@ Resources::Resources(std::unique_ptr<ResourceLocator> locator, const HalleyAPI*
 {}
 
 Resources::~Resources() = default;
+
+Future<void> Resources::preload(const Vector<ResourceReference>& assets, ResourceLoadPriority priority)
+{
+	Vector<Future<std::shared_ptr<Resource>>> futures;
+	futures.reserve(assets.size());
+	for (auto& asset: assets) {
+		futures.push_back(ofType(asset.type).doGetAsync(asset.name, priority));
+	}
+	return Concurrent::whenAll(futures.begin(), futures.end());
+}
@@ -6,6 +6,7 @@
 #include <halley/entity/world.h>
 #include <halley/entity/system.h>
 #include "halley/text/string_converter.h"
+#include "halley/data_structures/frame_arena.h"
 
 using namespace Halley;
 
@@ -77,9 +78,11 @@ void WorldStatsView::draw(RenderContext& context)
 		}
 
 		int maxFPS = int(lround(1'000'000'000.0 / grandTotal));
+		auto arena = FrameArena::getStats();
 		text
 			.setColour(Colour(1, 1, 1))
-			.setText("Total elapsed: " + formatTime(grandTotal) + " ms [" + toString(maxFPS) + " FPS maximum].\n" + toString(painter.getPrevDrawCalls()) + " draw calls, " + toString(painter.getPrevTriangles()) + " triangles, " + toString(painter.getPrevVertices()) + " vertices.")
+			.setText("Total elapsed: " + formatTime(grandTotal) + " ms [" + toString(maxFPS) + " FPS maximum].\n" + toString(painter.getPrevDrawCalls()) + " draw calls (" + toString(painter.getPrevDrawCallsUnbatched()) + " unbatched), " + toString(painter.getPrevTriangles()) + " triangles, " + toString(painter.getPrevVertices()) + " vertices, " + toString((painter.getPrevBytesSubmitted() + 1023) / 1024) + " KB submitted. "
+				+ "Frame arena: " + toString((arena.used + 1023) / 1024) + " KB used, " + toString((arena.highWater + 1023) / 1024) + " KB peak.")
 			.setPosition(Vector2f(20, 20))
 			.draw(painter);
 	});
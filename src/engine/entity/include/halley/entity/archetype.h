@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <halley/data_structures/vector.h>
+#include <halley/data_structures/tree_map.h>
+#include <gsl/gsl>
+#include "family_mask.h"
+
+namespace Halley {
+	class Entity;
+	class Family;
+	class TypeDeleterBase;
+
+	// Stores the components of every entity with the same mask in contiguous per-component columns.
+	// Columns are split into fixed-size chunks, so growing the archetype never moves existing components.
+	class Archetype
+	{
+	public:
+		explicit Archetype(const Vector<int>& componentIds);
+		~Archetype();
+
+		Archetype(const Archetype& other) = delete;
+		Archetype& operator=(const Archetype& other) = delete;
+
+		size_t size() const { return entities.size(); }
+		bool hasComponent(int componentId) const;
+		void* getComponent(size_t row, int componentId) const;
+
+		size_t allocRow(Entity& entity);
+
+		// Destroys whatever is still alive in the row, then fills the hole with the last row
+		void releaseRow(size_t row, const Vector<char>& columnsMovedOut);
+
+		int getColumn(int componentId) const;
+		size_t getNumColumns() const { return columns.size(); }
+
+		// Rows are laid out in chunks; within one, each column is a contiguous array of its component
+		size_t getNumChunks() const { return (entities.size() + rowsPerChunk - 1) / rowsPerChunk; }
+		size_t getNumRows(size_t chunk) const { return std::min(rowsPerChunk, entities.size() - chunk * rowsPerChunk); }
+		void* getColumnData(size_t chunk, int column) const { return chunks[chunk].get() + columns[column].offset; }
+
+	private:
+		struct Column
+		{
+			int componentId;
+			TypeDeleterBase* type;
+			size_t size;
+			size_t offset;
+		};
+
+		Vector<Column> columns;
+		Vector<std::unique_ptr<char[]>> chunks;
+		Vector<Entity*> entities;
+		size_t rowsPerChunk = 0;
+		size_t chunkSize = 0;
+
+		char* getSlot(size_t row, const Column& column) const;
+	};
+
+	class ArchetypeStorage
+	{
+	public:
+		~ArchetypeStorage();
+
+		// Moves the entity's components into the archetype matching its current mask, or releases them if it's dead
+		void update(Entity& entity);
+
+		// Binds the family to every archetype which has all of its components, including the ones created later
+		void bindFamily(Family& family);
+
+		size_t getNumArchetypes() const { return archetypes.size(); }
+
+		// Calls f(rows, columns) for each chunk of every archetype which has all of the given components, with one column per component, in the same order
+		void forEachChunk(const FamilyMaskType& mask, gsl::span<const int> componentIds, const std::function<void(size_t, void* const*)>& f) const;
+
+	private:
+		TreeMap<FamilyMaskType, std::unique_ptr<Archetype>> archetypes;
+		Vector<Family*> families;
+		Vector<char> columnsMovedOut;
+
+		Archetype& getArchetype(const Entity& entity);
+		void removeFromArchetype(Entity& entity);
+	};
+}
@@ -12,17 +12,8 @@
 namespace Halley {
 	class World;
 	class System;
-
-	class MessageEntry
-	{
-	public:
-		std::unique_ptr<Message> msg;
-		int type = -1;
-		int age = -1;
-
-		MessageEntry() {}
-		MessageEntry(std::unique_ptr<Message> msg, int type, int age) : msg(std::move(msg)), type(type), age(age) {}
-	};
+	class Archetype;
+	class ArchetypeStorage;
 
 	class EntityRef;
 
@@ -31,6 +22,8 @@ namespace Halley {
 		friend class World;
 		friend class System;
 		friend class EntityRef;
+		friend class Archetype;
+		friend class ArchetypeStorage;
 
 	public:
 		~Entity();
@@ -85,9 +78,10 @@ namespace Halley {
 
 	private:
 		Vector<std::pair<int, Component*>> components;
-		Vector<MessageEntry> inbox;
 		FamilyMaskType mask;
 		EntityId uid;
+		Archetype* archetype = nullptr;
+		size_t archetypeRow = 0;
 		int liveComponents = 0;
 		bool dirty = false;
 		bool alive = true;
@@ -122,6 +116,7 @@ namespace Halley {
 		void addComponent(Component* component, int id);
 		void removeComponentAt(int index);
 		void deleteComponent(Component* component, int id);
+		bool isStoredInArchetype(int id, Component* component) const;
 		void onReady();
 
 		void markDirty(World& world);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
+#include <limits>
 #include <gsl/gsl_assert>
 #include "family_type.h"
 #include "family_mask.h"
@@ -13,24 +15,35 @@
 namespace Halley {
 	class Entity;
 	class FamilyBindingBase;
+	class Archetype;
 
 	class Family {
 		friend class World;
+		friend class ArchetypeStorage;
 
 	public:
-		Family(FamilyMaskType mask);
+		Family(FamilyMaskType mask, Vector<int> componentIds);
 		virtual ~Family() {}
 
 		size_t count() const
 		{
-			return elemCount;
+			return archetypeBound ? countArchetypeRows() : elemCount;
 		}
 
 		void* getElement(size_t n) const
 		{
+			Expects(!archetypeBound);
 			return static_cast<char*>(elems) + (n * elemSize);
 		}
 
+		// With archetype storage, a family doesn't hold its entities, only the archetypes which have all of its components.
+		// They can then only be walked a chunk at a time: f(rows, columns) gets one column per component of the family, or nullptr for optional ones the chunk doesn't have.
+		bool isBoundToArchetypes() const { return archetypeBound; }
+		void forEachChunk(const std::function<void(size_t, void* const*)>& f) const;
+
+		// Index of the entity's element, or count() if it's not in this family
+		size_t find(EntityId id) const;
+
 		void addOnEntitiesAdded(FamilyBindingBase* bind);
 		void removeOnEntityAdded(FamilyBindingBase* bind);
 		void addOnEntitiesRemoved(FamilyBindingBase* bind);
@@ -42,19 +55,45 @@ namespace Halley {
 	protected:
 		virtual void addEntity(Entity& entity) = 0;
 		void removeEntity(Entity& entity);
-		virtual void updateEntities() = 0;
+		void updateEntities();
+		virtual void removeDeadEntities() = 0; // The first half of updateEntities()
+		virtual void addNewEntities() = 0; // The second half, which loads the components of entities added since
 		virtual void clearEntities() = 0;
 		
 		void* elems = nullptr;
 		size_t elemCount = 0;
 		size_t elemSize = 0;
+		Vector<Entity*> toAdd;
 		Vector<EntityId> toRemove;
 
+		// Sparse index from entity slot to position in the dense family storage
+		constexpr static size_t invalidIndex = std::numeric_limits<size_t>::max();
+		size_t getIndex(EntityId id) const;
+		void setIndex(EntityId id, size_t idx);
+		void clearIndex(EntityId id);
+		void clearIndices();
+
 		Vector<FamilyBindingBase*> addEntityCallbacks;
 		Vector<FamilyBindingBase*> removeEntityCallbacks;
 
 	private:
+		struct ArchetypeColumns
+		{
+			const Archetype* archetype;
+			Vector<int> columns;
+		};
+
 		FamilyMaskType inclusionMask;
+		Vector<int> componentIds;
+		Vector<uint32_t> sparse;
+
+		bool archetypeBound = false;
+		Vector<ArchetypeColumns> archetypes;
+
+		void bindToArchetypes();
+		void unbindFromArchetypes();
+		void addArchetype(const Archetype& archetype);
+		size_t countArchetypeRows() const;
 	};
 
 	class FamilyBase {
@@ -100,49 +139,47 @@ namespace Halley {
 		};
 
 	public:
-		FamilyImpl() : Family(T::Type::inclusionMask()) {}
+		FamilyImpl() : Family(T::Type::inclusionMask(), T::Type::getComponentIds()) {}
 				
 	protected:
 		void addEntity(Entity& entity) override
 		{
-			entities.push_back(StorageType());
-			auto& e = entities.back();
-			e.entityId = entity.getEntityId();
-			T::Type::loadComponents(entity, &e.data[0]);
-
-			dirty = true;
+			// Components are only loaded on updateEntities(), after pending removals are done
+			toAdd.push_back(&entity);
 		}
 
-		void updateEntities() override
+		void addNewEntities() override
 		{
-			if (dirty) {
+			if (!toAdd.empty()) {
 				// Notify additions
 				HALLEY_DEBUG_TRACE();
-				size_t prevSize = elemCount;
-				size_t curSize = entities.size();
-				updateElems();
-				Expects(curSize >= prevSize);
-				if (curSize > prevSize) {
-					notifyAdd(entities.data() + prevSize, curSize - prevSize);
+				const size_t prevSize = entities.size();
+				entities.reserve(prevSize + toAdd.size());
+				for (auto& entity: toAdd) {
+					entities.push_back(StorageType());
+					auto& e = entities.back();
+					e.entityId = entity->getEntityId();
+					T::Type::loadComponents(*entity, &e.data[0]);
+					setIndex(e.entityId, entities.size() - 1);
 				}
+				toAdd.clear();
 
-				dirty = false;
+				updateElems();
+				notifyAdd(entities.data() + prevSize, entities.size() - prevSize);
 			}
-
-			// Remove
-			removeDeadEntities();
 		}
 
 		void clearEntities() override
 		{
 			notifyRemove(entities.data(), entities.size());
 			entities.clear();
+			toAdd.clear();
+			clearIndices();
 			updateElems();
 		}
 
 	private:
 		Vector<StorageType> entities;
-		bool dirty = false;
 
 		void updateElems()
 		{
@@ -151,56 +188,49 @@ namespace Halley {
 			elemSize = sizeof(StorageType);
 		}
 
-		void removeDeadEntities()
+		size_t findEntity(EntityId id) const
+		{
+			const size_t idx = getIndex(id);
+			return idx < entities.size() && entities[idx].entityId == id ? idx : invalidIndex;
+		}
+
+		void removeDeadEntities() override
 		{
 			// Performance-critical code
-			// Benchmarks suggest that using a Vector is faster than std::set and std::unordered_set
+			// Each removal swaps the entity with the last live one, so all removed entities end up contiguous at the back
 			if (!toRemove.empty()) {
 				HALLEY_DEBUG_TRACE();
-				size_t removeCount = toRemove.size();
-				Expects(removeCount > 0);
-				Expects(removeCount <= entities.size());
-				std::sort(toRemove.begin(), toRemove.end());
-
-				for (size_t i = 1; i < toRemove.size(); ++i) {
-					Expects(toRemove[i - 1] != toRemove[i]);
-				}
+				size_t n = entities.size();
+				for (auto& id: toRemove) {
+					const size_t idx = findEntity(id);
+					if (idx == invalidIndex) {
+						// Never made it into the family, so just cancel the addition (order of pending additions doesn't matter)
+						auto iter = std::find_if(toAdd.begin(), toAdd.end(), [&] (const Entity* e) { return e->getEntityId() == id; });
+						Expects(iter != toAdd.end());
+						std::swap(*iter, toAdd.back());
+						toAdd.pop_back();
+						continue;
+					}
 
-				// Move all entities to be removed to the back of the vector
-				{
-					int n = int(entities.size());
-					// Note: it's important to scan it forward. Scanning backwards would improve performance for short-lived entities,
-					// but it causes an issue where an entity is removed and added to the same family in one frame.
-					for (int i = 0; i < n; i++) {
-						EntityId id = entities[i].entityId;
-						auto iter = std::lower_bound(toRemove.begin(), toRemove.end(), id);
-						if (iter != toRemove.end() && id == *iter) {
-							toRemove.erase(iter);
-							if (i != n - 1) {
-								std::swap(entities[i], entities[n - 1]);
-								i--;
-							}
-							n--;
-							if (toRemove.empty()) {
-								break;
-							}
-						}
+					--n;
+					if (idx != n) {
+						std::swap(entities[idx], entities[n]);
+						setIndex(entities[idx].entityId, idx);
 					}
-					Ensures(size_t(n) + removeCount == entities.size());
+					clearIndex(id);
 				}
-
-				Expects(toRemove.empty());
+				toRemove.clear();
 
 				// Notify removal
-				size_t newSize = entities.size() - removeCount;
-				Ensures(newSize < entities.size());
-				notifyRemove(entities.data() + newSize, removeCount);
+				const size_t removeCount = entities.size() - n;
+				if (removeCount > 0) {
+					notifyRemove(entities.data() + n, removeCount);
 
-				// Remove them
-				entities.resize(newSize);
-				updateElems();
+					// Remove them
+					entities.resize(n);
+					updateElems();
+				}
 			}
-			Ensures(toRemove.empty());
 		}
 	};
 }
@@ -18,6 +18,7 @@ namespace Halley {
 	protected:
 		FamilyBindingBase(FamilyMaskType readMask, FamilyMaskType writeMask);
 		void* getElement(size_t index) const { return family->getElement(index); }
+		Family& getFamily() const { return *family; }
 		virtual void bindFamily(World& world) = 0;
 		void setFamily(Family* family);
 
@@ -96,6 +97,17 @@ namespace Halley {
 			return getSingleton();
 		}
 
+		// Walks the family a chunk at a time with archetype storage: f(size_t count, Components*... components) gets one contiguous array per component,
+		// in the order of T::Type, or nullptr for optional components that chunk doesn't have
+		template <typename F>
+		void forEachChunk(F f)
+		{
+			getFamily().forEachChunk([&] (size_t count, void* const* columns)
+			{
+				T::Type::callWithColumns(f, count, columns);
+			});
+		}
+
 		template <typename F>
 		T* tryMatch(F f)
 		{
@@ -28,6 +28,9 @@ namespace Halley {
 			
 			bool contains(const Handle& handle) const;
 
+			// Dense interned index. The empty mask has one like any other; only a default-constructed handle is -1.
+			int getIndex() const { return value; }
+
 		private:
 			int value = -1;
 		};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <utility>
 #include "family_extractor.h"
 
 namespace Halley {
@@ -22,9 +23,28 @@ namespace Halley {
 			Halley::FamilyExtractor::Evaluator<Ts...>::buildEntity(entity, reinterpret_cast<void**>(data), 0);
 		}
 
+		static Vector<int> getComponentIds()
+		{
+			return { FamilyMask::RetrieveComponentIndex<Ts>::componentIndex... };
+		}
+
 		constexpr static size_t getNumComponents()
 		{
 			return sizeof...(Ts);
 		}
+
+		// Calls f(count, Ts*... components), with optional components passed as a plain pointer
+		template <typename F>
+		static void callWithColumns(F& f, size_t count, void* const* columns)
+		{
+			callWithColumns(f, count, columns, std::index_sequence_for<Ts...>());
+		}
+
+	private:
+		template <typename F, size_t... Is>
+		static void callWithColumns(F& f, size_t count, void* const* columns, std::index_sequence<Is...>)
+		{
+			f(count, static_cast<typename FamilyExtractor::StripMaybeRef<Ts>::type*>(columns[Is])...);
+		}
 	};
 }
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <gsl/gsl>
+#include "entity_id.h"
+#include "message.h"
+#include <halley/data_structures/vector.h>
+
+namespace Halley {
+	class SizePool;
+
+	// Per-type message queues, with messages allocated from a per-type pool.
+	// Every message is tagged with the id of the system that sent it (its "age"), and lives until that system purges it on its next update.
+	// Each queue is kept grouped by target, with each target's messages in the order they were sent.
+	class MessageBus
+	{
+	public:
+		struct Entry
+		{
+			EntityId target;
+			Message* msg;
+			int age;
+		};
+
+		MessageBus();
+		~MessageBus();
+
+		MessageBus(const MessageBus& other) = delete;
+		MessageBus& operator=(const MessageBus& other) = delete;
+
+		void* alloc(int msgType, size_t size);
+		void destroy(int msgType, Message* msg);
+
+		// Messages posted are only grouped with the rest of the queue once group() is called
+		void post(int msgType, EntityId target, Message* msg, int age);
+		void group(int msgType);
+		void purge(int msgType, int age);
+
+		const Vector<Entry>& getQueue(int msgType) const;
+		gsl::span<const Entry> getMessages(int msgType, EntityId target) const;
+
+	private:
+		struct Queue
+		{
+			Vector<Entry> entries;
+			size_t nGrouped = 0;
+			std::unique_ptr<SizePool> pool;
+		};
+
+		Vector<Queue> queues;
+		const Vector<Entry> emptyQueue;
+
+		Queue& getQueue(int msgType, size_t size);
+	};
+}
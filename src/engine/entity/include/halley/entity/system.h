@@ -8,6 +8,7 @@
 #include "family_mask.h"
 #include "family_type.h"
 #include "entity.h"
+#include "system_dependencies.h"
 #include "halley/utils/type_traits.h"
 
 namespace Halley {
@@ -33,7 +34,7 @@ namespace Halley {
 	{
 	public:
 		System(std::initializer_list<FamilyBindingBase*> families, std::initializer_list<int> messageTypesReceived);
-		virtual ~System() {}
+		virtual ~System();
 
 		String getName() const { return name; }
 		void setName(String n) { name = n; }
@@ -44,6 +45,8 @@ namespace Halley {
 		long long getNanoSecondsTakenAvg() const { return timer.averageElapsedNanoSeconds(); }
 		void setCollectSamples(bool collect);
 
+		const SystemDependencies& getDependencies() const { return dependencies; }
+
 	protected:
 		const HalleyAPI& doGetAPI() const { return *api; }
 		World& doGetWorld() const { return *world; }
@@ -52,6 +55,7 @@ namespace Halley {
 		virtual void updateBase(Time) {}
 		virtual void renderBase(RenderContext&) {}
 		virtual void onMessagesReceived(int, Message**, size_t*, size_t) {}
+		virtual void declareDependenciesBase(SystemDependencies&) const {}
 
 		template <typename F, typename V>
 		static void invokeIndividual(F&& f, V& fam)
@@ -64,7 +68,8 @@ namespace Halley {
 		template <typename F, typename V>
 		static void invokeParallel(F&& f, V& fam)
 		{
-			Concurrent::foreach(std::begin(fam), std::end(fam), [&] (auto& e) {
+			// Small chunks, since per-entity cost can vary a lot
+			Concurrent::parallelFor(std::begin(fam), std::end(fam), 16, [&] (auto& e) {
 				f(e);
 			});
 		}
@@ -72,9 +77,8 @@ namespace Halley {
 		template <typename T>
 		void sendMessageGeneric(EntityId entityId, const T& msg)
 		{
-			auto toSend = std::make_unique<T>();
-			*toSend = msg;
-			doSendMessage(entityId, std::move(toSend), sizeof(T), T::messageIndex);
+			auto toSend = new (allocMessage(T::messageIndex, sizeof(T))) T(msg);
+			doSendMessage(entityId, toSend, T::messageIndex);
 		}
 
 		template <typename T, typename std::enable_if<HasInitMember<T>::value, int>::type = 0>
@@ -122,11 +126,19 @@ namespace Halley {
 
 	private:
 		friend class World;
+		friend class SystemScheduler;
 
 		Vector<FamilyBindingBase*> families;
+		struct OutboxEntry
+		{
+			EntityId target;
+			Message* msg;
+			int type;
+		};
+
 		Vector<int> messageTypesReceived;
-		Vector<EntityId> messagesSentTo;
-		Vector<std::pair<EntityId, MessageEntry>> outbox;
+		Vector<int> messageTypesSent;
+		Vector<OutboxEntry> outbox;
 
 		World* world = nullptr;
 		const HalleyAPI* api = nullptr;
@@ -136,6 +148,7 @@ namespace Halley {
 		bool collectSamples = false;
 
 		StopwatchAveraging timer;
+		SystemDependencies dependencies;
 
 		void doUpdate(Time time);
 		void doRender(RenderContext& rc);
@@ -143,7 +156,8 @@ namespace Halley {
 
 		void purgeMessages();
 		void processMessages();
-		void doSendMessage(EntityId target, std::unique_ptr<Message> msg, size_t msgSize, int msgId);
+		void* allocMessage(int msgId, size_t msgSize);
+		void doSendMessage(EntityId target, Message* msg, int msgId);
 		void dispatchMessages();
 	};
 
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <halley/data_structures/vector.h>
+#include <halley/text/halleystring.h>
+#include "family_mask.h"
+
+namespace Halley {
+	// Describes what a system touches during update, so the scheduler can decide which systems may run concurrently.
+	// Generated by codegen from the system's yaml definition; systems which don't declare anything are treated as exclusive.
+	class SystemDependencies
+	{
+	public:
+		template <typename T>
+		SystemDependencies& read()
+		{
+			FamilyMask::setBit(componentsRead, T::componentIndex);
+			return *this;
+		}
+
+		template <typename T>
+		SystemDependencies& write()
+		{
+			FamilyMask::setBit(componentsWritten, T::componentIndex);
+			return *this;
+		}
+
+		template <typename T>
+		SystemDependencies& sendMessage()
+		{
+			// Copied first, as push_back would bind the constant by reference, which needs it defined out of line
+			messagesSent.push_back(int(T::messageIndex));
+			return *this;
+		}
+
+		template <typename T>
+		SystemDependencies& receiveMessage()
+		{
+			messagesReceived.push_back(int(T::messageIndex));
+			return *this;
+		}
+
+		SystemDependencies& useService(const String& name);
+		SystemDependencies& useWorld();
+		SystemDependencies& useAPI();
+		SystemDependencies& useResources();
+		SystemDependencies& setParallelStrategy();
+		SystemDependencies& setDeclared();
+
+		bool isExclusive() const;
+		bool conflictsWith(const SystemDependencies& other) const;
+
+	private:
+		FamilyMask::RealType componentsRead;
+		FamilyMask::RealType componentsWritten;
+		Vector<int> messagesSent;
+		Vector<int> messagesReceived;
+		Vector<String> services;
+
+		bool worldAccess = false;
+		bool apiAccess = false;
+		bool parallelStrategy = false;
+		bool declared = false;
+	};
+}
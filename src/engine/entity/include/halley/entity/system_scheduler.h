@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <halley/data_structures/vector.h>
+#include <halley/time/halleytime.h>
+
+namespace Halley {
+	class System;
+	class World;
+
+	// Runs the systems of one timeline as a dependency graph, executing non-conflicting systems concurrently on the CPU executor.
+	// Edges always point from earlier to later systems in the timeline, so conflicting systems keep their declared order.
+	// Exclusive systems run alone on the calling thread, and pending entities are spawned right after them.
+	class SystemScheduler
+	{
+	public:
+		void build(const Vector<std::unique_ptr<System>>& systems);
+		void run(World& world, Time time);
+
+		bool isBuilt() const { return built; }
+		void invalidate() { built = false; }
+
+	private:
+		struct Node
+		{
+			System* system = nullptr;
+			Vector<size_t> dependents;
+			int nDependencies = 0;
+			bool exclusive = false;
+		};
+
+		Vector<Node> nodes;
+		Vector<int> pendingDependencies;
+		Vector<size_t> ready;
+		bool built = false;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		Vector<size_t> finished;
+		std::exception_ptr error;
+
+		void runSerial(World& world, Time time);
+		void onNodeFinished(size_t idx);
+	};
+}
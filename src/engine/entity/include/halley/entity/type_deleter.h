@@ -1,6 +1,8 @@
 #pragma once
 
 #include <halley/data_structures/vector.h>
+#include <new>
+#include <utility>
 
 namespace Halley {
 	class TypeDeleterBase
@@ -8,7 +10,9 @@ namespace Halley {
 	public:
 		virtual ~TypeDeleterBase() {}
 		virtual size_t getSize() = 0;
+		virtual size_t getAlignment() = 0;
 		virtual void callDestructor(void* ptr) = 0;
+		virtual void moveConstruct(void* dst, void* src) = 0;
 	};
 
 	class ComponentDeleterTable
@@ -53,6 +57,11 @@ namespace Halley {
 			return sizeof(T);
 		}
 
+		size_t getAlignment() override
+		{
+			return alignof(T);
+		}
+
 		void callDestructor(void* ptr) override
 		{
 #ifdef _MSC_VER
@@ -60,5 +69,10 @@ namespace Halley {
 #endif
 			static_cast<T*>(ptr)->~T();
 		}
+
+		void moveConstruct(void* dst, void* src) override
+		{
+			::new (dst) T(std::move(*static_cast<T*>(src)));
+		}
 	};
 }
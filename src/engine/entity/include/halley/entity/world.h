@@ -1,8 +1,12 @@
 #pragma once
 
+#include <array>
+#include <functional>
 #include <memory>
 #include <typeinfo>
 #include <type_traits>
+#include <utility>
+#include <gsl/gsl>
 #include "entity_id.h"
 #include "family_mask.h"
 #include "family.h"
@@ -13,6 +17,7 @@
 #include <halley/data_structures/vector.h>
 #include <halley/data_structures/tree_map.h>
 #include "service.h"
+#include "message_bus.h"
 
 namespace Halley {
 	class ConfigNode;
@@ -21,6 +26,8 @@ namespace Halley {
 	class System;
 	class Painter;
 	class HalleyAPI;
+	class SystemScheduler;
+	class ArchetypeStorage;
 
 	class World
 	{
@@ -34,6 +41,29 @@ namespace Halley {
 		
 		int64_t getAverageTime(TimeLine timeline) const;
 
+		// When enabled, systems on update timelines which don't conflict with each other run concurrently
+		void setParallelSystems(bool enabled);
+		bool isParallelSystems() const;
+
+		// When enabled, components of entities sharing the same mask are stored contiguously in chunks. Must be set before creating entities.
+		// Families are then bound to those chunks, and can only be walked with FamilyBinding::forEachChunk().
+		void setArchetypeStorage(bool enabled);
+		bool isArchetypeStorage() const;
+
+		// Walks the components of every entity which has all of Ts, a chunk at a time: f(size_t count, Ts*... components) gets one contiguous array per component.
+		// Needs archetype storage. Sees the entities families saw on the last update, so entities created or changed since aren't included yet.
+		template <typename... Ts, typename F>
+		void forEachChunk(F f)
+		{
+			const std::array<int, sizeof...(Ts)> ids = {{ FamilyMask::RetrieveComponentIndex<Ts>::componentIndex... }};
+			forEachArchetypeChunk(FamilyMask::Evaluator<Ts...>::getMask(), ids, [&] (size_t count, void* const* columns)
+			{
+				callWithColumns<Ts...>(f, count, columns, std::index_sequence_for<Ts...>());
+			});
+		}
+
+		MessageBus& getMessageBus();
+
 		System& addSystem(std::unique_ptr<System> system, TimeLine timeline);
 		void removeSystem(System& system);
 		Vector<System*> getSystems();
@@ -83,19 +113,56 @@ namespace Halley {
 		
 	private:
 		const HalleyAPI* api;
+		MessageBus messageBus; // Must outlive the systems, which purge their messages on destruction
 		std::array<Vector<std::unique_ptr<System>>, static_cast<int>(TimeLine::NUMBER_OF_TIMELINES)> systems;
+		std::array<std::unique_ptr<SystemScheduler>, static_cast<int>(TimeLine::NUMBER_OF_TIMELINES)> schedulers;
 		bool collectMetrics = false;
 		bool entityDirty = false;
+		bool parallelSystems = false;
 		
 		Vector<Entity*> entities;
 		Vector<Entity*> entitiesPendingCreation;
 		MappedPool<Entity*> entityMap;
+		std::unique_ptr<ArchetypeStorage> archetypes;
 
 		//TreeMap<FamilyMaskType, std::unique_ptr<Family>> families;
 		Vector<std::unique_ptr<Family>> families;
 		TreeMap<String, std::shared_ptr<Service>> services;
 
-		TreeMap<FamilyMaskType, std::vector<Family*>> familyCache;
+		struct FamilyChange
+		{
+			Entity* entity;
+			FamilyMaskType oldMask;
+			FamilyMaskType newMask;
+			bool removed;
+		};
+
+		// Families an entity joins and leaves when one component is added to or removed from its mask
+		struct MaskTransition
+		{
+			Vector<Family*> leaving;
+			Vector<Family*> joining;
+		};
+
+		struct MaskFamilies
+		{
+			FamilyMaskType mask;
+			Vector<Family*> families;
+			Vector<MaskTransition> transitions; // Indexed by slot in familyComponents
+			bool built = false;
+		};
+
+		// Persistent across frames, so updating entities doesn't allocate once they've grown
+		Vector<FamilyChange> familyChanges;
+		Vector<size_t> entitiesRemoved;
+		Vector<Entity*> entitiesToMigrate;
+
+		// Indexed by mask handle index + 1
+		Vector<MaskFamilies> familiesByMask;
+
+		// Components which are part of some family's inclusion mask; changing any other component doesn't affect family membership
+		Vector<int> familyComponents;
+		std::array<int, FamilyMask::RealType().size()> familyComponentSlot;
 
 		mutable std::array<StopwatchAveraging, 3> timer;
 
@@ -111,6 +178,16 @@ namespace Halley {
 
 		Service& getService(const String& name) const;
 
-		const std::vector<Family*>& getFamiliesFor(const FamilyMaskType& mask);
+		MaskFamilies& getMaskFamilies(const FamilyMaskType& mask);
+		void buildMaskFamilies(MaskFamilies& entry);
+		void updateFamilyMembership(const FamilyChange& change);
+
+		void forEachArchetypeChunk(const FamilyMaskType& mask, gsl::span<const int> componentIds, const std::function<void(size_t, void* const*)>& f) const;
+
+		template <typename... Ts, typename F, size_t... Is>
+		static void callWithColumns(F& f, size_t count, void* const* columns, std::index_sequence<Is...>)
+		{
+			f(count, static_cast<Ts*>(columns[Is])...);
+		}
 	};
 }
@@ -0,0 +1,259 @@
+#include "archetype.h"
+#include "entity.h"
+#include "type_deleter.h"
+#include "family.h"
+#include <halley/data_structures/memory_pool.h>
+#include <halley/utils/utils.h>
+#include <gsl/gsl_assert>
+#include <algorithm>
+
+using namespace Halley;
+
+namespace {
+	constexpr size_t targetChunkSize = 16 * 1024;
+	constexpr size_t minRowsPerChunk = 16;
+	constexpr size_t columnAlignment = 16;
+}
+
+Archetype::Archetype(const Vector<int>& componentIds)
+{
+	size_t rowSize = 0;
+	for (auto id: componentIds) {
+		auto type = ComponentDeleterTable::get(id);
+		Expects(type->getAlignment() <= columnAlignment);
+		columns.push_back(Column{ id, type, type->getSize(), 0 });
+		rowSize += type->getSize();
+	}
+
+	rowsPerChunk = std::max(minRowsPerChunk, targetChunkSize / std::max(rowSize, size_t(1)));
+	size_t offset = 0;
+	for (auto& c: columns) {
+		offset = alignUp(offset, columnAlignment);
+		c.offset = offset;
+		offset += c.size * rowsPerChunk;
+	}
+	chunkSize = std::max(offset, size_t(1));
+}
+
+Archetype::~Archetype()
+{
+	for (size_t row = 0; row < entities.size(); ++row) {
+		for (auto& c: columns) {
+			c.type->callDestructor(getSlot(row, c));
+		}
+	}
+}
+
+bool Archetype::hasComponent(int componentId) const
+{
+	return getColumn(componentId) != -1;
+}
+
+int Archetype::getColumn(int componentId) const
+{
+	for (size_t i = 0; i < columns.size(); ++i) {
+		if (columns[i].componentId == componentId) {
+			return int(i);
+		}
+	}
+	return -1;
+}
+
+void* Archetype::getComponent(size_t row, int componentId) const
+{
+	const int column = getColumn(componentId);
+	if (column == -1 || row >= entities.size()) {
+		return nullptr;
+	}
+	return getSlot(row, columns[column]);
+}
+
+char* Archetype::getSlot(size_t row, const Column& column) const
+{
+	return chunks[row / rowsPerChunk].get() + column.offset + (row % rowsPerChunk) * column.size;
+}
+
+size_t Archetype::allocRow(Entity& entity)
+{
+	const size_t row = entities.size();
+	if (row / rowsPerChunk >= chunks.size()) {
+		chunks.emplace_back(new char[chunkSize]);
+	}
+	entities.push_back(&entity);
+	return row;
+}
+
+void Archetype::releaseRow(size_t row, const Vector<char>& columnsMovedOut)
+{
+	Expects(row < entities.size());
+	Expects(columnsMovedOut.size() == columns.size());
+
+	for (size_t i = 0; i < columns.size(); ++i) {
+		if (!columnsMovedOut[i]) {
+			columns[i].type->callDestructor(getSlot(row, columns[i]));
+		}
+	}
+
+	const size_t last = entities.size() - 1;
+	if (row != last) {
+		// Fill the hole with the last row, and repoint that entity's components
+		Entity* moved = entities[last];
+		for (auto& c: columns) {
+			char* dst = getSlot(row, c);
+			char* src = getSlot(last, c);
+			c.type->moveConstruct(dst, src);
+			c.type->callDestructor(src);
+
+			for (auto& comp: moved->components) {
+				if (comp.second == reinterpret_cast<Component*>(src)) {
+					comp.second = reinterpret_cast<Component*>(dst);
+				}
+			}
+		}
+		moved->archetypeRow = row;
+		entities[row] = moved;
+	}
+	entities.pop_back();
+
+	// Release trailing chunks once they're empty, but keep one spare around to avoid thrashing
+	const size_t chunksNeeded = (entities.size() + rowsPerChunk - 1) / rowsPerChunk;
+	if (chunks.size() > chunksNeeded + 1) {
+		chunks.resize(chunksNeeded + 1);
+	}
+}
+
+ArchetypeStorage::~ArchetypeStorage()
+{
+}
+
+void ArchetypeStorage::update(Entity& entity)
+{
+	if (!entity.isAlive()) {
+		removeFromArchetype(entity);
+		return;
+	}
+
+	Archetype& dst = getArchetype(entity);
+	Archetype* src = entity.archetype;
+
+	if (src == &dst) {
+		// Same archetype, but some components might have been replaced by freshly allocated ones
+		for (auto& c: entity.components) {
+			auto slot = static_cast<Component*>(dst.getComponent(entity.archetypeRow, c.first));
+			if (c.second != slot) {
+				auto type = ComponentDeleterTable::get(c.first);
+				type->callDestructor(slot);
+				type->moveConstruct(slot, c.second);
+				type->callDestructor(c.second);
+				PoolPool::getPool(type->getSize())->free(c.second);
+				c.second = slot;
+			}
+		}
+		return;
+	}
+
+	const size_t newRow = dst.allocRow(entity);
+	if (src) {
+		columnsMovedOut.assign(src->getNumColumns(), 0);
+	}
+
+	for (auto& c: entity.components) {
+		auto type = ComponentDeleterTable::get(c.first);
+		auto slot = static_cast<Component*>(dst.getComponent(newRow, c.first));
+		type->moveConstruct(slot, c.second);
+		type->callDestructor(c.second);
+
+		const int srcColumn = src ? src->getColumn(c.first) : -1;
+		if (srcColumn != -1 && src->getComponent(entity.archetypeRow, c.first) == c.second) {
+			columnsMovedOut[srcColumn] = 1;
+		} else {
+			PoolPool::getPool(type->getSize())->free(c.second);
+		}
+		c.second = slot;
+	}
+
+	if (src) {
+		src->releaseRow(entity.archetypeRow, columnsMovedOut);
+	}
+
+	entity.archetype = &dst;
+	entity.archetypeRow = newRow;
+}
+
+void ArchetypeStorage::bindFamily(Family& family)
+{
+	family.bindToArchetypes();
+	for (auto& a: archetypes) {
+		if (a.first.contains(family.inclusionMask)) {
+			family.addArchetype(*a.second);
+		}
+	}
+	families.push_back(&family);
+}
+
+void ArchetypeStorage::forEachChunk(const FamilyMaskType& mask, gsl::span<const int> componentIds, const std::function<void(size_t, void* const*)>& f) const
+{
+	Vector<int> columns(size_t(componentIds.size()));
+	Vector<void*> data(size_t(componentIds.size()));
+	for (auto& a: archetypes) {
+		auto& archetype = *a.second;
+		if (archetype.size() == 0 || !a.first.contains(mask)) {
+			continue;
+		}
+
+		for (size_t i = 0; i < columns.size(); ++i) {
+			columns[i] = archetype.getColumn(componentIds[i]);
+			Expects(columns[i] != -1);
+		}
+		for (size_t chunk = 0; chunk < archetype.getNumChunks(); ++chunk) {
+			for (size_t i = 0; i < columns.size(); ++i) {
+				data[i] = archetype.getColumnData(chunk, columns[i]);
+			}
+			f(archetype.getNumRows(chunk), data.data());
+		}
+	}
+}
+
+Archetype& ArchetypeStorage::getArchetype(const Entity& entity)
+{
+	auto iter = archetypes.find(entity.getMask());
+	if (iter != archetypes.end()) {
+		return *iter->second;
+	}
+
+	Vector<int> ids;
+	ids.reserve(entity.components.size());
+	for (auto& c: entity.components) {
+		ids.push_back(c.first);
+	}
+	std::sort(ids.begin(), ids.end());
+
+	auto archetype = std::make_unique<Archetype>(ids);
+	auto& result = *archetype;
+	archetypes[entity.getMask()] = std::move(archetype);
+
+	for (auto& family: families) {
+		if (entity.getMask().contains(family->inclusionMask)) {
+			family->addArchetype(result);
+		}
+	}
+	return result;
+}
+
+void ArchetypeStorage::removeFromArchetype(Entity& entity)
+{
+	for (auto& c: entity.components) {
+		if (!entity.isStoredInArchetype(c.first, c.second)) {
+			entity.deleteComponent(c.second, c.first);
+		}
+	}
+	entity.components.clear();
+	entity.liveComponents = 0;
+
+	if (entity.archetype) {
+		columnsMovedOut.assign(entity.archetype->getNumColumns(), 0);
+		entity.archetype->releaseRow(entity.archetypeRow, columnsMovedOut);
+		entity.archetype = nullptr;
+		entity.archetypeRow = 0;
+	}
+}
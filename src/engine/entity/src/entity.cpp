@@ -1,6 +1,7 @@
 #include <halley/data_structures/memory_pool.h>
 #include "entity.h"
 #include "world.h"
+#include "archetype.h"
 
 using namespace Halley;
 
@@ -11,8 +12,11 @@ Entity::Entity()
 
 Entity::~Entity()
 {
+	// Components living in an archetype chunk are owned by it
 	for (auto i = components.begin(); i != components.end(); ++i) {
-		deleteComponent(i->second, i->first);
+		if (!isStoredInArchetype(i->first, i->second)) {
+			deleteComponent(i->second, i->first);
+		}
 	}
 	liveComponents = 0;
 }
@@ -41,6 +45,11 @@ void Entity::deleteComponent(Component* component, int id)
 	PoolPool::getPool(deleter->getSize())->free(component);
 }
 
+bool Entity::isStoredInArchetype(int id, Component* component) const
+{
+	return archetype && archetype->getComponent(archetypeRow, id) == component;
+}
+
 void Entity::onReady()
 {
 }
@@ -63,9 +72,11 @@ void Entity::refresh()
 	if (dirty) {
 		dirty = false;
 
-		// Delete stale components
+		// Delete stale components (the ones in an archetype are released when the entity migrates)
 		for (int i = liveComponents; i < int(components.size()); ++i) {
-			deleteComponent(components[i].second, components[i].first);
+			if (!isStoredInArchetype(components[i].first, components[i].second)) {
+				deleteComponent(components[i].second, components[i].first);
+			}
 		}
 		components.resize(liveComponents);
 
@@ -1,14 +1,42 @@
 #include "family.h"
 #include "family_binding.h"
+#include "archetype.h"
 
 using namespace Halley;
 
-Family::Family(FamilyMaskType mask) 
+namespace {
+	constexpr uint32_t sparseEmpty = std::numeric_limits<uint32_t>::max();
+
+	size_t getSparseKey(EntityId id)
+	{
+		// The lower 32 bits are the entity's slot in the world's entity map, so they're dense and never shared by two live entities
+		return size_t(id.value & 0xFFFFFFFFll);
+	}
+}
+
+constexpr size_t Family::invalidIndex;
+
+Family::Family(FamilyMaskType mask, Vector<int> componentIds)
 	: inclusionMask(mask)
+	, componentIds(std::move(componentIds))
 {}
 
+size_t Family::find(EntityId id) const
+{
+	Expects(!archetypeBound);
+
+	const size_t idx = getIndex(id);
+	if (idx < elemCount && static_cast<const FamilyBase*>(getElement(idx))->entityId == id) {
+		return idx;
+	}
+	return elemCount;
+}
+
 void Family::addOnEntitiesAdded(FamilyBindingBase* bind)
 {
+	if (archetypeBound) {
+		throw Exception("Families bound to archetypes can't notify entities being added.", HalleyExceptions::Entity);
+	}
 	addEntityCallbacks.push_back(bind);
 	bind->onEntitiesAdded(elems, elemCount);
 }
@@ -20,6 +48,9 @@ void Family::removeOnEntityAdded(FamilyBindingBase* bind)
 
 void Family::addOnEntitiesRemoved(FamilyBindingBase* bind)
 {
+	if (archetypeBound) {
+		throw Exception("Families bound to archetypes can't notify entities being removed.", HalleyExceptions::Entity);
+	}
 	removeEntityCallbacks.push_back(bind);
 }
 
@@ -46,3 +77,93 @@ void Family::removeEntity(Entity& entity)
 {
 	toRemove.push_back(entity.getEntityId());
 }
+
+void Family::updateEntities()
+{
+	// Remove first, so an entity that is removed and re-added in the same frame ends up with a single entry
+	removeDeadEntities();
+	addNewEntities();
+}
+
+void Family::forEachChunk(const std::function<void(size_t, void* const*)>& f) const
+{
+	Expects(archetypeBound);
+
+	Vector<void*> data(componentIds.size());
+	for (auto& a: archetypes) {
+		auto& archetype = *a.archetype;
+		for (size_t chunk = 0; chunk < archetype.getNumChunks(); ++chunk) {
+			for (size_t i = 0; i < data.size(); ++i) {
+				data[i] = a.columns[i] == -1 ? nullptr : archetype.getColumnData(chunk, a.columns[i]);
+			}
+			f(archetype.getNumRows(chunk), data.data());
+		}
+	}
+}
+
+void Family::bindToArchetypes()
+{
+	if (!addEntityCallbacks.empty() || !removeEntityCallbacks.empty()) {
+		throw Exception("Families bound to archetypes can't notify entities being added or removed.", HalleyExceptions::Entity);
+	}
+	Expects(elemCount == 0 && toAdd.empty());
+	archetypeBound = true;
+	archetypes.clear();
+}
+
+void Family::unbindFromArchetypes()
+{
+	archetypeBound = false;
+	archetypes.clear();
+}
+
+void Family::addArchetype(const Archetype& archetype)
+{
+	Expects(archetypeBound);
+
+	ArchetypeColumns entry{ &archetype, Vector<int>(componentIds.size()) };
+	for (size_t i = 0; i < componentIds.size(); ++i) {
+		entry.columns[i] = archetype.getColumn(componentIds[i]);
+	}
+	archetypes.push_back(std::move(entry));
+}
+
+size_t Family::countArchetypeRows() const
+{
+	size_t n = 0;
+	for (auto& a: archetypes) {
+		n += a.archetype->size();
+	}
+	return n;
+}
+
+size_t Family::getIndex(EntityId id) const
+{
+	const size_t key = getSparseKey(id);
+	if (key >= sparse.size() || sparse[key] == sparseEmpty) {
+		return invalidIndex;
+	}
+	return sparse[key];
+}
+
+void Family::setIndex(EntityId id, size_t idx)
+{
+	const size_t key = getSparseKey(id);
+	if (key >= sparse.size()) {
+		sparse.resize(std::max(key + 1, sparse.size() * 2), sparseEmpty);
+	}
+	sparse[key] = uint32_t(idx);
+}
+
+void Family::clearIndex(EntityId id)
+{
+	const size_t key = getSparseKey(id);
+	if (key < sparse.size()) {
+		sparse[key] = sparseEmpty;
+	}
+}
+
+void Family::clearIndices()
+{
+	sparse.clear();
+}
@@ -0,0 +1,114 @@
+#include "message_bus.h"
+#include <halley/data_structures/memory_pool.h>
+#include <gsl/gsl_assert>
+#include <algorithm>
+
+using namespace Halley;
+
+MessageBus::MessageBus() = default;
+
+MessageBus::~MessageBus()
+{
+	for (auto& q: queues) {
+		for (auto& e: q.entries) {
+			e.msg->~Message();
+			q.pool->free(e.msg);
+		}
+	}
+}
+
+void* MessageBus::alloc(int msgType, size_t size)
+{
+	return getQueue(msgType, size).pool->alloc();
+}
+
+void MessageBus::destroy(int msgType, Message* msg)
+{
+	Expects(msgType >= 0 && size_t(msgType) < queues.size());
+	msg->~Message();
+	queues[msgType].pool->free(msg);
+}
+
+void MessageBus::post(int msgType, EntityId target, Message* msg, int age)
+{
+	Expects(msgType >= 0 && size_t(msgType) < queues.size());
+	queues[msgType].entries.push_back(Entry{ target, msg, age });
+}
+
+void MessageBus::group(int msgType)
+{
+	if (msgType < 0 || size_t(msgType) >= queues.size()) {
+		return;
+	}
+
+	auto& q = queues[msgType];
+	auto& entries = q.entries;
+	if (q.nGrouped == entries.size()) {
+		return;
+	}
+
+	// Both sorts are stable, and merging keeps older entries first, so each target still sees its messages in the order they were sent
+	const auto byTarget = [] (const Entry& a, const Entry& b) { return a.target < b.target; };
+	const auto mid = entries.begin() + q.nGrouped;
+	std::stable_sort(mid, entries.end(), byTarget);
+	std::inplace_merge(entries.begin(), mid, entries.end(), byTarget);
+	q.nGrouped = entries.size();
+}
+
+void MessageBus::purge(int msgType, int age)
+{
+	if (msgType < 0 || size_t(msgType) >= queues.size()) {
+		return;
+	}
+
+	group(msgType);
+	auto& q = queues[msgType];
+	auto& entries = q.entries;
+	auto first = std::find_if(entries.begin(), entries.end(), [&] (const Entry& e) { return e.age == age; });
+	if (first == entries.end()) {
+		return;
+	}
+
+	// Stable compaction, so the queue stays grouped by target and in the order messages were sent
+	auto dst = first;
+	for (auto iter = first; iter != entries.end(); ++iter) {
+		if (iter->age == age) {
+			iter->msg->~Message();
+			q.pool->free(iter->msg);
+		} else {
+			*dst++ = *iter;
+		}
+	}
+	entries.erase(dst, entries.end());
+	q.nGrouped = entries.size();
+}
+
+const Vector<MessageBus::Entry>& MessageBus::getQueue(int msgType) const
+{
+	if (msgType < 0 || size_t(msgType) >= queues.size()) {
+		return emptyQueue;
+	}
+	return queues[msgType].entries;
+}
+
+gsl::span<const MessageBus::Entry> MessageBus::getMessages(int msgType, EntityId target) const
+{
+	auto& queue = getQueue(msgType);
+	auto range = std::equal_range(queue.begin(), queue.end(), Entry{ target, nullptr, 0 }, [] (const Entry& a, const Entry& b) { return a.target < b.target; });
+	return gsl::span<const Entry>(queue.data() + (range.first - queue.begin()), range.second - range.first);
+}
+
+MessageBus::Queue& MessageBus::getQueue(int msgType, size_t size)
+{
+	Expects(msgType >= 0);
+	if (size_t(msgType) >= queues.size()) {
+		queues.resize(size_t(msgType) + 1);
+	}
+
+	auto& q = queues[msgType];
+	if (!q.pool) {
+		q.pool = std::make_unique<SizePool>(size);
+	}
+	Expects(q.pool->getSize() == size);
+	return q;
+}
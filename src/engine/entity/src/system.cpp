@@ -1,5 +1,5 @@
 #include "system.h"
-#include <halley/data_structures/flat_map.h>
+#include <halley/data_structures/frame_arena.h>
 #include "halley/support/debug.h"
 
 using namespace Halley;
@@ -10,6 +10,19 @@ System::System(std::initializer_list<FamilyBindingBase*> uninitializedFamilies,
 {
 }
 
+System::~System()
+{
+	if (world) {
+		auto& bus = world->getMessageBus();
+		for (auto& o: outbox) {
+			bus.destroy(o.type, o.msg);
+		}
+		for (auto type: messageTypesSent) {
+			bus.purge(type, systemId);
+		}
+	}
+}
+
 size_t System::getEntityCount() const
 {
 	size_t n = 0;
@@ -38,74 +51,87 @@ void System::onAddedToWorld(World& w, int id) {
 	for (auto f : families) {
 		f->bindFamily(w);
 	}
+
+	dependencies = SystemDependencies();
+	declareDependenciesBase(dependencies);
 }
 
 void System::purgeMessages()
 {
-	if (messagesSentTo.size() > 0) {
-		for (auto& target: messagesSentTo) {
-			// Purge all messages of this age
-			Entity* entity = world->tryGetEntity(target);
-
-			if (entity) {
-				auto& inbox = entity->inbox;
-				inbox.erase(std::remove_if(inbox.begin(), inbox.end(), [&] (const MessageEntry& e) { return e.age == systemId; }), inbox.end());
-			}
+	if (!messageTypesSent.empty()) {
+		// Purge all messages of this age
+		auto& bus = world->getMessageBus();
+		for (auto type: messageTypesSent) {
+			bus.purge(type, systemId);
 		}
-		messagesSentTo.clear();
+		messageTypesSent.clear();
 	}
 }
 
 void System::processMessages()
 {
-	// This whole method is probably very inefficient.
-	struct MessageBox
-	{
-		Vector<Message*> msg;
-		Vector<size_t> elemIdx;
-	};
-	FlatMap<int, MessageBox> inboxes;
-
 	if (!families.empty()) {
-		auto& fam = *families[0];
-		size_t sz = fam.count();
-		for (size_t i = 0; i < sz; i++) {
-			FamilyBase* elem = reinterpret_cast<FamilyBase*>(fam.getElement(i));
-			Entity* entity = world->tryGetEntity(elem->entityId);
-			if (entity) {
-				for (const auto& msg: entity->inbox) {
-					if (std::find(messageTypesReceived.begin(), messageTypesReceived.end(), msg.type) != messageTypesReceived.end()) {
-						auto& inbox = inboxes[msg.type];
-						inbox.msg.emplace_back(msg.msg.get());
-						inbox.elemIdx.emplace_back(i);
+		auto& fam = *families[0]->family;
+		auto& bus = world->getMessageBus();
+
+		// Each type already has its own queue, grouped by target, so each receiver only has to be found once in the main family
+		FrameVector<Message*> msgs;
+		FrameVector<size_t> elemIdx;
+		for (auto type: messageTypesReceived) {
+			auto& queue = bus.getQueue(type);
+			if (queue.empty()) {
+				continue;
+			}
+
+			msgs.clear();
+			elemIdx.clear();
+			const size_t n = queue.size();
+			for (size_t i = 0; i < n; ) {
+				const auto target = queue[i].target;
+				const size_t idx = fam.find(target);
+				for (; i < n && queue[i].target == target; ++i) {
+					if (idx != fam.count()) {
+						msgs.push_back(queue[i].msg);
+						elemIdx.push_back(idx);
 					}
 				}
 			}
-		}
-		for (auto& iter : inboxes) {
-			int id = iter.first;
-			auto& inbox = iter.second;
-			onMessagesReceived(id, inbox.msg.data(), inbox.elemIdx.data(), inbox.msg.size());
+			if (!msgs.empty()) {
+				onMessagesReceived(type, msgs.data(), elemIdx.data(), msgs.size());
+			}
 		}
 	}
 }
 
-void System::doSendMessage(EntityId entityId, std::unique_ptr<Message> msg, size_t, int id)
+void* System::allocMessage(int msgId, size_t msgSize)
+{
+	return world->getMessageBus().alloc(msgId, msgSize);
+}
+
+void System::doSendMessage(EntityId entityId, Message* msg, int id)
 {
-	outbox.emplace_back(std::make_pair(entityId, MessageEntry(std::move(msg), id, systemId)));
+	outbox.push_back(OutboxEntry{ entityId, msg, id });
 }
 
 void System::dispatchMessages()
 {
 	if (!outbox.empty()) {
+		auto& bus = world->getMessageBus();
 		for (auto& o: outbox) {
-			Entity* entity = world->tryGetEntity(o.first);
-			if (entity) {
-				entity->inbox.emplace_back(std::move(o.second));
-				messagesSentTo.push_back(o.first);
+			if (world->tryGetEntity(o.target)) {
+				bus.post(o.type, o.target, o.msg, systemId);
+				if (std::find(messageTypesSent.begin(), messageTypesSent.end(), o.type) == messageTypesSent.end()) {
+					messageTypesSent.push_back(o.type);
+				}
+			} else {
+				bus.destroy(o.type, o.msg);
 			}
 		}
 		outbox.clear();
+
+		for (auto type: messageTypesSent) {
+			bus.group(type);
+		}
 	}
 }
 
@@ -115,6 +141,9 @@ void System::doUpdate(Time time) {
 		timer.beginSample();
 	}
 
+	// Systems may run on worker threads, whose arenas no World::step is rewinding
+	FrameArena::Scope arenaScope;
+
 	purgeMessages();
 	if (!messageTypesReceived.empty()) {
 		processMessages();
@@ -0,0 +1,81 @@
+#include "system_dependencies.h"
+#include <algorithm>
+
+using namespace Halley;
+
+SystemDependencies& SystemDependencies::useService(const String& name)
+{
+	services.push_back(name);
+	return *this;
+}
+
+SystemDependencies& SystemDependencies::useWorld()
+{
+	worldAccess = true;
+	return *this;
+}
+
+SystemDependencies& SystemDependencies::useAPI()
+{
+	apiAccess = true;
+	return *this;
+}
+
+SystemDependencies& SystemDependencies::useResources()
+{
+	// Resources are reached through the API, and neither is thread-safe, so treat them as the same thing
+	apiAccess = true;
+	return *this;
+}
+
+SystemDependencies& SystemDependencies::setParallelStrategy()
+{
+	parallelStrategy = true;
+	return *this;
+}
+
+SystemDependencies& SystemDependencies::setDeclared()
+{
+	declared = true;
+	return *this;
+}
+
+bool SystemDependencies::isExclusive() const
+{
+	// World access means it can create or destroy entities, which changes families under everyone's feet.
+	// Parallel systems already fan out over the CPU pool, so running them alongside others would starve them.
+	return !declared || worldAccess || parallelStrategy;
+}
+
+bool SystemDependencies::conflictsWith(const SystemDependencies& other) const
+{
+	if (isExclusive() || other.isExclusive()) {
+		return true;
+	}
+
+	// Components
+	if ((componentsWritten & (other.componentsRead | other.componentsWritten)).any()) {
+		return true;
+	}
+	if ((componentsRead & other.componentsWritten).any()) {
+		return true;
+	}
+
+	// Message queues on the world's bus get written when sending (and purging) and read when receiving
+	const bool sends = !messagesSent.empty();
+	const bool receives = !messagesReceived.empty();
+	const bool otherSends = !other.messagesSent.empty();
+	const bool otherReceives = !other.messagesReceived.empty();
+	if ((sends && (otherSends || otherReceives)) || (otherSends && receives)) {
+		return true;
+	}
+
+	// Services are assumed not to be thread-safe
+	for (auto& s: services) {
+		if (std::find(other.services.begin(), other.services.end(), s) != other.services.end()) {
+			return true;
+		}
+	}
+
+	return apiAccess && other.apiAccess;
+}
@@ -0,0 +1,148 @@
+#include "system_scheduler.h"
+#include "system.h"
+#include "world.h"
+#include <halley/concurrency/concurrent.h>
+
+using namespace Halley;
+
+void SystemScheduler::build(const Vector<std::unique_ptr<System>>& systems)
+{
+	const size_t n = systems.size();
+	nodes.clear();
+	nodes.resize(n);
+
+	for (size_t i = 0; i < n; ++i) {
+		auto& node = nodes[i];
+		node.system = systems[i].get();
+		node.exclusive = node.system->getDependencies().isExclusive();
+	}
+
+	// Systems only wait on earlier conflicting systems, so the graph is acyclic by construction
+	for (size_t j = 0; j < n; ++j) {
+		auto& later = nodes[j].system->getDependencies();
+		for (size_t i = 0; i < j; ++i) {
+			if (nodes[i].system->getDependencies().conflictsWith(later)) {
+				nodes[i].dependents.push_back(j);
+				nodes[j].nDependencies++;
+			}
+		}
+	}
+
+	pendingDependencies.resize(n);
+	ready.reserve(n);
+	finished.reserve(n);
+	built = true;
+}
+
+void SystemScheduler::run(World& world, Time time)
+{
+	Expects(built);
+
+	if (Executors::getCPU().threadCount() == 0) {
+		runSerial(world, time);
+		return;
+	}
+
+	const size_t n = nodes.size();
+	ready.clear();
+	for (size_t i = 0; i < n; ++i) {
+		pendingDependencies[i] = nodes[i].nDependencies;
+		if (pendingDependencies[i] == 0) {
+			ready.push_back(i);
+		}
+	}
+
+	// Every system becomes ready exactly once, so ready is only appended to and consumed through nextReady
+	size_t nextReady = 0;
+	size_t nDone = 0;
+	size_t nRunning = 0;
+	std::exception_ptr localError;
+
+	while (nDone < n) {
+		// Launch everything that's ready. The last one (and any exclusive system) runs on this thread.
+		while (nextReady < ready.size() && !localError) {
+			const size_t idx = ready[nextReady++];
+			auto& node = nodes[idx];
+
+			if (node.exclusive || nextReady == ready.size()) {
+				try {
+					node.system->doUpdate(time);
+					if (node.exclusive) {
+						world.spawnPending();
+					}
+				} catch (...) {
+					localError = std::current_exception();
+				}
+				onNodeFinished(idx);
+				++nDone;
+			} else {
+				++nRunning;
+				Concurrent::execute(Executors::getCPU(), [this, idx, time] () {
+					std::exception_ptr e;
+					try {
+						nodes[idx].system->doUpdate(time);
+					} catch (...) {
+						e = std::current_exception();
+					}
+
+					std::unique_lock<std::mutex> lock(mutex);
+					if (e && !error) {
+						error = e;
+					}
+					finished.push_back(idx);
+					condition.notify_one();
+				});
+			}
+		}
+
+		if (nRunning == 0) {
+			if (localError || nextReady == ready.size()) {
+				break;
+			}
+			continue;
+		}
+
+		// Wait for at least one system running on the pool to finish
+		Vector<size_t> justFinished;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (finished.empty()) {
+				condition.wait(lock);
+			}
+			justFinished.swap(finished);
+			if (error && !localError) {
+				localError = error;
+			}
+			error = std::exception_ptr();
+		}
+
+		for (auto idx: justFinished) {
+			onNodeFinished(idx);
+		}
+		nRunning -= justFinished.size();
+		nDone += justFinished.size();
+	}
+
+	if (localError) {
+		std::rethrow_exception(localError);
+	}
+
+	world.spawnPending();
+}
+
+void SystemScheduler::runSerial(World& world, Time time)
+{
+	for (auto& node: nodes) {
+		node.system->doUpdate(time);
+		world.spawnPending();
+	}
+}
+
+void SystemScheduler::onNodeFinished(size_t idx)
+{
+	for (auto dependent: nodes[idx].dependents) {
+		if (--pendingDependencies[dependent] == 0) {
+			ready.push_back(dependent);
+		}
+	}
+}
@@ -2,9 +2,12 @@
 #include <chrono>
 #include <halley/support/exception.h>
 #include <halley/data_structures/memory_pool.h>
+#include <halley/data_structures/frame_arena.h>
 #include <halley/utils/utils.h>
 #include "world.h"
 #include "system.h"
+#include "system_scheduler.h"
+#include "archetype.h"
 #include "family.h"
 #include "halley/text/string_converter.h"
 #include "halley/support/debug.h"
@@ -15,7 +18,11 @@ using namespace Halley;
 World::World(const HalleyAPI* api, bool collectMetrics)
 	: api(api)
 	, collectMetrics(collectMetrics)
-{	
+{
+	for (auto& s: schedulers) {
+		s = std::make_unique<SystemScheduler>();
+	}
+	familyComponentSlot.fill(-1);
 }
 
 World::~World()
@@ -33,6 +40,7 @@ World::~World()
 	for (auto e: entities) {
 		deleteEntity(e);
 	}
+	archetypes.reset();
 	families.clear();
 	services.clear();
 }
@@ -45,6 +53,7 @@ System& World::addSystem(std::unique_ptr<System> system, TimeLine timelineType)
 	auto& timeline = getSystems(timelineType);
 	timeline.emplace_back(std::move(system));
 	ref.onAddedToWorld(*this, int(timeline.size()));
+	schedulers[int(timelineType)]->invalidate();
 	return ref;
 }
 
@@ -54,6 +63,9 @@ void World::removeSystem(System& system)
 		for (size_t i = 0; i < sys.size(); i++) {
 			if (sys[i].get() == &system) {
 				sys.erase(sys.begin() + i);
+				for (auto& s: schedulers) {
+					s->invalidate();
+				}
 				return;
 			}
 		}
@@ -203,6 +215,52 @@ int64_t World::getAverageTime(TimeLine timeline) const
 	return timer[int(timeline)].averageElapsedNanoSeconds();
 }
 
+void World::setParallelSystems(bool enabled)
+{
+	parallelSystems = enabled;
+}
+
+bool World::isParallelSystems() const
+{
+	return parallelSystems;
+}
+
+void World::setArchetypeStorage(bool enabled)
+{
+	if (enabled == isArchetypeStorage()) {
+		return;
+	}
+	if (!entities.empty() || !entitiesPendingCreation.empty()) {
+		throw Exception("Archetype storage must be set before any entities are created.", HalleyExceptions::Entity);
+	}
+	archetypes = enabled ? std::make_unique<ArchetypeStorage>() : std::unique_ptr<ArchetypeStorage>();
+	for (auto& family: families) {
+		if (archetypes) {
+			archetypes->bindFamily(*family);
+		} else {
+			family->unbindFromArchetypes();
+		}
+	}
+}
+
+bool World::isArchetypeStorage() const
+{
+	return static_cast<bool>(archetypes);
+}
+
+void World::forEachArchetypeChunk(const FamilyMaskType& mask, gsl::span<const int> componentIds, const std::function<void(size_t, void* const*)>& f) const
+{
+	if (!archetypes) {
+		throw Exception("Iterating components by chunk needs archetype storage.", HalleyExceptions::Entity);
+	}
+	archetypes->forEachChunk(mask, componentIds, f);
+}
+
+MessageBus& World::getMessageBus()
+{
+	return messageBus;
+}
+
 void World::step(TimeLine timeline, Time elapsed)
 {
 	auto& t = timer[int(timeline)];
@@ -210,6 +268,9 @@ void World::step(TimeLine timeline, Time elapsed)
 		t.beginSample();
 	}
 
+	// Nothing allocated from this thread's frame arena during this step may be used past it
+	FrameArena::Scope arenaScope;
+
 	spawnPending();
 
 	initSystems();
@@ -266,13 +327,9 @@ void World::updateEntities()
 	HALLEY_DEBUG_TRACE();
 	size_t nEntities = entities.size();
 
-	std::vector<size_t> entitiesRemoved;
-
-	struct FamilyTodo {
-		std::vector<Entity*> toAdd;
-		std::vector<Entity*> toRemove;
-	};
-	std::map<FamilyMaskType, FamilyTodo> pending;
+	familyChanges.clear();
+	entitiesRemoved.clear();
+	entitiesToMigrate.clear();
 
 	// Update all entities
 	// This loop should be as fast as reasonably possible
@@ -284,10 +341,14 @@ void World::updateEntities()
 
 		// Check if it needs any sort of updating
 		if (entity.needsRefresh()) {
+			if (archetypes) {
+				entitiesToMigrate.push_back(&entity);
+			}
+
 			// First of all, let's check if it's dead
 			if (!entity.isAlive()) {
 				// Remove from systems
-				pending[entity.getMask()].toRemove.push_back(&entity);
+				familyChanges.push_back(FamilyChange{ &entity, entity.getMask(), entity.getMask(), true });
 				entitiesRemoved.push_back(i);
 			} else {
 				// It's alive, so check old and new system inclusions
@@ -297,29 +358,28 @@ void World::updateEntities()
 
 				// Did it change?
 				if (oldMask != newMask) {
-					pending[oldMask].toRemove.push_back(&entity);
-					pending[newMask].toAdd.push_back(&entity);
+					familyChanges.push_back(FamilyChange{ &entity, oldMask, newMask, false });
 				}
 			}
 		}
 	}
 
 	HALLEY_DEBUG_TRACE();
-	for (auto& todo: pending) {
-		for (auto& fam: getFamiliesFor(todo.first)) {
-			for (auto& e: todo.second.toRemove) {
-				fam->removeEntity(*e);
-			}
-			for (auto& e: todo.second.toAdd) {
-				fam->addEntity(*e);
-			}
+	if (!archetypes) {
+		for (auto& change: familyChanges) {
+			updateFamilyMembership(change);
 		}
-	}
 
-	HALLEY_DEBUG_TRACE();
-	// Update families
-	for (auto& iter : families) {
-		iter->updateEntities();
+		HALLEY_DEBUG_TRACE();
+		// Update families
+		for (auto& iter : families) {
+			iter->updateEntities();
+		}
+	} else {
+		// Families are bound to archetypes, so entities join and leave them by moving between archetypes
+		for (auto& e: entitiesToMigrate) {
+			archetypes->update(*e);
+		}
 	}
 
 	HALLEY_DEBUG_TRACE();
@@ -355,6 +415,15 @@ void World::initSystems() const
 
 void World::updateSystems(TimeLine timeline, Time time)
 {
+	if (parallelSystems) {
+		auto& scheduler = *schedulers[int(timeline)];
+		if (!scheduler.isBuilt()) {
+			scheduler.build(getSystems(timeline));
+		}
+		scheduler.run(*this, time);
+		return;
+	}
+
 	for (auto& system : getSystems(timeline)) {
 		system->doUpdate(time);
 		spawnPending();
@@ -370,34 +439,137 @@ void World::renderSystems(RenderContext& rc) const
 
 void World::onAddFamily(Family& family)
 {
+	const auto& fMask = family.inclusionMask;
+
 	// Add any existing entities to this new family
-	size_t nEntities = entities.size();
-	for (size_t i = 0; i < nEntities; i++) {
-		auto& entity = *entities[i];
-		auto eMask = entity.getMask();
-		auto fMask = family.inclusionMask;
-		if ((eMask & fMask) == fMask) {
-			family.addEntity(entity);
+	if (archetypes) {
+		archetypes->bindFamily(family);
+	} else {
+		size_t nEntities = entities.size();
+		for (size_t i = 0; i < nEntities; i++) {
+			auto& entity = *entities[i];
+			if (entity.getMask().contains(fMask)) {
+				family.addEntity(entity);
+			}
+		}
+	}
+
+	// Families are only added every so often, so the whole table is rebuilt rather than patched
+	const auto& bits = fMask.getRealValue();
+	for (int i = 0; i < int(bits.size()); ++i) {
+		if (bits[i] && familyComponentSlot[i] == -1) {
+			familyComponentSlot[i] = int(familyComponents.size());
+			familyComponents.push_back(i);
+		}
+	}
+	for (auto& entry: familiesByMask) {
+		if (entry.built) {
+			buildMaskFamilies(entry);
 		}
 	}
-	familyCache.clear();
 }
 
-const std::vector<Family*>& World::getFamiliesFor(const FamilyMaskType& mask)
+World::MaskFamilies& World::getMaskFamilies(const FamilyMaskType& mask)
 {
-	auto i = familyCache.find(mask);
-	if (i != familyCache.end()) {
-		return i->second;
-	} else {
-		std::vector<Family*> result;
+	// A default-constructed handle is -1, so it gets slot 0
+	const size_t idx = size_t(mask.getIndex() + 1);
+	if (idx >= familiesByMask.size()) {
+		familiesByMask.resize(std::max(idx + 1, familiesByMask.size() * 2));
+	}
+
+	auto& entry = familiesByMask[idx];
+	if (!entry.built) {
+		entry.mask = mask;
+		buildMaskFamilies(entry);
+		entry.built = true;
+	}
+	return entry;
+}
+
+void World::buildMaskFamilies(MaskFamilies& entry)
+{
+	const auto& mask = entry.mask.getRealValue();
+	auto isIn = [] (const FamilyMask::RealType& m, const Family& family)
+	{
+		const auto& fMask = family.inclusionMask.getRealValue();
+		return (m & fMask) == fMask;
+	};
+
+	entry.families.clear();
+	for (auto& iter : families) {
+		if (isIn(mask, *iter)) {
+			entry.families.push_back(iter.get());
+		}
+	}
+
+	// Work out where toggling each component leads, without interning masks that might never be used
+	entry.transitions.resize(familyComponents.size());
+	for (size_t i = 0; i < familyComponents.size(); ++i) {
+		auto& transition = entry.transitions[i];
+		transition.leaving.clear();
+		transition.joining.clear();
+
+		auto toggled = mask;
+		toggled.flip(size_t(familyComponents[i]));
 		for (auto& iter : families) {
-			auto& family = *iter;
-			FamilyMaskType famMask = family.inclusionMask;
-			if (mask.contains(famMask)) {
-				result.push_back(&family);
+			const bool wasIn = isIn(mask, *iter);
+			const bool isInNow = isIn(toggled, *iter);
+			if (wasIn && !isInNow) {
+				transition.leaving.push_back(iter.get());
+			} else if (isInNow && !wasIn) {
+				transition.joining.push_back(iter.get());
+			}
+		}
+	}
+}
+
+void World::updateFamilyMembership(const FamilyChange& change)
+{
+	auto& entity = *change.entity;
+	auto& from = getMaskFamilies(change.oldMask);
+
+	if (change.removed) {
+		for (auto& fam: from.families) {
+			fam->removeEntity(entity);
+		}
+		return;
+	}
+
+	// Only the components which some family cares about matter
+	const auto diff = change.oldMask.getRealValue() ^ change.newMask.getRealValue();
+	int changedSlot = -1;
+	int nChanged = 0;
+	for (auto c: familyComponents) {
+		if (diff[size_t(c)]) {
+			changedSlot = familyComponentSlot[c];
+			++nChanged;
+		}
+	}
+
+	if (nChanged == 0) {
+		return;
+	} else if (nChanged == 1) {
+		// The usual case: a single component was added or removed
+		auto& transition = from.transitions[size_t(changedSlot)];
+		for (auto& fam: transition.leaving) {
+			fam->removeEntity(entity);
+		}
+		for (auto& fam: transition.joining) {
+			fam->addEntity(entity);
+		}
+	} else {
+		// Several at once, so diff the two family lists; families in both are left alone
+		// Building the new mask's entry can grow the table, so the old one is looked up again afterwards
+		auto& to = getMaskFamilies(change.newMask);
+		for (auto& fam: getMaskFamilies(change.oldMask).families) {
+			if (!change.newMask.contains(fam->inclusionMask)) {
+				fam->removeEntity(entity);
+			}
+		}
+		for (auto& fam: to.families) {
+			if (!change.oldMask.contains(fam->inclusionMask)) {
+				fam->addEntity(entity);
 			}
 		}
-		familyCache[mask] = std::move(result);
-		return familyCache[mask];
 	}
 }
@@ -1,9 +1,44 @@
 #pragma once
 #include "../utils/utils.h"
+#include "halley/data_structures/vector.h"
+#include "halley/text/halleystring.h"
 #include <gsl/gsl>
+#include <functional>
 #include <limits>
+#include <memory>
 
 namespace Halley {
+	// Decompresses a stream a piece at a time, pulling compressed bytes from its source as it needs them
+	class ICompressionDecoder {
+	public:
+		// Fills as much of dst as it can, and returns how much it filled. Only returns 0 at the end.
+		using Source = std::function<size_t(gsl::span<gsl::byte> dst)>;
+
+		virtual ~ICompressionDecoder() {}
+
+		virtual size_t getDecompressedSize() const = 0;
+
+		// Returns how many bytes were written, which is only less than dst.size() at the end of the stream
+		virtual size_t read(gsl::span<gsl::byte> dst) = 0;
+	};
+
+	// Compressed data always starts with its uncompressed size, as a uint64_t, so the output can be allocated up front
+	class ICompressionCodec {
+	public:
+		virtual ~ICompressionCodec() {}
+
+		virtual String getName() const = 0;
+
+		virtual Bytes compress(gsl::span<const gsl::byte> src) const = 0;
+
+		size_t getDecompressedSize(gsl::span<const gsl::byte> src) const;
+
+		// dst must be exactly getDecompressedSize() bytes
+		virtual void decompress(gsl::span<const gsl::byte> src, gsl::span<gsl::byte> dst) const = 0;
+
+		virtual std::unique_ptr<ICompressionDecoder> makeDecoder(ICompressionDecoder::Source source) const = 0;
+	};
+
 	class Compression {
 	public:
 		static Bytes compress(const Bytes& bytes);
@@ -11,8 +46,15 @@ namespace Halley {
 		static Bytes decompress(const Bytes& bytes, size_t maxSize = std::numeric_limits<size_t>::max());
 		static Bytes decompress(gsl::span<const gsl::byte> bytes, size_t maxSize = std::numeric_limits<size_t>::max());
 		static std::shared_ptr<const char> decompressToSharedPtr(gsl::span<const gsl::byte> bytes, size_t& outSize, size_t maxSize = std::numeric_limits<size_t>::max());
+		static std::shared_ptr<const char> decompressToSharedPtr(const ICompressionCodec& codec, gsl::span<const gsl::byte> bytes, size_t& outSize, size_t maxSize = std::numeric_limits<size_t>::max());
 
 		static Bytes compressRaw(gsl::span<const gsl::byte> bytes, bool insertLength);
 		static Bytes decompressRaw(gsl::span<const gsl::byte> bytes, size_t maxSize, size_t expectedSize = 0);
+
+		// Codecs are looked up by the name assets use in their "asset_compression" metadata.
+		// "deflate" (what compress() and decompress() use) and "lz4-chunked" (much faster to decompress, but compresses less) are always available.
+		static void addCodec(std::unique_ptr<ICompressionCodec> codec);
+		static const ICompressionCodec* getCodec(const String& name); // Null if there's no such codec
+		static Vector<String> getCodecNames();
 	};
 }
@@ -1,5 +1,8 @@
 #pragma once
 #include <array>
+#include <atomic>
+#include <algorithm>
+#include <exception>
 #include <functional>
 #include <halley/text/halleystring.h>
 #include "executor.h"
@@ -52,28 +55,67 @@ namespace Halley
 			return future.getFuture();
 		}
 
+		// Runs f on every element in [begin, end), in chunks of grainSize elements (0 picks one automatically)
+		// Chunks are claimed dynamically, so uneven work is balanced, and the calling thread processes chunks too
 		template <typename T, typename F>
-		void foreach(ExecutionQueue& e, T begin, T end, F f)
+		void parallelFor(ExecutionQueue& e, T begin, T end, size_t grainSize, F f)
 		{
 			const size_t n = end - begin;
-			constexpr size_t maxThreads = 8;
-			size_t nThreads = std::max(size_t(1), std::min(maxThreads, e.threadCount()));
-			std::array<Future<void>, maxThreads> futures;
-
-			size_t prevEnd = 0;
-			for (size_t j = 0; j < nThreads; ++j) {
-				size_t curStart = prevEnd;
-				size_t curEnd = n * (j + 1) / nThreads;
-				prevEnd = curEnd;
-
-				futures[j] = execute([begin, f, curStart, curEnd]() {
-					for (auto i = begin + curStart; i < begin + curEnd; ++i) {
-						f(*i);
+			if (n == 0) {
+				return;
+			}
+
+			const size_t nWorkers = e.threadCount();
+			if (grainSize == 0) {
+				grainSize = std::max(size_t(1), n / ((nWorkers + 1) * 8));
+			}
+			const size_t nChunks = (n + grainSize - 1) / grainSize;
+			const size_t nHelpers = std::min(nWorkers, nChunks - 1);
+
+			std::atomic<size_t> next(0);
+			std::atomic<bool> failed(false);
+			std::exception_ptr error;
+			auto run = [&] () {
+				try {
+					for (size_t start = next.fetch_add(grainSize); start < n; start = next.fetch_add(grainSize)) {
+						const size_t chunkEnd = std::min(start + grainSize, n);
+						for (auto i = begin + start; i < begin + chunkEnd; ++i) {
+							f(*i);
+						}
 					}
-				});
+				} catch (...) {
+					// Keep the first exception for the caller, and stop handing out chunks
+					if (!failed.exchange(true)) {
+						error = std::current_exception();
+					}
+					next.store(n);
+				}
+			};
+
+			JoinCounter counter;
+			for (size_t i = 0; i < nHelpers; ++i) {
+				e.addToQueue([&run] () { run(); }, &counter);
+			}
+			run();
+
+			// Helpers that didn't get to start will find no chunks left and return immediately
+			e.wait(counter);
+
+			if (error) {
+				std::rethrow_exception(error);
 			}
+		}
 
-			whenAll(futures.data(), futures.data() + nThreads).wait();
+		template <typename T, typename F>
+		void parallelFor(T begin, T end, size_t grainSize, F f)
+		{
+			parallelFor(ExecutionQueue::getDefault(), begin, end, grainSize, f);
+		}
+
+		template <typename T, typename F>
+		void foreach(ExecutionQueue& e, T begin, T end, F f)
+		{
+			parallelFor(e, begin, end, 0, f);
 		}
 
 		template <typename T, typename F>
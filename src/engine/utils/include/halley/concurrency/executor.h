@@ -1,41 +1,138 @@
 #pragma once
 #include <deque>
+#include <array>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
 #include <atomic>
 #include <vector>
+#include <memory>
 #include "halley/text/halleystring.h"
+#include "task_function.h"
+#include "work_stealing_deque.h"
 
 namespace Halley
 {
-	using TaskBase = std::function<void()>;
+	using TaskBase = TaskFunction;
 
+	// Counts outstanding child tasks, so a parent can wait for them (see ExecutionQueue::wait)
+	class JoinCounter
+	{
+	public:
+		explicit JoinCounter(int n = 0) : count(n) {}
+
+		JoinCounter(const JoinCounter& other) = delete;
+		JoinCounter& operator=(const JoinCounter& other) = delete;
+
+		void add(int n = 1) { count.fetch_add(n, std::memory_order_relaxed); }
+		bool isDone() const { return count.load(std::memory_order_acquire) == 0; }
+
+		void done()
+		{
+			int c = count.load(std::memory_order_relaxed);
+			while (c > 1) {
+				if (count.compare_exchange_weak(c, c - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+					return;
+				}
+			}
+
+			// The last one finishes under the lock, so a waiter can't see zero and destroy the counter while it's still being notified
+			std::unique_lock<std::mutex> lock(mutex);
+			count.fetch_sub(1, std::memory_order_acq_rel);
+			condition.notify_all();
+		}
+
+		// Blocks until every child is done. Always call this before destroying a counter that's been waited on.
+		void waitUntilDone()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this] () { return isDone(); });
+		}
+
+	private:
+		std::atomic<int> count;
+		std::mutex mutex;
+		std::condition_variable condition;
+	};
+
+	// Work-stealing queue: each attached thread owns a lock-free deque, and takes from others when it runs out.
+	// Tasks queued from threads that don't belong to the queue go into a shared injection queue.
 	class ExecutionQueue
 	{
 	public:
 		ExecutionQueue();
-		void addToQueue(TaskBase task);
+		~ExecutionQueue();
+
+		ExecutionQueue(const ExecutionQueue& other) = delete;
+		ExecutionQueue& operator=(const ExecutionQueue& other) = delete;
+
+		// If a counter is given, it's incremented now and decremented once the task has run
+		void addToQueue(TaskBase task, JoinCounter* counter = nullptr);
 
 		TaskBase getNext();
 		std::vector<TaskBase> getAll();
 
+		// Blocks until a task is available (running it), or the queue is aborted. Returns false on abort.
+		bool runNext();
+
+		// Waits until the counter reaches zero. Threads belonging to this queue run its tasks in the meantime, so waiting doesn't idle a worker.
+		// Other threads (e.g. the main thread) only run the counter's own tasks which haven't been picked up yet, so they're never held up by unrelated work.
+		void wait(JoinCounter& counter);
+
+		// Gives up the calling thread's deque, so another thread can take it over
+		void releaseWorker();
+
 		size_t threadCount() const;
 		void onAttached();
 		void onDetached();
+
+		// Stops waiting threads. Tasks still queued, or queued afterwards, are dropped without running, and their counters are completed.
 		void abort();
 
 		static ExecutionQueue& getDefault();
 
 	private:
-		std::deque<TaskBase> queue;
+		struct Job
+		{
+			TaskBase task;
+			JoinCounter* counter = nullptr;
+		};
+
+		struct Worker
+		{
+			WorkStealingDeque<Job> deque;
+			bool owned = true;
+		};
+
+		struct JobCache;
+
+		constexpr static int maxWorkers = 64;
+
+		std::array<std::atomic<Worker*>, maxWorkers> workers;
+		std::atomic<int> nWorkers;
+
+		std::deque<Job> injected;
+		std::atomic<size_t> injectedCount;
 		std::mutex mutex;
 		std::condition_variable condition;
+		std::atomic<int> sleeping;
 
 		std::atomic<int> attachedCount;
-		std::atomic<bool> hasTasks;
 		std::atomic<bool> aborted;
+
+		Worker* getLocalWorker(bool registerIfNeeded);
+		Job* waitForJob();
+		Job* tryGetJob(Worker* local);
+		Job* tryTakeInjected();
+		Job* tryTakeInjected(const JoinCounter& counter);
+		void drop();
+		bool hasWork() const;
+		void runJob(Job* job);
+
+		static Job* allocJob();
+		static void freeJob(Job* job);
+		static JobCache& getJobCache();
 	};
 
 	class Executors
@@ -500,7 +500,8 @@ namespace Halley
 
 		auto task = Task<R>();
 		data->addContinuation([task, f, executor](typename TaskHelper<T>::DataType v) mutable {
-			task.setPayload(MovableFunction<R>(f, std::move(v)));
+			// Goes through FunctionHelper, so continuations of Future<void> take no arguments
+			task.setPayload(MovableFunction<R>([f] (typename TaskHelper<T>::DataType&& value) { return TaskHelper<T>::template FunctionHelper<F>::call(f, std::move(value)); }, std::move(v)));
 			task.enqueueOn(executor.get());
 		});
 		return task.getFuture();
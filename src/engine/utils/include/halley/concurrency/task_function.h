@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+namespace Halley
+{
+	// Move-only void() callable which stores small functors inline, so most tasks never touch the heap
+	class TaskFunction
+	{
+	public:
+		constexpr static size_t bufferSize = 64;
+
+		TaskFunction() {}
+
+		template <typename F, typename std::enable_if<!std::is_same<typename std::decay<F>::type, TaskFunction>::value, int>::type = 0>
+		TaskFunction(F&& f)
+		{
+			using T = typename std::decay<F>::type;
+			if (fitsInline<T>()) {
+				::new (&buffer) T(std::forward<F>(f));
+				vtable = &InlineOps<T>::vtable;
+			} else {
+				*reinterpret_cast<T**>(&buffer) = new T(std::forward<F>(f));
+				vtable = &HeapOps<T>::vtable;
+			}
+		}
+
+		TaskFunction(TaskFunction&& other) noexcept
+		{
+			moveFrom(other);
+		}
+
+		TaskFunction& operator=(TaskFunction&& other) noexcept
+		{
+			if (this != &other) {
+				reset();
+				moveFrom(other);
+			}
+			return *this;
+		}
+
+		TaskFunction(const TaskFunction& other) = delete;
+		TaskFunction& operator=(const TaskFunction& other) = delete;
+
+		~TaskFunction()
+		{
+			reset();
+		}
+
+		void operator()()
+		{
+			vtable->call(&buffer);
+		}
+
+		explicit operator bool() const
+		{
+			return vtable != nullptr;
+		}
+
+		void reset()
+		{
+			if (vtable) {
+				vtable->destroy(&buffer);
+				vtable = nullptr;
+			}
+		}
+
+	private:
+		struct VTable
+		{
+			void (*call)(void*);
+			void (*move)(void* dst, void* src);
+			void (*destroy)(void*);
+		};
+
+		template <typename T>
+		struct InlineOps
+		{
+			static void call(void* p) { (*static_cast<T*>(p))(); }
+			static void move(void* dst, void* src) { ::new (dst) T(std::move(*static_cast<T*>(src))); static_cast<T*>(src)->~T(); }
+			static void destroy(void* p) { static_cast<T*>(p)->~T(); }
+			constexpr static VTable vtable = { &call, &move, &destroy };
+		};
+
+		template <typename T>
+		struct HeapOps
+		{
+			static void call(void* p) { (**static_cast<T**>(p))(); }
+			static void move(void* dst, void* src) { *static_cast<T**>(dst) = *static_cast<T**>(src); }
+			static void destroy(void* p) { delete *static_cast<T**>(p); }
+			constexpr static VTable vtable = { &call, &move, &destroy };
+		};
+
+		template <typename T>
+		constexpr static bool fitsInline()
+		{
+			return sizeof(T) <= bufferSize && alignof(T) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<T>::value;
+		}
+
+		typename std::aligned_storage<bufferSize, alignof(std::max_align_t)>::type buffer;
+		const VTable* vtable = nullptr;
+
+		void moveFrom(TaskFunction& other)
+		{
+			vtable = other.vtable;
+			if (vtable) {
+				vtable->move(&buffer, &other.buffer);
+				other.vtable = nullptr;
+			}
+		}
+	};
+
+	template <typename T>
+	constexpr TaskFunction::VTable TaskFunction::InlineOps<T>::vtable;
+
+	template <typename T>
+	constexpr TaskFunction::VTable TaskFunction::HeapOps<T>::vtable;
+}
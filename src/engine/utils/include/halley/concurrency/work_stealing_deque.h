@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <gsl/gsl_assert>
+
+namespace Halley
+{
+	// Fixed-capacity Chase-Lev deque
+	// The owner thread pushes and pops at the bottom, any other thread may steal from the top
+	template <typename T>
+	class WorkStealingDeque
+	{
+	public:
+		explicit WorkStealingDeque(size_t capacity = 1024)
+			: mask(int64_t(capacity) - 1)
+			, slots(new std::atomic<T*>[capacity])
+		{
+			Expects(capacity > 0 && (capacity & (capacity - 1)) == 0);
+		}
+
+		WorkStealingDeque(const WorkStealingDeque& other) = delete;
+		WorkStealingDeque& operator=(const WorkStealingDeque& other) = delete;
+
+		// Owner only. Returns false if the deque is full.
+		bool push(T* value)
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed);
+			const int64_t t = top.load(std::memory_order_acquire);
+			if (b - t > mask) {
+				return false;
+			}
+			slots[b & mask].store(value, std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Owner only
+		T* pop()
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+
+			if (t > b) {
+				// Empty
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			T* value = slots[b & mask].load(std::memory_order_relaxed);
+			if (t == b) {
+				// Last element, race against thieves for it
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					value = nullptr;
+				}
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return value;
+		}
+
+		// Any thread
+		T* steal()
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = bottom.load(std::memory_order_acquire);
+
+			if (t < b) {
+				T* value = slots[t & mask].load(std::memory_order_acquire);
+				if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					return value;
+				}
+			}
+			return nullptr;
+		}
+
+		bool empty() const
+		{
+			return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+		}
+
+	private:
+		const int64_t mask;
+		std::unique_ptr<std::atomic<T*>[]> slots;
+		std::atomic<int64_t> top { 0 };
+		std::atomic<int64_t> bottom { 0 };
+	};
+}
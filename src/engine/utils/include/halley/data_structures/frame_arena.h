@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <type_traits>
+#include <gsl/gsl_assert>
+#include "vector.h"
+
+namespace Halley
+{
+	// Bump allocator for temporaries that don't outlive the current frame.
+	// Every thread has its own arena (see getLocal()), which is only allocated from while a Scope is open on it, and is rewound when the outermost one closes.
+	// World::step and each system update open one, so nothing allocated from it may be kept past them.
+	class FrameArena
+	{
+	public:
+		struct Stats
+		{
+			size_t used = 0; // Bytes used by each arena's last outermost scope, across all threads
+			size_t highWater = 0; // Sum of each arena's peak usage
+			size_t capacity = 0;
+			size_t nArenas = 0;
+		};
+
+		class Scope
+		{
+		public:
+			explicit Scope(FrameArena& arena = FrameArena::getLocal())
+				: arena(arena)
+			{
+				++arena.depth;
+			}
+
+			~Scope()
+			{
+				if (--arena.depth == 0) {
+					arena.reset();
+				}
+			}
+
+			Scope(const Scope& other) = delete;
+			Scope& operator=(const Scope& other) = delete;
+
+		private:
+			FrameArena& arena;
+		};
+
+		explicit FrameArena(size_t blockSize = 64 * 1024);
+		~FrameArena();
+
+		FrameArena(const FrameArena& other) = delete;
+		FrameArena& operator=(const FrameArena& other) = delete;
+
+		void* alloc(size_t size, size_t align)
+		{
+			Expects(depth > 0);
+
+			const size_t start = alignedPos(align);
+			if (start + size <= blockEnd) {
+				usedBytes += start + size - pos;
+				pos = start + size;
+				return blockData + start;
+			}
+			return allocSlow(size, align);
+		}
+
+		// Only gives memory back if it was the last allocation, which makes growing vectors cheap
+		void free(void* ptr, size_t size)
+		{
+			if (static_cast<char*>(ptr) + size == blockData + pos) {
+				pos -= size;
+				usedBytes -= size;
+			}
+		}
+
+		void reset();
+
+		size_t getUsed() const { return usedBytes; }
+		size_t getHighWater() const { return highWater.load(std::memory_order_relaxed); }
+		size_t getCapacity() const { return capacity.load(std::memory_order_relaxed); }
+
+		static FrameArena& getLocal();
+		static Stats getStats();
+
+	private:
+		struct Block
+		{
+			std::unique_ptr<char[]> data;
+			size_t size;
+		};
+
+		Vector<Block> blocks;
+		size_t curBlock = 0;
+		char* blockData = nullptr;
+		size_t pos = 0;
+		size_t blockEnd = 0;
+
+		const size_t blockSize;
+		size_t usedBytes = 0;
+		int depth = 0;
+
+		std::atomic<size_t> lastFrameUsed;
+		std::atomic<size_t> highWater;
+		std::atomic<size_t> capacity;
+
+		void* allocSlow(size_t size, size_t align);
+
+		size_t alignedPos(size_t align) const
+		{
+			// Aligns the address rather than the offset, as blocks only have new[]'s default alignment
+			const auto base = reinterpret_cast<uintptr_t>(blockData);
+			return size_t(((base + pos + align - 1) & ~uintptr_t(align - 1)) - base);
+		}
+		void useBlock(size_t idx);
+	};
+
+	// STL allocator on top of a FrameArena. Containers using it must stay on the thread that created them.
+	template <typename T>
+	class FrameAllocator
+	{
+	public:
+		using value_type = T;
+		using propagate_on_container_copy_assignment = std::true_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+
+		FrameAllocator() noexcept
+			: arena(&FrameArena::getLocal())
+		{}
+
+		explicit FrameAllocator(FrameArena& arena) noexcept
+			: arena(&arena)
+		{}
+
+		template <typename U>
+		FrameAllocator(const FrameAllocator<U>& other) noexcept
+			: arena(other.arena)
+		{}
+
+		T* allocate(size_t n)
+		{
+			return static_cast<T*>(arena->alloc(n * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T* ptr, size_t n) noexcept
+		{
+			arena->free(ptr, n * sizeof(T));
+		}
+
+		template <typename U>
+		bool operator==(const FrameAllocator<U>& other) const
+		{
+			return arena == other.arena;
+		}
+
+		template <typename U>
+		bool operator!=(const FrameAllocator<U>& other) const
+		{
+			return arena != other.arena;
+		}
+
+	private:
+		template <typename U>
+		friend class FrameAllocator;
+
+		FrameArena* arena;
+	};
+
+	template <typename T> using FrameVector = std::vector<T, FrameAllocator<T>>;
+}
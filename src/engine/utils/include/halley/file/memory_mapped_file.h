@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include <gsl/span>
+
+namespace Halley
+{
+	class Path;
+	class MemoryMappedFilePimpl;
+
+	// Read-only view of a whole file, which the OS pages in as it's accessed.
+	// Not every platform supports it; open() fails there, and the file should be read normally instead.
+	class MemoryMappedFile
+	{
+	public:
+		MemoryMappedFile();
+		MemoryMappedFile(const MemoryMappedFile& other) = delete;
+		~MemoryMappedFile();
+
+		MemoryMappedFile& operator=(const MemoryMappedFile& other) = delete;
+
+		bool open(const Path& path);
+		void close();
+		bool isOpen() const;
+
+		gsl::span<const gsl::byte> getSpan() const;
+
+		// Hints that the range will be needed soon, so the OS can start reading it in
+		void prefetch(size_t pos, size_t size) const;
+
+	private:
+		std::unique_ptr<MemoryMappedFilePimpl> pimpl;
+	};
+}
@@ -178,6 +178,7 @@ namespace Halley
 
 		static std::unique_ptr<ConfigFile> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::ConfigFile; }
+		constexpr static bool canLoadAsync() { return true; }
 
 		void reload(Resource&& resource) override;
 
@@ -88,6 +88,7 @@ namespace Halley {
 
 		static std::unique_ptr<Image> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::Image; }
+		constexpr static bool canLoadAsync() { return true; }
 		void reload(Resource&& resource) override;
 
 		Image& operator=(const Image& o) = delete;
@@ -1,8 +1,8 @@
 #pragma once
 
 #include "halley/text/halleystring.h"
+#include "halley/data_structures/vector.h"
 #include <memory>
-#include <map>
 
 namespace Halley
 {
@@ -10,34 +10,75 @@ namespace Halley
 	class Serializer;
 	class ResourceDataStatic;
 
+	// An interned metadata key, so lookups compare ids instead of strings.
+	// Constructing one from a string looks it up in a shared table; code which reads metadata often can keep its keys in statics.
+	class MetadataKey
+	{
+	public:
+		MetadataKey(const char* key);
+		MetadataKey(const std::string& key);
+		MetadataKey(const String& key);
+
+		uint32_t getId() const { return id; }
+		const String& getName() const;
+
+		bool operator==(const MetadataKey& other) const { return id == other.id; }
+		bool operator!=(const MetadataKey& other) const { return id != other.id; }
+
+	private:
+		uint32_t id;
+	};
+
+	enum class MetadataType : uint8_t
+	{
+		String,
+		Bool,
+		Int,
+		Float
+	};
+
+	// Values are stored with the type they were set with, so reading them back doesn't parse text.
+	// Reading a value as a different type converts it, the same way it would have been if it were stored as text.
 	class Metadata
 	{
 	public:
+		// Deserializers set to this version read the old format, where every value was text in a std::map<String, String>
+		constexpr static int legacyTextFormatVersion = -1;
+
 		Metadata();
 		Metadata(const Metadata& other) = default;
+		Metadata(Metadata&& other) noexcept = default;
 		~Metadata();
 
-		bool hasKey(String key) const;
-
-		bool getBool(String key) const;
-		int getInt(String key) const;
-		float getFloat(String key) const;
-		String getString(String key) const;
-
-		bool getBool(String key, bool defaultValue) const;
-		int getInt(String key, int defaultValue) const;
-		float getFloat(String key, float defaultValue) const;
-		String getString(String key, String defaultValue) const;
-
-		void set(String key, bool value);
-		void set(String key, int value);
-		void set(String key, float value);
-		void set(String key, const char* value);
-		void set(String key, const std::string& value);
-		void set(String key, const String& value);
-		
+		Metadata& operator=(const Metadata& other) = default;
+		Metadata& operator=(Metadata&& other) noexcept = default;
+
+		bool hasKey(MetadataKey key) const;
+		MetadataType getType(MetadataKey key) const;
+
+		bool getBool(MetadataKey key) const;
+		int getInt(MetadataKey key) const;
+		float getFloat(MetadataKey key) const;
+		String getString(MetadataKey key) const;
+
+		bool getBool(MetadataKey key, bool defaultValue) const;
+		int getInt(MetadataKey key, int defaultValue) const;
+		float getFloat(MetadataKey key, float defaultValue) const;
+		String getString(MetadataKey key, String defaultValue) const;
+
+		void set(MetadataKey key, bool value);
+		void set(MetadataKey key, int value);
+		void set(MetadataKey key, float value);
+		void set(MetadataKey key, const char* value);
+		void set(MetadataKey key, const std::string& value);
+		void set(MetadataKey key, const String& value);
+
+		// Stores text (e.g. from a .meta file) as a bool, int or float when that's what it holds, so it's parsed only once.
+		// Only text which would be written back the same way is converted, so getString() still returns exactly what was set.
+		void setParsed(MetadataKey key, const String& value);
+
 		static std::unique_ptr<Metadata> fromBinary(ResourceDataStatic& data);
-		
+
 		void serialize(Serializer& s) const;
 		void deserialize(Deserializer& s);
 
@@ -47,6 +88,30 @@ namespace Halley
 		String toString() const;
 
 	private:
-		std::map<String, String> entries;
+		struct Entry
+		{
+			uint32_t key;
+			MetadataType type;
+			union {
+				bool boolValue;
+				int intValue;
+				float floatValue;
+			};
+			String stringValue;
+
+			bool operator==(const Entry& other) const;
+			bool asBool() const;
+			int asInt() const;
+			float asFloat() const;
+			String asString() const;
+		};
+
+		Vector<Entry> entries; // Sorted by key id
+
+		const Entry* tryGet(MetadataKey key) const;
+		const Entry& get(MetadataKey key) const;
+		Entry& getOrAdd(MetadataKey key);
+		Vector<const Entry*> getEntriesByName() const;
+		void deserializeLegacy(Deserializer& s);
 	};
 }
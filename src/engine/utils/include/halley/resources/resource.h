@@ -6,6 +6,7 @@
 #include <condition_variable>
 #include "metadata.h"
 #include "halley/text/string_converter.h"
+#include "halley/data_structures/vector.h"
 
 namespace Halley
 {
@@ -73,16 +74,26 @@ namespace Halley
 	class ResourceObserver;
 	class Resources;
 
+	struct ResourceReference
+	{
+		AssetType type;
+		String name;
+	};
+
 	class Resource
 	{
 	public:
 		virtual ~Resource();
 
+		// Types whose loadResource() only decodes data, without calling the API or getting other resources (which can happen in onLoaded()), can be loaded on worker threads
+		constexpr static bool canLoadAsync() { return false; }
+
 		void setMeta(const Metadata& meta);
 		const Metadata& getMeta() const;
 		void setAssetId(const String& name);
 		const String& getAssetId() const;
 		virtual void onLoaded(Resources& resources);
+		virtual void getDependencies(Vector<ResourceReference>& dependencies) const; // Resources that onLoaded() will get
 		
 		int getAssetVersion() const;
 		void reloadResource(Resource&& resource);
@@ -127,10 +138,17 @@ namespace Halley
 		void waitForLoad() const;
 
 		bool isLoaded() const;
+		bool hasFailed() const;
+
+	protected:
+		// For resources whose loaders only hold weak references to them while loading (see ResourceLoader::getAsync(owner)).
+		// Anything still working on such a resource holds a strong reference, so by the time it's destroyed either its load is done, or it was abandoned and will never finish. It doesn't wait in its destructor.
+		void setLoadedThroughWeakReferences();
 
 	private:
 		std::atomic<bool> failed;
 		std::atomic<bool> loading;
+		bool loadedThroughWeakReferences = false;
 		mutable std::condition_variable loadWait;
 		mutable std::mutex loadMutex;
 	};
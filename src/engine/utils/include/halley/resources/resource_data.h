@@ -31,6 +31,7 @@ This file is subject to the terms of halley_license.txt.
 
 namespace Halley {
 	enum class AssetType;
+	class ICompressionCodec;
 
 	class ResourceDataReader {
 	public:
@@ -59,6 +60,7 @@ namespace Halley {
 	public:
 		ResourceDataStatic(String path);
 		ResourceDataStatic(const void* data, size_t size, String path, bool owning = true);
+		ResourceDataStatic(std::shared_ptr<const char> data, size_t size, String path); // e.g. a slice of a larger, shared buffer
 
 		void set(const void* data, size_t size, bool owning = true);
 		bool isLoaded() const;
@@ -67,7 +69,8 @@ namespace Halley {
 		gsl::span<const gsl::byte> getSpan() const;
 		size_t getSize() const;
 		String getString() const;
-		void inflate();
+		void inflate(); // Deflate
+		void inflate(const ICompressionCodec& codec);
 
 		static std::unique_ptr<ResourceDataStatic> loadFromFileSystem(Path path);
 		void writeToFileSystem(String path) const;
@@ -88,6 +91,14 @@ namespace Halley {
 		ResourceDataMakeReader make;
 	};
 
+	// Where an asset's bytes are stored. Only locations with the same source can be read together.
+	struct ResourceDataLocation
+	{
+		const void* source = nullptr;
+		size_t pos = 0;
+		size_t size = 0;
+	};
+
 	class IResourceLocator
 	{
 	public:
@@ -95,6 +106,10 @@ namespace Halley {
 		virtual const Metadata& getMetaData(const String& resource, AssetType type) const = 0;
 		virtual std::unique_ptr<ResourceDataStatic> getStatic(const String& asset, AssetType type) = 0;
 		virtual std::unique_ptr<ResourceDataStream> getStream(const String& asset, AssetType type) = 0;
+
+		// Optional. Locators that can report where assets are, and read any range of their source, let the IO queue merge reads of neighbouring assets.
+		virtual bool getLocation(const String& asset, AssetType type, ResourceDataLocation& location) { return false; }
+		virtual void readLocation(const ResourceDataLocation& location, gsl::span<gsl::byte> dst);
 	};
 
 
@@ -106,6 +121,7 @@ namespace Halley {
 
 	class HalleyAPI;
 	class Metadata;
+	class Resource;
 
 	class ResourceLoader
 	{
@@ -117,9 +133,15 @@ namespace Halley {
 		const HalleyAPI& getAPI() const { return *api; }
 		const Metadata& getMeta() const { return *metadata; }
 
+		// Both decompress the asset if its "asset_compression" metadata says it's compressed; streams are decompressed as they're read.
 		std::unique_ptr<ResourceDataStatic> getStatic();
 		std::unique_ptr<ResourceDataStream> getStream();
+
+		// Reads on the disk IO thread, ahead of anything queued with a lower priority.
+		// If an owner is given, the read is skipped if it's gone by the time it would happen; so is it if the future is cancelled.
+		// The result is null if the read fails.
 		Future<std::unique_ptr<ResourceDataStatic>> getAsync() const;
+		Future<std::unique_ptr<ResourceDataStatic>> getAsync(std::weak_ptr<const Resource> owner) const;
 
 	private:
 		ResourceLoader(ResourceLoader&& loader) noexcept;
@@ -133,6 +155,9 @@ namespace Halley {
 		const HalleyAPI* api;
 		const Metadata* metadata;
 		bool loaded = false;
+		std::unique_ptr<ResourceDataStatic> prefetched;
+
+		const ICompressionCodec* getCodec() const;
 	};
 
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "utils.h"
+#include <gsl/gsl>
 
 namespace Halley {
 	class String;
@@ -9,5 +10,14 @@ namespace Halley {
 	public:
 		static Bytes encrypt(const Bytes& iv, const String& key, const Bytes& data);
 		static Bytes decrypt(const Bytes& iv, const String& key, const Bytes& data);
+
+		// AES-CBC in place, without padding, so data must be a multiple of 16 bytes long.
+		// A buffer can be split anywhere on a 16 byte boundary and each piece processed separately (e.g. in parallel), as long as each gets the right IV.
+		static void encryptInPlace(gsl::span<const gsl::byte> iv, const String& key, gsl::span<gsl::byte> data);
+		static void decryptInPlace(gsl::span<const gsl::byte> iv, const String& key, gsl::span<gsl::byte> data);
+
+		// PKCS7, as used by encrypt() and decrypt()
+		static void addPadding(Bytes& data);
+		static void removePadding(Bytes& data);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,400 @@
+#include "chunked_lz4_codec.h"
+#include "halley/support/exception.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+using namespace Halley;
+
+namespace {
+	constexpr size_t minMatch = 4;
+	constexpr size_t lastLiterals = 5; // The last 5 bytes of a block are always literals...
+	constexpr size_t matchFindLimit = 12; // ...and the last match starts at least 12 bytes before its end
+	constexpr size_t maxOffset = 65535;
+	constexpr int hashLog = 14;
+	constexpr size_t headerSize = sizeof(uint64_t) + sizeof(uint32_t);
+
+	uint32_t read32(const uint8_t* p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	uint32_t hashSequence(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - hashLog);
+	}
+
+	uint8_t* writeLength(uint8_t* op, size_t length)
+	{
+		while (length >= 255) {
+			*op++ = 255;
+			length -= 255;
+		}
+		*op++ = uint8_t(length);
+		return op;
+	}
+
+	uint8_t* writeLiterals(uint8_t* op, uint8_t* token, const uint8_t* literals, size_t numLiterals)
+	{
+		*token = uint8_t(std::min(numLiterals, size_t(15)) << 4);
+		if (numLiterals >= 15) {
+			op = writeLength(op, numLiterals - 15);
+		}
+		memcpy(op, literals, numLiterals);
+		return op + numLiterals;
+	}
+
+	uint8_t* writeSequence(uint8_t* op, const uint8_t* literals, size_t numLiterals, size_t offset, size_t matchLength)
+	{
+		const auto token = op++;
+		op = writeLiterals(op, token, literals, numLiterals);
+
+		*op++ = uint8_t(offset);
+		*op++ = uint8_t(offset >> 8);
+
+		const size_t length = matchLength - minMatch;
+		*token |= uint8_t(std::min(length, size_t(15)));
+		if (length >= 15) {
+			op = writeLength(op, length - 15);
+		}
+		return op;
+	}
+
+	size_t readLength(const uint8_t*& ip, const uint8_t* end)
+	{
+		size_t length = 0;
+		uint8_t b;
+		do {
+			if (ip == end) {
+				throw Exception("Corrupt LZ4 block.", HalleyExceptions::Compression);
+			}
+			b = *ip++;
+			length += b;
+		} while (b == 255);
+		return length;
+	}
+
+	bool readExactly(ICompressionDecoder::Source& source, gsl::span<gsl::byte> dst)
+	{
+		while (dst.size() > 0) {
+			const size_t n = source(dst);
+			if (n == 0) {
+				return false;
+			}
+			dst = dst.subspan(n);
+		}
+		return true;
+	}
+
+	class ChunkedLZ4Decoder : public ICompressionDecoder {
+	public:
+		explicit ChunkedLZ4Decoder(Source source)
+			: source(std::move(source))
+		{
+			std::array<gsl::byte, headerSize> header;
+			if (!readExactly(this->source, header)) {
+				throw Exception("Chunked LZ4 stream is too short.", HalleyExceptions::Compression);
+			}
+			memcpy(&size, header.data(), sizeof(size));
+			memcpy(&chunkSize, header.data() + sizeof(size), sizeof(chunkSize));
+			if (chunkSize == 0 && size > 0) {
+				throw Exception("Corrupt chunked LZ4 stream.", HalleyExceptions::Compression);
+			}
+		}
+
+		size_t getDecompressedSize() const override
+		{
+			return size_t(size);
+		}
+
+		size_t read(gsl::span<gsl::byte> dst) override
+		{
+			size_t written = 0;
+			while (written < size_t(dst.size())) {
+				if (chunkPos == chunk.size()) {
+					const size_t next = getNextChunkSize();
+					if (next == 0) {
+						break;
+					}
+					if (size_t(dst.size()) - written >= next) {
+						// Room for all of it, so skip the chunk buffer
+						readChunk(dst.subspan(written, next));
+						written += next;
+						continue;
+					}
+					chunk.resize(next);
+					chunkPos = 0;
+					readChunk(gsl::as_writeable_bytes(gsl::span<Byte>(chunk)));
+				}
+
+				const size_t n = std::min(chunk.size() - chunkPos, size_t(dst.size()) - written);
+				memcpy(dst.data() + written, chunk.data() + chunkPos, n);
+				chunkPos += n;
+				written += n;
+			}
+			return written;
+		}
+
+	private:
+		Source source;
+		uint64_t size = 0;
+		uint32_t chunkSize = 0;
+		uint64_t decoded = 0;
+		Bytes chunk;
+		size_t chunkPos = 0;
+		Bytes compressed;
+
+		size_t getNextChunkSize() const
+		{
+			return size_t(std::min(uint64_t(chunkSize), size - decoded));
+		}
+
+		void readChunk(gsl::span<gsl::byte> dst)
+		{
+			uint32_t blockHeader;
+			if (!readExactly(source, gsl::as_writeable_bytes(gsl::span<uint32_t>(&blockHeader, 1)))) {
+				throw Exception("Chunked LZ4 stream ended unexpectedly.", HalleyExceptions::Compression);
+			}
+
+			const size_t blockSize = blockHeader & ~ChunkedLZ4Codec::storedFlag;
+			if ((blockHeader & ChunkedLZ4Codec::storedFlag) != 0) {
+				if (blockSize != size_t(dst.size()) || !readExactly(source, dst)) {
+					throw Exception("Corrupt chunked LZ4 stream.", HalleyExceptions::Compression);
+				}
+			} else {
+				if (blockSize > ChunkedLZ4Codec::getMaxCompressedBlockSize(chunkSize)) {
+					throw Exception("Corrupt chunked LZ4 stream.", HalleyExceptions::Compression);
+				}
+				compressed.resize(blockSize);
+				auto compressedSpan = gsl::as_writeable_bytes(gsl::span<Byte>(compressed));
+				if (!readExactly(source, compressedSpan)) {
+					throw Exception("Chunked LZ4 stream ended unexpectedly.", HalleyExceptions::Compression);
+				}
+				ChunkedLZ4Codec::decompressBlock(compressedSpan, dst);
+			}
+			decoded += uint64_t(dst.size());
+		}
+	};
+}
+
+String ChunkedLZ4Codec::getName() const
+{
+	return "lz4-chunked";
+}
+
+Bytes ChunkedLZ4Codec::compress(gsl::span<const gsl::byte> src) const
+{
+	const uint64_t size = uint64_t(src.size());
+	const uint32_t chunkSize = uint32_t(defaultChunkSize);
+
+	Bytes result(headerSize);
+	memcpy(result.data(), &size, sizeof(size));
+	memcpy(result.data() + sizeof(size), &chunkSize, sizeof(chunkSize));
+
+	for (size_t pos = 0; pos < size_t(size); pos += chunkSize) {
+		const auto chunk = src.subspan(pos, std::min(size_t(chunkSize), size_t(size) - pos));
+		const size_t chunkLen = size_t(chunk.size());
+		const size_t blockPos = result.size();
+		result.resize(blockPos + sizeof(uint32_t) + getMaxCompressedBlockSize(chunkLen));
+		auto dst = gsl::as_writeable_bytes(gsl::span<Byte>(result)).subspan(blockPos + sizeof(uint32_t));
+
+		size_t blockSize = compressBlock(chunk, dst);
+		uint32_t blockHeader = uint32_t(blockSize);
+		if (blockSize >= chunkLen) {
+			memcpy(dst.data(), chunk.data(), chunkLen);
+			blockSize = chunkLen;
+			blockHeader = uint32_t(chunkLen) | storedFlag;
+		}
+		memcpy(result.data() + blockPos, &blockHeader, sizeof(blockHeader));
+		result.resize(blockPos + sizeof(uint32_t) + blockSize);
+	}
+
+	return result;
+}
+
+void ChunkedLZ4Codec::decompress(gsl::span<const gsl::byte> src, gsl::span<gsl::byte> dst) const
+{
+	if (size_t(src.size()) < headerSize) {
+		throw Exception("Chunked LZ4 data is too short.", HalleyExceptions::Compression);
+	}
+	uint64_t size;
+	uint32_t chunkSize;
+	memcpy(&size, src.data(), sizeof(size));
+	memcpy(&chunkSize, src.data() + sizeof(size), sizeof(chunkSize));
+	if (size != uint64_t(dst.size()) || (chunkSize == 0 && size > 0)) {
+		throw Exception("Unexpected size when decompressing chunked LZ4 data.", HalleyExceptions::Compression);
+	}
+
+	size_t ip = headerSize;
+	for (size_t pos = 0; pos < size_t(size); pos += chunkSize) {
+		const size_t chunkLen = std::min(size_t(chunkSize), size_t(size) - pos);
+		uint32_t blockHeader;
+		if (size_t(src.size()) - ip < sizeof(blockHeader)) {
+			throw Exception("Corrupt chunked LZ4 data.", HalleyExceptions::Compression);
+		}
+		memcpy(&blockHeader, src.data() + ip, sizeof(blockHeader));
+		ip += sizeof(blockHeader);
+
+		const size_t blockSize = blockHeader & ~storedFlag;
+		if (size_t(src.size()) - ip < blockSize) {
+			throw Exception("Corrupt chunked LZ4 data.", HalleyExceptions::Compression);
+		}
+		if ((blockHeader & storedFlag) != 0) {
+			if (blockSize != chunkLen) {
+				throw Exception("Corrupt chunked LZ4 data.", HalleyExceptions::Compression);
+			}
+			memcpy(dst.data() + pos, src.data() + ip, chunkLen);
+		} else {
+			decompressBlock(src.subspan(ip, blockSize), dst.subspan(pos, chunkLen));
+		}
+		ip += blockSize;
+	}
+}
+
+std::unique_ptr<ICompressionDecoder> ChunkedLZ4Codec::makeDecoder(ICompressionDecoder::Source source) const
+{
+	return std::make_unique<ChunkedLZ4Decoder>(std::move(source));
+}
+
+size_t ChunkedLZ4Codec::getMaxCompressedBlockSize(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t ChunkedLZ4Codec::compressBlock(gsl::span<const gsl::byte> srcSpan, gsl::span<gsl::byte> dstSpan)
+{
+	const size_t n = size_t(srcSpan.size());
+	Expects(size_t(dstSpan.size()) >= getMaxCompressedBlockSize(n));
+
+	const auto src = reinterpret_cast<const uint8_t*>(srcSpan.data());
+	const auto dst = reinterpret_cast<uint8_t*>(dstSpan.data());
+	auto op = dst;
+	size_t anchor = 0;
+
+	if (n > matchFindLimit) {
+		// Greedy, with a single candidate per hash; positions of 0 are indistinguishable from empty slots, but every candidate is checked anyway
+		std::vector<uint32_t> table(size_t(1) << hashLog, 0);
+		const size_t matchLimit = n - lastLiterals;
+		const size_t ipLimit = n - matchFindLimit;
+
+		size_t ip = 1;
+		while (ip <= ipLimit) {
+			const uint32_t sequence = read32(src + ip);
+			auto& slot = table[hashSequence(sequence)];
+			const size_t ref = slot;
+			slot = uint32_t(ip);
+
+			if (ip - ref > maxOffset || read32(src + ref) != sequence) {
+				// Step further the longer it's been since the last match, so incompressible data goes by quickly
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+
+			size_t start = ip;
+			size_t startRef = ref;
+			while (start > anchor && startRef > 0 && src[start - 1] == src[startRef - 1]) {
+				--start;
+				--startRef;
+			}
+			size_t end = ip + minMatch;
+			while (end < matchLimit && src[end] == src[ref + (end - ip)]) {
+				++end;
+			}
+
+			op = writeSequence(op, src + anchor, start - anchor, start - startRef, end - start);
+			anchor = ip = end;
+			if (ip <= ipLimit) {
+				table[hashSequence(read32(src + ip - 2))] = uint32_t(ip - 2);
+			}
+		}
+	}
+
+	const auto token = op++;
+	op = writeLiterals(op, token, src + anchor, n - anchor);
+	return size_t(op - dst);
+}
+
+void ChunkedLZ4Codec::decompressBlock(gsl::span<const gsl::byte> srcSpan, gsl::span<gsl::byte> dstSpan)
+{
+	auto ip = reinterpret_cast<const uint8_t*>(srcSpan.data());
+	const auto ipEnd = ip + srcSpan.size();
+	const auto opStart = reinterpret_cast<uint8_t*>(dstSpan.data());
+	const auto opEnd = opStart + dstSpan.size();
+	auto op = opStart;
+
+	while (true) {
+		if (ip == ipEnd) {
+			throw Exception("Corrupt LZ4 block.", HalleyExceptions::Compression);
+		}
+		const unsigned token = *ip++;
+
+		size_t numLiterals = token >> 4;
+		if (numLiterals == 15) {
+			numLiterals += readLength(ip, ipEnd);
+		}
+		if (size_t(ipEnd - ip) < numLiterals || size_t(opEnd - op) < numLiterals) {
+			throw Exception("Corrupt LZ4 block.", HalleyExceptions::Compression);
+		}
+		if (numLiterals <= 16 && ipEnd - ip >= 16 && opEnd - op >= 16) {
+			// Most literal runs are short; a fixed size copy is much cheaper, and whatever it writes past the run gets overwritten
+			memcpy(op, ip, 16);
+		} else {
+			memcpy(op, ip, numLiterals);
+		}
+		op += numLiterals;
+		ip += numLiterals;
+
+		if (ip == ipEnd) {
+			// Blocks end with literals
+			break;
+		}
+
+		if (ipEnd - ip < 2) {
+			throw Exception("Corrupt LZ4 block.", HalleyExceptions::Compression);
+		}
+		const size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+		ip += 2;
+		size_t matchLength = token & 15;
+		if (matchLength == 15) {
+			matchLength += readLength(ip, ipEnd);
+		}
+		matchLength += minMatch;
+		if (offset == 0 || offset > size_t(op - opStart) || size_t(opEnd - op) < matchLength) {
+			throw Exception("Corrupt LZ4 block.", HalleyExceptions::Compression);
+		}
+
+		// Matches may overlap what they're writing, which repeats the pattern
+		const uint8_t* match = op - offset;
+		if (offset >= 8 && size_t(opEnd - op) >= matchLength + 8) {
+			// Copying 8 bytes at a time is fine even if the match overlaps, as each copy only reads what's already been written
+			const auto matchEnd = op + matchLength;
+			do {
+				memcpy(op, match, 8);
+				op += 8;
+				match += 8;
+			} while (op < matchEnd);
+			op = matchEnd;
+		} else if (offset >= matchLength) {
+			memcpy(op, match, matchLength);
+			op += matchLength;
+		} else {
+			if (offset >= 8) {
+				for (; matchLength >= 8; matchLength -= 8) {
+					memcpy(op, match, 8);
+					op += 8;
+					match += 8;
+				}
+			}
+			for (; matchLength > 0; --matchLength) {
+				*op++ = *match++;
+			}
+		}
+	}
+
+	if (op != opEnd) {
+		throw Exception("Unexpected size when decompressing LZ4 block.", HalleyExceptions::Compression);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "halley/bytes/compression.h"
+
+namespace Halley {
+	// Blocks in the LZ4 block format, split into independent chunks so streams can be decoded a chunk at a time.
+	// The container is Halley's own, not the standard LZ4 frame format, so other LZ4 tools can't read it; hence the name "lz4-chunked".
+	// Layout: uint64_t decompressed size, uint32_t chunk size, then one block per chunk, each starting with its uint32_t compressed size.
+	// Blocks which didn't compress are stored as they are, with storedFlag set in their size.
+	class ChunkedLZ4Codec : public ICompressionCodec {
+	public:
+		constexpr static size_t defaultChunkSize = 64 * 1024;
+		constexpr static uint32_t storedFlag = 0x80000000;
+
+		String getName() const override;
+		Bytes compress(gsl::span<const gsl::byte> src) const override;
+		void decompress(gsl::span<const gsl::byte> src, gsl::span<gsl::byte> dst) const override;
+		std::unique_ptr<ICompressionDecoder> makeDecoder(ICompressionDecoder::Source source) const override;
+
+		static size_t getMaxCompressedBlockSize(size_t size);
+		static size_t compressBlock(gsl::span<const gsl::byte> src, gsl::span<gsl::byte> dst);
+		static void decompressBlock(gsl::span<const gsl::byte> src, gsl::span<gsl::byte> dst);
+	};
+}
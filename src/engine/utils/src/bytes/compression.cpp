@@ -1,10 +1,14 @@
+#include <algorithm>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 #include "halley/bytes/compression.h"
 //#include "../../contrib/lodepng/lodepng.h"
 #include "../../contrib/zlib/zlib.h"
+#include "halley/data_structures/hash_map.h"
 #include "halley/support/exception.h"
 #include "halley/text/string_converter.h"
+#include "chunked_lz4_codec.h"
 
 using namespace Halley;
 
@@ -18,6 +22,161 @@ static void zlibFree(voidpf opaque, voidpf address)
 	free(address);
 }
 
+static void inflateInto(gsl::span<const gsl::byte> bytes, gsl::span<gsl::byte> dst)
+{
+	z_stream stream;
+	stream.zalloc = &zlibAlloc;
+	stream.zfree = &zlibFree;
+	stream.opaque = nullptr;
+	stream.avail_in = 0;
+	stream.next_in = nullptr;
+	int ret = inflateInit(&stream);
+	if (ret != Z_OK) {
+		throw Exception("Unable to initialise zlib", HalleyExceptions::Compression);
+	}
+	stream.avail_in = uInt(bytes.size_bytes());
+	stream.next_in = reinterpret_cast<unsigned char*>(const_cast<gsl::byte*>(bytes.data()));
+	unsigned char empty = 0; // zlib won't take a null output pointer, even with no room
+	stream.avail_out = uInt(dst.size_bytes());
+	stream.next_out = dst.empty() ? &empty : reinterpret_cast<unsigned char*>(dst.data());
+
+	const int res = inflate(&stream, Z_FINISH);
+	const size_t totalOut = size_t(stream.total_out);
+	inflateEnd(&stream);
+
+	if (res != Z_STREAM_END) {
+		throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
+	}
+	if (totalOut != size_t(dst.size_bytes())) {
+		throw Exception("Unexpected outsize (" + toString(totalOut) + ") when inflating data, expected (" + toString(dst.size_bytes()) + ").", HalleyExceptions::Compression);
+	}
+}
+
+namespace {
+	class DeflateDecoder : public ICompressionDecoder {
+	public:
+		explicit DeflateDecoder(Source src)
+			: source(std::move(src))
+			, inBuffer(64 * 1024)
+		{
+			auto header = gsl::as_writeable_bytes(gsl::span<uint64_t>(&size, 1));
+			while (header.size() > 0) {
+				const size_t n = source(header);
+				if (n == 0) {
+					throw Exception("Deflate stream is too short.", HalleyExceptions::Compression);
+				}
+				header = header.subspan(n);
+			}
+
+			stream.zalloc = &zlibAlloc;
+			stream.zfree = &zlibFree;
+			stream.opaque = nullptr;
+			stream.avail_in = 0;
+			stream.next_in = nullptr;
+			if (inflateInit(&stream) != Z_OK) {
+				throw Exception("Unable to initialise zlib", HalleyExceptions::Compression);
+			}
+		}
+
+		~DeflateDecoder()
+		{
+			inflateEnd(&stream);
+		}
+
+		size_t getDecompressedSize() const override
+		{
+			return size_t(size);
+		}
+
+		size_t read(gsl::span<gsl::byte> dst) override
+		{
+			stream.avail_out = uInt(dst.size_bytes());
+			stream.next_out = reinterpret_cast<unsigned char*>(dst.data());
+
+			while (stream.avail_out > 0 && !finished) {
+				bool inputEnded = false;
+				if (stream.avail_in == 0) {
+					const size_t n = source(gsl::as_writeable_bytes(gsl::span<Byte>(inBuffer)));
+					stream.avail_in = uInt(n);
+					stream.next_in = inBuffer.data();
+					inputEnded = n == 0;
+				}
+
+				const int res = inflate(&stream, Z_NO_FLUSH);
+				if (res == Z_STREAM_END) {
+					finished = true;
+				} else if (res != Z_OK && !(res == Z_BUF_ERROR && !inputEnded)) {
+					throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
+				}
+			}
+
+			return size_t(dst.size_bytes()) - size_t(stream.avail_out);
+		}
+
+	private:
+		Source source;
+		Bytes inBuffer;
+		z_stream stream;
+		uint64_t size = 0;
+		bool finished = false;
+	};
+
+	class DeflateCodec : public ICompressionCodec {
+	public:
+		String getName() const override
+		{
+			return "deflate";
+		}
+
+		Bytes compress(gsl::span<const gsl::byte> src) const override
+		{
+			return Compression::compress(src);
+		}
+
+		void decompress(gsl::span<const gsl::byte> src, gsl::span<gsl::byte> dst) const override
+		{
+			if (getDecompressedSize(src) != size_t(dst.size())) {
+				throw Exception("Unexpected size when inflating data.", HalleyExceptions::Compression);
+			}
+			inflateInto(src.subspan(sizeof(uint64_t)), dst);
+		}
+
+		std::unique_ptr<ICompressionDecoder> makeDecoder(ICompressionDecoder::Source source) const override
+		{
+			return std::make_unique<DeflateDecoder>(std::move(source));
+		}
+	};
+
+	struct CodecRegistry
+	{
+		std::mutex mutex;
+		HashMap<String, std::unique_ptr<ICompressionCodec>> codecs;
+
+		CodecRegistry()
+		{
+			for (auto codec: { static_cast<ICompressionCodec*>(new DeflateCodec()), static_cast<ICompressionCodec*>(new ChunkedLZ4Codec()) }) {
+				codecs[codec->getName()] = std::unique_ptr<ICompressionCodec>(codec);
+			}
+		}
+
+		static CodecRegistry& get()
+		{
+			static CodecRegistry registry;
+			return registry;
+		}
+	};
+}
+
+size_t ICompressionCodec::getDecompressedSize(gsl::span<const gsl::byte> src) const
+{
+	if (src.size_bytes() < 8) {
+		throw Exception("Compressed data is too short.", HalleyExceptions::Compression);
+	}
+	uint64_t size;
+	memcpy(&size, src.data(), sizeof(size));
+	return size_t(size);
+}
+
 Bytes Compression::compress(const Bytes& bytes)
 {
 	return compress(gsl::as_bytes(gsl::span<const Byte>(bytes)));
@@ -50,12 +209,20 @@ static void deleter(const char* data)
 
 std::shared_ptr<const char> Compression::decompressToSharedPtr(gsl::span<const gsl::byte> bytes, size_t& size, size_t maxSize)
 {
-	auto out = decompress(bytes, maxSize);
-	
-	size = out.size();
-	auto rawResult = new char[out.size()];
-	memcpy(rawResult, out.data(), out.size());
-	auto result = std::shared_ptr<const char>(rawResult, deleter);
+	return decompressToSharedPtr(*getCodec("deflate"), bytes, size, maxSize);
+}
+
+std::shared_ptr<const char> Compression::decompressToSharedPtr(const ICompressionCodec& codec, gsl::span<const gsl::byte> bytes, size_t& size, size_t maxSize)
+{
+	const size_t outSize = codec.getDecompressedSize(bytes);
+	if (outSize > maxSize) {
+		throw Exception("File is too big to decompress: " + String::prettySize(outSize), HalleyExceptions::Compression);
+	}
+
+	// Decompress straight into the buffer that will be handed out
+	auto result = std::shared_ptr<const char>(new char[outSize], deleter);
+	codec.decompress(bytes, gsl::span<gsl::byte>(reinterpret_cast<gsl::byte*>(const_cast<char*>(result.get())), outSize));
+	size = outSize;
 	return result;
 }
 
@@ -65,11 +232,6 @@ Bytes Compression::compressRaw(gsl::span<const gsl::byte> bytes, bool insertLeng
 
 	const uint64_t inSize = bytes.size_bytes();
 	const size_t headerSize = insertLength ? 8 : 0;
-	Bytes result(size_t(inSize) + headerSize + 16); // Header size, plus 16 bytes for headroom, should be enough for any compression
-
-	if (insertLength) {
-		memcpy(result.data(), &inSize, 8);
-	}
 
 	z_stream stream;
 	stream.zalloc = &zlibAlloc;
@@ -80,6 +242,12 @@ Bytes Compression::compressRaw(gsl::span<const gsl::byte> bytes, bool insertLeng
 		throw Exception("Unable to initialize zlib compression", HalleyExceptions::Compression);
 	}
 
+	// Incompressible data grows by a few bytes per stored block, so a fixed headroom isn't enough for large inputs
+	Bytes result(headerSize + size_t(deflateBound(&stream, uLong(inSize))));
+	if (insertLength) {
+		memcpy(result.data(), &inSize, 8);
+	}
+
 	stream.avail_in = uInt(bytes.size_bytes());
 	stream.next_in = reinterpret_cast<unsigned char*>(const_cast<gsl::byte*>(bytes.data()));
 	stream.avail_out = uInt(result.size() - headerSize);
@@ -106,6 +274,12 @@ Bytes Compression::decompressRaw(gsl::span<const gsl::byte> bytes, size_t maxSiz
 	if (expectedSize > uint64_t(maxSize)) {
 		throw Exception("File is too big to inflate: " + String::prettySize(expectedSize), HalleyExceptions::Compression);
 	}
+
+	if (expectedSize > 0) {
+		Bytes result(expectedSize);
+		inflateInto(bytes, gsl::as_writeable_bytes(gsl::span<Byte>(result)));
+		return result;
+	}
 	
 	z_stream stream;
 	stream.zalloc = &zlibAlloc;
@@ -120,51 +294,65 @@ Bytes Compression::decompressRaw(gsl::span<const gsl::byte> bytes, size_t maxSiz
 	stream.avail_in = uInt(bytes.size_bytes());
 	stream.next_in = reinterpret_cast<unsigned char*>(const_cast<gsl::byte*>(bytes.data()));
 
-	if (expectedSize > 0) {
-		Bytes result(expectedSize);
-		stream.avail_out = uInt(result.size());
-		stream.next_out = result.data();
-		
-		const int res = inflate(&stream, Z_NO_FLUSH);
-		const size_t totalOut = size_t(stream.total_out);
-		inflateEnd(&stream);
-
-		if (res != Z_STREAM_END) {
-			throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
-		}
-		if (totalOut != expectedSize) {
-			throw Exception("Unexpected outsize (" + toString(result.size()) + ") when inflating data, expected (" + toString(expectedSize) + ").", HalleyExceptions::Compression);
-		}
+	constexpr size_t blockSize = 256 * 1024;
+	Bytes result(std::min(blockSize, maxSize));
 
-		return result;
-	} else {
-		constexpr size_t blockSize = 256 * 1024;
-		Bytes result(std::min(blockSize, maxSize));
-
-		int res = 0;
-		do {
-			// Expand if needed
-			if (result.size() - size_t(stream.total_out) < blockSize / 2) {
-				if (result.size() >= maxSize) {
-					inflateEnd(&stream);
-					throw Exception("Unable to inflate stream, maximum size has been exceeded.", HalleyExceptions::Compression);
-				}
-				auto newSize = std::min(result.size() + blockSize, maxSize);
-				result.resize(newSize);
+	int res = 0;
+	do {
+		// Expand if needed
+		if (result.size() - size_t(stream.total_out) < blockSize / 2) {
+			if (result.size() >= maxSize) {
+				inflateEnd(&stream);
+				throw Exception("Unable to inflate stream, maximum size has been exceeded.", HalleyExceptions::Compression);
 			}
-			stream.avail_out = uInt(result.size()) - stream.total_out;
-			stream.next_out = result.data() + size_t(stream.total_out);
-			res = inflate(&stream, Z_NO_FLUSH);
-		} while (res == Z_OK);
+			auto newSize = std::min(result.size() + blockSize, maxSize);
+			result.resize(newSize);
+		}
+		stream.avail_out = uInt(result.size()) - stream.total_out;
+		stream.next_out = result.data() + size_t(stream.total_out);
+		res = inflate(&stream, Z_NO_FLUSH);
+	} while (res == Z_OK);
 
-		const size_t totalOut = size_t(stream.total_out);
-		inflateEnd(&stream);
+	const size_t totalOut = size_t(stream.total_out);
+	inflateEnd(&stream);
 
-		if (res != Z_STREAM_END) {
-			throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
-		}
-		result.resize(totalOut);
+	if (res != Z_STREAM_END) {
+		throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
+	}
+	result.resize(totalOut);
 
-		return result;
+	return result;
+}
+
+void Compression::addCodec(std::unique_ptr<ICompressionCodec> codec)
+{
+	auto& registry = CodecRegistry::get();
+	std::unique_lock<std::mutex> lock(registry.mutex);
+
+	// Codecs are never replaced, as getCodec() hands out plain pointers to them
+	const auto name = codec->getName();
+	if (registry.codecs.find(name) != registry.codecs.end()) {
+		throw Exception("Compression codec \"" + name + "\" already exists.", HalleyExceptions::Compression);
+	}
+	registry.codecs[name] = std::move(codec);
+}
+
+const ICompressionCodec* Compression::getCodec(const String& name)
+{
+	auto& registry = CodecRegistry::get();
+	std::unique_lock<std::mutex> lock(registry.mutex);
+	const auto iter = registry.codecs.find(name);
+	return iter != registry.codecs.end() ? iter->second.get() : nullptr;
+}
+
+Vector<String> Compression::getCodecNames()
+{
+	auto& registry = CodecRegistry::get();
+	std::unique_lock<std::mutex> lock(registry.mutex);
+	Vector<String> result;
+	for (auto& c: registry.codecs) {
+		result.push_back(c.first);
 	}
+	std::sort(result.begin(), result.end());
+	return result;
 }
@@ -3,55 +3,364 @@
 #include <halley/support/exception.h>
 #include "halley/text/string_converter.h"
 #include "halley/support/logger.h"
+#include <algorithm>
 
 using namespace Halley;
 
 Executors* Executors::instance = nullptr;
 
+namespace {
+	struct LocalWorker
+	{
+		const ExecutionQueue* queue = nullptr;
+		void* worker = nullptr;
+		unsigned stealStart = 0;
+	};
+
+	thread_local LocalWorker localWorker;
+
+	constexpr size_t maxCachedJobs = 1024;
+}
+
+struct ExecutionQueue::JobCache
+{
+	std::vector<Job*> jobs;
+
+	~JobCache()
+	{
+		for (auto& j: jobs) {
+			delete j;
+		}
+	}
+};
+
 ExecutionQueue::ExecutionQueue()
-	: aborted(false)
+	: nWorkers(0)
+	, injectedCount(0)
+	, sleeping(0)
+	, attachedCount(0)
+	, aborted(false)
+{
+	for (auto& w: workers) {
+		w.store(nullptr);
+	}
+}
+
+ExecutionQueue::~ExecutionQueue()
 {
-	hasTasks.store(false);
+	const int n = nWorkers.load();
+	for (int i = 0; i < n; ++i) {
+		auto worker = workers[i].load();
+		while (auto job = worker->deque.steal()) {
+			delete job;
+		}
+		delete worker;
+	}
+}
+
+void ExecutionQueue::addToQueue(TaskBase task, JoinCounter* counter)
+{
+#if HAS_THREADS
+	if (aborted) {
+		return;
+	}
+	if (counter) {
+		counter->add();
+	}
+
+	auto local = getLocalWorker(false);
+	bool pushed = false;
+	if (local) {
+		auto job = allocJob();
+		job->task = std::move(task);
+		job->counter = counter;
+		pushed = local->deque.push(job);
+		if (!pushed) {
+			task = std::move(job->task);
+			freeJob(job);
+		}
+	}
+
+	if (!pushed) {
+		std::unique_lock<std::mutex> lock(mutex);
+		injected.push_back(Job{ std::move(task), counter });
+		injectedCount.fetch_add(1);
+	}
+
+	// Pairs with the fence in waitForJob(): either the sleeper sees this job, or we see the sleeper
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (aborted) {
+		// Raced with abort(), which might have emptied the queues before this job got there
+		drop();
+	} else if (sleeping.load() > 0) {
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.notify_one();
+	}
+#else
+	task();
+#endif
 }
 
 TaskBase ExecutionQueue::getNext()
 {
+	auto job = waitForJob();
+	if (!job) {
+		return TaskBase([] () {});
+	}
+	return TaskBase([this, job] () { runJob(job); });
+}
+
+std::vector<TaskBase> ExecutionQueue::getAll()
+{
+	std::vector<TaskBase> tasks;
+	auto local = getLocalWorker(false);
+	while (auto job = tryGetJob(local)) {
+		tasks.emplace_back([this, job] () { runJob(job); });
+	}
+	return tasks;
+}
+
+bool ExecutionQueue::runNext()
+{
+	auto job = waitForJob();
+	if (!job) {
+		return false;
+	}
+	runJob(job);
+	return true;
+}
+
+void ExecutionQueue::wait(JoinCounter& counter)
+{
+	auto local = getLocalWorker(false);
+	while (!counter.isDone()) {
+		auto job = local ? tryGetJob(local) : tryTakeInjected(counter);
+		if (!job) {
+			// Whatever is left is already running elsewhere
+			break;
+		}
+		runJob(job);
+	}
+	counter.waitUntilDone();
+}
+
+void ExecutionQueue::releaseWorker()
+{
+	if (localWorker.queue == this) {
+		std::unique_lock<std::mutex> lock(mutex);
+		static_cast<Worker*>(localWorker.worker)->owned = false;
+		localWorker = LocalWorker();
+	}
+}
+
+ExecutionQueue::Worker* ExecutionQueue::getLocalWorker(bool registerIfNeeded)
+{
+	if (localWorker.queue == this) {
+		return static_cast<Worker*>(localWorker.worker);
+	}
+	if (!registerIfNeeded || localWorker.queue != nullptr) {
+		// Threads only own a deque on one queue
+		return nullptr;
+	}
+
 	std::unique_lock<std::mutex> lock(mutex);
-	while (queue.empty()) {
-		if (!aborted) {
+	Worker* worker = nullptr;
+	const int n = nWorkers.load();
+	for (int i = 0; i < n && !worker; ++i) {
+		auto w = workers[i].load();
+		if (!w->owned) {
+			w->owned = true;
+			worker = w;
+		}
+	}
+	if (!worker) {
+		if (n == maxWorkers) {
+			return nullptr;
+		}
+		worker = new Worker();
+		workers[n].store(worker, std::memory_order_release);
+		nWorkers.store(n + 1, std::memory_order_release);
+	}
+
+	localWorker.queue = this;
+	localWorker.worker = worker;
+	localWorker.stealStart = unsigned(n);
+	return worker;
+}
+
+ExecutionQueue::Job* ExecutionQueue::waitForJob()
+{
+	auto local = getLocalWorker(true);
+	while (!aborted) {
+		auto job = tryGetJob(local);
+		if (job) {
+			return job;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		sleeping.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!hasWork() && !aborted) {
 			condition.wait(lock);
 		}
-		if (aborted) {
-			queue.clear();
-			return TaskBase([] () {});
+		sleeping.fetch_sub(1);
+	}
+	return nullptr;
+}
+
+ExecutionQueue::Job* ExecutionQueue::tryGetJob(Worker* local)
+{
+	if (local) {
+		auto job = local->deque.pop();
+		if (job) {
+			return job;
 		}
 	}
 
-	TaskBase value = queue.front();
-	queue.pop_front();
-	return value;
+	auto job = tryTakeInjected();
+	if (job) {
+		return job;
+	}
+
+	const int n = nWorkers.load(std::memory_order_acquire);
+	const unsigned start = localWorker.stealStart++;
+	for (int i = 0; i < n; ++i) {
+		auto worker = workers[(start + unsigned(i)) % unsigned(n)].load(std::memory_order_acquire);
+		if (worker != local) {
+			job = worker->deque.steal();
+			if (job) {
+				return job;
+			}
+		}
+	}
+	return nullptr;
 }
 
-std::vector<TaskBase> ExecutionQueue::getAll()
+ExecutionQueue::Job* ExecutionQueue::tryTakeInjected()
 {
+	if (injectedCount.load(std::memory_order_acquire) == 0) {
+		return nullptr;
+	}
+
 	std::unique_lock<std::mutex> lock(mutex);
-	hasTasks.store(false);
-	std::vector<TaskBase> tasks(queue.begin(), queue.end());
-	queue.clear();
-	return tasks;
+	if (injected.empty()) {
+		return nullptr;
+	}
+	auto job = allocJob();
+	*job = std::move(injected.front());
+	injected.pop_front();
+	injectedCount.fetch_sub(1);
+	return job;
 }
 
-void ExecutionQueue::addToQueue(TaskBase task)
+ExecutionQueue::Job* ExecutionQueue::tryTakeInjected(const JoinCounter& counter)
 {
-#if HAS_THREADS
+	if (injectedCount.load(std::memory_order_acquire) == 0) {
+		return nullptr;
+	}
+
 	std::unique_lock<std::mutex> lock(mutex);
-	queue.emplace_back(task);
-	hasTasks.store(true);
+	auto iter = std::find_if(injected.begin(), injected.end(), [&] (const Job& j) { return j.counter == &counter; });
+	if (iter == injected.end()) {
+		return nullptr;
+	}
+	auto job = allocJob();
+	*job = std::move(*iter);
+	injected.erase(iter);
+	injectedCount.fetch_sub(1);
+	return job;
+}
 
-	condition.notify_one();
-#else
-	task();
-#endif
+void ExecutionQueue::drop()
+{
+	std::deque<Job> dropped;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		dropped.swap(injected);
+		injectedCount.store(0);
+	}
+	for (auto& job: dropped) {
+		if (job.counter) {
+			job.counter->done();
+		}
+	}
+
+	// Stealing is safe from any thread; it only fails when another thread got the job first
+	const int n = nWorkers.load(std::memory_order_acquire);
+	for (int i = 0; i < n; ++i) {
+		auto& deque = workers[i].load(std::memory_order_acquire)->deque;
+		while (!deque.empty()) {
+			if (auto job = deque.steal()) {
+				auto counter = job->counter;
+				freeJob(job);
+				if (counter) {
+					counter->done();
+				}
+			}
+		}
+	}
+}
+
+bool ExecutionQueue::hasWork() const
+{
+	if (injectedCount.load() > 0) {
+		return true;
+	}
+	const int n = nWorkers.load(std::memory_order_acquire);
+	for (int i = 0; i < n; ++i) {
+		if (!workers[i].load(std::memory_order_acquire)->deque.empty()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void ExecutionQueue::runJob(Job* job)
+{
+	auto counter = job->counter;
+	try {
+		job->task();
+	} catch (...) {
+		freeJob(job);
+		if (counter) {
+			counter->done();
+		}
+		throw;
+	}
+	freeJob(job);
+	if (counter) {
+		counter->done();
+	}
+}
+
+ExecutionQueue::JobCache& ExecutionQueue::getJobCache()
+{
+	thread_local JobCache cache;
+	return cache;
+}
+
+ExecutionQueue::Job* ExecutionQueue::allocJob()
+{
+	auto& jobs = getJobCache().jobs;
+	if (jobs.empty()) {
+		return new Job();
+	}
+	auto job = jobs.back();
+	jobs.pop_back();
+	return job;
+}
+
+void ExecutionQueue::freeJob(Job* job)
+{
+	job->task.reset();
+	job->counter = nullptr;
+
+	auto& jobs = getJobCache().jobs;
+	if (jobs.size() < maxCachedJobs) {
+		jobs.push_back(job);
+	} else {
+		delete job;
+	}
 }
 
 Executors& Executors::get()
@@ -92,6 +401,7 @@ void ExecutionQueue::abort()
 		aborted = true;
 	}
 	condition.notify_all();
+	drop();
 }
 
 ExecutionQueue& ExecutionQueue::getDefault()
@@ -131,10 +441,7 @@ void Executor::runForever()
 #if HAS_THREADS
 	try {
 		while (running)	{
-			auto next = queue.getNext();
-			if (running) {
-				next();
-			}
+			queue.runNext();
 		}
 	} catch (std::exception& e) {
 		Logger::logError("Executor aborting due to exception.");
@@ -142,6 +449,7 @@ void Executor::runForever()
 	} catch (...) {
 		Logger::logError("Executor aborting due to unknown exception.");
 	}
+	queue.releaseWorker();
 #endif
 }
 
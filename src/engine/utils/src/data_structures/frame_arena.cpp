@@ -0,0 +1,118 @@
+#include "halley/data_structures/frame_arena.h"
+#include <mutex>
+#include <algorithm>
+#include <gsl/gsl_assert>
+
+using namespace Halley;
+
+namespace {
+	struct ArenaRegistry
+	{
+		std::mutex mutex;
+		Vector<FrameArena*> arenas;
+	};
+
+	ArenaRegistry& getRegistry()
+	{
+		static ArenaRegistry* registry = nullptr;
+		if (!registry) {
+			registry = new ArenaRegistry();
+		}
+		return *registry;
+	}
+}
+
+FrameArena::FrameArena(size_t blockSize)
+	: blockSize(blockSize)
+	, lastFrameUsed(0)
+	, highWater(0)
+	, capacity(0)
+{
+	Expects(blockSize > 0);
+
+	auto& registry = getRegistry();
+	std::unique_lock<std::mutex> lock(registry.mutex);
+	registry.arenas.push_back(this);
+}
+
+FrameArena::~FrameArena()
+{
+	auto& registry = getRegistry();
+	std::unique_lock<std::mutex> lock(registry.mutex);
+	registry.arenas.erase(std::remove(registry.arenas.begin(), registry.arenas.end(), this), registry.arenas.end());
+}
+
+void FrameArena::reset()
+{
+	lastFrameUsed.store(usedBytes, std::memory_order_relaxed);
+	if (usedBytes > highWater.load(std::memory_order_relaxed)) {
+		highWater.store(usedBytes, std::memory_order_relaxed);
+	}
+	usedBytes = 0;
+
+	// If last frame spilled into several blocks, replace them with a single one that fits it all
+	if (blocks.size() > 1) {
+		size_t total = 0;
+		for (auto& b: blocks) {
+			total += b.size;
+		}
+		blocks.clear();
+		blocks.push_back(Block{ std::unique_ptr<char[]>(new char[total]), total });
+	}
+
+	if (blocks.empty()) {
+		blockData = nullptr;
+		pos = 0;
+		blockEnd = 0;
+	} else {
+		useBlock(0);
+	}
+}
+
+void* FrameArena::allocSlow(size_t size, size_t align)
+{
+	// Wasted tail of the current block still counts as used
+	usedBytes += blockEnd - pos;
+
+	for (size_t i = blockData ? curBlock + 1 : 0; i < blocks.size(); ++i) {
+		if (blocks[i].size >= size + align) {
+			useBlock(i);
+			return alloc(size, align);
+		}
+	}
+
+	const size_t newSize = std::max(blockSize, size + align);
+	blocks.push_back(Block{ std::unique_ptr<char[]>(new char[newSize]), newSize });
+	capacity.fetch_add(newSize, std::memory_order_relaxed);
+	useBlock(blocks.size() - 1);
+	return alloc(size, align);
+}
+
+void FrameArena::useBlock(size_t idx)
+{
+	curBlock = idx;
+	blockData = blocks[idx].data.get();
+	pos = 0;
+	blockEnd = blocks[idx].size;
+}
+
+FrameArena& FrameArena::getLocal()
+{
+	static thread_local FrameArena arena;
+	return arena;
+}
+
+FrameArena::Stats FrameArena::getStats()
+{
+	Stats result;
+
+	auto& registry = getRegistry();
+	std::unique_lock<std::mutex> lock(registry.mutex);
+	for (auto& a: registry.arenas) {
+		result.used += a->lastFrameUsed.load(std::memory_order_relaxed);
+		result.highWater += a->highWater.load(std::memory_order_relaxed);
+		result.capacity += a->capacity.load(std::memory_order_relaxed);
+	}
+	result.nArenas = registry.arenas.size();
+	return result;
+}
@@ -0,0 +1,202 @@
+#include "halley/file/memory_mapped_file.h"
+#include "halley/file/path.h"
+#include <algorithm>
+
+using namespace Halley;
+
+#if defined(_WIN32) && !defined(WINDOWS_STORE)
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+namespace Halley {
+	class MemoryMappedFilePimpl
+	{
+	public:
+		~MemoryMappedFilePimpl()
+		{
+			close();
+		}
+
+		bool open(const Path& path)
+		{
+			close();
+
+			// Sharing delete access lets the packer replace the file (by renaming a new one over it) while it's mapped
+			file = CreateFileW(String(path.string()).getUTF16().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+				close();
+				return false;
+			}
+
+			mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mapping) {
+				close();
+				return false;
+			}
+
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (!data) {
+				close();
+				return false;
+			}
+			size = size_t(fileSize.QuadPart);
+			return true;
+		}
+
+		void close()
+		{
+			if (data) {
+				UnmapViewOfFile(data);
+				data = nullptr;
+			}
+			if (mapping) {
+				CloseHandle(mapping);
+				mapping = nullptr;
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+			size = 0;
+		}
+
+		void prefetch(size_t pos, size_t len) const
+		{
+#if _WIN32_WINNT >= _WIN32_WINNT_WIN8
+			WIN32_MEMORY_RANGE_ENTRY range;
+			range.VirtualAddress = static_cast<char*>(data) + pos;
+			range.NumberOfBytes = len;
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+		}
+
+		void* data = nullptr;
+		size_t size = 0;
+
+	private:
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+	};
+}
+
+#elif defined(__APPLE__) || defined(__ANDROID__) || defined(linux) || defined(__linux__) || defined(__FreeBSD__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Halley {
+	class MemoryMappedFilePimpl
+	{
+	public:
+		~MemoryMappedFilePimpl()
+		{
+			close();
+		}
+
+		bool open(const Path& path)
+		{
+			close();
+
+			const int fd = ::open(path.string().c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+
+			struct stat info;
+			if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+				::close(fd);
+				return false;
+			}
+
+			// The mapping stays valid once the descriptor is closed
+			void* result = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (result == MAP_FAILED) {
+				return false;
+			}
+
+			data = result;
+			size = size_t(info.st_size);
+			return true;
+		}
+
+		void close()
+		{
+			if (data) {
+				munmap(data, size);
+				data = nullptr;
+			}
+			size = 0;
+		}
+
+		void prefetch(size_t pos, size_t len) const
+		{
+			// madvise needs a page aligned address
+			const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+			const size_t start = pos - pos % pageSize;
+			madvise(static_cast<char*>(data) + start, len + (pos - start), MADV_WILLNEED);
+		}
+
+		void* data = nullptr;
+		size_t size = 0;
+	};
+}
+
+#else
+
+namespace Halley {
+	// Not implemented
+	class MemoryMappedFilePimpl
+	{
+	public:
+		bool open(const Path&) { return false; }
+		void close() {}
+		void prefetch(size_t, size_t) const {}
+
+		void* data = nullptr;
+		size_t size = 0;
+	};
+}
+
+#endif
+
+MemoryMappedFile::MemoryMappedFile()
+	: pimpl(std::make_unique<MemoryMappedFilePimpl>())
+{}
+
+MemoryMappedFile::~MemoryMappedFile() = default;
+
+bool MemoryMappedFile::open(const Path& path)
+{
+	return pimpl->open(path);
+}
+
+void MemoryMappedFile::close()
+{
+	pimpl->close();
+}
+
+bool MemoryMappedFile::isOpen() const
+{
+	return pimpl->data != nullptr;
+}
+
+gsl::span<const gsl::byte> MemoryMappedFile::getSpan() const
+{
+	return gsl::span<const gsl::byte>(static_cast<const gsl::byte*>(pimpl->data), pimpl->size);
+}
+
+void MemoryMappedFile::prefetch(size_t pos, size_t size) const
+{
+	if (pimpl->data && pos < pimpl->size) {
+		pimpl->prefetch(pos, std::min(size, pimpl->size - pos));
+	}
+}
@@ -1,108 +1,292 @@
 #include "halley/resources/metadata.h"
 #include "halley/resources/resource_data.h"
 #include "halley/bytes/byte_serializer.h"
+#include "halley/data_structures/hash_map.h"
 #include "halley/text/string_converter.h"
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <mutex>
 
 using namespace Halley;
 
-Metadata::Metadata() {}
+namespace {
+	class MetadataKeyTable
+	{
+	public:
+		static MetadataKeyTable& getInstance()
+		{
+			static MetadataKeyTable table;
+			return table;
+		}
 
-Metadata::~Metadata() {}
+		uint32_t getId(const String& name)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			return getIdLocked(name);
+		}
+
+		void getIds(const Vector<String>& keys, Vector<uint32_t>& result)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			result.resize(keys.size());
+			for (size_t i = 0; i < keys.size(); ++i) {
+				result[i] = getIdLocked(keys[i]);
+			}
+		}
+
+		const String& getName(uint32_t id)
+		{
+			// Deque elements never move, so the reference stays valid after the lock is released
+			std::unique_lock<std::mutex> lock(mutex);
+			return names.at(id);
+		}
+
+	private:
+		std::mutex mutex;
+		HashMap<String, uint32_t> ids;
+		std::deque<String> names;
+
+		uint32_t getIdLocked(const String& name)
+		{
+			auto iter = ids.find(name);
+			if (iter != ids.end()) {
+				return iter->second;
+			}
+			const auto id = uint32_t(names.size());
+			names.push_back(name);
+			ids[name] = id;
+			return id;
+		}
+	};
+}
+
+MetadataKey::MetadataKey(const char* key)
+	: id(MetadataKeyTable::getInstance().getId(String(key)))
+{}
+
+MetadataKey::MetadataKey(const std::string& key)
+	: id(MetadataKeyTable::getInstance().getId(String(key)))
+{}
+
+MetadataKey::MetadataKey(const String& key)
+	: id(MetadataKeyTable::getInstance().getId(key))
+{}
 
-bool Metadata::hasKey(String key) const
+const String& MetadataKey::getName() const
 {
-	return entries.find(key) != entries.end();
+	return MetadataKeyTable::getInstance().getName(id);
 }
 
-bool Metadata::getBool(String key) const
+bool Metadata::Entry::operator==(const Entry& other) const
 {
-	return getString(key) == "true";
+	if (key != other.key || type != other.type) {
+		return false;
+	}
+	switch (type) {
+	case MetadataType::Bool:
+		return boolValue == other.boolValue;
+	case MetadataType::Int:
+		return intValue == other.intValue;
+	case MetadataType::Float:
+		return floatValue == other.floatValue;
+	default:
+		return stringValue == other.stringValue;
+	}
 }
 
-int Metadata::getInt(String key) const
+bool Metadata::Entry::asBool() const
 {
-	return getString(key).toInteger();
+	switch (type) {
+	case MetadataType::Bool:
+		return boolValue;
+	case MetadataType::String:
+		return stringValue == "true";
+	default:
+		return false;
+	}
 }
 
-float Metadata::getFloat(String key) const
+int Metadata::Entry::asInt() const
 {
-	return getString(key).toFloat();
+	switch (type) {
+	case MetadataType::Int:
+		return intValue;
+	case MetadataType::Float:
+		return int(floatValue);
+	case MetadataType::Bool:
+		return 0;
+	default:
+		return stringValue.toInteger();
+	}
 }
 
-String Metadata::getString(String key) const
+float Metadata::Entry::asFloat() const
 {
-	auto result = entries.find(key);
-	if (result != entries.end()) {
-		return result->second;
-	} else {
-		throw Exception("Key " + key + " not found in metafile.", HalleyExceptions::Resources);
+	switch (type) {
+	case MetadataType::Float:
+		return floatValue;
+	case MetadataType::Int:
+		return float(intValue);
+	case MetadataType::Bool:
+		return 0.0f;
+	default:
+		return stringValue.toFloat();
 	}
 }
 
-bool Metadata::getBool(String key, bool v) const
+String Metadata::Entry::asString() const
 {
-	if (hasKey(key)) {
-		return getBool(key);
-	} else {
-		return v;
+	switch (type) {
+	case MetadataType::Bool:
+		return boolValue ? "true" : "false";
+	case MetadataType::Int:
+		return Halley::toString(intValue);
+	case MetadataType::Float:
+		return Halley::toString(floatValue);
+	default:
+		return stringValue;
 	}
 }
 
-int Metadata::getInt(String key, int v) const
+Metadata::Metadata() {}
+
+Metadata::~Metadata() {}
+
+const Metadata::Entry* Metadata::tryGet(MetadataKey key) const
 {
-	if (hasKey(key)) {
-		return getInt(key);
-	} else {
-		return v;
+	const uint32_t id = key.getId();
+	auto iter = std::lower_bound(entries.begin(), entries.end(), id, [] (const Entry& e, uint32_t id) { return e.key < id; });
+	if (iter != entries.end() && iter->key == id) {
+		return &*iter;
 	}
+	return nullptr;
 }
 
-float Metadata::getFloat(String key, float v) const
+const Metadata::Entry& Metadata::get(MetadataKey key) const
 {
-	if (hasKey(key)) {
-		return getFloat(key);
-	} else {
-		return v;
+	auto entry = tryGet(key);
+	if (!entry) {
+		throw Exception("Key " + key.getName() + " not found in metafile.", HalleyExceptions::Resources);
 	}
+	return *entry;
 }
 
-String Metadata::getString(String key, String v) const
+Metadata::Entry& Metadata::getOrAdd(MetadataKey key)
 {
-	if (hasKey(key)) {
-		return getString(key);
-	} else {
-		return v;
+	const uint32_t id = key.getId();
+	auto iter = std::lower_bound(entries.begin(), entries.end(), id, [] (const Entry& e, uint32_t id) { return e.key < id; });
+	if (iter == entries.end() || iter->key != id) {
+		iter = entries.insert(iter, Entry());
+		iter->key = id;
 	}
+	iter->stringValue = String();
+	return *iter;
+}
+
+bool Metadata::hasKey(MetadataKey key) const
+{
+	return tryGet(key) != nullptr;
+}
+
+MetadataType Metadata::getType(MetadataKey key) const
+{
+	return get(key).type;
+}
+
+bool Metadata::getBool(MetadataKey key) const
+{
+	return get(key).asBool();
+}
+
+int Metadata::getInt(MetadataKey key) const
+{
+	return get(key).asInt();
 }
 
-void Metadata::set(String key, bool value)
+float Metadata::getFloat(MetadataKey key) const
 {
-	entries[key] = value ? "true" : "false";
+	return get(key).asFloat();
 }
 
-void Metadata::set(String key, int value)
+String Metadata::getString(MetadataKey key) const
 {
-	entries[key] = Halley::toString(value);
+	return get(key).asString();
 }
 
-void Metadata::set(String key, float value)
+bool Metadata::getBool(MetadataKey key, bool v) const
 {
-	entries[key] = Halley::toString(value);
+	auto entry = tryGet(key);
+	return entry ? entry->asBool() : v;
 }
 
-void Metadata::set(String key, const char* value)
+int Metadata::getInt(MetadataKey key, int v) const
 {
-	entries[key] = value;
+	auto entry = tryGet(key);
+	return entry ? entry->asInt() : v;
 }
 
-void Metadata::set(String key, const std::string& value)
+float Metadata::getFloat(MetadataKey key, float v) const
 {
-	entries[key] = value;
+	auto entry = tryGet(key);
+	return entry ? entry->asFloat() : v;
 }
 
-void Metadata::set(String key, const String& value)
+String Metadata::getString(MetadataKey key, String v) const
 {
-	entries[key] = value;
+	auto entry = tryGet(key);
+	return entry ? entry->asString() : v;
+}
+
+void Metadata::set(MetadataKey key, bool value)
+{
+	auto& e = getOrAdd(key);
+	e.type = MetadataType::Bool;
+	e.boolValue = value;
+}
+
+void Metadata::set(MetadataKey key, int value)
+{
+	auto& e = getOrAdd(key);
+	e.type = MetadataType::Int;
+	e.intValue = value;
+}
+
+void Metadata::set(MetadataKey key, float value)
+{
+	auto& e = getOrAdd(key);
+	e.type = MetadataType::Float;
+	e.floatValue = value;
+}
+
+void Metadata::set(MetadataKey key, const char* value)
+{
+	set(key, String(value));
+}
+
+void Metadata::set(MetadataKey key, const std::string& value)
+{
+	set(key, String(value));
+}
+
+void Metadata::set(MetadataKey key, const String& value)
+{
+	auto& e = getOrAdd(key);
+	e.type = MetadataType::String;
+	e.stringValue = value;
+}
+
+void Metadata::setParsed(MetadataKey key, const String& value)
+{
+	if (value == "true" || value == "false") {
+		set(key, value == "true");
+	} else if (value.isInteger() && Halley::toString(value.toInteger()) == value) {
+		set(key, value.toInteger());
+	} else if (value.isNumber() && Halley::toString(value.toFloat()) == value) {
+		set(key, value.toFloat());
+	} else {
+		set(key, value);
+	}
 }
 
 std::unique_ptr<Metadata> Metadata::fromBinary(ResourceDataStatic& data)
@@ -113,14 +297,107 @@ std::unique_ptr<Metadata> Metadata::fromBinary(ResourceDataStatic& data)
 	return meta;
 }
 
+Vector<const Metadata::Entry*> Metadata::getEntriesByName() const
+{
+	// Key ids depend on the order keys were first seen in, so anything written out is ordered by name instead
+	Vector<std::pair<const String*, const Entry*>> named;
+	named.reserve(entries.size());
+	for (auto& e: entries) {
+		named.emplace_back(&MetadataKeyTable::getInstance().getName(e.key), &e);
+	}
+	std::sort(named.begin(), named.end(), [] (const std::pair<const String*, const Entry*>& a, const std::pair<const String*, const Entry*>& b) { return *a.first < *b.first; });
+
+	Vector<const Entry*> result;
+	result.reserve(named.size());
+	for (auto& n: named) {
+		result.push_back(n.second);
+	}
+	return result;
+}
+
 void Metadata::serialize(Serializer& s) const
 {
-	s << entries;
+	s << uint32_t(entries.size());
+	for (auto e: getEntriesByName()) {
+		s << MetadataKeyTable::getInstance().getName(e->key);
+		s << uint8_t(e->type);
+		switch (e->type) {
+		case MetadataType::Bool:
+			s << e->boolValue;
+			break;
+		case MetadataType::Int:
+			s << int32_t(e->intValue);
+			break;
+		case MetadataType::Float:
+			s << e->floatValue;
+			break;
+		default:
+			s << e->stringValue;
+		}
+	}
 }
 
 void Metadata::deserialize(Deserializer& s)
 {
-	s >> entries;
+	if (s.getVersion() == legacyTextFormatVersion) {
+		deserializeLegacy(s);
+		return;
+	}
+
+	uint32_t n;
+	s >> n;
+
+	// Keys are interned all at once, so the table is only locked once
+	Vector<String> keys(n);
+	entries.clear();
+	entries.resize(n);
+	for (uint32_t i = 0; i < n; ++i) {
+		auto& e = entries[i];
+		uint8_t type;
+		s >> keys[i];
+		s >> type;
+		e.type = MetadataType(type);
+		switch (e.type) {
+		case MetadataType::Bool:
+			s >> e.boolValue;
+			break;
+		case MetadataType::Int:
+			{
+				int32_t value;
+				s >> value;
+				e.intValue = int(value);
+			}
+			break;
+		case MetadataType::Float:
+			s >> e.floatValue;
+			break;
+		case MetadataType::String:
+			s >> e.stringValue;
+			break;
+		default:
+			throw Exception("Invalid metadata value type: " + Halley::toString(int(type)), HalleyExceptions::Resources);
+		}
+	}
+
+	Vector<uint32_t> ids;
+	MetadataKeyTable::getInstance().getIds(keys, ids);
+	for (uint32_t i = 0; i < n; ++i) {
+		entries[i].key = ids[i];
+	}
+
+	// Written in name order, which isn't key id order
+	std::sort(entries.begin(), entries.end(), [] (const Entry& a, const Entry& b) { return a.key < b.key; });
+}
+
+void Metadata::deserializeLegacy(Deserializer& s)
+{
+	std::map<String, String> values;
+	s >> values;
+
+	entries.clear();
+	for (auto& v: values) {
+		setParsed(v.first, v.second);
+	}
 }
 
 bool Metadata::operator==(const Metadata& rhs) const
@@ -130,15 +407,20 @@ bool Metadata::operator==(const Metadata& rhs) const
 
 bool Metadata::operator!=(const Metadata& rhs) const
 {
-	return entries != rhs.entries;
+	return !(entries == rhs.entries);
 }
 
 String Metadata::toString() const
 {
 	std::stringstream ss;
 	ss << "{ ";
-	for (auto& e: entries) {
-		ss << "\"" << e.first << "\": \"" << e.second << "\" ";
+	for (auto e: getEntriesByName()) {
+		ss << "\"" << MetadataKeyTable::getInstance().getName(e->key) << "\": ";
+		if (e->type == MetadataType::String) {
+			ss << "\"" << e->stringValue << "\" ";
+		} else {
+			ss << e->asString() << " ";
+		}
 	}
 	ss << "}";
 	return ss.str();
@@ -29,6 +29,10 @@ void Resource::onLoaded(Resources& resources)
 {
 }
 
+void Resource::getDependencies(Vector<ResourceReference>& dependencies) const
+{
+}
+
 int Resource::getAssetVersion() const
 {
 	return assetVersion;
@@ -93,7 +97,13 @@ AsyncResource::AsyncResource()
 
 AsyncResource::~AsyncResource()
 {
-	waitForLoad();
+	if (!loadedThroughWeakReferences) {
+		// Not waitForLoad(), which would throw from here if the load failed
+		std::unique_lock<std::mutex> lock(loadMutex);
+		while (loading) {
+			loadWait.wait(lock);
+		}
+	}
 }
 
 void AsyncResource::startLoading()
@@ -134,3 +144,13 @@ bool AsyncResource::isLoaded() const
 {
 	return !loading;
 }
+
+bool AsyncResource::hasFailed() const
+{
+	return failed;
+}
+
+void AsyncResource::setLoadedThroughWeakReferences()
+{
+	loadedThroughWeakReferences = true;
+}
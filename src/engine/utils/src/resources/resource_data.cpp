@@ -1,9 +1,11 @@
+#include <cstdio>
 #include <fstream>
 #include "halley/resources/resource_data.h"
 #include "halley/resources/metadata.h"
 #include "halley/support/exception.h"
 #include <halley/concurrency/concurrent.h>
 #include "halley/bytes/compression.h"
+#include "resource_io_queue.h"
 
 using namespace Halley;
 
@@ -32,6 +34,14 @@ ResourceDataStatic::ResourceDataStatic(const void* _data, size_t _size, String p
 	set(_data, _size, owning);
 }
 
+ResourceDataStatic::ResourceDataStatic(std::shared_ptr<const char> data, size_t size, String path)
+	: ResourceData(path)
+	, data(std::move(data))
+	, size(size)
+	, loaded(true)
+{
+}
+
 static void deleter(const char* data)
 {
 	delete[] data;
@@ -80,6 +90,11 @@ void ResourceDataStatic::inflate()
 	data = Compression::decompressToSharedPtr(getSpan(), size);
 }
 
+void ResourceDataStatic::inflate(const ICompressionCodec& codec)
+{
+	data = Compression::decompressToSharedPtr(codec, getSpan(), size);
+}
+
 std::unique_ptr<ResourceDataStatic> ResourceDataStatic::loadFromFileSystem(Path path)
 {
 	std::ifstream fp(path.string(), std::ios::binary | std::ios::in);
@@ -114,11 +129,89 @@ ResourceDataStream::ResourceDataStream(String path, ResourceDataMakeReader makeR
 {
 }
 
+namespace {
+	// Presents the decompressed contents of a compressed stream.
+	// Seeking forwards decodes up to the new position; seeking backwards has to start decoding again from the beginning.
+	class DecompressingDataReader : public ResourceDataReader {
+	public:
+		DecompressingDataReader(std::unique_ptr<ResourceDataReader> reader, const ICompressionCodec& codec)
+			: reader(std::move(reader))
+			, codec(codec)
+		{
+			restart();
+		}
+
+		size_t size() const override
+		{
+			return decoder->getDecompressedSize();
+		}
+
+		int read(gsl::span<gsl::byte> dst) override
+		{
+			const size_t n = decoder->read(dst);
+			pos += n;
+			return int(n);
+		}
+
+		void seek(int64_t offset, int whence) override
+		{
+			int64_t target = offset;
+			if (whence == SEEK_CUR) {
+				target += int64_t(pos);
+			} else if (whence == SEEK_END) {
+				target += int64_t(size());
+			}
+			const size_t targetPos = size_t(clamp(target, int64_t(0), int64_t(size())));
+
+			if (targetPos < pos) {
+				restart();
+			}
+			if (targetPos > pos) {
+				Bytes skipBuffer(std::min(targetPos - pos, size_t(64 * 1024)));
+				while (targetPos > pos) {
+					const auto toSkip = gsl::as_writeable_bytes(gsl::span<Byte>(skipBuffer)).subspan(0, std::min(targetPos - pos, skipBuffer.size()));
+					if (read(toSkip) == 0) {
+						break;
+					}
+				}
+			}
+		}
+
+		size_t tell() const override
+		{
+			return pos;
+		}
+
+		void close() override
+		{
+			reader->close();
+		}
+
+	private:
+		std::unique_ptr<ResourceDataReader> reader;
+		const ICompressionCodec& codec;
+		std::unique_ptr<ICompressionDecoder> decoder;
+		size_t pos = 0;
+
+		void restart()
+		{
+			reader->seek(0, SEEK_SET);
+			pos = 0;
+			decoder = codec.makeDecoder([this] (gsl::span<gsl::byte> dst) -> size_t
+			{
+				const int n = reader->read(dst);
+				return n > 0 ? size_t(n) : 0;
+			});
+		}
+	};
+}
+
 ResourceLoader::ResourceLoader(ResourceLoader&& loader) noexcept
 	: locator(loader.locator)
 	, name(std::move(loader.name))
 	, priority(loader.priority)
 	, api(loader.api)
+	, prefetched(std::move(loader.prefetched))
 {
 }
 
@@ -138,11 +231,18 @@ ResourceLoader::ResourceLoader(IResourceLocator& locator, const String& name, As
 
 std::unique_ptr<ResourceDataStatic> ResourceLoader::getStatic()
 {
+	if (prefetched) {
+		// Already read and inflated by getAsync()
+		loaded = true;
+		return std::move(prefetched);
+	}
+
+	const auto codec = getCodec();
 	auto result = locator.getStatic(name, type);
 	if (result) {
-		if (metadata->getString("asset_compression", "") == "deflate") {
+		if (codec) {
 			try {
-				result->inflate();
+				result->inflate(*codec);
 			} catch (Exception &e) {
 				throw Exception("Failed to load resource \"" + getName() + "\" due to inflate exception: " + e.what(), HalleyExceptions::Resources);
 			}
@@ -154,25 +254,46 @@ std::unique_ptr<ResourceDataStatic> ResourceLoader::getStatic()
 
 std::unique_ptr<ResourceDataStream> ResourceLoader::getStream()
 {
+	const auto codec = getCodec();
 	auto result = locator.getStream(name, type);
 	if (result) {
 		loaded = true;
+		if (codec) {
+			std::shared_ptr<ResourceDataStream> compressed = std::move(result);
+			return std::make_unique<ResourceDataStream>(compressed->getPath(), [compressed, codec] () -> std::unique_ptr<ResourceDataReader>
+			{
+				return std::make_unique<DecompressingDataReader>(compressed->getReader(), *codec);
+			});
+		}
 	}
 	return result;
 }
 
 Future<std::unique_ptr<ResourceDataStatic>> ResourceLoader::getAsync() const
 {
-	std::reference_wrapper<IResourceLocator> loc = locator;
-	auto n = name;
-	auto t = type;
-	auto meta = getMeta();
-	return Concurrent::execute(Executors::getDiskIO(), [meta, loc, n, t] () -> std::unique_ptr<ResourceDataStatic>
-	{
-		auto result = loc.get().getStatic(n, t);
-		if (meta.getString("asset_compression", "") == "deflate") {
-			result->inflate();
-		}
-		return result;
-	});
+	return ResourceIOQueue::get().enqueue(locator, name, type, getCodec(), priority, {}, false);
+}
+
+Future<std::unique_ptr<ResourceDataStatic>> ResourceLoader::getAsync(std::weak_ptr<const Resource> owner) const
+{
+	return ResourceIOQueue::get().enqueue(locator, name, type, getCodec(), priority, std::move(owner), true);
+}
+
+const ICompressionCodec* ResourceLoader::getCodec() const
+{
+	static const MetadataKey compressionKey = "asset_compression";
+	const auto compression = metadata->getString(compressionKey, "");
+	if (compression.isEmpty()) {
+		return nullptr;
+	}
+	const auto codec = Compression::getCodec(compression);
+	if (!codec) {
+		throw Exception("Resource \"" + name + "\" uses unknown compression \"" + compression + "\"", HalleyExceptions::Resources);
+	}
+	return codec;
+}
+
+void IResourceLocator::readLocation(const ResourceDataLocation&, gsl::span<gsl::byte>)
+{
+	throw Exception("This resource locator can't read by location", HalleyExceptions::Resources);
 }
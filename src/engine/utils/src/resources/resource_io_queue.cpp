@@ -0,0 +1,215 @@
+#include "resource_io_queue.h"
+#include "halley/resources/resource.h"
+#include "halley/concurrency/executor.h"
+#include "halley/support/exception.h"
+#include "halley/support/logger.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace Halley;
+
+bool ResourceIOQueue::Request::isCancelled() const
+{
+	return promise.isCancelled() || (hasOwner && owner.expired());
+}
+
+ResourceIOQueue& ResourceIOQueue::get()
+{
+	static ResourceIOQueue queue;
+	return queue;
+}
+
+Future<ResourceIOQueue::Result> ResourceIOQueue::enqueue(IResourceLocator& locator, const String& name, AssetType type, const ICompressionCodec* codec, ResourceLoadPriority priority, std::weak_ptr<const Resource> owner, bool hasOwner)
+{
+	Request request;
+	request.locator = &locator;
+	request.name = name;
+	request.type = type;
+	request.codec = codec;
+	request.hasLocation = locator.getLocation(name, type, request.location);
+	request.hasOwner = hasOwner;
+	request.owner = std::move(owner);
+	auto future = request.promise.getFuture();
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		const uint64_t id = nextId++;
+		if (request.hasLocation) {
+			pendingBySource[SourceKey(request.locator, request.location.source)].emplace(request.location.pos, id);
+		}
+		pending[size_t(priority)].push_back(id);
+		requests.emplace(id, std::move(request));
+	}
+	Executors::getDiskIO().addToQueue([this] () { runNext(); });
+
+	return future;
+}
+
+void ResourceIOQueue::runNext()
+{
+	Vector<Request> batch;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!takeNext(batch)) {
+			// Already served as part of an earlier batch, or cancelled
+			return;
+		}
+		takeNeighbours(batch);
+	}
+	read(batch);
+}
+
+bool ResourceIOQueue::takeNext(Vector<Request>& batch)
+{
+	for (auto queue = pending.rbegin(); queue != pending.rend(); ++queue) {
+		while (!queue->empty()) {
+			const uint64_t id = queue->front();
+			queue->pop_front();
+			auto iter = requests.find(id);
+			if (iter == requests.end()) {
+				continue;
+			}
+
+			auto& request = iter->second;
+			if (request.hasLocation) {
+				auto source = pendingBySource.find(SourceKey(request.locator, request.location.source));
+				auto& offsets = source->second;
+				auto range = offsets.equal_range(request.location.pos);
+				offsets.erase(std::find_if(range.first, range.second, [&] (const std::pair<const size_t, uint64_t>& e) { return e.second == id; }));
+				if (offsets.empty()) {
+					pendingBySource.erase(source);
+				}
+			}
+			if (take(id, batch)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void ResourceIOQueue::takeNeighbours(Vector<Request>& batch)
+{
+	if (!batch[0].hasLocation) {
+		return;
+	}
+	auto source = pendingBySource.find(SourceKey(batch[0].locator, batch[0].location.source));
+	if (source == pendingBySource.end()) {
+		return;
+	}
+	auto& offsets = source->second;
+	size_t start = batch[0].location.pos;
+	size_t end = start + batch[0].location.size;
+
+	// Grow the range over whatever is pending, of any priority, next to it in the same source, until there's too big a gap.
+	// Assets in a source don't overlap, so the ones nearest to the range are the ones adjacent to it in offset order.
+	for (auto iter = offsets.lower_bound(start); iter != offsets.end(); ) {
+		const auto& loc = requests.find(iter->second)->second.location;
+		const size_t newEnd = std::max(end, loc.pos + loc.size);
+		if (loc.pos > end + maxGap || newEnd - start > maxMergedSize) {
+			break;
+		}
+		if (take(iter->second, batch)) {
+			end = newEnd;
+		}
+		iter = offsets.erase(iter);
+	}
+	for (auto iter = offsets.lower_bound(start); iter != offsets.begin(); ) {
+		const auto prev = std::prev(iter);
+		const auto& loc = requests.find(prev->second)->second.location;
+		const size_t newStart = std::min(start, loc.pos);
+		if (loc.pos + loc.size + maxGap < start || end - newStart > maxMergedSize) {
+			break;
+		}
+		if (take(prev->second, batch)) {
+			start = newStart;
+		}
+		iter = offsets.erase(prev);
+	}
+
+	if (offsets.empty()) {
+		pendingBySource.erase(source);
+	}
+}
+
+bool ResourceIOQueue::take(uint64_t id, Vector<Request>& batch)
+{
+	// Removes the request from the pending set, but cancelled ones are dropped rather than read
+	auto iter = requests.find(id);
+	const bool taken = !iter->second.isCancelled();
+	if (taken) {
+		batch.push_back(std::move(iter->second));
+	}
+	requests.erase(iter);
+	return taken;
+}
+
+void ResourceIOQueue::read(Vector<Request>& batch)
+{
+	if (batch.size() > 1) {
+		size_t start = batch[0].location.pos;
+		size_t end = start;
+		for (auto& r: batch) {
+			start = std::min(start, r.location.pos);
+			end = std::max(end, r.location.pos + r.location.size);
+		}
+
+		ResourceDataLocation range;
+		range.source = batch[0].location.source;
+		range.pos = start;
+		range.size = end - start;
+		std::shared_ptr<char> buffer(new char[range.size], std::default_delete<char[]>());
+
+		bool ok = false;
+		try {
+			batch[0].locator->readLocation(range, gsl::as_writeable_bytes(gsl::span<char>(buffer.get(), range.size)));
+			ok = true;
+		} catch (std::exception& e) {
+			Logger::logError("Merged read of " + toString(batch.size()) + " assets failed, reading them one by one.");
+			Logger::logException(e);
+		}
+
+		if (ok) {
+			for (auto& r: batch) {
+				const char* src = buffer.get() + (r.location.pos - start);
+				if (r.codec || r.location.size * 2 >= range.size) {
+					// Keeps a slice of the shared buffer. Compressed assets only keep it until they're inflated.
+					finish(r, [&] () { return std::make_unique<ResourceDataStatic>(std::shared_ptr<const char>(buffer, src), r.location.size, r.name); });
+				} else {
+					// Small assets get their own copy, so holding on to one of them doesn't keep the whole merged read alive
+					finish(r, [&] ()
+					{
+						auto copy = new char[r.location.size];
+						memcpy(copy, src, r.location.size);
+						return std::make_unique<ResourceDataStatic>(copy, r.location.size, r.name, true);
+					});
+				}
+			}
+			return;
+		}
+	}
+
+	for (auto& r: batch) {
+		finish(r, [&] () { return r.locator->getStatic(r.name, r.type); });
+	}
+}
+
+void ResourceIOQueue::finish(Request& request, std::function<Result()> read)
+{
+	// The promise is always fulfilled, with null if anything failed, so nothing waiting on it is left hanging
+	Result data;
+	try {
+		data = read();
+		if (data && request.codec) {
+			try {
+				data->inflate(*request.codec);
+			} catch (Exception& e) {
+				throw Exception("Failed to load resource \"" + request.name + "\" due to inflate exception: " + e.what(), HalleyExceptions::Resources);
+			}
+		}
+	} catch (std::exception& e) {
+		Logger::logException(e);
+		data.reset();
+	}
+	request.promise.setValue(std::move(data));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include "halley/resources/resource_data.h"
+#include "halley/data_structures/vector.h"
+#include "halley/data_structures/hash_map.h"
+#include "halley/data_structures/tree_map.h"
+
+namespace Halley {
+	// Schedules asset reads on the disk IO executor.
+	// Each task posted there serves the most urgent request pending at the time it runs, rather than the one that posted it, so High requests overtake a backlog of Low ones.
+	// Requests that were cancelled, or whose owner is gone, are dropped without being read, and requests for neighbouring data in the same source are read together.
+	class ResourceIOQueue
+	{
+	public:
+		using Result = std::unique_ptr<ResourceDataStatic>;
+
+		static ResourceIOQueue& get();
+
+		Future<Result> enqueue(IResourceLocator& locator, const String& name, AssetType type, const ICompressionCodec* codec, ResourceLoadPriority priority, std::weak_ptr<const Resource> owner, bool hasOwner);
+
+	private:
+		struct Request
+		{
+			IResourceLocator* locator;
+			String name;
+			AssetType type;
+			const ICompressionCodec* codec; // Null if not compressed
+			bool hasLocation;
+			bool hasOwner;
+			ResourceDataLocation location;
+			std::weak_ptr<const Resource> owner;
+			Promise<Result> promise;
+
+			bool isCancelled() const;
+		};
+
+		using SourceKey = std::pair<const IResourceLocator*, const void*>;
+
+		constexpr static size_t maxGap = 64 * 1024;
+		constexpr static size_t maxMergedSize = 8 * 1024 * 1024;
+
+		std::mutex mutex;
+		uint64_t nextId = 0;
+		HashMap<uint64_t, Request> requests; // Everything not taken yet
+		std::array<std::deque<uint64_t>, 3> pending; // One FIFO per ResourceLoadPriority. Ids no longer in requests were taken as part of an earlier batch.
+		TreeMap<SourceKey, std::multimap<size_t, uint64_t>> pendingBySource; // Requests with a location, by offset in their source
+
+		void runNext();
+		bool takeNext(Vector<Request>& batch);
+		void takeNeighbours(Vector<Request>& batch);
+		bool take(uint64_t id, Vector<Request>& batch);
+		void read(Vector<Request>& batch);
+		void finish(Request& request, std::function<Result()> read);
+	};
+}
@@ -12,26 +12,9 @@ Bytes Encrypt::encrypt(const Bytes& iv, const String& key, const Bytes& data)
 {
 	Expects(iv.size() == 16);
 
-	// Prepare buffer
 	Bytes result = data;
-	const size_t origSize = result.size();
-	size_t newSize = alignUp(origSize, size_t(AES_BLOCKLEN));
-	if (newSize == origSize) {
-		// Must always add some padding, otherwise PKCS7 can't be undone
-		newSize += AES_BLOCKLEN;
-	}
-
-	// Pad with PKCS7
-	const unsigned char pad = static_cast<unsigned char>(newSize - origSize);
-	result.resize(newSize);
-	for (size_t i = origSize; i < newSize; ++i) {
-		result[i] = pad;
-	}
-
-	// Encrypt
-	AES_ctx ctx;
-	AES_init_ctx_iv(&ctx, reinterpret_cast<const uint8_t*>(key.c_str()), iv.data());
-	AES_CBC_encrypt_buffer(&ctx, result.data(), uint32_t(result.size()));
+	addPadding(result);
+	encryptInPlace(gsl::as_bytes(gsl::span<const Byte>(iv)), key, gsl::as_writeable_bytes(gsl::span<Byte>(result)));
 
 	return result;
 }
@@ -50,18 +33,56 @@ Bytes Encrypt::decrypt(const Bytes& iv, const String& key, const Bytes& data)
 		result.resize(alignUp(result.size(), size_t(AES_BLOCKLEN)));
 	}
 
-	// Decrypt
+	decryptInPlace(gsl::as_bytes(gsl::span<const Byte>(iv)), key, gsl::as_writeable_bytes(gsl::span<Byte>(result)));
+	removePadding(result);
+
+	return result;
+}
+
+void Encrypt::encryptInPlace(gsl::span<const gsl::byte> iv, const String& key, gsl::span<gsl::byte> data)
+{
+	Expects(iv.size() == AES_BLOCKLEN);
+	Expects(key.size() >= 16);
+	Expects(data.size() % AES_BLOCKLEN == 0);
+
+	AES_ctx ctx;
+	AES_init_ctx_iv(&ctx, reinterpret_cast<const uint8_t*>(key.c_str()), reinterpret_cast<const uint8_t*>(iv.data()));
+	AES_CBC_encrypt_buffer(&ctx, reinterpret_cast<uint8_t*>(data.data()), uint32_t(data.size()));
+}
+
+void Encrypt::decryptInPlace(gsl::span<const gsl::byte> iv, const String& key, gsl::span<gsl::byte> data)
+{
+	Expects(iv.size() == AES_BLOCKLEN);
+	Expects(key.size() >= 16);
+	Expects(data.size() % AES_BLOCKLEN == 0);
+
 	AES_ctx ctx;
 	std::memset(&ctx, 0, sizeof(ctx));
-	AES_init_ctx_iv(&ctx, reinterpret_cast<const uint8_t*>(key.c_str()), iv.data());
-	AES_CBC_decrypt_buffer(&ctx, result.data(), uint32_t(result.size()));
+	AES_init_ctx_iv(&ctx, reinterpret_cast<const uint8_t*>(key.c_str()), reinterpret_cast<const uint8_t*>(iv.data()));
+	AES_CBC_decrypt_buffer(&ctx, reinterpret_cast<uint8_t*>(data.data()), uint32_t(data.size()));
+}
 
-	// Remove padding
-	unsigned char padSize = result.back();
-	if (padSize >= result.size()) {
-		throw Exception("Unable to undo padding", HalleyExceptions::Utils);
+void Encrypt::addPadding(Bytes& data)
+{
+	const size_t origSize = data.size();
+	size_t newSize = alignUp(origSize, size_t(AES_BLOCKLEN));
+	if (newSize == origSize) {
+		// Must always add some padding, otherwise PKCS7 can't be undone
+		newSize += AES_BLOCKLEN;
 	}
-	result.resize(result.size() - padSize);
 
-	return result;
+	const unsigned char pad = static_cast<unsigned char>(newSize - origSize);
+	data.resize(newSize, pad);
+}
+
+void Encrypt::removePadding(Bytes& data)
+{
+	if (data.empty()) {
+		throw Exception("Unable to undo padding", HalleyExceptions::Utils);
+	}
+	unsigned char padSize = data.back();
+	if (padSize >= data.size()) {
+		throw Exception("Unable to undo padding", HalleyExceptions::Utils);
+	}
+	data.resize(data.size() - padSize);
 }
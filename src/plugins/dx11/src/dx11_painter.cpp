@@ -42,7 +42,7 @@ void DX11Painter::doEndRender()
 {
 }
 
-void DX11Painter::clear(Colour colour)
+void DX11Painter::doClear(Colour colour)
 {
 	const float col[] = { colour.r, colour.g, colour.b, colour.a };
 	auto view = dynamic_cast<IDX11RenderTarget&>(getActiveRenderTarget()).getRenderTargetView();
@@ -55,7 +55,7 @@ void DX11Painter::setMaterialPass(const Material& material, int passN)
 
 	// Shader
 	auto& shader = static_cast<DX11Shader&>(pass.getShader());
-	shader.setMaterialLayout(video, material.getDefinition().getAttributes());
+	shader.setMaterialLayout(video, material.getDefinition().getAttributes(), material.getDefinition().isInstanced());
 	shader.bind(video);
 
 	// Blend
@@ -94,12 +94,14 @@ void DX11Painter::setMaterialData(const Material& material)
 	}
 }
 
-void DX11Painter::setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly)
+void DX11Painter::setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly)
 {
 	const size_t stride = material.getVertexStride();
 	const size_t vertexDataSize = stride * numVertices;
+	const bool wide = indexFormat == IndexFormat::UInt32;
+	const size_t indexDataSize = numIndices * (wide ? sizeof(uint32_t) : sizeof(unsigned short));
 
-	if (!vertexBuffers[curBuffer].canFit(vertexDataSize) || !indexBuffers[curBuffer].canFit(numIndices * sizeof(unsigned short))) {
+	if (!vertexBuffers[curBuffer].canFit(vertexDataSize) || !indexBuffers[curBuffer].canFit(indexDataSize)) {
 		rotateBuffers();
 	}
 
@@ -114,8 +116,8 @@ void DX11Painter::setVertices(const MaterialDefinition& material, size_t numVert
 
 	{
 		auto& ib = indexBuffers[curBuffer];
-		ib.setData(gsl::as_bytes(gsl::span<unsigned short>(indices, numIndices)));
-		video.getDeviceContext().IASetIndexBuffer(ib.getBuffer(), DXGI_FORMAT_R16_UINT, ib.getOffset());
+		ib.setData(gsl::span<const gsl::byte>(static_cast<const gsl::byte*>(indices), indexDataSize));
+		video.getDeviceContext().IASetIndexBuffer(ib.getBuffer(), wide ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, ib.getOffset());
 	}
 }
 
@@ -126,6 +128,23 @@ void DX11Painter::drawTriangles(size_t numIndices)
 	devCon.DrawIndexed(UINT(numIndices), 0, 0);
 }
 
+void DX11Painter::drawInstances(size_t numIndices, size_t numInstances)
+{
+	auto& devCon = video.getDeviceContext();
+	devCon.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	devCon.DrawIndexedInstanced(UINT(numIndices), UINT(numInstances), 0, 0, 0);
+}
+
+bool DX11Painter::supportsInstancing() const
+{
+	return true;
+}
+
+bool DX11Painter::supports32BitIndices() const
+{
+	return true;
+}
+
 void DX11Painter::setViewPort(Rect4i rect)
 {
 	auto fRect = Rect4f(rect);
@@ -14,20 +14,24 @@ namespace Halley
 	public:
 		explicit DX11Painter(DX11Video& video, Resources& resources);
 		
-		void clear(Colour colour) override;
+		void doClear(Colour colour) override;
 		void setMaterialPass(const Material& material, int pass) override;
 		void setMaterialData(const Material& material) override;
 
 		void doStartRender() override;
 		void doEndRender() override;
 
-		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly) override;
+		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly) override;
 		void drawTriangles(size_t numIndices) override;
+		void drawInstances(size_t numIndices, size_t numInstances) override;
 		void setViewPort(Rect4i rect) override;
 		void setClip(Rect4i clip, bool enable) override;
 
 		void onUpdateProjection(Material& material) override;
 
+		bool supportsInstancing() const override;
+		bool supports32BitIndices() const override;
+
 	private:
 		DX11Video& video;
 
@@ -106,7 +106,7 @@ static DXGI_FORMAT getDX11Format(ShaderParameterType type)
 	}
 }
 
-void DX11Shader::setMaterialLayout(DX11Video& video, const std::vector<MaterialAttribute>& attributes)
+void DX11Shader::setMaterialLayout(DX11Video& video, const std::vector<MaterialAttribute>& attributes, bool instanced)
 {
 	if (layout) {
 		return;
@@ -135,7 +135,11 @@ void DX11Shader::setMaterialLayout(DX11Video& video, const std::vector<MaterialA
 		}
 		strcpy_s(names[i].data(), 64, name.c_str());
 
-		desc[i] = { names[i].data(), semanticIndex, format, inputSlot, byteOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 };
+		if (instanced) {
+			desc[i] = { names[i].data(), semanticIndex, format, inputSlot, byteOffset, D3D11_INPUT_PER_INSTANCE_DATA, 1 };
+		} else {
+			desc[i] = { names[i].data(), semanticIndex, format, inputSlot, byteOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 };
+		}
 	}
 
 	HRESULT result = video.getDevice().CreateInputLayout(desc.data(), UINT(desc.size()), vertexBlob.data(), vertexBlob.size(), &layout);
@@ -38,6 +38,7 @@ void PainterOpenGL::doStartRender()
 	vertexBuffer.init(GL_ARRAY_BUFFER);
 	elementBuffer.init(GL_ELEMENT_ARRAY_BUFFER);
 	stdQuadElementBuffer.init(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+	stdQuadElementBuffer32.init(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
 
 #ifdef WITH_OPENGL
 	if (vao == 0) {
@@ -63,7 +64,7 @@ void PainterOpenGL::doEndRender()
 	glCheckError();
 }
 
-void PainterOpenGL::clear(Colour colour)
+void PainterOpenGL::doClear(Colour colour)
 {
 	glCheckError();
 	glClearColor(colour.r, colour.g, colour.b, colour.a);
@@ -132,25 +133,25 @@ void PainterOpenGL::onUpdateProjection(Material& material)
 	setMaterialData(material);
 }
 
-void PainterOpenGL::setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly)
+void PainterOpenGL::setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly)
 {
 	Expects(numVertices > 0);
-	Expects(numIndices >= numVertices);
+	Expects(numIndices >= numVertices || material.isInstanced());
 	Expects(vertexData);
 	Expects(indices);
 
 	// Load indices into VBO
+	const bool wide = indexFormat == IndexFormat::UInt32;
+	indexType = wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
 	if (standardQuadsOnly) {
-		if (stdQuadElementBuffer.getSize() < numIndices * sizeof(unsigned short)) {
-			size_t indicesToAllocate = nextPowerOf2(numIndices);
-			std::vector<unsigned short> tmp(indicesToAllocate);
-			generateQuadIndices(0, indicesToAllocate / 6, tmp.data());
-			stdQuadElementBuffer.setData(gsl::as_bytes(gsl::span<unsigned short>(tmp)));
+		if (wide) {
+			bindStandardQuadIndices<uint32_t>(stdQuadElementBuffer32, numIndices);
 		} else {
-			stdQuadElementBuffer.bind();
+			bindStandardQuadIndices<unsigned short>(stdQuadElementBuffer, numIndices);
 		}
 	} else {
-		elementBuffer.setData(gsl::as_bytes(gsl::span<unsigned short>(indices, numIndices)));
+		const size_t indexBytes = numIndices * (wide ? sizeof(uint32_t) : sizeof(unsigned short));
+		elementBuffer.setData(gsl::span<const gsl::byte>(static_cast<const gsl::byte*>(indices), indexBytes));
 	}
 
 	// Load vertices into VBO
@@ -161,10 +162,24 @@ void PainterOpenGL::setVertices(const MaterialDefinition& material, size_t numVe
 	setupVertexAttributes(material);
 }
 
+template <typename T>
+void PainterOpenGL::bindStandardQuadIndices(GLBuffer& buffer, size_t numIndices)
+{
+	if (buffer.getSize() < numIndices * sizeof(T)) {
+		size_t indicesToAllocate = nextPowerOf2(numIndices);
+		std::vector<T> tmp(indicesToAllocate);
+		generateQuadIndices(T(0), indicesToAllocate / 6, tmp.data());
+		buffer.setData(gsl::as_bytes(gsl::span<T>(tmp)));
+	} else {
+		buffer.bind();
+	}
+}
+
 void PainterOpenGL::setupVertexAttributes(const MaterialDefinition& material)
 {
 	// Set vertex attribute pointers in VBO
 	size_t vertexStride = material.getVertexStride();
+	const GLuint divisor = material.isInstanced() ? 1 : 0;
 	for (auto& attribute : material.getAttributes()) {
 		int count = 0;
 		int type = 0;
@@ -207,6 +222,9 @@ void PainterOpenGL::setupVertexAttributes(const MaterialDefinition& material)
 		glEnableVertexAttribArray(attribute.location);
 		size_t offset = attribute.offset;
 		glVertexAttribPointer(attribute.location, count, type, GL_FALSE, GLsizei(vertexStride), reinterpret_cast<GLvoid*>(offset));
+#ifdef WITH_OPENGL
+		glVertexAttribDivisor(attribute.location, divisor);
+#endif
 		glCheckError();
 	}
 
@@ -218,6 +236,36 @@ void PainterOpenGL::drawTriangles(size_t numIndices)
 	Expects(numIndices > 0);
 	Expects(numIndices % 3 == 0);
 
-	glDrawElements(GL_TRIANGLES, int(numIndices), GL_UNSIGNED_SHORT, nullptr);
+	glDrawElements(GL_TRIANGLES, int(numIndices), indexType, nullptr);
+	glCheckError();
+}
+
+void PainterOpenGL::drawInstances(size_t numIndices, size_t numInstances)
+{
+	Expects(numIndices > 0);
+	Expects(numIndices % 3 == 0);
+
+#ifdef WITH_OPENGL
+	glDrawElementsInstanced(GL_TRIANGLES, int(numIndices), indexType, nullptr, int(numInstances));
 	glCheckError();
+#endif
+}
+
+bool PainterOpenGL::supportsInstancing() const
+{
+#ifdef WITH_OPENGL
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool PainterOpenGL::supports32BitIndices() const
+{
+	// Core on desktop, but only an extension on ES2
+#ifdef WITH_OPENGL
+	return true;
+#else
+	return false;
+#endif
 }
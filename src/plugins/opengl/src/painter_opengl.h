@@ -18,15 +18,19 @@ namespace Halley
 		void doStartRender() override;
 		void doEndRender() override;
 
-		void clear(Colour colour) override;
+		void doClear(Colour colour) override;
 		void setMaterialPass(const Material& material, int pass) override;
 		void setMaterialData(const Material& material) override;
 
 		void setClip(Rect4i clip, bool enable) override;
 
+		bool supportsInstancing() const override;
+		bool supports32BitIndices() const override;
+
 	protected:
-		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly) override;
+		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, const void* indices, IndexFormat indexFormat, bool standardQuadsOnly) override;
 		void drawTriangles(size_t numIndices) override;
+		void drawInstances(size_t numIndices, size_t numInstances) override;
 		void setViewPort(Rect4i rect) override;
 		void onUpdateProjection(Material& material) override;
 
@@ -37,8 +41,11 @@ namespace Halley
 		GLBuffer vertexBuffer;
 		GLBuffer elementBuffer;
 		GLBuffer stdQuadElementBuffer;
+		GLBuffer stdQuadElementBuffer32;
+		GLenum indexType = GL_UNSIGNED_SHORT;
 		std::unique_ptr<GLUtils> glUtils;
 
 		void setupVertexAttributes(const MaterialDefinition& material);
+		template <typename T> void bindStandardQuadIndices(GLBuffer& buffer, size_t numIndices);
 	};
 }
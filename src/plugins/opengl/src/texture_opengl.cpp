@@ -20,7 +20,9 @@ TextureOpenGL::TextureOpenGL(VideoOpenGL& parent, Vector2i size)
 
 TextureOpenGL::~TextureOpenGL()
 {
-	waitForOpenGLLoad();
+	if (isLoaded() && !hasFailed()) {
+		waitForOpenGLLoad();
+	}
 	if (textureId != 0) {
 		glDeleteTextures(1, &textureId);
 		textureId = 0;
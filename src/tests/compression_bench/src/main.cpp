@@ -0,0 +1,162 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <boost/filesystem.hpp>
+#include <halley/bytes/compression.h>
+#include <halley/resources/resource_data.h>
+#include <halley/time/stopwatch.h>
+
+// Compresses the test assets with every registered codec, then times loading them back the way ResourceLoader does:
+// whole assets decompressed into their final buffer (getStatic), and streams decompressed 4 KB at a time (getStream).
+
+using namespace Halley;
+
+namespace {
+	struct Asset
+	{
+		String name;
+		Bytes data;
+	};
+
+	void addAsset(Vector<Asset>& assets, const boost::filesystem::path& path)
+	{
+		std::ifstream fp(path.string(), std::ios::binary | std::ios::in);
+		fp.seekg(0, std::ios::end);
+		Asset asset;
+		asset.name = path.string();
+		asset.data.resize(size_t(fp.tellg()));
+		fp.seekg(0, std::ios::beg);
+		fp.read(reinterpret_cast<char*>(asset.data.data()), asset.data.size());
+		if (!asset.data.empty()) {
+			assets.push_back(std::move(asset));
+		}
+	}
+
+	void addAssets(Vector<Asset>& assets, const boost::filesystem::path& path)
+	{
+		if (boost::filesystem::is_directory(path)) {
+			for (auto& entry: boost::filesystem::recursive_directory_iterator(path)) {
+				if (boost::filesystem::is_regular_file(entry.path())) {
+					addAsset(assets, entry.path());
+				}
+			}
+		} else if (boost::filesystem::is_regular_file(path)) {
+			addAsset(assets, path);
+		}
+	}
+
+	double getMBPerSecond(size_t bytes, int64_t ns)
+	{
+		return double(bytes) / (1024.0 * 1024.0) / (double(std::max(ns, int64_t(1))) / 1000000000.0);
+	}
+
+	void printResult(const String& name, size_t rawSize, size_t compressedSize, int64_t compressNs, int64_t staticNs, int64_t streamNs)
+	{
+		std::cout << std::left << std::setw(16) << name.cppStr() << std::right << std::fixed << std::setprecision(1)
+			<< "ratio " << std::setw(5) << (100.0 * double(compressedSize) / double(std::max(rawSize, size_t(1)))) << "%"
+			<< ", compress " << std::setw(7) << getMBPerSecond(rawSize, compressNs) << " MB/s"
+			<< ", static load " << std::setw(7) << getMBPerSecond(rawSize, staticNs) << " MB/s";
+		if (streamNs > 0) {
+			std::cout << ", stream load " << std::setw(7) << getMBPerSecond(rawSize, streamNs) << " MB/s";
+		}
+		std::cout << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+		std::cout << "Usage: halley-compression-bench [rounds] [files or directories...]" << std::endl;
+		return 1;
+	}
+	const int nRounds = argc > 1 ? std::max(1, atoi(argv[1])) : 20;
+
+	try {
+		Vector<Asset> assets;
+		if (argc > 2) {
+			for (int i = 2; i < argc; ++i) {
+				addAssets(assets, argv[i]);
+			}
+		} else {
+			const boost::filesystem::path root = HALLEY_TEST_ASSETS_DIR;
+			addAssets(assets, root / "entity" / "assets_src");
+			addAssets(assets, root / "audio" / "assets_src");
+		}
+
+		size_t rawSize = 0;
+		for (auto& a: assets) {
+			rawSize += a.data.size();
+		}
+		std::cout << assets.size() << " assets, " << String::prettySize(rawSize) << ", " << nRounds << " rounds" << std::endl;
+		if (assets.empty()) {
+			return 1;
+		}
+
+		for (auto& codecName: Compression::getCodecNames()) {
+			const auto& codec = *Compression::getCodec(codecName);
+
+			Vector<Bytes> compressed;
+			size_t compressedSize = 0;
+			Stopwatch compressTimer;
+			for (auto& a: assets) {
+				compressed.push_back(codec.compress(gsl::as_bytes(gsl::span<const Byte>(a.data))));
+				compressedSize += compressed.back().size();
+			}
+			compressTimer.pause();
+			const int64_t compressNs = compressTimer.elapsedNanoSeconds();
+
+			// What ResourceLoader::getStatic() does: the compressed data as read, decompressed straight into the final buffer
+			Stopwatch staticTimer;
+			for (int round = 0; round < nRounds; ++round) {
+				for (auto& c: compressed) {
+					ResourceDataStatic data(c.data(), c.size(), "", false);
+					data.inflate(codec);
+				}
+			}
+			staticTimer.pause();
+			const int64_t staticNs = staticTimer.elapsedNanoSeconds() / nRounds;
+
+			// What ResourceLoader::getStream() does, with reads the size vorbis makes
+			Bytes buffer(4096);
+			Stopwatch streamTimer;
+			for (int round = 0; round < nRounds; ++round) {
+				for (auto& c: compressed) {
+					size_t pos = 0;
+					auto decoder = codec.makeDecoder([&] (gsl::span<gsl::byte> dst) -> size_t
+					{
+						const size_t n = std::min(size_t(dst.size()), c.size() - pos);
+						memcpy(dst.data(), c.data() + pos, n);
+						pos += n;
+						return n;
+					});
+					while (decoder->read(gsl::as_writeable_bytes(gsl::span<Byte>(buffer))) == buffer.size()) {}
+				}
+			}
+			streamTimer.pause();
+			const int64_t streamNs = streamTimer.elapsedNanoSeconds() / nRounds;
+
+			printResult(codecName, rawSize, compressedSize, compressNs, staticNs, streamNs);
+
+			if (codecName == "deflate") {
+				// How deflate assets used to be loaded: decompressed into a temporary, then copied into the final buffer
+				Stopwatch copyTimer;
+				for (int round = 0; round < nRounds; ++round) {
+					for (auto& c: compressed) {
+						auto bytes = Compression::decompress(gsl::as_bytes(gsl::span<const Byte>(c)));
+						auto result = std::shared_ptr<const char>(new char[bytes.size()], [] (const char* p) { delete[] p; });
+						memcpy(const_cast<char*>(result.get()), bytes.data(), bytes.size());
+					}
+				}
+				copyTimer.pause();
+				printResult("deflate (copy)", rawSize, compressedSize, compressNs, copyTimer.elapsedNanoSeconds() / nRounds, 0);
+			}
+		}
+	} catch (std::exception& e) {
+		std::cout << "Exception: " << e.what() << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
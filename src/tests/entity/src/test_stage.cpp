@@ -22,6 +22,10 @@ void TestStage::onVariableUpdate(Time time)
 	if (key->isButtonDown(Keys::Esc)) {
 		getCoreAPI().quit();
 	}
+	if (key->isButtonPressed(Keys::P)) {
+		world->setParallelSystems(!world->isParallelSystems());
+		Logger::logInfo(String("Parallel systems ") + (world->isParallelSystems() ? "on" : "off"));
+	}
 }
 
 void TestStage::onRender(RenderContext& context) const
@@ -0,0 +1,769 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <halley/core/game/halley_statics.h>
+#include <halley/concurrency/executor.h>
+#include <halley/data_structures/frame_arena.h>
+#include <halley/entity/world.h>
+#include <halley/entity/entity.h>
+#include <halley/entity/family_binding.h>
+#include <halley/entity/family_type.h>
+#include <halley/entity/message.h>
+#include <halley/entity/message_bus.h>
+#include <halley/entity/system.h>
+#include <halley/maths/random.h>
+#include <halley/maths/vector2.h>
+#include <halley/time/stopwatch.h>
+
+// Moves entities by their velocity, as a movement system would, through a family with the default pooled storage,
+// and with archetype storage through the chunks a family is bound to and through the world's chunks. Every entity has to
+// end up in the same place either way, and families have to be bound to archetypes whether they're created before or after them.
+// Before that, it checks that the frame arena rewinds and aligns what it hands out, that messages reach the right entities
+// in the order they were sent, and that the parallel scheduler never runs conflicting systems out of order.
+// Last, it times how long families take to keep up with entities being constantly created and destroyed.
+
+using namespace Halley;
+
+namespace {
+	class PositionComponent final : public Component
+	{
+	public:
+		static constexpr int componentIndex = 0;
+
+		Vector2f position;
+
+		PositionComponent() {}
+		explicit PositionComponent(Vector2f position) : position(position) {}
+	};
+
+	class VelocityComponent final : public Component
+	{
+	public:
+		static constexpr int componentIndex = 1;
+
+		Vector2f velocity;
+
+		VelocityComponent() {}
+		explicit VelocityComponent(Vector2f velocity) : velocity(velocity) {}
+	};
+
+	class TagComponent final : public Component
+	{
+	public:
+		static constexpr int componentIndex = 2;
+
+		int value = 0;
+	};
+
+	class MoverFamily : public FamilyBaseOf<MoverFamily>
+	{
+	public:
+		PositionComponent& position;
+		VelocityComponent& velocity;
+
+		using Type = FamilyType<PositionComponent, VelocityComponent>;
+
+	protected:
+		MoverFamily(PositionComponent& position, VelocityComponent& velocity)
+			: position(position)
+			, velocity(velocity)
+		{}
+	};
+
+	class MoverBinding : public FamilyBinding<MoverFamily>
+	{
+	public:
+		explicit MoverBinding(World& world)
+		{
+			bindFamily(world);
+		}
+	};
+
+	void populate(World& world, int nEntities)
+	{
+		Random rng(1234);
+		for (int i = 0; i < nEntities; ++i) {
+			auto e = world.createEntity();
+			e.addComponent(PositionComponent(Vector2f(rng.getFloat(0.0f, 1280.0f), rng.getFloat(0.0f, 720.0f))));
+			if (i % 10 != 0) {
+				e.addComponent(VelocityComponent(Vector2f(rng.getFloat(-50.0f, 50.0f), rng.getFloat(-50.0f, 50.0f))));
+			}
+			if (i % 10 == 1) {
+				e.addComponent(TagComponent());
+			}
+		}
+		world.spawnPending();
+	}
+
+	// Destroys some entities, and moves others between archetypes
+	void churn(World& world, Vector<EntityId>& ids)
+	{
+		for (size_t i = 0; i < ids.size(); ++i) {
+			if (i % 7 == 0) {
+				world.destroyEntity(ids[i]);
+			} else if (i % 11 == 0) {
+				world.getEntity(ids[i]).removeComponent<VelocityComponent>();
+			} else if (i % 13 == 0) {
+				world.getEntity(ids[i]).addComponent(TagComponent());
+			}
+		}
+		world.spawnPending();
+	}
+
+	Vector<EntityId> getIds(World& world, Family& family)
+	{
+		Vector<EntityId> ids;
+		for (size_t i = 0; i < family.count(); ++i) {
+			ids.push_back(static_cast<MoverFamily*>(family.getElement(i))->entityId);
+		}
+		return ids;
+	}
+
+	void moveFamily(Family& family, float time)
+	{
+		const size_t n = family.count();
+		for (size_t i = 0; i < n; ++i) {
+			auto& e = *static_cast<MoverFamily*>(family.getElement(i));
+			e.position.position += e.velocity.velocity * time;
+		}
+	}
+
+	void moveFamilyChunks(MoverBinding& binding, float time)
+	{
+		binding.forEachChunk([time] (size_t n, PositionComponent* position, VelocityComponent* velocity)
+		{
+			for (size_t i = 0; i < n; ++i) {
+				position[i].position += velocity[i].velocity * time;
+			}
+		});
+	}
+
+	void moveChunks(World& world, float time)
+	{
+		world.forEachChunk<PositionComponent, const VelocityComponent>([time] (size_t n, PositionComponent* position, const VelocityComponent* velocity)
+		{
+			for (size_t i = 0; i < n; ++i) {
+				position[i].position += velocity[i].velocity * time;
+			}
+		});
+	}
+
+	class TagFamily : public FamilyBaseOf<TagFamily>
+	{
+	public:
+		TagComponent& tag;
+
+		using Type = FamilyType<TagComponent>;
+
+	protected:
+		TagFamily(TagComponent& tag)
+			: tag(tag)
+		{}
+	};
+
+	class MeasureFamily : public FamilyBaseOf<MeasureFamily>
+	{
+	public:
+		const PositionComponent& position;
+		TagComponent& tag;
+
+		using Type = FamilyType<PositionComponent, TagComponent>;
+
+	protected:
+		MeasureFamily(const PositionComponent& position, TagComponent& tag)
+			: position(position)
+			, tag(tag)
+		{}
+	};
+
+	class HitMessage final : public Message
+	{
+	public:
+		static constexpr int messageIndex = 0;
+
+		int seq = 0;
+
+		HitMessage() {}
+		explicit HitMessage(int seq) : seq(seq) {}
+
+		size_t getSize() const override { return sizeof(HitMessage); }
+	};
+
+	bool checkFrameArena()
+	{
+		FrameArena arena(256);
+		const size_t aligns[] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+		const int nAllocs = 200;
+		Vector<std::pair<char*, size_t>> allocs;
+
+		// Small blocks, so the first frame spills over many of them
+		auto fill = [&] () -> bool
+		{
+			allocs.clear();
+			for (int i = 0; i < nAllocs; ++i) {
+				const size_t align = aligns[i % 8];
+				const size_t size = 1 + (i * 37) % 100;
+				auto p = static_cast<char*>(arena.alloc(size, align));
+				if (reinterpret_cast<uintptr_t>(p) % align != 0) {
+					std::cout << "Frame arena returned " << size << " bytes misaligned for " << align << std::endl;
+					return false;
+				}
+				memset(p, i & 0xFF, size);
+				allocs.emplace_back(p, size);
+			}
+			for (int i = 0; i < nAllocs; ++i) {
+				for (size_t j = 0; j < allocs[i].second; ++j) {
+					if (allocs[i].first[j] != char(i & 0xFF)) {
+						std::cout << "Frame arena allocations overlap" << std::endl;
+						return false;
+					}
+				}
+			}
+			return true;
+		};
+
+		size_t capacity;
+		size_t used;
+		{
+			FrameArena::Scope scope(arena);
+			if (!fill()) {
+				return false;
+			}
+			capacity = arena.getCapacity();
+
+			// Only the last allocation can be given back
+			auto last = arena.alloc(24, 8);
+			used = arena.getUsed();
+			arena.free(last, 24);
+			if (arena.alloc(24, 8) != last || arena.getUsed() != used) {
+				std::cout << "Frame arena didn't reuse its last allocation after it was freed" << std::endl;
+				return false;
+			}
+
+			// Inner scopes don't rewind the arena under the outer one
+			{
+				FrameArena::Scope inner(arena);
+				arena.alloc(8, 8);
+			}
+			if (arena.getUsed() != used + 8) {
+				std::cout << "Frame arena was rewound when an inner scope ended" << std::endl;
+				return false;
+			}
+			used += 8;
+		}
+
+		// Closing the outermost scope rewinds the arena, coalescing its blocks into one
+		if (arena.getUsed() != 0 || arena.getHighWater() != used) {
+			std::cout << "Frame arena wasn't rewound at the end of its scope: " << arena.getUsed() << " bytes used, high water mark " << arena.getHighWater() << std::endl;
+			return false;
+		}
+		{
+			FrameArena::Scope scope(arena);
+			if (!fill()) {
+				return false;
+			}
+		}
+		if (arena.getCapacity() != capacity) {
+			std::cout << "Frame arena grew from " << capacity << " to " << arena.getCapacity() << " bytes on a frame that fit in the last one" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// Sends hits to its targets in a fixed, interleaved order, as a system hitting several entities would
+	class HitSenderSystem final : public System
+	{
+	public:
+		HitSenderSystem(int& seq)
+			: System({}, {})
+			, seq(seq)
+		{}
+
+		Vector<EntityId> targets;
+		Vector<std::pair<EntityId, int>> sent;
+
+	protected:
+		void updateBase(Time) override
+		{
+			sent.clear();
+			for (int i = 0; i < 20; ++i) {
+				const auto target = targets[(i * 7) % targets.size()];
+				sendMessageGeneric(target, HitMessage(seq));
+				sent.emplace_back(target, seq++);
+			}
+		}
+
+		void declareDependenciesBase(SystemDependencies& deps) const override
+		{
+			deps.setDeclared();
+			deps.sendMessage<HitMessage>();
+		}
+
+	private:
+		int& seq;
+	};
+
+	class HitReceiverSystem final : public System
+	{
+	public:
+		HitReceiverSystem()
+			: System({ &mainFamily }, { HitMessage::messageIndex })
+		{}
+
+		Vector<std::pair<EntityId, int>> received;
+
+	protected:
+		void onMessagesReceived(int msgIndex, Message** msgs, size_t* idx, size_t n) override
+		{
+			if (msgIndex == HitMessage::messageIndex) {
+				for (size_t i = 0; i < n; ++i) {
+					received.emplace_back(mainFamily[idx[i]].entityId, static_cast<HitMessage*>(msgs[i])->seq);
+				}
+			}
+		}
+
+		void declareDependenciesBase(SystemDependencies& deps) const override
+		{
+			deps.setDeclared();
+			deps.receiveMessage<HitMessage>();
+		}
+
+	private:
+		FamilyBinding<MoverFamily> mainFamily;
+	};
+
+	bool checkMessages()
+	{
+		World world(nullptr, false);
+		int seq = 0;
+		auto& first = static_cast<HitSenderSystem&>(world.addSystem(std::make_unique<HitSenderSystem>(seq), TimeLine::VariableUpdate));
+		auto& second = static_cast<HitSenderSystem&>(world.addSystem(std::make_unique<HitSenderSystem>(seq), TimeLine::VariableUpdate));
+		auto& receiver = static_cast<HitReceiverSystem&>(world.addSystem(std::make_unique<HitReceiverSystem>(), TimeLine::VariableUpdate));
+
+		Vector<EntityId> targets;
+		for (int i = 0; i < 4; ++i) {
+			auto e = world.createEntity();
+			e.addComponent(PositionComponent());
+			if (i != 2) {
+				e.addComponent(VelocityComponent());
+			}
+			targets.push_back(e.getEntityId());
+		}
+		world.spawnPending();
+
+		// The third target isn't in the receiver's family, so it shouldn't get anything
+		first.targets = { targets[0], targets[1], targets[2] };
+		second.targets = { targets[3], targets[1], targets[0], targets[2] };
+
+		for (int step = 0; step < 3; ++step) {
+			receiver.received.clear();
+			world.step(TimeLine::VariableUpdate, 1.0 / 60.0);
+
+			// Each target in the family gets exactly what was sent to it, in the order it was sent, and all of it together
+			for (auto target: targets) {
+				Vector<int> expected;
+				for (auto sender: { &first, &second }) {
+					for (auto& s: sender->sent) {
+						if (s.first == target && target != targets[2]) {
+							expected.push_back(s.second);
+						}
+					}
+				}
+
+				Vector<int> got;
+				size_t firstIdx = receiver.received.size();
+				size_t lastIdx = 0;
+				for (size_t i = 0; i < receiver.received.size(); ++i) {
+					if (receiver.received[i].first == target) {
+						got.push_back(receiver.received[i].second);
+						firstIdx = std::min(firstIdx, i);
+						lastIdx = i;
+					}
+				}
+
+				if (got != expected) {
+					std::cout << "Entity " << target.value << " received " << got.size() << " messages, out of the " << expected.size() << " sent to it, or in a different order" << std::endl;
+					return false;
+				}
+				if (!got.empty() && lastIdx - firstIdx + 1 != got.size()) {
+					std::cout << "Messages to entity " << target.value << " weren't delivered together" << std::endl;
+					return false;
+				}
+				const auto queued = world.getMessageBus().getMessages(HitMessage::messageIndex, target);
+				const size_t nSent = size_t(std::count_if(first.sent.begin(), first.sent.end(), [&] (const std::pair<EntityId, int>& s) { return s.first == target; })
+					+ std::count_if(second.sent.begin(), second.sent.end(), [&] (const std::pair<EntityId, int>& s) { return s.first == target; }));
+				if (size_t(queued.size()) != nSent) {
+					std::cout << "Message bus has " << queued.size() << " messages queued for entity " << target.value << ", rather than the " << nSent << " sent to it" << std::endl;
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Stands in for a generated system: declares what it touches, and notes when it started and finished so the order can be checked
+	class OrderedSystem : public System
+	{
+	public:
+		OrderedSystem(std::initializer_list<FamilyBindingBase*> families, std::atomic<int>& clock)
+			: System(families, {})
+			, clock(clock)
+		{}
+
+		int started = -1;
+		int finished = -1;
+
+	protected:
+		void updateBase(Time time) final override
+		{
+			started = clock++;
+			run(float(time));
+			finished = clock++;
+		}
+
+		virtual void run(float time) = 0;
+
+	private:
+		std::atomic<int>& clock;
+	};
+
+	class IntegrateSystem final : public OrderedSystem
+	{
+	public:
+		IntegrateSystem(std::atomic<int>& clock) : OrderedSystem({ &mainFamily }, clock) {}
+
+	protected:
+		void run(float time) override
+		{
+			for (auto& e: mainFamily) {
+				e.position.position += e.velocity.velocity * time;
+			}
+		}
+
+		void declareDependenciesBase(SystemDependencies& deps) const override
+		{
+			deps.setDeclared();
+			deps.write<PositionComponent>();
+			deps.read<VelocityComponent>();
+		}
+
+	private:
+		FamilyBinding<MoverFamily> mainFamily;
+	};
+
+	class AccelerateSystem final : public OrderedSystem
+	{
+	public:
+		AccelerateSystem(std::atomic<int>& clock) : OrderedSystem({ &mainFamily }, clock) {}
+
+	protected:
+		void run(float) override
+		{
+			for (auto& e: mainFamily) {
+				e.velocity.velocity = e.velocity.velocity * 0.9f + Vector2f(1.0f, -2.0f);
+			}
+		}
+
+		void declareDependenciesBase(SystemDependencies& deps) const override
+		{
+			deps.setDeclared();
+			deps.write<VelocityComponent>();
+		}
+
+	private:
+		FamilyBinding<MoverFamily> mainFamily;
+	};
+
+	class CountSystem final : public OrderedSystem
+	{
+	public:
+		CountSystem(std::atomic<int>& clock) : OrderedSystem({ &mainFamily }, clock) {}
+
+	protected:
+		void run(float) override
+		{
+			for (auto& e: mainFamily) {
+				e.tag.value++;
+			}
+		}
+
+		void declareDependenciesBase(SystemDependencies& deps) const override
+		{
+			deps.setDeclared();
+			deps.write<TagComponent>();
+		}
+
+	private:
+		FamilyBinding<TagFamily> mainFamily;
+	};
+
+	class MeasureSystem final : public OrderedSystem
+	{
+	public:
+		MeasureSystem(std::atomic<int>& clock) : OrderedSystem({ &mainFamily }, clock) {}
+
+	protected:
+		void run(float) override
+		{
+			for (auto& e: mainFamily) {
+				e.tag.value = e.tag.value * 31 + int(e.position.position.x * 16.0f);
+			}
+		}
+
+		void declareDependenciesBase(SystemDependencies& deps) const override
+		{
+			deps.setDeclared();
+			deps.read<PositionComponent>();
+			deps.write<TagComponent>();
+		}
+
+	private:
+		FamilyBinding<MeasureFamily> mainFamily;
+	};
+
+	// Declares nothing, so it runs alone
+	class SpawnSystem final : public OrderedSystem
+	{
+	public:
+		SpawnSystem(std::atomic<int>& clock) : OrderedSystem({}, clock) {}
+
+	protected:
+		void run(float) override
+		{
+			doGetWorld().createEntity()
+				.addComponent(PositionComponent(Vector2f(float(started), 0.0f)))
+				.addComponent(VelocityComponent(Vector2f(1.0f, 1.0f)))
+				.addComponent(TagComponent());
+		}
+	};
+
+	void addOrderedSystems(World& world, std::atomic<int>& clock)
+	{
+		world.addSystem(std::make_unique<IntegrateSystem>(clock), TimeLine::FixedUpdate);
+		world.addSystem(std::make_unique<CountSystem>(clock), TimeLine::FixedUpdate);
+		world.addSystem(std::make_unique<AccelerateSystem>(clock), TimeLine::FixedUpdate);
+		world.addSystem(std::make_unique<MeasureSystem>(clock), TimeLine::FixedUpdate);
+		world.addSystem(std::make_unique<SpawnSystem>(clock), TimeLine::FixedUpdate);
+		world.addSystem(std::make_unique<IntegrateSystem>(clock), TimeLine::FixedUpdate);
+		world.addSystem(std::make_unique<CountSystem>(clock), TimeLine::FixedUpdate);
+	}
+
+	bool checkScheduler(int nEntities)
+	{
+		// Conflicting systems have to run in timeline order, so the parallel world has to end up exactly where the serial one does
+		ThreadPool cpuThreads("CPU", Executors::getCPU(), std::max(2u, std::thread::hardware_concurrency()), [] (String, std::function<void()> f) { return std::thread(f); });
+
+		std::atomic<int> serialClock(0);
+		std::atomic<int> parallelClock(0);
+		World serial(nullptr, false);
+		World parallel(nullptr, false);
+		parallel.setParallelSystems(true);
+		addOrderedSystems(serial, serialClock);
+		addOrderedSystems(parallel, parallelClock);
+		populate(serial, nEntities);
+		populate(parallel, nEntities);
+
+		auto& systems = parallel.getSystems(TimeLine::FixedUpdate);
+		for (int step = 0; step < 10; ++step) {
+			serial.step(TimeLine::FixedUpdate, 1.0 / 60.0);
+			parallel.step(TimeLine::FixedUpdate, 1.0 / 60.0);
+
+			for (size_t j = 0; j < systems.size(); ++j) {
+				auto& later = static_cast<OrderedSystem&>(*systems[j]);
+				for (size_t i = 0; i < j; ++i) {
+					auto& earlier = static_cast<OrderedSystem&>(*systems[i]);
+					if (earlier.getDependencies().conflictsWith(later.getDependencies()) && earlier.finished > later.started) {
+						std::cout << "System " << j << " started before system " << i << ", which it conflicts with, had finished" << std::endl;
+						return false;
+					}
+				}
+			}
+		}
+
+		if (serial.numEntities() != parallel.numEntities()) {
+			std::cout << "Parallel systems spawned " << parallel.numEntities() << " entities, rather than " << serial.numEntities() << std::endl;
+			return false;
+		}
+		auto& serialFamily = serial.getFamily<MoverFamily>();
+		for (size_t i = 0; i < serialFamily.count(); ++i) {
+			auto& e = *static_cast<MoverFamily*>(serialFamily.getElement(i));
+			auto other = parallel.getEntity(e.entityId);
+			const auto tag = serial.getEntity(e.entityId).tryGetComponent<TagComponent>();
+			const auto otherTag = other.tryGetComponent<TagComponent>();
+			if (other.getComponent<PositionComponent>().position != e.position.position || other.getComponent<VelocityComponent>().velocity != e.velocity.velocity
+				|| (tag == nullptr) != (otherTag == nullptr) || (tag && tag->value != otherTag->value)) {
+				std::cout << "Entity " << e.entityId.value << " ended up different with parallel systems" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void printResult(const String& name, int64_t ns, size_t nEntities, int nRounds)
+	{
+		std::cout << std::left << std::setw(32) << name.cppStr() << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(8) << (double(ns) / double(nEntities * nRounds)) << " ns per entity" << std::endl;
+	}
+
+	// Each round destroys a tenth of the entities and creates as many, as something spawning short-lived entities would,
+	// and times how long the world takes to bring its families up to date. They have to end up with exactly the entities that match them.
+	bool benchChurn(int nEntities, int nRounds)
+	{
+		World world(nullptr, false);
+		auto& movers = world.getFamily<MoverFamily>();
+		auto& tags = world.getFamily<TagFamily>();
+
+		Random rng(4321);
+		Vector<std::pair<EntityId, int>> live;
+		int nSpawned = 0;
+		auto spawn = [&] ()
+		{
+			const int kind = nSpawned++ % 10;
+			auto e = world.createEntity();
+			e.addComponent(PositionComponent(Vector2f(rng.getFloat(0.0f, 1280.0f), rng.getFloat(0.0f, 720.0f))));
+			if (kind != 0) {
+				e.addComponent(VelocityComponent(Vector2f(rng.getFloat(-50.0f, 50.0f), rng.getFloat(-50.0f, 50.0f))));
+			}
+			if (kind == 1) {
+				e.addComponent(TagComponent());
+			}
+			live.emplace_back(e.getEntityId(), kind);
+		};
+
+		for (int i = 0; i < nEntities; ++i) {
+			spawn();
+		}
+		world.spawnPending();
+
+		const size_t nChurn = live.size() / 10;
+		Stopwatch timer(false);
+		for (int round = 0; round < nRounds; ++round) {
+			for (size_t i = 0; i < nChurn; ++i) {
+				const size_t idx = rng.getSizeT(0, live.size() - 1);
+				world.destroyEntity(live[idx].first);
+				live[idx] = live.back();
+				live.pop_back();
+			}
+			for (size_t i = 0; i < nChurn; ++i) {
+				spawn();
+			}
+
+			timer.start();
+			world.spawnPending();
+			timer.pause();
+		}
+
+		const auto nMovers = size_t(std::count_if(live.begin(), live.end(), [] (const std::pair<EntityId, int>& e) { return e.second != 0; }));
+		const auto nTags = size_t(std::count_if(live.begin(), live.end(), [] (const std::pair<EntityId, int>& e) { return e.second == 1; }));
+		if (movers.count() != nMovers || tags.count() != nTags) {
+			std::cout << "Families out of date after churning: " << movers.count() << " movers rather than " << nMovers << ", " << tags.count() << " tagged rather than " << nTags << std::endl;
+			return false;
+		}
+
+		std::cout << nChurn << " entities destroyed and created per round" << std::endl;
+		printResult("churn, pooled families", timer.elapsedNanoSeconds(), nChurn * 2, nRounds);
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+		std::cout << "Usage: halley-entity-bench [entities] [rounds]" << std::endl;
+		return 1;
+	}
+	const int nEntities = argc > 1 ? std::max(100, atoi(argv[1])) : 100000;
+	const int nRounds = argc > 2 ? std::max(1, atoi(argv[2])) : 100;
+	const float time = 1.0f / 60.0f;
+
+	try {
+		HalleyStatics statics;
+		statics.setupGlobals();
+
+		if (!checkFrameArena() || !checkMessages() || !checkScheduler(std::min(nEntities, 10000))) {
+			return 3;
+		}
+
+		World pooled(nullptr, false);
+		World chunked(nullptr, false);
+		chunked.setArchetypeStorage(true);
+
+		auto& pooledFamily = pooled.getFamily<MoverFamily>();
+		auto& pooledTagFamily = pooled.getFamily<TagFamily>();
+		MoverBinding binding(chunked);
+
+		populate(pooled, nEntities);
+		populate(chunked, nEntities);
+		auto ids = getIds(pooled, pooledFamily);
+		churn(pooled, ids);
+		churn(chunked, ids);
+
+		size_t familyCount = 0;
+		binding.forEachChunk([&] (size_t n, PositionComponent*, VelocityComponent*) { familyCount += n; });
+		size_t chunkedCount = 0;
+		chunked.forEachChunk<PositionComponent, VelocityComponent>([&] (size_t n, PositionComponent*, VelocityComponent*) { chunkedCount += n; });
+		if (pooledFamily.count() != binding.count() || familyCount != binding.count() || chunkedCount != binding.count()) {
+			std::cout << "Entity counts differ: " << pooledFamily.count() << " pooled, " << binding.count() << " in the family with archetypes, "
+				<< familyCount << " in its chunks, " << chunkedCount << " in the world's chunks" << std::endl;
+			return 3;
+		}
+
+		// Families created once the archetypes exist have to find them too
+		const size_t pooledTags = pooledTagFamily.count();
+		const size_t chunkedTags = chunked.getFamily<TagFamily>().count();
+		if (pooledTags != chunkedTags) {
+			std::cout << "Family created after its archetypes has " << chunkedTags << " entities, rather than " << pooledTags << std::endl;
+			return 3;
+		}
+		const size_t n = pooledFamily.count();
+
+		Stopwatch pooledTimer;
+		for (int i = 0; i < nRounds; ++i) {
+			moveFamily(pooledFamily, time);
+		}
+		pooledTimer.pause();
+
+		Stopwatch familyTimer;
+		for (int i = 0; i < nRounds; ++i) {
+			moveFamilyChunks(binding, time);
+		}
+		familyTimer.pause();
+
+		Stopwatch chunkTimer;
+		for (int i = 0; i < nRounds; ++i) {
+			moveChunks(chunked, time);
+		}
+		chunkTimer.pause();
+
+		// The chunked world has moved twice as many times, so the pooled one catches up before comparing
+		for (int i = 0; i < nRounds; ++i) {
+			moveFamily(pooledFamily, time);
+		}
+		for (size_t i = 0; i < n; ++i) {
+			auto& e = *static_cast<MoverFamily*>(pooledFamily.getElement(i));
+			if (chunked.getEntity(e.entityId).getComponent<PositionComponent>().position != e.position.position) {
+				std::cout << "Entity " << e.entityId.value << " ended up somewhere else with archetype storage" << std::endl;
+				return 3;
+			}
+		}
+
+		std::cout << n << " moving entities, " << nRounds << " rounds" << std::endl;
+		printResult("family, pooled components", pooledTimer.elapsedNanoSeconds(), n, nRounds);
+		printResult("family, archetype chunks", familyTimer.elapsedNanoSeconds(), n, nRounds);
+		printResult("world, archetype chunks", chunkTimer.elapsedNanoSeconds(), n, nRounds);
+
+		if (!benchChurn(nEntities, nRounds)) {
+			return 3;
+		}
+	} catch (std::exception& e) {
+		std::cout << "Exception: " << e.what() << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
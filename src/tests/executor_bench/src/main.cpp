@@ -0,0 +1,259 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <halley/concurrency/concurrent.h>
+#include <halley/concurrency/executor.h>
+#include <halley/time/stopwatch.h>
+
+// Times the CPU ExecutionQueue queueing tasks from outside and from inside its own tasks, forking and joining, and fanning out
+// with Concurrent::foreach, against a single-lock queue like the one it replaced. Every leaf of the task trees has to run exactly once.
+
+using namespace Halley;
+
+namespace {
+	constexpr int nTasks = 200000;
+	constexpr int nFanOuts = 2000;
+	constexpr int treeDepth = 16;
+	constexpr int nTreeLeaves = 1 << treeDepth;
+
+	// Single deque + mutex + condition variable, with heap-allocated std::functions
+	class LockedQueue
+	{
+	public:
+		explicit LockedQueue(size_t nThreads)
+		{
+			for (size_t i = 0; i < nThreads; ++i) {
+				threads.emplace_back([this] () { runForever(); });
+			}
+		}
+
+		~LockedQueue()
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				running = false;
+			}
+			condition.notify_all();
+			for (auto& t: threads) {
+				t.join();
+			}
+		}
+
+		void add(std::function<void()> f)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queue.push_back(std::move(f));
+			condition.notify_one();
+		}
+
+	private:
+		std::deque<std::function<void()>> queue;
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::vector<std::thread> threads;
+		bool running = true;
+
+		void runForever()
+		{
+			while (true) {
+				std::function<void()> f;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					while (queue.empty() && running) {
+						condition.wait(lock);
+					}
+					if (!running) {
+						return;
+					}
+					f = std::move(queue.front());
+					queue.pop_front();
+				}
+				f();
+			}
+		}
+	};
+
+	void spinUntil(std::atomic<int>& counter, int target)
+	{
+		while (counter.load() < target) {
+			std::this_thread::yield();
+		}
+	}
+
+	// Each task queues two more from inside itself, down to the leaves, without waiting for them
+	void spawnTree(ExecutionQueue& queue, JoinCounter& counter, std::atomic<int>& leaves, int depth)
+	{
+		if (depth == 0) {
+			leaves.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		for (int i = 0; i < 2; ++i) {
+			queue.addToQueue([&queue, &counter, &leaves, depth] () { spawnTree(queue, counter, leaves, depth - 1); }, &counter);
+		}
+	}
+
+	void spawnTree(LockedQueue& queue, std::atomic<int>& leaves, int depth)
+	{
+		if (depth == 0) {
+			leaves.fetch_add(1);
+			return;
+		}
+		for (int i = 0; i < 2; ++i) {
+			queue.add([&queue, &leaves, depth] () { spawnTree(queue, leaves, depth - 1); });
+		}
+	}
+
+	// Each task queues one half, does the other itself, then waits for the half it queued
+	void forkJoin(ExecutionQueue& queue, std::atomic<int>& leaves, int depth)
+	{
+		if (depth == 0) {
+			leaves.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		JoinCounter counter;
+		queue.addToQueue([&queue, &leaves, depth] () { forkJoin(queue, leaves, depth - 1); }, &counter);
+		forkJoin(queue, leaves, depth - 1);
+		queue.wait(counter);
+	}
+
+	void printResult(const String& name, Stopwatch& timer, int n, const String& unit)
+	{
+		timer.pause();
+		const double perOp = double(timer.elapsedNanoSeconds()) / n;
+		std::cout << name << ": " << int64_t(1e9 / perOp) << " " << unit << "/s, " << int64_t(perOp) << " ns each" << std::endl;
+	}
+
+	bool checkCount(const String& name, std::atomic<int>& count, int expected)
+	{
+		const int n = count.exchange(0);
+		if (n != expected) {
+			std::cout << name << " ran " << n << " leaves, expected " << expected << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	bool run(ExecutionQueue& cpu)
+	{
+		const size_t nThreads = std::max(size_t(1), cpu.threadCount());
+		std::cout << "Executor benchmark, " << nThreads << " threads" << std::endl;
+
+		std::vector<int> values(nThreads * 16, 1);
+		std::atomic<int> sum(0);
+		std::atomic<int> leaves(0);
+
+		{
+			// Tasks per second, queued from this thread
+			JoinCounter counter;
+			Stopwatch timer;
+			for (int i = 0; i < nTasks; ++i) {
+				cpu.addToQueue([&sum] () { sum.fetch_add(1, std::memory_order_relaxed); }, &counter);
+			}
+			cpu.wait(counter);
+			printResult("Work-stealing queue, tasks", timer, nTasks, "tasks");
+
+			// Tasks queued from inside tasks
+			JoinCounter treeCounter;
+			timer.reset();
+			timer.start();
+			spawnTree(cpu, treeCounter, leaves, treeDepth);
+			cpu.wait(treeCounter);
+			printResult("Work-stealing queue, nested tasks", timer, nTreeLeaves * 2 - 2, "tasks");
+			if (!checkCount("Work-stealing queue, nested tasks", leaves, nTreeLeaves)) {
+				return false;
+			}
+
+			// Tasks waiting for the tasks they queued
+			JoinCounter rootCounter;
+			timer.reset();
+			timer.start();
+			cpu.addToQueue([&] () { forkJoin(cpu, leaves, treeDepth); }, &rootCounter);
+			cpu.wait(rootCounter);
+			printResult("Work-stealing queue, fork-join", timer, nTreeLeaves - 1, "forks");
+			if (!checkCount("Work-stealing queue, fork-join", leaves, nTreeLeaves)) {
+				return false;
+			}
+
+			// Fan-out latency
+			timer.reset();
+			timer.start();
+			for (int i = 0; i < nFanOuts; ++i) {
+				Concurrent::foreach(cpu, values.begin(), values.end(), [&sum] (int& v) { sum.fetch_add(v, std::memory_order_relaxed); });
+			}
+			printResult("Work-stealing queue, foreach", timer, nFanOuts, "fan-outs");
+		}
+
+		{
+			LockedQueue queue(nThreads);
+			std::atomic<int> done(0);
+
+			Stopwatch timer;
+			for (int i = 0; i < nTasks; ++i) {
+				queue.add([&sum, &done] () { sum.fetch_add(1, std::memory_order_relaxed); done.fetch_add(1); });
+			}
+			spinUntil(done, nTasks);
+			printResult("Locked queue, tasks", timer, nTasks, "tasks");
+
+			// Nothing can block waiting on the locked queue from one of its threads without risking a deadlock, so there's no fork-join here
+			timer.reset();
+			timer.start();
+			spawnTree(queue, leaves, treeDepth);
+			spinUntil(leaves, nTreeLeaves);
+			printResult("Locked queue, nested tasks", timer, nTreeLeaves * 2 - 2, "tasks");
+			if (!checkCount("Locked queue, nested tasks", leaves, nTreeLeaves)) {
+				return false;
+			}
+
+			// Same split as Concurrent::foreach, blocking until all chunks are done
+			timer.reset();
+			timer.start();
+			const size_t nChunks = std::min(size_t(8), nThreads);
+			for (int i = 0; i < nFanOuts; ++i) {
+				std::atomic<int> chunksDone(0);
+				for (size_t j = 0; j < nChunks; ++j) {
+					const size_t start = values.size() * j / nChunks;
+					const size_t end = values.size() * (j + 1) / nChunks;
+					queue.add([&, start, end] () {
+						for (size_t k = start; k < end; ++k) {
+							sum.fetch_add(values[k], std::memory_order_relaxed);
+						}
+						chunksDone.fetch_add(1);
+					});
+				}
+				spinUntil(chunksDone, int(nChunks));
+			}
+			printResult("Locked queue, foreach", timer, nFanOuts, "fan-outs");
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 2 || (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))) {
+		std::cout << "Usage: halley-executor-bench [threads]" << std::endl;
+		return 1;
+	}
+	const int nThreads = argc > 1 ? std::max(1, atoi(argv[1])) : int(std::max(1u, std::thread::hardware_concurrency()));
+
+	try {
+		Executors executors;
+		Executors::set(executors);
+		ThreadPool cpuThreads("CPU", executors.getCPU(), nThreads, [] (String, std::function<void()> f) { return std::thread(f); });
+
+		if (!run(executors.getCPU())) {
+			return 3;
+		}
+	} catch (std::exception& e) {
+		std::cout << "Exception: " << e.what() << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,244 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <halley/resources/metadata.h>
+#include <halley/bytes/byte_serializer.h>
+#include <halley/text/string_converter.h>
+#include <halley/time/stopwatch.h>
+
+// Builds the metadata of a game-sized asset database (textures and sprite sheets, audio, configs, shaders), then times
+// reading it back the way the loaders do (Texture::loadResource, AudioClip, ResourceLoader) and deserializing it from
+// the pack index. Metadata is compared against how it used to be stored, as text in a std::map keyed by strings.
+
+using namespace Halley;
+
+namespace {
+	// The previous implementation, kept here for comparison
+	class LegacyMetadata
+	{
+	public:
+		bool hasKey(String key) const { return entries.find(key) != entries.end(); }
+		bool getBool(String key, bool v) const { return hasKey(key) ? getString(key) == "true" : v; }
+		int getInt(String key, int v) const { return hasKey(key) ? getString(key).toInteger() : v; }
+		String getString(String key) const
+		{
+			auto result = entries.find(key);
+			if (result == entries.end()) {
+				throw Exception("Key " + key + " not found in metafile.", HalleyExceptions::Resources);
+			}
+			return result->second;
+		}
+		String getString(String key, String v) const { return hasKey(key) ? getString(key) : v; }
+
+		void set(String key, const String& value) { entries[key] = value; }
+
+		void serialize(Serializer& s) const { s << entries; }
+		void deserialize(Deserializer& s) { s >> entries; }
+
+	private:
+		std::map<String, String> entries;
+	};
+
+	struct AssetMeta
+	{
+		Vector<std::pair<String, String>> values;
+	};
+
+	// What the importers leave in the database, as text
+	Vector<AssetMeta> makeDatabase(int nTextures, int nAudio, int nConfigs, int nShaders)
+	{
+		Vector<AssetMeta> result;
+		srand(1234);
+		for (int i = 0; i < nTextures; ++i) {
+			AssetMeta m;
+			m.values.emplace_back("width", toString(32 << (rand() % 7)));
+			m.values.emplace_back("height", toString(32 << (rand() % 7)));
+			m.values.emplace_back("format", rand() % 4 == 0 ? "rgba_premultiplied" : "rgba");
+			m.values.emplace_back("compression", i % 3 == 0 ? "png" : "raw_image");
+			m.values.emplace_back("filtering", rand() % 2 ? "true" : "false");
+			m.values.emplace_back("mipmap", "false");
+			if (i % 4 == 0) {
+				m.values.emplace_back("clamp", "false");
+			}
+			if (i % 5 == 0) {
+				m.values.emplace_back("palette", "palette_" + toString(i % 7));
+			}
+			if (i % 3 != 0) {
+				m.values.emplace_back("pivotX", toString(rand() % 64));
+				m.values.emplace_back("pivotY", toString(rand() % 64));
+				m.values.emplace_back("trim", "true");
+				m.values.emplace_back("asset_compression", "lz4-chunked");
+			}
+			result.push_back(std::move(m));
+		}
+		for (int i = 0; i < nAudio; ++i) {
+			AssetMeta m;
+			m.values.emplace_back("channels", toString(1 + i % 2));
+			m.values.emplace_back("sampleRate", "48000");
+			m.values.emplace_back("streaming", i % 4 == 0 ? "true" : "false");
+			if (i % 3 == 0) {
+				m.values.emplace_back("loopPoint", toString(rand() * 7));
+			}
+			result.push_back(std::move(m));
+		}
+		for (int i = 0; i < nConfigs; ++i) {
+			AssetMeta m;
+			m.values.emplace_back("asset_compression", "lz4-chunked");
+			result.push_back(std::move(m));
+		}
+		for (int i = 0; i < nShaders; ++i) {
+			AssetMeta m;
+			m.values.emplace_back("language", i % 2 ? "glsl" : "hlsl");
+			result.push_back(std::move(m));
+		}
+		return result;
+	}
+
+	// What the loaders read when an asset is loaded. Every asset goes through ResourceLoader, textures and audio clips then read their own.
+	template <typename Meta, typename Keys>
+	int64_t readAsLoaders(const Meta& meta, const Keys& keys)
+	{
+		int64_t result = meta.getString(keys.assetCompression, "").size();
+		if (meta.hasKey(keys.width)) {
+			result += meta.getInt(keys.width, -1) + meta.getInt(keys.height, -1);
+			result += meta.getString(keys.compression, "") == "png" ? 1 : 0;
+			result += meta.getString(keys.format, "rgba").size();
+			result += meta.getBool(keys.filtering, false) ? 1 : 0;
+			result += meta.getBool(keys.mipmap, false) ? 1 : 0;
+			result += meta.getBool(keys.clamp, true) ? 1 : 0;
+		} else if (meta.hasKey(keys.channels)) {
+			result += meta.getBool(keys.streaming, false) ? 1 : 0;
+			result += meta.getInt(keys.channels, 1);
+			result += meta.getInt(keys.loopPoint, 0);
+		}
+		return result;
+	}
+
+	struct LiteralKeys
+	{
+		const char* assetCompression = "asset_compression";
+		const char* width = "width";
+		const char* height = "height";
+		const char* compression = "compression";
+		const char* format = "format";
+		const char* filtering = "filtering";
+		const char* mipmap = "mipmap";
+		const char* clamp = "clamp";
+		const char* channels = "channels";
+		const char* streaming = "streaming";
+		const char* loopPoint = "loopPoint";
+	};
+
+	struct InternedKeys
+	{
+		MetadataKey assetCompression = "asset_compression";
+		MetadataKey width = "width";
+		MetadataKey height = "height";
+		MetadataKey compression = "compression";
+		MetadataKey format = "format";
+		MetadataKey filtering = "filtering";
+		MetadataKey mipmap = "mipmap";
+		MetadataKey clamp = "clamp";
+		MetadataKey channels = "channels";
+		MetadataKey streaming = "streaming";
+		MetadataKey loopPoint = "loopPoint";
+	};
+
+	template <typename Meta, typename Keys>
+	int64_t timeReads(const Vector<Meta>& metas, const Keys& keys, int nRounds, int64_t& checksum)
+	{
+		Stopwatch timer;
+		for (int round = 0; round < nRounds; ++round) {
+			for (auto& m: metas) {
+				checksum += readAsLoaders(m, keys);
+			}
+		}
+		timer.pause();
+		return timer.elapsedNanoSeconds();
+	}
+
+	template <typename Meta>
+	int64_t timeDeserialize(const Vector<Bytes>& data, int nRounds, size_t& checksum)
+	{
+		Stopwatch timer;
+		for (int round = 0; round < nRounds; ++round) {
+			for (auto& d: data) {
+				Meta meta;
+				Deserializer s(d);
+				meta.deserialize(s);
+				checksum += meta.hasKey("width") ? 1 : 0;
+			}
+		}
+		timer.pause();
+		return timer.elapsedNanoSeconds();
+	}
+
+	void printResult(const String& name, int64_t ns, size_t nAssets, int nRounds)
+	{
+		std::cout << std::left << std::setw(36) << name.cppStr() << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(8) << (double(ns) / double(nAssets * nRounds)) << " ns per asset" << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+		std::cout << "Usage: halley-metadata-bench [rounds] [assets]" << std::endl;
+		return 1;
+	}
+	const int nRounds = argc > 1 ? std::max(1, atoi(argv[1])) : 50;
+	const int nAssets = argc > 2 ? std::max(10, atoi(argv[2])) : 10000;
+
+	try {
+		const auto db = makeDatabase(nAssets * 7 / 10, nAssets * 15 / 100, nAssets / 10, nAssets / 20);
+
+		Vector<LegacyMetadata> legacy;
+		Vector<Metadata> typed;
+		Vector<Bytes> legacyData;
+		Vector<Bytes> typedData;
+		size_t legacySize = 0;
+		size_t typedSize = 0;
+		for (auto& a: db) {
+			LegacyMetadata l;
+			Metadata t;
+			for (auto& v: a.values) {
+				l.set(v.first, v.second);
+				t.setParsed(v.first, v.second);
+			}
+			legacyData.push_back(Serializer::toBytes(l));
+			typedData.push_back(Serializer::toBytes(t));
+			legacySize += legacyData.back().size();
+			typedSize += typedData.back().size();
+			legacy.push_back(std::move(l));
+			typed.push_back(std::move(t));
+		}
+
+		std::cout << db.size() << " assets, " << nRounds << " rounds, serialized metadata " << String::prettySize(legacySize) << " before, " << String::prettySize(typedSize) << " now" << std::endl;
+
+		int64_t checksumLegacy = 0;
+		int64_t checksumLiteral = 0;
+		int64_t checksumInterned = 0;
+		const auto legacyNs = timeReads(legacy, LiteralKeys(), nRounds, checksumLegacy);
+		const auto literalNs = timeReads(typed, LiteralKeys(), nRounds, checksumLiteral);
+		const auto internedNs = timeReads(typed, InternedKeys(), nRounds, checksumInterned);
+		if (checksumLegacy != checksumLiteral || checksumLegacy != checksumInterned) {
+			std::cout << "Metadata read back differently: " << checksumLegacy << ", " << checksumLiteral << ", " << checksumInterned << std::endl;
+			return 3;
+		}
+
+		printResult("read, std::map of text", legacyNs, db.size(), nRounds);
+		printResult("read, typed with string literal keys", literalNs, db.size(), nRounds);
+		printResult("read, typed with static keys", internedNs, db.size(), nRounds);
+
+		size_t checksum = 0;
+		printResult("deserialize, std::map of text", timeDeserialize<LegacyMetadata>(legacyData, nRounds, checksum), db.size(), nRounds);
+		printResult("deserialize, typed", timeDeserialize<Metadata>(typedData, nRounds, checksum), db.size(), nRounds);
+	} catch (std::exception& e) {
+		std::cout << "Exception: " << e.what() << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,456 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+#include <halley/concurrency/executor.h>
+#include <halley/file_formats/config_file.h>
+#include <halley/maths/random.h>
+#include <halley/time/stopwatch.h>
+#include "halley/core/graphics/material/material.h"
+#include "halley/core/graphics/material/material_definition.h"
+#include "halley/core/graphics/material/material_parameter.h"
+#include "halley/core/graphics/render_command_buffer.h"
+#include "halley/core/graphics/render_context.h"
+#include "halley/core/graphics/sprite/sprite.h"
+#include "halley/core/graphics/sprite/sprite_painter.h"
+#include "halley/core/graphics/text/font.h"
+#include "halley/core/graphics/text/text_renderer.h"
+#include "halley/core/resources/resource_locator.h"
+#include "halley/core/resources/resources.h"
+#include "dummy/dummy_video.h"
+#include "graphics/sprite/sprite_culler.h"
+
+// Renders sprites, sliced sprites and text through the SpritePainter, into the dummy backend, and prints timings and backend stats.
+// Each scenario is also recorded and replayed once, and has to reach the backend exactly as it does when drawn directly.
+// Before that, every sprite culler this CPU can run has to agree with the portable one, and a batch too big for 16-bit indices has to reach the backend intact.
+// Last, it times sorting ten times as many sprites, spread over four times the screen, as they stay still, move or are shuffled.
+// Needs no window, GPU or assets, so it can track rendering regressions on any machine.
+
+using namespace Halley;
+
+namespace {
+	ConfigNode makeEntry(const String& key, const String& value)
+	{
+		ConfigNode::MapType map;
+		map[key] = ConfigNode(String(value));
+		return ConfigNode(std::move(map));
+	}
+
+	std::shared_ptr<MaterialDefinition> makeMaterialDefinition(const String& name, bool sprite)
+	{
+		ConfigNode::MapType root;
+		root["name"] = ConfigNode(String(name));
+		if (sprite) {
+			// Same layout as sprite_base.yaml
+			ConfigNode::SequenceType attributes;
+			attributes.push_back(makeEntry("a_vertPos", "vec4"));
+			attributes.push_back(makeEntry("a_position", "vec2"));
+			attributes.push_back(makeEntry("a_pivot", "vec2"));
+			attributes.push_back(makeEntry("a_size", "vec2"));
+			attributes.push_back(makeEntry("a_scale", "vec2"));
+			attributes.push_back(makeEntry("a_colour", "vec4"));
+			attributes.push_back(makeEntry("a_texCoord0", "vec4"));
+			attributes.push_back(makeEntry("a_rotation", "float"));
+			attributes.push_back(makeEntry("a_textureRotation", "float"));
+			root["attributes"] = ConfigNode(std::move(attributes));
+
+			ConfigNode::SequenceType textures;
+			textures.push_back(makeEntry("tex0", "sampler2D"));
+			root["textures"] = ConfigNode(std::move(textures));
+		} else {
+			ConfigNode::SequenceType block;
+			block.push_back(makeEntry("u_mvp", "mat4"));
+			ConfigNode::MapType blocks;
+			blocks["HalleyBlock"] = ConfigNode(std::move(block));
+			ConfigNode::SequenceType uniforms;
+			uniforms.push_back(ConfigNode(std::move(blocks)));
+			root["uniforms"] = ConfigNode(std::move(uniforms));
+		}
+
+		auto def = std::make_shared<MaterialDefinition>();
+		def->load(ConfigNode(std::move(root)));
+		def->addPass(MaterialPass(BlendType::AlphaPremultiplied, std::make_shared<DummyShader>()));
+		return def;
+	}
+
+	std::shared_ptr<Material> makeMaterial(std::shared_ptr<MaterialDefinition> def, Vector2i textureSize)
+	{
+		auto material = std::make_shared<Material>(def);
+		material->set("tex0", std::shared_ptr<const Texture>(std::make_shared<DummyTexture>(textureSize)));
+		return material;
+	}
+
+	std::shared_ptr<Font> makeFont(std::shared_ptr<Material> material)
+	{
+		// Monospaced, laid out in a 16x16 grid on a 256x256 texture
+		auto font = std::make_shared<Font>("bench", "bench", 12.0f, 16.0f, 16.0f, 1.0f);
+		for (int c = 0; c < 128; ++c) {
+			const Rect4f area(Vector2f(float(c % 16), float(c / 16)) / 16.0f, 1.0f / 16.0f, 1.0f / 16.0f);
+			font->addGlyph(Font::Glyph(c, area, Vector2f(16, 16), Vector2f(0, 12), Vector2f(), Vector2f(10, 0)));
+		}
+		font->setMaterial(std::move(material));
+		return font;
+	}
+
+	struct Scenario
+	{
+		String name;
+		Vector<Sprite> sprites;
+		Vector<TextRenderer> texts;
+	};
+
+	bool checkReplay(DummyRenderer& renderer, std::function<void(RenderContext&)> frame)
+	{
+		auto& painter = renderer.getPainter();
+		renderer.render(frame);
+		const auto direct = painter.getLastFrameStats();
+
+		RenderCommandBuffer buffer;
+		painter.setRecording(&buffer);
+		renderer.render(frame);
+		painter.setRecording(nullptr);
+		painter.replay(buffer);
+		return painter.getLastFrameStats() == direct;
+	}
+
+	// Some sprites get values no real sprite should have, to check the kernels handle them like the portable code does
+	float makeCullingValue(Random& rng, float min, float max)
+	{
+		static const float special[] = {
+			std::numeric_limits<float>::quiet_NaN(),
+			std::numeric_limits<float>::infinity(),
+			-std::numeric_limits<float>::infinity(),
+			std::numeric_limits<float>::denorm_min(),
+			0.0f,
+			-0.0f,
+			1e30f,
+			-1e30f
+		};
+		if (rng.getInt(0, 9) == 0) {
+			return special[rng.getInt(0, int(sizeof(special) / sizeof(float)) - 1)];
+		}
+		return rng.getFloat(min, max);
+	}
+
+	bool checkCullers(Random& rng)
+	{
+		// Not a multiple of any vector width, so the scalar tails are covered too
+		constexpr size_t n = 10007;
+		Vector<float> posX(n), posY(n), pivotX(n), pivotY(n), sizeX(n), sizeY(n), rotation(n);
+		for (size_t i = 0; i < n; ++i) {
+			posX[i] = makeCullingValue(rng, -1000.0f, 1000.0f);
+			posY[i] = makeCullingValue(rng, -1000.0f, 1000.0f);
+			pivotX[i] = makeCullingValue(rng, -0.5f, 1.5f);
+			pivotY[i] = makeCullingValue(rng, -0.5f, 1.5f);
+			sizeX[i] = makeCullingValue(rng, -64.0f, 256.0f);
+			sizeY[i] = makeCullingValue(rng, -64.0f, 256.0f);
+			rotation[i] = rng.getInt(0, 1) == 0 ? 0.0f : makeCullingValue(rng, -0.001f, 0.001f);
+		}
+		SpriteBounds bounds { posX, posY, pivotX, pivotY, sizeX, sizeY, rotation };
+
+		const Vector<Rect4f> views = {
+			Rect4f(-640, -360, 1280, 720),
+			Rect4f(0, 0, 0, 0),
+			Rect4f(-1e30f, -1e30f, 2e30f, 2e30f)
+		};
+
+		auto cullers = SpriteCuller::makeAllCullers();
+		Vector<uint32_t> expected((n + 31) / 32);
+		Vector<uint32_t> visible(expected.size());
+		for (auto& view: views) {
+			cullers[0]->cull(bounds, view, expected);
+			for (size_t c = 1; c < cullers.size(); ++c) {
+				std::fill(visible.begin(), visible.end(), 0xFFFFFFFFu);
+				cullers[c]->cull(bounds, view, visible);
+				for (size_t i = 0; i < n; ++i) {
+					if (((expected[i >> 5] ^ visible[i >> 5]) >> (i & 31)) & 1) {
+						std::cout << "Sprite culler " << c << " disagrees with the portable one about sprite " << i
+							<< " (pos " << posX[i] << ", " << posY[i] << ", pivot " << pivotX[i] << ", " << pivotY[i]
+							<< ", size " << sizeX[i] << ", " << sizeY[i] << ", rotation " << rotation[i] << ")" << std::endl;
+						return false;
+					}
+				}
+			}
+		}
+		std::cout << "Sprite cullers: " << cullers.size() << " agree" << std::endl;
+		return true;
+	}
+
+	template <typename T>
+	bool checkQuadIndices(const T* indices, size_t numIndices, size_t numVertices)
+	{
+		for (size_t i = 0; i < numIndices; i += 6) {
+			const size_t base = i / 6 * 4;
+			const size_t expected[] = { base, base + 1, base + 2, base + 2, base + 3, base };
+			for (size_t j = 0; j < 6; ++j) {
+				if (size_t(indices[i + j]) != expected[j] || expected[j] >= numVertices) {
+					std::cout << "Index " << (i + j) << " is " << size_t(indices[i + j]) << ", expected " << expected[j] << std::endl;
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Sprites of one material with more vertices than 16-bit indices can address have to be drawn in one batch with 32-bit indices,
+	// or split into as few batches as fit if the backend can't take them. The batches are recorded, so what was submitted can be checked.
+	bool checkLargeBatch(DummyRenderer& renderer, std::shared_ptr<Material> material)
+	{
+		constexpr size_t nSprites = 25000;
+		Vector<Sprite> sprites(nSprites);
+		for (size_t i = 0; i < nSprites; ++i) {
+			sprites[i].setMaterial(material)
+				.setSize(Vector2f(4, 4))
+				.setPos(Vector2f(float(i % 250) * 4.0f - 500.0f, float(i / 250) * 4.0f - 200.0f));
+		}
+
+		RenderCommandBuffer buffer;
+		bool supports32BitIndices = false;
+		renderer.render([&] (RenderContext& context)
+		{
+			context.bind([&] (Painter& painter)
+			{
+				supports32BitIndices = painter.supports32BitIndices();
+				painter.flush();
+				painter.setRecording(&buffer);
+				for (auto& s: sprites) {
+					s.draw(painter);
+				}
+				painter.setRecording(nullptr);
+				painter.replay(buffer);
+			});
+		});
+
+		size_t totalVertices = 0;
+		for (uint32_t i = 0; i < uint32_t(buffer.getNumDraws()); ++i) {
+			const auto& draw = buffer.getDraw(i);
+			totalVertices += draw.numVertices;
+			bool ok;
+			if (draw.numIndices != size_t(draw.numVertices) * 3 / 2) {
+				std::cout << "Large batch draw " << i << " has " << draw.numIndices << " indices for " << draw.numVertices << " vertices" << std::endl;
+				ok = false;
+			} else if (draw.indexFormat == IndexFormat::UInt16) {
+				ok = draw.numVertices <= 65536 && checkQuadIndices(static_cast<const unsigned short*>(buffer.getIndexData(draw)), draw.numIndices, draw.numVertices);
+			} else {
+				ok = checkQuadIndices(static_cast<const uint32_t*>(buffer.getIndexData(draw)), draw.numIndices, draw.numVertices);
+			}
+			if (!ok) {
+				return false;
+			}
+		}
+
+		const size_t expectedDraws = supports32BitIndices ? 1 : (nSprites * 4 + 65535) / 65536;
+		if (buffer.getNumDraws() != expectedDraws || totalVertices != nSprites * 4) {
+			std::cout << "Large batch: expected " << expectedDraws << " draws with " << (nSprites * 4) << " vertices, got " << buffer.getNumDraws() << " with " << totalVertices << std::endl;
+			return false;
+		}
+		std::cout << "Large batch: " << nSprites << " sprites in " << buffer.getNumDraws() << " draw(s)" << std::endl;
+		return true;
+	}
+
+	void printResult(const Scenario& scenario, int64_t ns, int nFrames, const DummyRenderStats& stats)
+	{
+		std::cout << scenario.name
+			<< ": " << (ns / nFrames / 1000) << " us/frame"
+			<< ", draw calls " << stats.drawCalls
+			<< " (" << stats.instancedDrawCalls << " instanced)"
+			<< ", state changes " << stats.stateChanges
+			<< ", material binds " << stats.materialBinds
+			<< ", material data " << stats.materialDataUpdates
+			<< ", clip changes " << stats.clipChanges
+			<< ", vertices " << stats.vertices
+			<< ", vertex bytes " << stats.vertexBytes
+			<< ", index bytes " << stats.indexBytes
+			<< std::endl;
+	}
+
+	// About 1/16th of the sprites are on screen. Moving a little keeps most of the last frame's order, shuffling keeps none of it.
+	void benchSorting(DummyRenderer& renderer, std::shared_ptr<Material> material, Random& rng, size_t nSprites, int nFrames, Rect4f view)
+	{
+		const Vector2f area = view.getSize() * 4.0f;
+		auto randomPos = [&] ()
+		{
+			return view.getTopLeft() - area * 0.375f + Vector2f(rng.getFloat(0.0f, area.x), rng.getFloat(0.0f, area.y));
+		};
+
+		Vector<Sprite> sprites(nSprites);
+		for (auto& s: sprites) {
+			s.setMaterial(material)
+				.setSize(Vector2f(32, 32))
+				.setPivot(Vector2f(0.5f, 0.5f))
+				.setPos(randomPos());
+		}
+
+		SpritePainter spritePainter;
+		auto frame = [&] (RenderContext& context)
+		{
+			context.bind([&] (Painter& p)
+			{
+				spritePainter.start(sprites.size());
+				for (size_t i = 0; i < sprites.size(); ++i) {
+					spritePainter.add(sprites[i], 1, int(i % 3), sprites[i].getPosition().y);
+				}
+				spritePainter.draw(1, p);
+			});
+		};
+
+		auto timeFrames = [&] (const String& name, std::function<void()> update)
+		{
+			Stopwatch timer;
+			for (int i = 0; i < nFrames; ++i) {
+				update();
+				renderer.render(frame);
+			}
+			timer.pause();
+			std::cout << name << ": " << (timer.elapsedNanoSeconds() / nFrames / 1000) << " us/frame" << std::endl;
+		};
+
+		std::cout << "Sorting " << nSprites << " sprites" << std::endl;
+		timeFrames("Static sprites", [] () {});
+		timeFrames("Moving sprites", [&] ()
+		{
+			for (auto& s: sprites) {
+				s.setPos(s.getPosition() + Vector2f(rng.getFloat(-2.0f, 2.0f), rng.getFloat(-2.0f, 2.0f)));
+			}
+		});
+		timeFrames("Shuffled sprites", [&] ()
+		{
+			for (auto& s: sprites) {
+				s.setPos(randomPos());
+			}
+		});
+
+		// What the painter used to do before drawing: a comparison sort of every entry, visible or not
+		Vector<SpritePainterEntry> entries;
+		entries.reserve(sprites.size());
+		Stopwatch timer;
+		for (int i = 0; i < nFrames; ++i) {
+			entries.clear();
+			for (size_t j = 0; j < sprites.size(); ++j) {
+				entries.push_back(SpritePainterEntry(sprites[j], 1, int(j % 3), sprites[j].getPosition().y + float(i)));
+			}
+			std::sort(entries.begin(), entries.end());
+		}
+		timer.pause();
+		std::cout << "Full std::sort, no drawing: " << (timer.elapsedNanoSeconds() / nFrames / 1000) << " us/frame" << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 3) {
+		std::cout << "Usage: halley-render-bench [sprites] [frames]" << std::endl;
+		return 1;
+	}
+	const int nSprites = argc > 1 ? std::max(1, atoi(argv[1])) : 20000;
+	const int nFrames = argc > 2 ? std::max(1, atoi(argv[2])) : 100;
+	const Vector2i screenSize(1280, 720);
+
+	try {
+		Executors executors;
+		Executors::set(executors);
+		ThreadPool cpuThreads("CPU", executors.getCPU(), std::max(1u, std::thread::hardware_concurrency()), [] (String, std::function<void()> f) { return std::thread(f); });
+
+		auto& rng = Random::getGlobal();
+		if (!checkCullers(rng)) {
+			return 3;
+		}
+
+		Resources resources(nullptr, nullptr);
+		resources.init<MaterialDefinition>();
+		resources.of<MaterialDefinition>().setResource(0, "Halley/MaterialBase", makeMaterialDefinition("Halley/MaterialBase", false));
+		auto spriteDef = makeMaterialDefinition("Halley/Sprite", true);
+
+		DummyRenderer renderer(resources, screenSize);
+		auto& painter = renderer.getPainter();
+
+		// One texture per layer
+		constexpr int nLayers = 3;
+		Vector<std::shared_ptr<Material>> materials;
+		for (int i = 0; i < nLayers; ++i) {
+			materials.push_back(makeMaterial(spriteDef, Vector2i(32, 32) * (1 << i)));
+		}
+		auto font = makeFont(makeMaterial(spriteDef, Vector2i(256, 256)));
+
+		if (!checkLargeBatch(renderer, materials[0])) {
+			return 3;
+		}
+
+		// About a quarter of everything is off screen
+		auto randomPos = [&] ()
+		{
+			return Vector2f(rng.getFloat(-0.25f, 1.25f) * screenSize.x, rng.getFloat(-0.25f, 1.25f) * screenSize.y) - Vector2f(screenSize) * 0.5f;
+		};
+
+		Vector<Scenario> scenarios(3);
+
+		scenarios[0].name = "Sprites";
+		scenarios[0].sprites.resize(nSprites);
+		for (int i = 0; i < nSprites; ++i) {
+			scenarios[0].sprites[i]
+				.setMaterial(materials[i % nLayers])
+				.setSize(Vector2f(32, 32))
+				.setPivot(Vector2f(0.5f, 0.5f))
+				.setRotation(Angle1f::fromRadians(rng.getFloat(0.0f, 6.28f)))
+				.setPos(randomPos());
+		}
+
+		scenarios[1].name = "Sliced sprites";
+		scenarios[1].sprites.resize(std::max(1, nSprites / 10));
+		for (auto& s: scenarios[1].sprites) {
+			s.setMaterial(materials[0])
+				.setSize(Vector2f(32, 32))
+				.setScale(Vector2f(rng.getFloat(1.0f, 4.0f), rng.getFloat(1.0f, 4.0f)))
+				.setSliced(Vector4s(8, 8, 8, 8))
+				.setPos(randomPos());
+		}
+
+		scenarios[2].name = "Text";
+		scenarios[2].texts.resize(std::max(1, nSprites / 20));
+		for (auto& t: scenarios[2].texts) {
+			t.setFont(font)
+				.setText("The quick brown fox " + toString(rng.getInt(0, 1000)))
+				.setSize(16)
+				.setPosition(randomPos());
+		}
+
+		SpritePainter spritePainter;
+		for (auto& scenario: scenarios) {
+			auto frame = [&] (RenderContext& context)
+			{
+				context.bind([&] (Painter& p)
+				{
+					spritePainter.start(scenario.sprites.size() + scenario.texts.size());
+					for (size_t j = 0; j < scenario.sprites.size(); ++j) {
+						spritePainter.add(scenario.sprites[j], 1, int(j % nLayers), scenario.sprites[j].getPosition().y);
+					}
+					for (auto& t: scenario.texts) {
+						spritePainter.add(t, 1, 0, t.getPosition().y);
+					}
+					spritePainter.draw(1, p);
+				});
+			};
+
+			if (!checkReplay(renderer, frame)) {
+				std::cout << scenario.name << ": replayed frame differs from the one drawn directly" << std::endl;
+				return 3;
+			}
+
+			Stopwatch timer;
+			for (int i = 0; i < nFrames; ++i) {
+				renderer.render(frame);
+			}
+			timer.pause();
+			printResult(scenario, timer.elapsedNanoSeconds(), nFrames, painter.getLastFrameStats());
+		}
+
+		const Rect4f view(-0.5f * screenSize.x, -0.5f * screenSize.y, float(screenSize.x), float(screenSize.y));
+		benchSorting(renderer, materials[0], rng, size_t(nSprites) * 10, std::max(1, nFrames / 10), view);
+	} catch (std::exception& e) {
+		std::cout << "Exception: " << e.what() << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
@@ -24,8 +24,10 @@ namespace Halley {
 		static void copyFile(const Path& src, const Path& dst);
 		static bool remove(const Path& path);
 
+		// Replaces the whole file at once (through a temporary file), throws if it can't be written
 		static void writeFile(const Path& path, gsl::span<const gsl::byte> data);
 		static void writeFile(const Path& path, const Bytes& data);
+		static void writeFile(const Path& path, const std::vector<gsl::span<const gsl::byte>>& parts);
 		static Bytes readFile(const Path& path);
 
 		static std::vector<Path> enumerateDirectory(const Path& path);
@@ -6,6 +6,8 @@
 #include "halley/core/resources/asset_database.h"
 
 namespace Halley {
+	class AssetPackIndex;
+
     class AssetPackInspector {
     public:
 	    explicit AssetPackInspector(String name);
@@ -32,6 +34,7 @@ namespace Halley {
 		std::vector<int> sortedEntries;
 
 		void parseTable(Deserializer s, const Bytes& packBytes);
+		void parseIndex(const AssetPackIndex& index, const Bytes& packBytes);
 	    void parseTypedDB(Deserializer& s, const Bytes& packBytes);
 		void computeHash();
     };
@@ -8,6 +8,7 @@
 
 namespace Halley {
 	class Project;
+	class AssetPack;
 	class AssetPackManifest;
 	class Path;
 		
@@ -18,16 +19,18 @@ namespace Halley {
 			String name;
 			String path;
 			Metadata metadata;
+			bool modified;
 
 			bool operator<(const Entry& other) const;
 		};
 		
 		AssetPackListing();
-		AssetPackListing(String name, String encryptionKey);
+		AssetPackListing(String name, String encryptionKey, String compression);
 		
-		void addFile(AssetType type, const String& name, const AssetDatabase::Entry& entry);
+		void addFile(AssetType type, const String& name, const AssetDatabase::Entry& entry, bool modified);
 		const std::vector<Entry>& getEntries() const;
 		const String& getEncryptionKey() const;
+		const String& getCompression() const;
 		
 		void setActive(bool active);
 		bool isActive() const;
@@ -36,6 +39,7 @@ namespace Halley {
 	private:
 		String name;
 		String encryptionKey;
+		String compression;
 
 		bool active = false;
 
@@ -49,7 +53,10 @@ namespace Halley {
 
 	private:
 		static std::map<String, AssetPackListing> sortIntoPacks(const AssetPackManifest& manifest, const AssetDatabase& srcAssetDb, Maybe<std::set<String>> assetsToPack, const std::vector<String>& deletedAssets);
-		static void generatePacks(std::map<String, AssetPackListing> packs, const Path& src, const Path& dst);
-		static void generatePack(const String& packId, const AssetPackListing& pack, const Path& src, const Path& dst);
+		// If reuseSince is set, unmodified assets are copied from the previous packs, as long as those were written after it.
+		// Write times are whole seconds, and an asset is only reused if its source was written in an earlier second than the pack, so anything saved in the same second as the pack is packed again.
+		static void generatePacks(std::map<String, AssetPackListing> packs, const Path& src, const Path& dst, Maybe<int64_t> reuseSince);
+		static void generatePack(const String& packId, const AssetPackListing& pack, const Path& src, const Path& dst, Maybe<int64_t> reuseSince);
+		static std::unique_ptr<AssetPack> loadPreviousPack(const String& packId, const AssetPackListing& pack, const Path& path, Maybe<int64_t> reuseSince);
 	};
 }
@@ -21,9 +21,13 @@ void AssetCollector::output(const String& name, AssetType type, const Bytes& dat
 	Path filePath = Path(toString(type)) / id;
 	Path fullPath = Path(platform) / filePath;
 
-	if (metadata && metadata->getString("asset_compression", "") == "deflate") {
-		auto newData = Compression::compress(data);
-		outFiles.emplace_back(fullPath, newData);
+	const String compression = metadata ? metadata->getString("asset_compression", "") : "";
+	if (!compression.isEmpty()) {
+		const auto codec = Compression::getCodec(compression);
+		if (!codec) {
+			throw Exception("Unknown asset_compression \"" + compression + "\" for \"" + name + "\"; available codecs are: " + String::concatList(Compression::getCodecNames(), ", "), HalleyExceptions::Tools);
+		}
+		outFiles.emplace_back(fullPath, codec->compress(gsl::as_bytes(gsl::span<const Byte>(data))));
 	} else {
 		outFiles.emplace_back(fullPath, data);
 	}
@@ -57,7 +57,7 @@ static void loadMetaTable(Metadata& meta, const YAML::Node& root)
 	for (YAML::const_iterator it = root.begin(); it != root.end(); ++it) {
 		String key = it->first.as<std::string>();
 		String value = it->second.as<std::string>();
-		meta.set(key, value);
+		meta.setParsed(key, value);
 	}
 }
 
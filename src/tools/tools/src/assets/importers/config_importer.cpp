@@ -12,7 +12,10 @@ void ConfigImporter::import(const ImportingAsset& asset, IAssetCollector& collec
 	parseConfig(config, gsl::as_bytes(gsl::span<const Byte>(asset.inputFiles.at(0).data)));
 	
 	Metadata meta = asset.inputFiles.at(0).metadata;
-	meta.set("asset_compression", "deflate");
+	if (!meta.hasKey("asset_compression")) {
+		// Other codecs (e.g. lz4-chunked, which loads faster) have to be picked in the config's .meta file
+		meta.set("asset_compression", "deflate");
+	}
 
 	collector.output(Path(asset.assetId).replaceExtension("").string(), AssetType::ConfigFile, Serializer::toBytes(config), meta);
 }
@@ -343,6 +343,42 @@ Vector<String> CodegenCPP::generateSystemHeader(SystemSchema& system) const
 	}
 	sysClassGen.addMethodDefinition(MethodSchema(TypeSchema("void"), {}, "initBase", false, false, true), initBaseMethodBody);
 
+	// Construct declareDependenciesBase(), used by the world's scheduler
+	std::vector<String> dependenciesBody = { "deps.setDeclared();" };
+	for (auto& fam : system.families) {
+		for (auto& comp : fam.components) {
+			if (comp.write) {
+				dependenciesBody.push_back("deps.write<" + comp.name + "Component>();");
+			} else {
+				dependenciesBody.push_back("deps.read<" + comp.name + "Component>();");
+			}
+		}
+	}
+	for (auto& msg : system.messages) {
+		if (msg.send) {
+			dependenciesBody.push_back("deps.sendMessage<" + msg.name + "Message>();");
+		}
+		if (msg.receive) {
+			dependenciesBody.push_back("deps.receiveMessage<" + msg.name + "Message>();");
+		}
+	}
+	for (auto& service: system.services) {
+		dependenciesBody.push_back("deps.useService(\"" + service.name + "\");");
+	}
+	if ((int(system.access) & int(SystemAccess::API)) != 0) {
+		dependenciesBody.push_back("deps.useAPI();");
+	}
+	if ((int(system.access) & int(SystemAccess::World)) != 0) {
+		dependenciesBody.push_back("deps.useWorld();");
+	}
+	if ((int(system.access) & int(SystemAccess::Resources)) != 0) {
+		dependenciesBody.push_back("deps.useResources();");
+	}
+	if (system.strategy == SystemStrategy::Parallel) {
+		dependenciesBody.push_back("deps.setParallelStrategy();");
+	}
+	sysClassGen.addMethodDefinition(MethodSchema(TypeSchema("void"), { VariableSchema(TypeSchema("Halley::SystemDependencies&"), "deps") }, "declareDependenciesBase", true, false, true), dependenciesBody);
+
 	auto fams = convert<FamilySchema, VariableSchema>(system.families, [](auto& fam) { return VariableSchema(TypeSchema("Halley::FamilyBinding<" + upperFirst(fam.name) + "Family>"), fam.name + "Family"); });
 	auto mid = fams.begin() + std::min(fams.size(), size_t(1));
 	std::vector<VariableSchema> mainFams(fams.begin(), mid);
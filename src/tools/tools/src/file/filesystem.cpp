@@ -3,6 +3,7 @@
 #include <halley/file/path.h>
 #include "halley/os/os.h"
 #include "halley/maths/random.h"
+#include "halley/support/exception.h"
 #include <cstdio>
 
 using namespace Halley;
@@ -70,10 +71,7 @@ bool FileSystem::remove(const Path& path)
 
 void FileSystem::writeFile(const Path& path, gsl::span<const gsl::byte> data)
 {
-	createParentDir(path);
-	std::ofstream fp(path.string(), std::ios::binary | std::ios::out);
-	fp.write(reinterpret_cast<const char*>(data.data()), data.size());
-	fp.close();
+	writeFile(path, std::vector<gsl::span<const gsl::byte>>{ data });
 }
 
 void FileSystem::writeFile(const Path& path, const Bytes& data)
@@ -81,6 +79,36 @@ void FileSystem::writeFile(const Path& path, const Bytes& data)
 	writeFile(path, as_bytes(gsl::span<const Byte>(data)));
 }
 
+void FileSystem::writeFile(const Path& path, const std::vector<gsl::span<const gsl::byte>>& parts)
+{
+	// Written to a temporary file which then replaces the destination, so anything still reading or mapping the old file
+	// (e.g. a running game holding an asset pack) keeps seeing it whole instead of having it truncated underneath it
+	createParentDir(path);
+	const auto dst = getNative(path);
+	auto tmp = dst;
+	tmp += ".tmp";
+
+	{
+		std::ofstream fp(tmp.string(), std::ios::binary | std::ios::out | std::ios::trunc);
+		for (auto& data: parts) {
+			fp.write(reinterpret_cast<const char*>(data.data()), data.size());
+		}
+		fp.close();
+		if (fp.fail()) {
+			boost::system::error_code ec;
+			boost::filesystem::remove(tmp, ec);
+			throw Exception("Unable to write file " + path.string(), HalleyExceptions::Tools);
+		}
+	}
+
+	boost::system::error_code ec;
+	rename(tmp, dst, ec);
+	if (ec) {
+		boost::filesystem::remove(tmp, ec);
+		throw Exception("Unable to replace file " + path.string(), HalleyExceptions::Tools);
+	}
+}
+
 Bytes FileSystem::readFile(const Path& path)
 {
 	Bytes result;
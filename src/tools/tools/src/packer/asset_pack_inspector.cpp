@@ -6,6 +6,7 @@
 #include "halley/bytes/compression.h"
 #include "halley/support/console.h"
 #include "halley/core/resources/asset_database.h"
+#include "halley/core/resources/asset_pack_index.h"
 #include "halley/utils/hash.h"
 
 using namespace Halley;
@@ -29,9 +30,15 @@ void AssetPackInspector::parse(const Bytes& bytes)
 	s >> tableSpan;
 
 	rawTableSize = tableData.size();
-	auto rawTableData = Compression::decompress(tableData);
-	tableSize = rawTableData.size();
-	parseTable(Deserializer(rawTableData), bytes);
+	if (memcmp(header.identifier.data(), "HALLEYPK", 8) == 0) {
+		// Old format, with a compressed AssetDatabase
+		auto rawTableData = Compression::decompress(tableData);
+		tableSize = rawTableData.size();
+		parseTable(Deserializer(rawTableData), bytes);
+	} else {
+		tableSize = rawTableSize;
+		parseIndex(AssetPackIndex(std::move(tableData)), bytes);
+	}
 
 	// Generated sorted entries
 	sortedEntries.resize(entries.size());
@@ -56,6 +63,22 @@ void AssetPackInspector::parseTable(Deserializer s, const Bytes& packBytes)
 	}
 }
 
+void AssetPackInspector::parseIndex(const AssetPackIndex& index, const Bytes& packBytes)
+{
+	entries.reserve(index.getNumEntries());
+	for (size_t i = 0; i < index.getNumEntries(); ++i) {
+		auto& e = index.getEntry(i);
+		auto hash = Hash::hash(gsl::as_bytes(gsl::span<const Byte>(packBytes.data() + e.pos + dataStartPos, size_t(e.size))));
+		entries.emplace_back(e.type, hash, index.getName(e), AssetDatabase::Entry(e.pos, e.size, index.getMetadata(e)));
+	}
+
+	// The index is sorted by name, but the listing is grouped by type
+	std::stable_sort(entries.begin(), entries.end(), [] (const Entry& a, const Entry& b)
+	{
+		return a.assetType < b.assetType;
+	});
+}
+
 void AssetPackInspector::parseTypedDB(Deserializer& s, const Bytes& packBytes)
 {
 	int curAssetType;
@@ -74,6 +97,8 @@ void AssetPackInspector::parseTypedDB(Deserializer& s, const Bytes& packBytes)
 		auto splitPath = entry.path.split(':');
 		size_t pos = splitPath.at(0).toInteger64();
 		size_t size = splitPath.at(1).toInteger64();
+		entry.pos = pos;
+		entry.size = size;
 		auto hash = Hash::hash(gsl::as_bytes(gsl::span<const Byte>(packBytes.data() + pos + dataStartPos, size)));
 
 		entries.emplace_back(curAssetType, hash, std::move(key), std::move(entry));
@@ -110,8 +135,7 @@ void AssetPackInspector::printData() const
 			std::cout << "  Assets of type " << infoCol << lastType << stdCol << ":\n";
 		}
 
-		auto splitPath = entry.entry.path.split(':');
-		std::cout << "    [" << i << "] " << strCol << entry.key << stdCol << " [" << infoCol << toString(entry.hash, 16) << stdCol << "]: at " << infoCol << splitPath.at(0) << stdCol << ", " << infoCol << splitPath.at(1) << stdCol << " bytes, " << strCol << toString(entry.entry.meta) <<  stdCol << "\n";
+		std::cout << "    [" << i << "] " << strCol << entry.key << stdCol << " [" << infoCol << toString(entry.hash, 16) << stdCol << "]: at " << infoCol << entry.entry.pos << stdCol << ", " << infoCol << entry.entry.size << stdCol << " bytes, " << strCol << toString(entry.entry.meta) <<  stdCol << "\n";
 
 		++i;
 	}
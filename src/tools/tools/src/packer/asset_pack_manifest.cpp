@@ -13,6 +13,7 @@ AssetPackManifestEntry::AssetPackManifestEntry(const ConfigNode& node)
 {
 	name = node["name"].asString();
 	encryptionKey = node["encryptionKey"].asString("");
+	compression = node["compression"].asString("");
 	if (node.hasKey("matches")) {
 		for (auto& m: node["matches"].asSequence()) {
 			matches.push_back(m.asString());
@@ -45,6 +46,11 @@ const String& AssetPackManifestEntry::getEncryptionKey() const
 	return encryptionKey;
 }
 
+const String& AssetPackManifestEntry::getCompression() const
+{
+	return compression;
+}
+
 AssetPackManifest::AssetPackManifest(const Bytes& data)
 {
 	ConfigFile config;
@@ -6,8 +6,14 @@
 #include "halley/tools/packer/asset_pack_manifest.h"
 #include "halley/resources/resource.h"
 #include "halley/core/resources/asset_pack.h"
+#include "halley/core/resources/asset_pack_index.h"
 #include "halley/tools/project/project.h"
 #include "halley/tools/assets/import_assets_database.h"
+#include "halley/bytes/compression.h"
+#include "halley/concurrency/concurrent.h"
+#include "halley/file/memory_mapped_file.h"
+#include "halley/time/stopwatch.h"
+#include <atomic>
 using namespace Halley;
 
 
@@ -20,15 +26,16 @@ AssetPackListing::AssetPackListing()
 {
 }
 
-AssetPackListing::AssetPackListing(String name, String encryptionKey)
+AssetPackListing::AssetPackListing(String name, String encryptionKey, String compression)
 	: name(name)
 	, encryptionKey(encryptionKey)
+	, compression(compression)
 {
 }
 
-void AssetPackListing::addFile(AssetType type, const String& name, const AssetDatabase::Entry& entry)
+void AssetPackListing::addFile(AssetType type, const String& name, const AssetDatabase::Entry& entry, bool modified)
 {
-	entries.push_back(Entry{ type, name, entry.path, entry.meta });
+	entries.push_back(Entry{ type, name, entry.path, entry.meta, modified });
 }
 
 const std::vector<AssetPackListing::Entry>& AssetPackListing::getEntries() const
@@ -41,6 +48,11 @@ const String& AssetPackListing::getEncryptionKey() const
 	return encryptionKey;
 }
 
+const String& AssetPackListing::getCompression() const
+{
+	return compression;
+}
+
 void AssetPackListing::setActive(bool a)
 {
 	active = a;
@@ -76,7 +88,12 @@ void AssetPacker::packPlatform(Project& project, Maybe<std::set<String>> assetsT
 	const std::map<String, AssetPackListing> packs = sortIntoPacks(manifest, *db, assetsToPack, deletedAssets);
 
 	// Generate packs
-	generatePacks(packs, src, dst);
+	// When only some assets changed, the rest can come from the previous packs, unless the manifest changed since (e.g. the encryption key)
+	Maybe<int64_t> reuseSince;
+	if (assetsToPack) {
+		reuseSince = FileSystem::getLastWriteTime(project.getAssetPackManifestPath());
+	}
+	generatePacks(packs, src, dst, reuseSince);
 }
 
 std::map<String, AssetPackListing> AssetPacker::sortIntoPacks(const AssetPackManifest& manifest, const AssetDatabase& srcAssetDb, Maybe<std::set<String>> assetsToPack, const std::vector<String>& deletedAssets)
@@ -92,16 +109,18 @@ std::map<String, AssetPackListing> AssetPacker::sortIntoPacks(const AssetPackMan
 			auto packEntry = manifest.getPack("~:" + assetName);
 			String packName;
 			String encryptionKey;
+			String compression;
 			if (packEntry) {
 				packName = packEntry.get().get().getName();
 				encryptionKey = packEntry.get().get().getEncryptionKey();
+				compression = packEntry.get().get().getCompression();
 			}
 
 			// Retrieve pack
 			auto iter = packs.find(packName);
 			if (iter == packs.end()) {
 				// Pack doesn't exist yet, create it first
-				packs[packName] = AssetPackListing(packName, encryptionKey);
+				packs[packName] = AssetPackListing(packName, encryptionKey, compression);
 				iter = packs.find(packName);
 
 				// Initialise it to active if there's no asset list to pack
@@ -111,14 +130,13 @@ std::map<String, AssetPackListing> AssetPacker::sortIntoPacks(const AssetPackMan
 			}
 
 			// Activate the pack if this asset was actually supposed to be packed
-			if (assetsToPack) {
-				if (assetsToPack.get().find(assetName) != assetsToPack.get().end()) {
-					iter->second.setActive(true);
-				}
+			const bool modified = !assetsToPack || assetsToPack.get().find(assetName) != assetsToPack.get().end();
+			if (assetsToPack && modified) {
+				iter->second.setActive(true);
 			}
 
 			// Add file to pack
-			iter->second.addFile(type, assetEntry.first, assetEntry.second);
+			iter->second.addFile(type, assetEntry.first, assetEntry.second, modified);
 		}
 	}
 
@@ -145,7 +163,7 @@ std::map<String, AssetPackListing> AssetPacker::sortIntoPacks(const AssetPackMan
 	return packs;
 }
 
-void AssetPacker::generatePacks(std::map<String, AssetPackListing> packs, const Path& src, const Path& dst)
+void AssetPacker::generatePacks(std::map<String, AssetPackListing> packs, const Path& src, const Path& dst, Maybe<int64_t> reuseSince)
 {
 	for (auto& packListing: packs) {
 		if (packListing.first.isEmpty()) {
@@ -158,43 +176,181 @@ void AssetPacker::generatePacks(std::map<String, AssetPackListing> packs, const
 			// Only pack if this pack listing is active or if it doesn't exist
 			auto dstPack = dst / packListing.first + ".dat";
 			if (packListing.second.isActive() || !FileSystem::exists(dstPack)) {
-				generatePack(packListing.first, packListing.second, src, dstPack);
+				generatePack(packListing.first, packListing.second, src, dstPack, reuseSince);
 			}
 		}
 	}
 }
 
-void AssetPacker::generatePack(const String& packId, const AssetPackListing& packListing, const Path& src, const Path& dst)
+namespace {
+	struct PackJob
+	{
+		const AssetPackListing::Entry* entry = nullptr;
+		Metadata metadata;
+		Bytes data;
+		std::unique_ptr<ResourceDataStatic> reused; // From the previous pack
+		size_t pos = 0;
+
+		gsl::span<const gsl::byte> getBytes() const
+		{
+			return reused ? reused->getSpan() : gsl::as_bytes(gsl::span<const Byte>(data));
+		}
+	};
+
+	bool isSameAsset(const Metadata& previous, const Metadata& current, const ICompressionCodec* codec)
+	{
+		if (previous == current) {
+			return true;
+		}
+		if (codec && !current.hasKey("asset_compression")) {
+			// Compressed by the packer last time
+			auto compressed = current;
+			compressed.set("asset_compression", codec->getName());
+			return previous == compressed;
+		}
+		return false;
+	}
+
+	String toMilliseconds(int64_t ns)
+	{
+		return toString(ns / 1000000) + " ms";
+	}
+}
+
+void AssetPacker::generatePack(const String& packId, const AssetPackListing& packListing, const Path& src, const Path& dst, Maybe<int64_t> reuseSince)
 {
-	AssetPack pack;
-	AssetDatabase& db = pack.getAssetDatabase();
-	Bytes& data = pack.getData();
+	Stopwatch totalTimer;
 
-	for (auto& entry: packListing.getEntries()) {
-		//Logger::logDev("  [" + toString(entry.type) + "] " + entry.name);
+	const ICompressionCodec* codec = nullptr;
+	if (!packListing.getCompression().isEmpty()) {
+		codec = Compression::getCodec(packListing.getCompression());
+		if (!codec) {
+			throw Exception("Unknown compression \"" + packListing.getCompression() + "\" for pack \"" + packId + "\"", HalleyExceptions::Tools);
+		}
+	}
 
-		// Read original file
-		auto fileData = FileSystem::readFile(src / entry.path);
-		const size_t pos = data.size();
-		const size_t size = fileData.size();
-		if (size == 0) {
-			throw Exception("Unable to pack: \"" + (src / entry.path) + "\". File not found or empty.", HalleyExceptions::Tools);
+	// Take whatever hasn't changed from the previous version of the pack
+	Stopwatch previousTimer;
+	auto previous = loadPreviousPack(packId, packListing, dst, reuseSince);
+	previousTimer.pause();
+	const int64_t previousTime = previous ? FileSystem::getLastWriteTime(dst) : 0;
+
+	const auto& entries = packListing.getEntries();
+	Vector<PackJob> jobs(entries.size());
+	size_t nReused = 0;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		auto& entry = entries[i];
+		auto& job = jobs[i];
+		job.entry = &entry;
+		job.metadata = entry.metadata;
+
+		// Write times only have a resolution of one second, so a source written in the same second as the pack might be newer than it; strictly earlier is the only safe case
+		if (previous && !entry.modified && FileSystem::getLastWriteTime(src / entry.path) < previousTime) {
+			const auto& index = previous->getIndex();
+			const auto previousEntry = index.find(entry.name, entry.type);
+			if (previousEntry && isSameAsset(index.getMetadata(*previousEntry), entry.metadata, codec)) {
+				job.metadata = index.getMetadata(*previousEntry);
+				job.reused.reset(static_cast<ResourceDataStatic*>(previous->getData(entry.name, entry.type, false).release()));
+				++nReused;
+			}
 		}
-		
-		// Read data into pack data
-		data.reserve(nextPowerOf2(pos + size));
-		data.resize(pos + size);
-		memcpy(data.data() + pos, fileData.data(), size);
+	}
 
-		db.addAsset(entry.name, entry.type, AssetDatabase::Entry(toString(pos) + ":" + toString(size), entry.metadata));
+	// Read and compress the rest, each asset separately, so they stay independently loadable
+	std::atomic<int64_t> readTime(0);
+	std::atomic<int64_t> compressTime(0);
+	Concurrent::parallelFor(Executors::getCPU(), jobs.begin(), jobs.end(), 1, [&] (PackJob& job)
+	{
+		if (job.reused) {
+			return;
+		}
+
+		Stopwatch readTimer;
+		job.data = FileSystem::readFile(src / job.entry->path);
+		if (job.data.empty()) {
+			throw Exception("Unable to pack: \"" + (src / job.entry->path) + "\". File not found or empty.", HalleyExceptions::Tools);
+		}
+		readTimer.pause();
+		readTime += readTimer.elapsedNanoSeconds();
+
+		if (codec && !job.metadata.hasKey("asset_compression")) {
+			Stopwatch compressTimer;
+			auto compressed = codec->compress(gsl::as_bytes(gsl::span<const Byte>(job.data)));
+
+			// Already compressed formats (e.g. png, ogg) aren't worth decompressing on load
+			if (compressed.size() < job.data.size() - job.data.size() / 16) {
+				job.data = std::move(compressed);
+				job.metadata.set("asset_compression", codec->getName());
+			}
+			compressTimer.pause();
+			compressTime += compressTimer.elapsedNanoSeconds();
+		}
+	});
+
+	// Lay it all out
+	AssetPack pack;
+	AssetDatabase& db = pack.getAssetDatabase();
+	Bytes& data = pack.getData();
+	size_t totalSize = 0;
+	for (auto& job: jobs) {
+		const size_t size = size_t(job.getBytes().size());
+		job.pos = totalSize;
+		totalSize += size;
+		db.addAsset(job.entry->name, job.entry->type, AssetDatabase::Entry(uint64_t(job.pos), uint64_t(size), job.metadata));
 	}
 
+	data.resize(totalSize);
+	Concurrent::parallelFor(Executors::getCPU(), jobs.begin(), jobs.end(), 0, [&] (PackJob& job)
+	{
+		const auto bytes = job.getBytes();
+		memcpy(data.data() + job.pos, bytes.data(), bytes.size());
+		job.data = Bytes();
+		job.reused.reset();
+	});
+
+	// Release the previous pack's mapping before its file is replaced, as Windows won't replace a file that's mapped
+	jobs.clear();
+	previous.reset();
+
+	Stopwatch encryptTimer;
 	if (!packListing.getEncryptionKey().isEmpty()) {
 		Logger::logInfo("- Encrypting \"" + packId + "\"...");
 		pack.encrypt(packListing.getEncryptionKey());
 	}
+	encryptTimer.pause();
 
 	// Write pack
-	FileSystem::writeFile(dst, pack.writeOut());
-	Logger::logInfo("- Packed " + toString(packListing.getEntries().size()) + " entries on \"" + packId + "\" (" + String::prettySize(data.size()) + ").");
+	Stopwatch writeTimer;
+	const auto header = pack.writeOutHeader();
+	FileSystem::writeFile(dst, { gsl::as_bytes(gsl::span<const Byte>(header)), gsl::as_bytes(gsl::span<const Byte>(data)) });
+	writeTimer.pause();
+	totalTimer.pause();
+
+	Logger::logInfo("- Packed " + toString(entries.size()) + " entries on \"" + packId + "\" (" + String::prettySize(data.size()) + ") in " + toMilliseconds(totalTimer.elapsedNanoSeconds()) + ": "
+		+ toString(nReused) + " reused from the previous pack (loaded in " + toMilliseconds(previousTimer.elapsedNanoSeconds()) + "), "
+		+ "reading " + toMilliseconds(readTime) + " and compressing " + toMilliseconds(compressTime) + " across threads, "
+		+ "encrypting " + toMilliseconds(encryptTimer.elapsedNanoSeconds()) + ", writing " + toMilliseconds(writeTimer.elapsedNanoSeconds()) + ".");
+}
+
+std::unique_ptr<AssetPack> AssetPacker::loadPreviousPack(const String& packId, const AssetPackListing& packListing, const Path& path, Maybe<int64_t> reuseSince)
+{
+	if (!reuseSince || !FileSystem::exists(path) || FileSystem::getLastWriteTime(path) <= reuseSince.get()) {
+		return {};
+	}
+
+	// Decrypting the whole previous pack, or reading it without memory mapping, is slower than just reading its assets again
+	if (!packListing.getEncryptionKey().isEmpty()) {
+		return {};
+	}
+
+	try {
+		auto file = std::make_shared<MemoryMappedFile>();
+		if (!file->open(path)) {
+			return {};
+		}
+		return std::make_unique<AssetPack>(std::move(file));
+	} catch (std::exception& e) {
+		Logger::logWarning("Unable to read the previous version of \"" + packId + "\", so it will be packed from scratch: " + e.what());
+		return {};
+	}
 }
@@ -2,6 +2,7 @@
 #include "halley/tools/project/project.h"
 #include "halley/core/devcon/devcon_server.h"
 #include "halley/support/logger.h"
+#include "halley/time/stopwatch.h"
 
 using namespace Halley;
 
@@ -15,9 +16,11 @@ AssetPackerTask::AssetPackerTask(Project& project, Maybe<std::set<String>> asset
 
 void AssetPackerTask::run()
 {
+	Stopwatch timer;
 	Logger::logInfo("Packing assets (" + toString(assetsToPack->size()) + " modified).");
 	AssetPacker::pack(project, assetsToPack, deletedAssets);
-	Logger::logInfo("Done packing assets");
+	timer.pause();
+	Logger::logInfo("Done packing assets, took " + toString(timer.elapsedSeconds()) + " seconds");
 
 	if (!isCancelled()) {
 		setProgress(1.0f, "");